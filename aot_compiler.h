@@ -0,0 +1,1549 @@
+#ifndef AOT_COMPILER_H
+#define AOT_COMPILER_H
+
+#include "ast_node.h"
+#include "binary_expression.h"
+#include "call_expression.h"
+#include "class_declaration.h"
+#include "closure_expression.h"
+#include "concatenation_chain.h"
+#include "constructor_call_expression.h"
+#include "dot_access_expression.h"
+#include "for_statement.h"
+#include "function_declaration.h"
+#include "function_object.h"
+#include "if_statement.h"
+#include "lambda_expression.h"
+#include "literal_expression.h"
+#include "package.h"
+#include "parameter.h"
+#include "return_statement.h"
+#include "soda_type.h"
+#include "value.h"
+#include "variable_binding.h"
+#include "variable_declaration.h"
+#include "variable_expression.h"
+#include "while_statement.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// How AotCompiler::build invokes the system compiler
+struct AotBuildOptions {
+  std::string Compiler = "c++";
+  std::string Flags = "-std=c++17 -O2 -shared -fPIC";
+  std::string IncludeDirectory = "."; // Holding aot_runtime.h
+};
+
+// Translates a resolved package to C++ source for the AotRuntime. Each
+// function becomes a C++ function over Values that does what its bytecode
+// would. Top-level functions whose parameters, locals and result are all
+// Int, Long, Float, Double or Bool, and which only call such functions,
+// also get a variant over int64_t, double and bool; the Value version
+// enters it whenever the arguments have the declared types. Needs the
+// ScopeResolver and ClosureConverter to have run, like the
+// BytecodeCompiler.
+class AotCompiler {
+public:
+  std::string compile(const Package &package) {
+    errors.clear();
+    units.clear();
+    classes.clear();
+    classIndex.clear();
+    classDeclarations.clear();
+    functions.clear();
+    typedFunctions.clear();
+    states.clear();
+
+    globals = &package.Globals;
+    thisGlobal = findGlobal("this");
+    superGlobal = findGlobal("super");
+    for (const auto &member : package.Members) {
+      if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+        classDeclarations[cls->Name] = cls.get();
+      }
+    }
+    findTypedFunctions(package);
+
+    std::string name = package.Name.empty() ? "<package>" : package.Name;
+    int initializer = newUnit(name, 0, package.FrameSize, -1);
+    pushUnit(initializer, nullptr);
+    for (const auto &member : package.Members) {
+      if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+        compileClass(*cls);
+      } else if (auto func =
+                     std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        functions.push_back(
+            {findGlobal(func->Name), compileFunction(*func, -1)});
+      } else {
+        compileStatement(member);
+      }
+    }
+    popUnit();
+    return assemble(package, initializer);
+  }
+
+  const std::vector<std::string> &getErrors() const { return errors; }
+
+  // Writes source next to output and compiles it into the shared object
+  // output, for AotRuntime::load. Returns false if the compiler fails.
+  static bool build(const std::string &source, const std::string &output,
+                    const AotBuildOptions &options = AotBuildOptions()) {
+    std::string path = output + ".cpp";
+    {
+      std::ofstream file(path);
+      file << source;
+      if (!file) {
+        return false;
+      }
+    }
+    std::string command = options.Compiler + " " + options.Flags + " -I\"" +
+                          options.IncludeDirectory + "\" -o \"" + output +
+                          "\" \"" + path + "\"";
+    return std::system(command.c_str()) == 0;
+  }
+
+private:
+  // A generated C++ function over Values, and the FunctionObject the entry
+  // point creates for it
+  struct Unit {
+    std::string Symbol;
+    std::string Name;
+    int Arity = 0;
+    int FrameSize = 0;
+    int Owner = -1; // Class of a method, or of the method around a closure
+    std::vector<CaptureDescriptor> Captures;
+    std::vector<std::string> Names;
+    int Caches = 0; // Member access sites, each with an inline cache
+    std::vector<std::string> Strings; // Constants, all of them strings
+    std::vector<int> Prototypes;      // Units of closures created inside
+    std::string Code;
+  };
+
+  struct ClassRecord {
+    std::string Name;
+    int Base = -1;
+    const ClassDeclaration *Declaration;
+    std::vector<std::pair<std::string, int>> Methods;
+    int Initializer = -1;
+  };
+
+  // Unit whose body is being generated
+  struct State {
+    int Unit;
+    const std::vector<CapturedVariable> *Captures; // Null outside closures
+    std::string Body;
+    int Indent = 1;
+    int Temporaries = 0;
+    bool Returned = false; // Whether the last line returns from the body
+    std::unordered_map<std::string, int> NameIndex;
+    std::unordered_map<std::string, int> StringIndex;
+  };
+
+  // C++ expression and whether evaluating it later gives the same value
+  struct Fragment {
+    std::string Code;
+    bool Stable;
+  };
+
+  // Native variant of a top-level function
+  struct TypedFunction {
+    std::string Symbol;
+    const FunctionDeclaration *Declaration;
+    std::vector<TypeKind> Parameters;
+    TypeKind Result;
+    std::string Code;
+  };
+
+  struct TypedState {
+    std::string Body;
+    int Indent = 1;
+    int Temporaries = 0;
+    TypeKind Result;
+    std::unordered_map<int, TypeKind> Locals; // Current variable per slot
+    std::vector<std::pair<int, TypeKind>> Declared;
+  };
+
+  struct TypedValue {
+    std::string Code;
+    TypeKind Kind;
+  };
+
+  std::vector<std::string> errors;
+  const std::vector<std::string> *globals = nullptr;
+  int thisGlobal = -1;
+  int superGlobal = -1;
+  std::vector<Unit> units;
+  std::vector<ClassRecord> classes;
+  std::unordered_map<std::string, int> classIndex;
+  std::unordered_map<std::string, ClassDeclaration *> classDeclarations;
+  std::vector<std::pair<int, int>> functions; // Global and unit
+  std::unordered_map<std::string, TypedFunction> typedFunctions;
+  std::vector<State> states;
+
+  void error(const std::string &message) {
+    errors.push_back(message + " in '" + units[states.back().Unit].Name +
+                     "'");
+  }
+
+  int findGlobal(const std::string &name) const {
+    auto found = std::find(globals->begin(), globals->end(), name);
+    return found == globals->end()
+               ? -1
+               : static_cast<int>(found - globals->begin());
+  }
+
+  // Source text
+
+  static std::string quote(const std::string &text) {
+    std::string quoted = "\"";
+    for (unsigned char c : text) {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+        quoted += static_cast<char>(c);
+      } else if (c < 0x20 || c >= 0x7F) {
+        char escape[8];
+        std::snprintf(escape, sizeof(escape), "\\%03o", c);
+        quoted += escape;
+      } else {
+        quoted += static_cast<char>(c);
+      }
+    }
+    return quoted + "\"";
+  }
+
+  static std::string identifier(const std::string &name) {
+    std::string result;
+    for (unsigned char c : name) {
+      result += std::isalnum(c) ? static_cast<char>(c) : '_';
+    }
+    return result;
+  }
+
+  static std::string stringList(const std::vector<std::string> &names) {
+    std::string list;
+    for (const auto &name : names) {
+      list += (list.empty() ? "" : ", ") + quote(name);
+    }
+    return "{" + list + "}";
+  }
+
+  static bool usesIdentifier(const std::string &code,
+                             const std::string &name) {
+    for (size_t at = code.find(name); at != std::string::npos;
+         at = code.find(name, at + 1)) {
+      bool before = at > 0 && (std::isalnum(static_cast<unsigned char>(
+                                   code[at - 1])) ||
+                               code[at - 1] == '_');
+      size_t end = at + name.size();
+      bool after = end < code.size() &&
+                   (std::isalnum(static_cast<unsigned char>(code[end])) ||
+                    code[end] == '_');
+      if (!before && !after) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static std::string integerLiteral(const std::string &text) {
+    return "INT64_C(" +
+           std::to_string(std::strtoll(text.c_str(), nullptr, 10)) + ")";
+  }
+
+  static std::string doubleLiteral(const std::string &text) {
+    double value = std::strtod(text.c_str(), nullptr);
+    if (std::isinf(value)) {
+      return "HUGE_VAL";
+    }
+    std::ostringstream stream;
+    stream.precision(17);
+    stream << value;
+    std::string literal = stream.str();
+    if (literal.find_first_of(".e") == std::string::npos) {
+      literal += ".0";
+    }
+    return literal;
+  }
+
+  static const char *operatorName(BinaryOperator op) {
+    switch (op) {
+    case BinaryOperator::Add:
+      return "Add";
+    case BinaryOperator::Subtract:
+      return "Subtract";
+    case BinaryOperator::Multiply:
+      return "Multiply";
+    case BinaryOperator::Divide:
+      return "Divide";
+    case BinaryOperator::Modulo:
+      return "Modulo";
+    case BinaryOperator::Equal:
+      return "Equal";
+    case BinaryOperator::NotEqual:
+      return "NotEqual";
+    case BinaryOperator::Less:
+      return "Less";
+    case BinaryOperator::Greater:
+      return "Greater";
+    case BinaryOperator::LessEqual:
+      return "LessEqual";
+    default:
+      return "GreaterEqual";
+    }
+  }
+
+  // Units
+
+  int newUnit(const std::string &name, int arity, int frameSize, int owner) {
+    Unit unit;
+    unit.Symbol =
+        "f" + std::to_string(units.size()) + "_" + identifier(name);
+    unit.Name = name;
+    unit.Arity = arity;
+    unit.FrameSize = frameSize;
+    unit.Owner = owner;
+    units.push_back(std::move(unit));
+    return static_cast<int>(units.size()) - 1;
+  }
+
+  void pushUnit(int unit, const std::vector<CapturedVariable> *captures) {
+    State state;
+    state.Unit = unit;
+    state.Captures = captures;
+    states.push_back(std::move(state));
+  }
+
+  // Finishes the definition of the innermost unit
+  void popUnit(const std::string &prologue = "") {
+    State &state = states.back();
+    Unit &unit = units[state.Unit];
+    std::string body = state.Body;
+    if (!state.Returned) {
+      body += "  return Value();\n";
+    }
+    std::string code = "Value " + unit.Symbol +
+                       "(AotRuntime &rt, ClosureObject *closure, "
+                       "const Value &" +
+                       (usesIdentifier(body, "self") ? "self" : "") +
+                       ",\n    const Value *args, int argc) {\n" + prologue +
+                       "  AotRuntime::Scope scope(rt, closure->Function, args, "
+                       "argc);\n";
+    if (usesIdentifier(body, "s")) {
+      code += "  Value *s = scope.Slots;\n";
+    }
+    unit.Code = code + body + "}\n";
+    states.pop_back();
+  }
+
+  State &current() { return states.back(); }
+
+  void line(const std::string &text) {
+    State &state = current();
+    state.Body += std::string(state.Indent * 2, ' ') + text + "\n";
+    state.Returned = state.Indent == 1 && text.compare(0, 7, "return ") == 0;
+  }
+
+  std::string temporaryName() {
+    return "t" + std::to_string(current().Temporaries++);
+  }
+
+  // Evaluates value now, unless it gives the same result later
+  std::string temporary(const Fragment &value) {
+    if (value.Stable) {
+      return value.Code;
+    }
+    std::string name = temporaryName();
+    line("Value " + name + " = " + value.Code + ";");
+    return name;
+  }
+
+  std::string addName(const std::string &name) {
+    State &state = current();
+    auto found = state.NameIndex.find(name);
+    int index;
+    if (found != state.NameIndex.end()) {
+      index = found->second;
+    } else {
+      auto &names = units[state.Unit].Names;
+      index = static_cast<int>(names.size());
+      names.push_back(name);
+      state.NameIndex[name] = index;
+    }
+    return "closure->Function->Names[" + std::to_string(index) + "]";
+  }
+
+  // A new inline cache for one member access site
+  std::string addCache() {
+    int index = units[current().Unit].Caches++;
+    return "closure->Function->Caches[" + std::to_string(index) + "]";
+  }
+
+  std::string addString(const std::string &text) {
+    State &state = current();
+    auto found = state.StringIndex.find(text);
+    int index;
+    if (found != state.StringIndex.end()) {
+      index = found->second;
+    } else {
+      auto &strings = units[state.Unit].Strings;
+      index = static_cast<int>(strings.size());
+      strings.push_back(text);
+      state.StringIndex[text] = index;
+    }
+    return "closure->Function->Constants[" + std::to_string(index) + "]";
+  }
+
+  // Declarations
+
+  int compileClass(const ClassDeclaration &decl) {
+    auto existing = classIndex.find(decl.Name);
+    if (existing != classIndex.end()) {
+      return existing->second;
+    }
+    int base = -1;
+    if (decl.BaseClass) {
+      auto found = classDeclarations.find(decl.BaseClass->Name);
+      if (found != classDeclarations.end()) {
+        base = compileClass(*found->second);
+      }
+    }
+    int index = static_cast<int>(classes.size());
+    classIndex[decl.Name] = index;
+    classes.push_back(ClassRecord{decl.Name, base, &decl, {}, -1});
+
+    int fields = -1;
+    for (const auto &member : decl.Members) {
+      if (auto func = std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        int method = compileFunction(*func, index);
+        classes[index].Methods.push_back({func->Name, method});
+      } else if (auto var =
+                     std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        if (var->Value && var->Binding.Kind == FieldBinding) {
+          if (fields < 0) {
+            fields = newUnit(decl.Name + ".<fields>", 0, 0, index);
+            pushUnit(fields, nullptr);
+          }
+          line("rt.setField(self, " + std::to_string(var->Binding.Slot) +
+               ", " + compileExpression(var->Value).Code + ");");
+        }
+      }
+    }
+    if (fields >= 0) {
+      popUnit();
+      classes[index].Initializer = fields;
+    }
+    return index;
+  }
+
+  int compileFunction(const FunctionDeclaration &func, int owner) {
+    std::string name =
+        owner >= 0 ? classes[owner].Name + "." + func.Name : func.Name;
+    int unit = newUnit(name, static_cast<int>(func.Parameters.size()),
+                       func.FrameSize, owner);
+    pushUnit(unit, nullptr);
+    if (func.Async) {
+      error("Async functions need the VirtualMachine");
+    }
+    std::string prologue;
+    auto typed = owner < 0 ? typedFunctions.find(func.Name)
+                           : typedFunctions.end();
+    if (typed != typedFunctions.end() &&
+        typed->second.Declaration == &func) {
+      prologue = typedEntry(typed->second);
+    }
+    compileParameters(func.Parameters);
+    compileStatements(func.Body);
+    popUnit(prologue);
+    return unit;
+  }
+
+  void
+  compileParameters(const std::vector<std::shared_ptr<Parameter>> &parameters) {
+    for (const auto &parameter : parameters) {
+      if (parameter->Binding.IsBoxed) {
+        std::string slot = "s[" + std::to_string(parameter->Binding.Slot) + "]";
+        line(slot + " = rt.newCell(" + slot + ");");
+      }
+    }
+  }
+
+  // Statements
+
+  void compileStatements(const std::vector<std::shared_ptr<AstNode>> &body) {
+    for (const auto &statement : body) {
+      compileStatement(statement);
+    }
+  }
+
+  void compileBlock(const std::vector<std::shared_ptr<AstNode>> &body) {
+    current().Indent++;
+    compileStatements(body);
+    current().Indent--;
+  }
+
+  void compileStatement(const std::shared_ptr<AstNode> &node) {
+    if (!node) {
+      return;
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      const VariableBinding &binding = var->Binding;
+      if (binding.Kind == LocalBinding) {
+        std::string slot = "s[" + std::to_string(binding.Slot) + "]";
+        line(slot + " = " + compileExpression(var->Value).Code + ";");
+        if (binding.IsBoxed) {
+          line(slot + " = rt.newCell(" + slot + ");");
+        }
+      } else if (binding.Kind == GlobalBinding && var->Value) {
+        line("rt.global(" + std::to_string(binding.Slot) +
+             ") = " + compileExpression(var->Value).Code + ";");
+      }
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      line("return " + compileExpression(ret->ReturnValue).Code + ";");
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      line("if (" + compileExpression(ifStmt->Condition).Code +
+           ".isTruthy()) {");
+      compileBlock(ifStmt->ThenBody);
+      if (!ifStmt->ElseBody.empty()) {
+        line("} else {");
+        compileBlock(ifStmt->ElseBody);
+      }
+      line("}");
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      line("for (;;) {");
+      current().Indent++;
+      compileExit(whileStmt->Condition);
+      compileStatements(whileStmt->Body);
+      current().Indent--;
+      line("}");
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      compileStatement(forStmt->Initializer);
+      line("for (;;) {");
+      current().Indent++;
+      if (forStmt->Condition) {
+        compileExit(forStmt->Condition);
+      }
+      compileStatements(forStmt->Body);
+      compileStatement(forStmt->Increment);
+      current().Indent--;
+      line("}");
+    } else if (std::dynamic_pointer_cast<FunctionDeclaration>(node) ||
+               std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      error("Nested declarations are not supported");
+    } else if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      Fragment value = compileExpression(expr);
+      if (!value.Stable) {
+        line(value.Code + ";");
+      }
+    }
+  }
+
+  // Leaves the loop around it unless condition holds
+  void compileExit(const std::shared_ptr<Expression> &condition) {
+    line("if (!" + compileExpression(condition).Code + ".isTruthy()) {");
+    line("  break;");
+    line("}");
+  }
+
+  // Expressions
+
+  // Code that runs whatever has to run before the expression's own, which
+  // has to be evaluated right away unless it is stable
+  Fragment compileExpression(const std::shared_ptr<Expression> &expr) {
+    Fragment value = compileValue(expr);
+    if (expr && expr->ToDouble) {
+      value.Code = "AotRuntime::toDouble(" + value.Code + ")";
+    }
+    return value;
+  }
+
+  // The expression without the conversion the TypeChecker asked for
+  Fragment compileValue(const std::shared_ptr<Expression> &expr) {
+    if (!expr) {
+      return {"Value()", true};
+    }
+    if (auto literal = std::dynamic_pointer_cast<LiteralExpression>(expr)) {
+      return compileLiteral(*literal);
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      return compileLoad(var->Name, var->Binding);
+    }
+    if (auto binary = std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      return compileBinary(*binary);
+    }
+    if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      return compileDotAccess(*dot);
+    }
+    if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      return compileCall(*call);
+    }
+    if (auto closure = std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      return compileClosure(*closure, [&]() {
+        compileStatements(closure->Body);
+      });
+    }
+    if (auto lambda = std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      return compileClosure(*lambda, [&]() {
+        // An expression body is the lambda's result
+        auto body = std::dynamic_pointer_cast<Expression>(lambda->Body);
+        auto binary = std::dynamic_pointer_cast<BinaryExpression>(body);
+        if (body && !(binary && binary->Op == BinaryOperator::Assign)) {
+          line("return " + compileExpression(body).Code + ";");
+        } else {
+          compileStatement(lambda->Body);
+        }
+      });
+    }
+    error("Unsupported expression");
+    return {"Value()", true};
+  }
+
+  Fragment compileLiteral(const LiteralExpression &literal) {
+    switch (literal.Kind) {
+    case IntegerLiteral:
+    case LongLiteral: {
+      std::string value = integerLiteral(literal.Value);
+      // Too wide to be inline, boxed each time it is evaluated
+      if (!Value::fitsInline(
+              std::strtoll(literal.Value.c_str(), nullptr, 10))) {
+        return {"rt.integer(" + value + ")", false};
+      }
+      return {"Value::integer(" + value + ")", true};
+    }
+    case FloatLiteral:
+    case DoubleLiteral:
+      return {"Value::number(" + doubleLiteral(literal.Value) + ")", true};
+    case BooleanLiteral:
+      return {literal.Value == "true" ? "Value::boolean(true)"
+                                      : "Value::boolean(false)",
+              true};
+    default:
+      return {addString(literal.Value), true};
+    }
+  }
+
+  const CapturedVariable *capturedVariable(const VariableBinding &binding) {
+    const auto *captures = current().Captures;
+    if (!captures || binding.Capture < 0 ||
+        binding.Capture >= static_cast<int>(captures->size())) {
+      return nullptr;
+    }
+    return &(*captures)[binding.Capture];
+  }
+
+  Fragment compileLoad(const std::string &name,
+                       const VariableBinding &binding) {
+    std::string slot = std::to_string(binding.Slot);
+    switch (binding.Kind) {
+    case LocalBinding:
+      if (binding.Depth == 0) {
+        if (binding.IsBoxed) {
+          return {"AotRuntime::cell(s[" + slot + "])", false};
+        }
+        return {"s[" + slot + "]", true};
+      }
+      if (const CapturedVariable *captured = capturedVariable(binding)) {
+        std::string entry =
+            "closure->Environment[" + std::to_string(binding.Capture) + "]";
+        if (captured->ByReference) {
+          return {"rt.reference(" + entry + ")", false};
+        }
+        if (binding.IsBoxed) {
+          return {"AotRuntime::cell(" + entry + ")", false};
+        }
+        return {entry, true};
+      }
+      error("Cannot capture '" + name + "' across a named function");
+      break;
+    case GlobalBinding:
+      if (binding.Slot == thisGlobal) {
+        return {"self", true};
+      }
+      return {"rt.global(" + slot + ")", false};
+    case FieldBinding:
+      return {"rt.field(self, " + slot + ")", false};
+    case MethodBinding:
+      return {"rt.getMember(self, " + addName(name) + ", " + addCache() + ")",
+              false};
+    case UnresolvedBinding:
+      error("Unresolved name '" + name + "'");
+      break;
+    }
+    return {"Value()", true};
+  }
+
+  // The right side of = is evaluated before the left, so value is done
+  // before the target is checked, like in the VM
+  Fragment compileStore(const std::string &name,
+                        const VariableBinding &binding,
+                        const std::string &value) {
+    std::string slot = std::to_string(binding.Slot);
+    switch (binding.Kind) {
+    case LocalBinding:
+      if (binding.Depth == 0) {
+        if (binding.IsBoxed) {
+          return {"rt.setCell(s[" + slot + "], " + value + ")", false};
+        }
+        return {"(s[" + slot + "] = " + value + ")", false};
+      }
+      if (const CapturedVariable *captured = capturedVariable(binding)) {
+        std::string entry =
+            "closure->Environment[" + std::to_string(binding.Capture) + "]";
+        if (captured->ByReference) {
+          return {"(rt.reference(" + entry + ") = " + value + ")", false};
+        }
+        if (binding.IsBoxed) {
+          return {"rt.setCell(" + entry + ", " + value + ")", false};
+        }
+        error("Cannot assign to captured copy of '" + name + "'");
+      } else {
+        error("Cannot capture '" + name + "' across a named function");
+      }
+      break;
+    case GlobalBinding:
+      if (binding.Slot == thisGlobal || binding.Slot == superGlobal) {
+        error("Cannot assign to '" + name + "'");
+        break;
+      }
+      return {"(rt.global(" + slot + ") = " + value + ")", false};
+    case FieldBinding:
+      return {"rt.setField(self, " + slot + ", " + value + ")", false};
+    default:
+      error("Cannot assign to '" + name + "'");
+      break;
+    }
+    return {"Value()", true};
+  }
+
+  Fragment compileAssignment(const BinaryExpression &binary) {
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(binary.Left)) {
+      return compileStore(var->Name, var->Binding,
+                          compileExpression(binary.Right).Code);
+    }
+    auto dot = std::dynamic_pointer_cast<DotAccessExpression>(binary.Left);
+    auto member =
+        dot ? std::dynamic_pointer_cast<VariableExpression>(dot->Right)
+            : nullptr;
+    if (!member) {
+      error("Invalid assignment target");
+      return {"Value()", true};
+    }
+    std::string object = temporary(compileExpression(dot->Left));
+    std::string value = temporary(compileExpression(binary.Right));
+    line("rt.setMember(" + object + ", " + addName(member->Name) + ", " +
+         value + ", " + addCache() + ");");
+    return {value, true};
+  }
+
+  Fragment compileBinary(const BinaryExpression &binary) {
+    if (binary.Op == BinaryOperator::Assign) {
+      return compileAssignment(binary);
+    }
+    if (isLogical(binary.Op)) {
+      // The left value is the result when it decides the outcome
+      std::string result = temporaryName();
+      line("Value " + result + " = " + compileExpression(binary.Left).Code +
+           ";");
+      line(binary.Op == BinaryOperator::And ? "if (" + result + ".isTruthy()) {"
+                                            : "if (!" + result +
+                                                  ".isTruthy()) {");
+      current().Indent++;
+      line(result + " = " + compileExpression(binary.Right).Code + ";");
+      current().Indent--;
+      line("}");
+      return {result, true};
+    }
+    if (binary.Op == BinaryOperator::Unknown) {
+      error("Unknown operator '" + binary.Operator + "'");
+      return {"Value()", true};
+    }
+    std::vector<std::shared_ptr<Expression>> parts;
+    if (concatenationParts(binary, parts) && parts.size() >= 3) {
+      return {"rt.concatenateAll(" + compileArguments(parts) + ", " +
+                  std::to_string(parts.size()) + ")",
+              false};
+    }
+    // A stable left side is read after the right side ran, like a register
+    Fragment left = compileExpression(binary.Left);
+    std::string leftCode = temporary(left);
+    Fragment right = compileExpression(binary.Right);
+    std::string rightCode = left.Stable ? temporary(right) : right.Code;
+    return {std::string("rt.operation(BinaryOperator::") +
+                operatorName(binary.Op) + ", " + leftCode + ", " + rightCode +
+                ")",
+            false};
+  }
+
+  // Evaluates the arguments in order into an array and returns its name
+  std::string
+  compileArguments(const std::vector<std::shared_ptr<Expression>> &args) {
+    if (args.empty()) {
+      return "nullptr";
+    }
+    std::string array = temporaryName();
+    line("Value " + array + "[" + std::to_string(args.size()) + "];");
+    for (size_t i = 0; i < args.size(); i++) {
+      line(array + "[" + std::to_string(i) +
+           "] = " + compileExpression(args[i]).Code + ";");
+    }
+    return array;
+  }
+
+  bool isSuper(const VariableBinding &binding) const {
+    return binding.Kind == GlobalBinding && binding.Slot == superGlobal;
+  }
+
+  Fragment compileCall(const CallExpression &call) {
+    std::string argc = std::to_string(call.Arguments.size());
+    std::string args = compileArguments(call.Arguments);
+    const VariableBinding &binding = call.Binding;
+    if (dynamic_cast<const ConstructorCallExpression *>(&call)) {
+      return {"rt.newInstance(" +
+                  compileLoad(call.FunctionName, binding).Code + ", " + args +
+                  ", " + argc + ")",
+              false};
+    }
+    if (isSuper(binding)) {
+      return {"rt.callSuper(closure->Function->Owner, " +
+                  addName("constructor") + ", self, " + args + ", " + argc +
+                  ")",
+              false};
+    }
+    if (binding.Kind == MethodBinding && call.DirectSlot >= 0) {
+      return {"rt.callFinal(closure->Function->Owner, " +
+                  std::to_string(binding.Slot) + ", self, " + args + ", " +
+                  argc + ")",
+              false};
+    }
+    if (binding.Kind == MethodBinding) {
+      return {"rt.callSlot(self, " + std::to_string(binding.Slot) + ", " +
+                  args + ", " + argc + ")",
+              false};
+    }
+    return {"rt.call(" + compileLoad(call.FunctionName, binding).Code + ", " +
+                args + ", " + argc + ")",
+            false};
+  }
+
+  Fragment compileDotAccess(const DotAccessExpression &dot) {
+    if (auto call = std::dynamic_pointer_cast<CallExpression>(dot.Right)) {
+      std::string argc = std::to_string(call->Arguments.size());
+      std::string args = compileArguments(call->Arguments);
+      auto receiver = std::dynamic_pointer_cast<VariableExpression>(dot.Left);
+      if (receiver && isSuper(receiver->Binding)) {
+        return {"rt.callSuper(closure->Function->Owner, " +
+                    addName(call->FunctionName) + ", self, " + args + ", " +
+                    argc + ")",
+                false};
+      }
+      if (call->DirectSlot >= 0 && receiver &&
+          receiver->Binding.Kind == GlobalBinding &&
+          receiver->Binding.Slot == thisGlobal) {
+        return {"rt.callFinal(closure->Function->Owner, " +
+                    std::to_string(call->DirectSlot) + ", self, " + args +
+                    ", " + argc + ")",
+                false};
+      }
+      if (call->DirectSlot >= 0) {
+        return {"rt.callStatic(" + compileExpression(dot.Left).Code + ", " +
+                    std::to_string(call->DirectSlot) + ", " + args + ", " +
+                    argc + ")",
+                false};
+      }
+      return {"rt.invokeMember(" + compileExpression(dot.Left).Code + ", " +
+                  addName(call->FunctionName) + ", " + args + ", " + argc +
+                  ", " + addCache() + ")",
+              false};
+    }
+    if (auto member =
+            std::dynamic_pointer_cast<VariableExpression>(dot.Right)) {
+      return {"rt.getMember(" + compileExpression(dot.Left).Code + ", " +
+                  addName(member->Name) + ", " + addCache() + ")",
+              false};
+    }
+    error("Unsupported member access");
+    return {"Value()", true};
+  }
+
+  template <typename Closure, typename Body>
+  Fragment compileClosure(const Closure &closure,
+                          const Body &compileBodyStatements) {
+    int owner = units[current().Unit].Owner;
+    int unit = newUnit(units[current().Unit].Name + ".<closure>",
+                       static_cast<int>(closure.Parameters.size()),
+                       closure.FrameSize, owner);
+    for (const auto &captured : closure.Captures) {
+      CaptureDescriptor descriptor;
+      descriptor.FromEnvironment = captured.From.Capture >= 0;
+      descriptor.Index = descriptor.FromEnvironment ? captured.From.Capture
+                                                    : captured.From.Slot;
+      descriptor.ByReference = captured.ByReference;
+      units[unit].Captures.push_back(descriptor);
+    }
+    auto &prototypes = units[current().Unit].Prototypes;
+    int prototype = static_cast<int>(prototypes.size());
+    prototypes.push_back(unit);
+
+    pushUnit(unit, &closure.Captures);
+    compileParameters(closure.Parameters);
+    compileBodyStatements();
+    popUnit();
+    return {"rt.closure(closure->Function->Prototypes[" +
+                std::to_string(prototype) + "], closure, self, s)",
+            false};
+  }
+
+  // Typed functions
+
+  static TypeKind typedKind(const std::shared_ptr<TypeReference> &type) {
+    if (!type) {
+      return TypeKind::Unknown;
+    }
+    if (type->Name == "Int" || type->Name == "Long") {
+      return TypeKind::Int;
+    }
+    if (type->Name == "Float" || type->Name == "Double") {
+      return TypeKind::Double;
+    }
+    return type->Name == "Bool" ? TypeKind::Bool : TypeKind::Unknown;
+  }
+
+  static const char *nativeType(TypeKind kind) {
+    switch (kind) {
+    case TypeKind::Int:
+      return "int64_t";
+    case TypeKind::Double:
+      return "double";
+    default:
+      return "bool";
+    }
+  }
+
+  static const char *kindSuffix(TypeKind kind) {
+    switch (kind) {
+    case TypeKind::Int:
+      return "i";
+    case TypeKind::Double:
+      return "d";
+    default:
+      return "b";
+    }
+  }
+
+  static std::string typedLocal(int slot, TypeKind kind) {
+    return "v" + std::to_string(slot) + kindSuffix(kind);
+  }
+
+  // Finds the functions that get a native variant. A function qualifies if
+  // its typed body can be generated while calling only functions that
+  // qualify, and no code reassigns its global.
+  void findTypedFunctions(const Package &package) {
+    std::unordered_set<int> assigned;
+    for (const auto &member : package.Members) {
+      findAssignedGlobals(member, assigned);
+    }
+    for (const auto &member : package.Members) {
+      auto func = std::dynamic_pointer_cast<FunctionDeclaration>(member);
+      if (!func || assigned.count(findGlobal(func->Name)) ||
+          typedFunctions.count(func->Name)) {
+        continue;
+      }
+      TypedFunction typed;
+      typed.Symbol = "t" + std::to_string(typedFunctions.size()) + "_" +
+                     identifier(func->Name);
+      typed.Declaration = func.get();
+      typed.Result = typedKind(func->ReturnType);
+      bool qualifies = typed.Result != TypeKind::Unknown;
+      for (const auto &parameter : func->Parameters) {
+        TypeKind kind = typedKind(parameter->Type);
+        qualifies = qualifies && kind != TypeKind::Unknown &&
+                    !parameter->Binding.IsBoxed;
+        typed.Parameters.push_back(kind);
+      }
+      if (qualifies) {
+        typedFunctions[func->Name] = std::move(typed);
+      }
+    }
+    // Dropping a function can disqualify its callers
+    for (bool changed = true; changed;) {
+      changed = false;
+      std::vector<std::string> dropped;
+      for (auto &entry : typedFunctions) {
+        if (!compileTyped(entry.second)) {
+          dropped.push_back(entry.first);
+        }
+      }
+      for (const auto &name : dropped) {
+        typedFunctions.erase(name);
+        changed = true;
+      }
+    }
+  }
+
+  void findAssignedGlobals(const std::shared_ptr<AstNode> &node,
+                           std::unordered_set<int> &assigned) {
+    if (!node) {
+      return;
+    }
+    auto visitAll = [&](const std::vector<std::shared_ptr<AstNode>> &body) {
+      for (const auto &statement : body) {
+        findAssignedGlobals(statement, assigned);
+      }
+    };
+    if (auto binary = std::dynamic_pointer_cast<BinaryExpression>(node)) {
+      auto var = std::dynamic_pointer_cast<VariableExpression>(binary->Left);
+      if (binary->Op == BinaryOperator::Assign && var &&
+          var->Binding.Kind == GlobalBinding) {
+        assigned.insert(var->Binding.Slot);
+      }
+      findAssignedGlobals(binary->Left, assigned);
+      findAssignedGlobals(binary->Right, assigned);
+    } else if (auto var =
+                   std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      findAssignedGlobals(var->Value, assigned);
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      findAssignedGlobals(ret->ReturnValue, assigned);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      findAssignedGlobals(ifStmt->Condition, assigned);
+      visitAll(ifStmt->ThenBody);
+      visitAll(ifStmt->ElseBody);
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      findAssignedGlobals(whileStmt->Condition, assigned);
+      visitAll(whileStmt->Body);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      findAssignedGlobals(forStmt->Initializer, assigned);
+      findAssignedGlobals(forStmt->Condition, assigned);
+      findAssignedGlobals(forStmt->Increment, assigned);
+      visitAll(forStmt->Body);
+    } else if (auto func =
+                   std::dynamic_pointer_cast<FunctionDeclaration>(node)) {
+      visitAll(func->Body);
+    } else if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      visitAll(cls->Members);
+    } else if (auto dot =
+                   std::dynamic_pointer_cast<DotAccessExpression>(node)) {
+      findAssignedGlobals(dot->Left, assigned);
+      findAssignedGlobals(dot->Right, assigned);
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+      for (const auto &argument : call->Arguments) {
+        findAssignedGlobals(argument, assigned);
+      }
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(node)) {
+      visitAll(closure->Body);
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(node)) {
+      findAssignedGlobals(lambda->Body, assigned);
+    }
+  }
+
+  // Whether falling off the end of body is impossible, which the native
+  // variant needs since it cannot return null
+  static bool alwaysReturns(const std::vector<std::shared_ptr<AstNode>> &body) {
+    if (body.empty()) {
+      return false;
+    }
+    if (std::dynamic_pointer_cast<ReturnStatement>(body.back())) {
+      return true;
+    }
+    auto ifStmt = std::dynamic_pointer_cast<IfStatement>(body.back());
+    return ifStmt && alwaysReturns(ifStmt->ThenBody) &&
+           alwaysReturns(ifStmt->ElseBody);
+  }
+
+  // Generates the native variant into typed.Code. Returns false if the
+  // function does not qualify.
+  bool compileTyped(TypedFunction &typed) {
+    const FunctionDeclaration &func = *typed.Declaration;
+    if (!alwaysReturns(func.Body)) {
+      return false;
+    }
+    TypedState state;
+    state.Result = typed.Result;
+    std::string header = std::string(nativeType(typed.Result)) + " " +
+                         typed.Symbol + "(AotRuntime &rt";
+    for (size_t i = 0; i < func.Parameters.size(); i++) {
+      int slot = func.Parameters[i]->Binding.Slot;
+      state.Locals[slot] = typed.Parameters[i];
+      header += std::string(", ") + nativeType(typed.Parameters[i]) + " " +
+                typedLocal(slot, typed.Parameters[i]);
+    }
+    for (const auto &statement : func.Body) {
+      if (!compileTypedStatement(statement, state)) {
+        return false;
+      }
+    }
+    std::string code = header + ") {\n  AotRuntime::Scope scope(rt, " +
+                       quote(func.Name) + ");\n";
+    for (const auto &local : state.Declared) {
+      code += std::string("  ") + nativeType(local.second) + " " +
+              typedLocal(local.first, local.second) + " = 0;\n";
+    }
+    typed.Code = code + state.Body + "}\n";
+    return true;
+  }
+
+  // Enters the native variant from the Value version when the arguments
+  // have the declared types
+  std::string typedEntry(const TypedFunction &typed) {
+    std::string test;
+    std::string arguments = "rt";
+    for (size_t i = 0; i < typed.Parameters.size(); i++) {
+      std::string arg = "args[" + std::to_string(i) + "]";
+      const char *check = typed.Parameters[i] == TypeKind::Int
+                              ? ".isInt()"
+                              : typed.Parameters[i] == TypeKind::Double
+                                    ? ".isDouble()"
+                                    : ".isBool()";
+      const char *read = typed.Parameters[i] == TypeKind::Int
+                             ? ".asInt()"
+                             : typed.Parameters[i] == TypeKind::Double
+                                   ? ".asDouble()"
+                                   : ".asBool()";
+      test += (test.empty() ? "" : " && ") + arg + check;
+      arguments += ", " + arg + read;
+    }
+    const char *wrap = typed.Result == TypeKind::Int
+                           ? "rt.integer"
+                           : typed.Result == TypeKind::Double
+                                 ? "Value::number"
+                                 : "Value::boolean";
+    std::string call = std::string("return ") + wrap + "(" + typed.Symbol +
+                       "(" + arguments + "));\n";
+    if (test.empty()) {
+      return "  " + call;
+    }
+    return "  if (" + test + ") {\n    " + call + "  }\n";
+  }
+
+  static void typedLine(TypedState &state, const std::string &text) {
+    state.Body += std::string(state.Indent * 2, ' ') + text + "\n";
+  }
+
+  static std::string typedTemporary(TypedState &state, TypeKind kind,
+                                    const std::string &value) {
+    std::string name = "t" + std::to_string(state.Temporaries++);
+    typedLine(state, std::string(nativeType(kind)) + " " + name + " = " +
+                         value + ";");
+    return name;
+  }
+
+  bool compileTypedBlock(const std::vector<std::shared_ptr<AstNode>> &body,
+                         TypedState &state) {
+    state.Indent++;
+    for (const auto &statement : body) {
+      if (!compileTypedStatement(statement, state)) {
+        return false;
+      }
+    }
+    state.Indent--;
+    return true;
+  }
+
+  bool compileTypedCondition(const std::shared_ptr<Expression> &condition,
+                             TypedState &state, std::string &code) {
+    TypedValue value;
+    if (!compileTypedExpression(condition, state, value) ||
+        value.Kind != TypeKind::Bool) {
+      return false;
+    }
+    code = value.Code;
+    return true;
+  }
+
+  bool compileTypedStatement(const std::shared_ptr<AstNode> &node,
+                             TypedState &state) {
+    if (!node) {
+      return true;
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      const VariableBinding &binding = var->Binding;
+      TypedValue value;
+      if (binding.Kind != LocalBinding || binding.IsBoxed || !var->Value ||
+          !compileTypedExpression(var->Value, state, value)) {
+        return false;
+      }
+      TypeKind kind = var->Type ? typedKind(var->Type) : value.Kind;
+      if (kind != value.Kind) {
+        return false;
+      }
+      state.Locals[binding.Slot] = kind;
+      std::pair<int, TypeKind> local(binding.Slot, kind);
+      if (std::find(state.Declared.begin(), state.Declared.end(), local) ==
+          state.Declared.end()) {
+        state.Declared.push_back(local);
+      }
+      typedLine(state, typedLocal(binding.Slot, kind) + " = " + value.Code +
+                           ";");
+      return true;
+    }
+    if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      TypedValue value;
+      if (!ret->ReturnValue ||
+          !compileTypedExpression(ret->ReturnValue, state, value) ||
+          value.Kind != state.Result) {
+        return false;
+      }
+      typedLine(state, "return " + value.Code + ";");
+      return true;
+    }
+    if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      std::string condition;
+      if (!compileTypedCondition(ifStmt->Condition, state, condition)) {
+        return false;
+      }
+      typedLine(state, "if (" + condition + ") {");
+      if (!compileTypedBlock(ifStmt->ThenBody, state)) {
+        return false;
+      }
+      if (!ifStmt->ElseBody.empty()) {
+        typedLine(state, "} else {");
+        if (!compileTypedBlock(ifStmt->ElseBody, state)) {
+          return false;
+        }
+      }
+      typedLine(state, "}");
+      return true;
+    }
+    if (auto whileStmt = std::dynamic_pointer_cast<WhileStatement>(node)) {
+      return compileTypedLoop(whileStmt->Condition, whileStmt->Body, nullptr,
+                              state);
+    }
+    if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      return compileTypedStatement(forStmt->Initializer, state) &&
+             compileTypedLoop(forStmt->Condition, forStmt->Body,
+                              forStmt->Increment, state);
+    }
+    auto expr = std::dynamic_pointer_cast<Expression>(node);
+    if (!expr) {
+      return false;
+    }
+    auto binary = std::dynamic_pointer_cast<BinaryExpression>(expr);
+    if (binary && binary->Op == BinaryOperator::Assign) {
+      auto var = std::dynamic_pointer_cast<VariableExpression>(binary->Left);
+      TypedValue value;
+      if (!var || var->Binding.Kind != LocalBinding ||
+          var->Binding.Depth != 0 || var->Binding.IsBoxed ||
+          !state.Locals.count(var->Binding.Slot) ||
+          !compileTypedExpression(binary->Right, state, value) ||
+          value.Kind != state.Locals[var->Binding.Slot]) {
+        return false;
+      }
+      typedLine(state, typedLocal(var->Binding.Slot, value.Kind) + " = " +
+                           value.Code + ";");
+      return true;
+    }
+    // Calls run for their errors; anything else typed has no effect
+    TypedValue value;
+    return compileTypedExpression(expr, state, value);
+  }
+
+  bool compileTypedLoop(const std::shared_ptr<Expression> &condition,
+                        const std::vector<std::shared_ptr<AstNode>> &body,
+                        const std::shared_ptr<AstNode> &increment,
+                        TypedState &state) {
+    typedLine(state, "for (;;) {");
+    state.Indent++;
+    if (condition) {
+      std::string code;
+      if (!compileTypedCondition(condition, state, code)) {
+        return false;
+      }
+      typedLine(state, "if (!" + code + ") {");
+      typedLine(state, "  break;");
+      typedLine(state, "}");
+    }
+    state.Indent--;
+    if (!compileTypedBlock(body, state)) {
+      return false;
+    }
+    state.Indent++;
+    if (!compileTypedStatement(increment, state)) {
+      return false;
+    }
+    state.Indent--;
+    typedLine(state, "}");
+    return true;
+  }
+
+  // Produces code without side effects: calls and divisions, which can
+  // fail, are evaluated into temporaries in order
+  bool compileTypedExpression(const std::shared_ptr<Expression> &expr,
+                              TypedState &state, TypedValue &out) {
+    if (!compileTypedValue(expr, state, out)) {
+      return false;
+    }
+    if (expr->ToDouble && out.Kind == TypeKind::Int) {
+      out = {"static_cast<double>(" + out.Code + ")", TypeKind::Double};
+    }
+    return true;
+  }
+
+  bool compileTypedValue(const std::shared_ptr<Expression> &expr,
+                         TypedState &state, TypedValue &out) {
+    if (auto literal = std::dynamic_pointer_cast<LiteralExpression>(expr)) {
+      switch (literal->Kind) {
+      case IntegerLiteral:
+      case LongLiteral:
+        out = {integerLiteral(literal->Value), TypeKind::Int};
+        return true;
+      case FloatLiteral:
+      case DoubleLiteral:
+        out = {doubleLiteral(literal->Value), TypeKind::Double};
+        return true;
+      case BooleanLiteral:
+        out = {literal->Value == "true" ? "true" : "false", TypeKind::Bool};
+        return true;
+      default:
+        return false;
+      }
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      const VariableBinding &binding = var->Binding;
+      if (binding.Kind != LocalBinding || binding.Depth != 0 ||
+          binding.IsBoxed || !state.Locals.count(binding.Slot)) {
+        return false;
+      }
+      TypeKind kind = state.Locals[binding.Slot];
+      out = {typedLocal(binding.Slot, kind), kind};
+      return true;
+    }
+    if (auto binary = std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      return compileTypedBinary(*binary, state, out);
+    }
+    auto call = std::dynamic_pointer_cast<CallExpression>(expr);
+    if (!call || dynamic_cast<const ConstructorCallExpression *>(call.get()) ||
+        call->Binding.Kind != GlobalBinding ||
+        call->Binding.Slot == thisGlobal || isSuper(call->Binding)) {
+      return false;
+    }
+    auto callee = typedFunctions.find((*globals)[call->Binding.Slot]);
+    if (callee == typedFunctions.end() ||
+        callee->second.Parameters.size() != call->Arguments.size()) {
+      return false;
+    }
+    std::string arguments = "rt";
+    for (size_t i = 0; i < call->Arguments.size(); i++) {
+      TypedValue argument;
+      if (!compileTypedExpression(call->Arguments[i], state, argument) ||
+          argument.Kind != callee->second.Parameters[i]) {
+        return false;
+      }
+      arguments += ", " + argument.Code;
+    }
+    out = {typedTemporary(state, callee->second.Result,
+                          callee->second.Symbol + "(" + arguments + ")"),
+           callee->second.Result};
+    return true;
+  }
+
+  bool compileTypedBinary(const BinaryExpression &binary, TypedState &state,
+                          TypedValue &out) {
+    if (binary.Op == BinaryOperator::Assign ||
+        binary.Op == BinaryOperator::Unknown) {
+      return false;
+    }
+    TypedValue left;
+    if (!compileTypedExpression(binary.Left, state, left)) {
+      return false;
+    }
+    if (isLogical(binary.Op)) {
+      if (left.Kind != TypeKind::Bool) {
+        return false;
+      }
+      std::string result = typedTemporary(state, TypeKind::Bool, left.Code);
+      typedLine(state, binary.Op == BinaryOperator::And
+                           ? "if (" + result + ") {"
+                           : "if (!" + result + ") {");
+      state.Indent++;
+      TypedValue right;
+      if (!compileTypedExpression(binary.Right, state, right) ||
+          right.Kind != TypeKind::Bool) {
+        return false;
+      }
+      typedLine(state, result + " = " + right.Code + ";");
+      state.Indent--;
+      typedLine(state, "}");
+      out = {result, TypeKind::Bool};
+      return true;
+    }
+    TypedValue right;
+    if (!compileTypedExpression(binary.Right, state, right) ||
+        left.Kind != right.Kind) {
+      return false;
+    }
+    std::string operands = left.Code + ", " + right.Code;
+    bool integer = left.Kind == TypeKind::Int;
+    bool number = integer || left.Kind == TypeKind::Double;
+    switch (binary.Op) {
+    case BinaryOperator::Add:
+      out.Code = integer ? "AotRuntime::addInt(" + operands + ")"
+                         : "(" + left.Code + " + " + right.Code + ")";
+      break;
+    case BinaryOperator::Subtract:
+      out.Code = integer ? "AotRuntime::subtractInt(" + operands + ")"
+                         : "(" + left.Code + " - " + right.Code + ")";
+      break;
+    case BinaryOperator::Multiply:
+      out.Code = integer ? "AotRuntime::multiplyInt(" + operands + ")"
+                         : "(" + left.Code + " * " + right.Code + ")";
+      break;
+    case BinaryOperator::Divide:
+      out.Code = integer ? typedTemporary(state, TypeKind::Int,
+                                          "rt.divideInt(" + operands + ")")
+                         : "(" + left.Code + " / " + right.Code + ")";
+      break;
+    case BinaryOperator::Modulo:
+      out.Code = integer ? typedTemporary(state, TypeKind::Int,
+                                          "rt.moduloInt(" + operands + ")")
+                         : "AotRuntime::moduloDouble(" + operands + ")";
+      break;
+    case BinaryOperator::Equal:
+      out = {"(" + left.Code + " == " + right.Code + ")", TypeKind::Bool};
+      return true;
+    case BinaryOperator::NotEqual:
+      out = {"(" + left.Code + " != " + right.Code + ")", TypeKind::Bool};
+      return true;
+    case BinaryOperator::Less:
+      out = {"(" + left.Code + " < " + right.Code + ")", TypeKind::Bool};
+      return number;
+    case BinaryOperator::LessEqual:
+      out = {"(" + left.Code + " <= " + right.Code + ")", TypeKind::Bool};
+      return number;
+    case BinaryOperator::Greater:
+      out = {"(" + left.Code + " > " + right.Code + ")", TypeKind::Bool};
+      return number;
+    default:
+      out = {"(" + left.Code + " >= " + right.Code + ")", TypeKind::Bool};
+      return number;
+    }
+    out.Kind = left.Kind;
+    return number;
+  }
+
+  // Output
+
+  std::string assemble(const Package &package, int initializer) {
+    std::string source =
+        "// Generated by the SodaScript AotCompiler from package " +
+        quote(package.Name) + "\n#include \"aot_runtime.h\"\n\nnamespace {\n";
+    for (const auto &entry : typedFunctions) {
+      const TypedFunction &typed = entry.second;
+      source += "\n" + typed.Code.substr(0, typed.Code.find(" {\n")) + ";\n";
+    }
+    for (const auto &entry : typedFunctions) {
+      source += "\n" + entry.second.Code;
+    }
+    for (const auto &unit : units) {
+      source += "\n" + unit.Code;
+    }
+    // The name AotEntryName gives
+    source += "\n} // namespace\n\nSODA_AOT_EXPORT void "
+              "soda_aot_run(AotRuntime &rt) {\n";
+    source += "  rt.declareGlobals(" + stringList(*globals) + ");\n";
+
+    // A class copies the methods of its base when created
+    std::vector<bool> created(units.size(), false);
+    auto createUnits = [&](int owner) {
+      for (size_t i = 0; i < units.size(); i++) {
+        if (units[i].Owner != owner || created[i]) {
+          continue;
+        }
+        created[i] = true;
+        source += "  FunctionObject *u" + std::to_string(i) +
+                  " = rt.newFunction(" + quote(units[i].Name) + ", " +
+                  std::to_string(units[i].Arity) + ", " +
+                  std::to_string(units[i].FrameSize) + ", " +
+                  units[i].Symbol + ", " +
+                  (owner >= 0 ? "c" + std::to_string(owner) : "nullptr") +
+                  ");\n";
+      }
+    };
+    for (size_t i = 0; i < classes.size(); i++) {
+      const ClassRecord &cls = classes[i];
+      std::string name = "c" + std::to_string(i);
+      source += "  ClassObject *" + name + " = rt.newClass(" +
+                quote(cls.Name) + ", " +
+                (cls.Base >= 0 ? "c" + std::to_string(cls.Base) : "nullptr") +
+                ", " + stringList(cls.Declaration->FieldNames) + ", " +
+                stringList(cls.Declaration->MethodNames) + ");\n";
+      createUnits(static_cast<int>(i));
+      for (const auto &method : cls.Methods) {
+        source += "  rt.setMethod(" + name + ", " + quote(method.first) +
+                  ", u" + std::to_string(method.second) + ");\n";
+      }
+      if (cls.Initializer >= 0) {
+        source += "  rt.setInitializer(" + name + ", u" +
+                  std::to_string(cls.Initializer) + ");\n";
+      }
+    }
+    createUnits(-1);
+
+    for (size_t i = 0; i < units.size(); i++) {
+      const Unit &unit = units[i];
+      std::string name = "  u" + std::to_string(i);
+      if (!unit.Names.empty()) {
+        source += name + "->Names = " + stringList(unit.Names) + ";\n";
+      }
+      if (unit.Caches > 0) {
+        source += name + "->Caches.resize(" + std::to_string(unit.Caches) +
+                  ");\n";
+      }
+      if (!unit.Strings.empty()) {
+        std::string constants;
+        for (const auto &text : unit.Strings) {
+          constants += (constants.empty() ? "" : ", ") +
+                       std::string("rt.string(") + quote(text) + ")";
+        }
+        source += name + "->Constants = {" + constants + "};\n";
+      }
+      if (!unit.Prototypes.empty()) {
+        std::string prototypes;
+        for (int prototype : unit.Prototypes) {
+          prototypes += (prototypes.empty() ? "u" : ", u") +
+                        std::to_string(prototype);
+        }
+        source += name + "->Prototypes = {" + prototypes + "};\n";
+      }
+      for (const auto &captured : unit.Captures) {
+        source += name + "->Captures.push_back(CaptureDescriptor{" +
+                  (captured.FromEnvironment ? "true, " : "false, ") +
+                  std::to_string(captured.Index) +
+                  (captured.ByReference ? ", true});\n" : ", false});\n");
+      }
+    }
+
+    // Members are visible before any top-level code runs
+    for (size_t i = 0; i < classes.size(); i++) {
+      int global = findGlobal(classes[i].Name);
+      if (global >= 0) {
+        source += "  rt.global(" + std::to_string(global) +
+                  ") = Value::object(c" + std::to_string(i) + ");\n";
+      }
+    }
+    for (const auto &function : functions) {
+      if (function.first >= 0) {
+        source += "  rt.global(" + std::to_string(function.first) +
+                  ") = rt.closure(u" + std::to_string(function.second) +
+                  ", nullptr, Value(), nullptr);\n";
+      }
+    }
+    source += "  rt.call(rt.closure(u" + std::to_string(initializer) +
+              ", nullptr, Value(), nullptr), nullptr, 0);\n}\n";
+    return source;
+  }
+};
+
+#endif // AOT_COMPILER_H
@@ -0,0 +1,410 @@
+#ifndef AOT_RUNTIME_H
+#define AOT_RUNTIME_H
+
+#include "binary_operator.h"
+#include "cell_object.h"
+#include "class_object.h"
+#include "closure_object.h"
+#include "function_object.h"
+#include "instance_object.h"
+#include "script_runtime.h"
+#include "value.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#define SODA_AOT_EXPORT extern "C" __declspec(dllexport)
+#else
+#include <dlfcn.h>
+#define SODA_AOT_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+class AotRuntime;
+
+// Sets up and runs one package. Every source the AotCompiler generates
+// exports one under AotEntryName.
+typedef void (*AotEntry)(AotRuntime &runtime);
+
+const char *const AotEntryName = "soda_aot_run";
+
+// Runs packages the AotCompiler translated to C++, and is the library that
+// generated code links against: it keeps the slots of generic functions on
+// one stack, and does the calls, member accesses and operators the
+// generated code does not inline.
+class AotRuntime : public ScriptRuntime {
+public:
+  explicit AotRuntime(size_t stackSize = 1 << 16, int maxDepth = 1000)
+      : stack(stackSize), maxDepth(maxDepth) {}
+
+  // Loads a shared object built from generated source and runs its
+  // package. Returns false if it cannot be loaded or on a runtime error.
+  bool load(const std::string &path) {
+    error.clear();
+#ifdef _WIN32
+    HMODULE module = LoadLibraryA(path.c_str());
+    AotEntry entry = module ? reinterpret_cast<AotEntry>(reinterpret_cast<
+                                  void (*)()>(GetProcAddress(module,
+                                                             AotEntryName)))
+                            : nullptr;
+#else
+    void *module = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    AotEntry entry =
+        module ? reinterpret_cast<AotEntry>(dlsym(module, AotEntryName))
+               : nullptr;
+#endif
+    if (!entry) {
+      error = "Cannot load package '" + path + "'";
+      return false;
+    }
+    // Never unloaded, the heap holds objects of the module's classes
+    return run(entry);
+  }
+
+  // Runs a package whose generated source is linked into the host
+  bool run(AotEntry entry) {
+    Heap::StackScope scope(heap);
+    error.clear();
+    try {
+      entry(*this);
+    } catch (const std::exception &e) {
+      // Also errors thrown by another copy of RuntimeError in a module
+      error = e.what();
+      stackTop = 0;
+      depth = 0;
+      active = nullptr;
+      return false;
+    }
+    return true;
+  }
+
+  Value call(const Value &callee, const Value *arguments, int count) override {
+    Heap::StackScope scope(heap, arguments, count);
+    if (callee.isObject()) {
+      switch (callee.asObject()->Kind) {
+      case ObjectKind::Closure: {
+        auto *closure = static_cast<ClosureObject *>(callee.asObject());
+        return invoke(closure, closure->Receiver, arguments, count);
+      }
+      case ObjectKind::Native:
+        return callNative(static_cast<NativeObject *>(callee.asObject()),
+                          arguments, count);
+      case ObjectKind::Class:
+        return construct(static_cast<ClassObject *>(callee.asObject()),
+                         arguments, count);
+      default:
+        break;
+      }
+    }
+    fail("Cannot call " + std::string(valueTypeName(callee)));
+  }
+
+  Value callMethod(const Value &method, const Value &receiver,
+                   const Value *arguments, int count) override {
+    Heap::StackScope scope(heap, arguments, count);
+    if (method.isObject() && method.asObject()->Kind == ObjectKind::Closure) {
+      return invoke(static_cast<ClosureObject *>(method.asObject()), receiver,
+                    arguments, count);
+    }
+    return call(method, arguments, count);
+  }
+
+  void traceRoots(Tracer &tracer) override {
+    ScriptRuntime::traceRoots(tracer);
+    tracer.mark(stack.data(), stackTop);
+  }
+
+  // Everything below is used by generated code
+
+  // One call of a generated function. Generic functions get their slots
+  // here; typed ones only count towards the depth and name errors.
+  class Scope {
+  public:
+    Value *Slots = nullptr;
+
+    Scope(AotRuntime &runtime, const char *name)
+        : runtime(runtime), stackTop(runtime.stackTop),
+          active(runtime.active) {
+      if (runtime.depth == runtime.maxDepth) {
+        runtime.fail("Stack overflow");
+      }
+      runtime.depth++;
+      runtime.active = name;
+    }
+
+    Scope(AotRuntime &runtime, const FunctionObject *function,
+          const Value *arguments, int argc)
+        : Scope(runtime, function->Name.c_str()) {
+      size_t frameSize =
+          static_cast<size_t>(std::max(function->RegisterCount, argc));
+      if (stackTop + frameSize > runtime.stack.size()) {
+        runtime.fail("Stack overflow");
+      }
+      Slots = runtime.stack.data() + stackTop;
+      runtime.stackTop += frameSize;
+      for (int i = 0; i < argc; i++) {
+        Slots[i] = arguments[i];
+      }
+      for (size_t i = argc; i < frameSize; i++) {
+        Slots[i] = Value();
+      }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    ~Scope() {
+      runtime.depth--;
+      runtime.stackTop = stackTop;
+      runtime.active = active;
+    }
+
+  private:
+    AotRuntime &runtime;
+    size_t stackTop;
+    const char *active;
+  };
+
+  void declareGlobals(const std::vector<std::string> &names) {
+    bindGlobals(names);
+  }
+
+  Value &global(int index) { return globals[index]; }
+
+  Value integer(int64_t value) { return heap.integer(value); }
+
+  Value string(const std::string &text) {
+    return Value::object(heap.intern(text));
+  }
+
+  FunctionObject *newFunction(const std::string &name, int arity,
+                              int frameSize, CompiledCode code,
+                              ClassObject *owner) {
+    FunctionObject *function = heap.allocate<FunctionObject>();
+    function->Name = name;
+    function->Arity = arity;
+    function->RegisterCount = frameSize;
+    function->Compiled = code;
+    function->Owner = owner;
+    return function;
+  }
+
+  // Creates a class and lays out its members in the order the
+  // ScopeResolver assigned their slots
+  ClassObject *newClass(const std::string &name, ClassObject *base,
+                        const std::vector<std::string> &fields,
+                        const std::vector<std::string> &methods) {
+    ClassObject *cls = heap.allocate<ClassObject>(name);
+    if (base) {
+      cls->Base = base;
+      cls->Methods = base->Methods;
+    }
+    cls->FieldNames = fields;
+    cls->MethodNames = methods;
+    cls->Methods.resize(methods.size());
+    cls->indexMembers();
+    return cls;
+  }
+
+  void setMethod(ClassObject *cls, const std::string &name,
+                 FunctionObject *method) {
+    Value closure = Value::object(heap.allocate<ClosureObject>(method));
+    heap.writeBarrier(cls);
+    cls->Methods[cls->findMethod(name)] = closure;
+  }
+
+  void setInitializer(ClassObject *cls, FunctionObject *initializer) {
+    Value closure = Value::object(heap.allocate<ClosureObject>(initializer));
+    heap.writeBarrier(cls);
+    cls->Initializer = closure;
+  }
+
+  // Creates a closure of prototype inside a call of creator
+  Value closure(FunctionObject *prototype, ClosureObject *creator,
+                const Value &receiver, Value *slots) {
+    auto *closure = heap.allocate<ClosureObject>(prototype);
+    closure->Receiver = receiver;
+    closure->Environment.reserve(prototype->Captures.size());
+    for (const CaptureDescriptor &captured : prototype->Captures) {
+      if (captured.FromEnvironment) {
+        closure->Environment.push_back(creator->Environment[captured.Index]);
+      } else if (captured.ByReference) {
+        closure->Environment.push_back(
+            Value::integer(&slots[captured.Index] - stack.data()));
+      } else {
+        closure->Environment.push_back(slots[captured.Index]);
+      }
+    }
+    return Value::object(closure);
+  }
+
+  Value newCell(const Value &contents) {
+    return Value::object(heap.allocate<CellObject>(contents));
+  }
+
+  static Value &cell(const Value &cell) {
+    return static_cast<CellObject *>(cell.asObject())->Contents;
+  }
+
+  // Stores behind the heap's write barrier
+  Value setCell(const Value &cell, const Value &value) {
+    heap.writeBarrier(cell);
+    return AotRuntime::cell(cell) = value;
+  }
+
+  // The slot of a caller a non-escaping closure captured by reference
+  Value &reference(const Value &position) { return stack[position.asInt()]; }
+
+  Value &field(const Value &receiver, int slot) {
+    if (!receiver.isObject() ||
+        receiver.asObject()->Kind != ObjectKind::Instance) {
+      fail("Field access without an instance");
+    }
+    return static_cast<InstanceObject *>(receiver.asObject())->fields()[slot];
+  }
+
+  Value setField(const Value &receiver, int slot, const Value &value) {
+    Value &target = field(receiver, slot);
+    heap.writeBarrier(receiver);
+    return target = value;
+  }
+
+  // Calls the method in slot of the receiver's method table
+  Value callSlot(const Value &receiver, int slot, const Value *arguments,
+                 int argc) {
+    ClassObject *cls = methodTable(receiver);
+    if (!cls) {
+      fail("Method call without an instance");
+    }
+    return callMethod(cls->Methods[slot], receiver, arguments, argc);
+  }
+
+  // Calls a method the ClassHierarchy bound to slot of owner's table
+  Value callFinal(ClassObject *owner, int slot, const Value &receiver,
+                  const Value *arguments, int argc) {
+    return callMethod(owner->Methods[slot], receiver, arguments, argc);
+  }
+
+  Value callStatic(const Value &cls, int slot, const Value *arguments,
+                   int argc) {
+    if (!cls.isObject() || cls.asObject()->Kind != ObjectKind::Class) {
+      fail("Cannot call a static method on " +
+           std::string(valueTypeName(cls)));
+    }
+    return callMethod(static_cast<ClassObject *>(cls.asObject())->Methods[slot],
+                      cls, arguments, argc);
+  }
+
+  Value callSuper(ClassObject *owner, const std::string &name,
+                  const Value &receiver, const Value *arguments, int argc) {
+    int method = owner && owner->Base ? owner->Base->findMethod(name) : -1;
+    if (method >= 0 && !owner->Base->Methods[method].isNull()) {
+      return callMethod(owner->Base->Methods[method], receiver, arguments,
+                        argc);
+    }
+    if (name != "constructor") {
+      fail("No base class method '" + name + "'");
+    }
+    // Nothing to run, the base fields were initialized on allocation
+    return Value();
+  }
+
+  Value newInstance(const Value &cls, const Value *arguments, int argc) {
+    if (!cls.isObject() || cls.asObject()->Kind != ObjectKind::Class) {
+      fail("Cannot instantiate " + std::string(valueTypeName(cls)));
+    }
+    return construct(static_cast<ClassObject *>(cls.asObject()), arguments,
+                     argc);
+  }
+
+  // Any operator on Values. Generated code passes a constant op, so only
+  // its own integer case stays inline.
+  Value operation(BinaryOperator op, const Value &a, const Value &b) {
+    if (a.isInt() && b.isInt()) {
+      int64_t x = a.asInt();
+      int64_t y = b.asInt();
+      switch (op) {
+      case BinaryOperator::Add:
+        return integer(addInt(x, y));
+      case BinaryOperator::Subtract:
+        return integer(subtractInt(x, y));
+      case BinaryOperator::Multiply:
+        return integer(multiplyInt(x, y));
+      case BinaryOperator::Equal:
+        return Value::boolean(x == y);
+      case BinaryOperator::NotEqual:
+        return Value::boolean(x != y);
+      case BinaryOperator::Less:
+        return Value::boolean(x < y);
+      case BinaryOperator::LessEqual:
+        return Value::boolean(x <= y);
+      case BinaryOperator::Greater:
+        return Value::boolean(x > y);
+      case BinaryOperator::GreaterEqual:
+        return Value::boolean(x >= y);
+      default:
+        break;
+      }
+    }
+    return binary(op, a, b);
+  }
+
+  // Operators of typed code, with the same results as on Values
+
+  static int64_t addInt(int64_t a, int64_t b) {
+    return wrap(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+  }
+
+  static int64_t subtractInt(int64_t a, int64_t b) {
+    return wrap(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+  }
+
+  static int64_t multiplyInt(int64_t a, int64_t b) {
+    return wrap(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+  }
+
+  int64_t divideInt(int64_t a, int64_t b) {
+    if (b == 0) {
+      fail("Division by zero");
+    }
+    // INT64_MIN / -1 overflows, and wraps back to INT64_MIN
+    return b == -1 ? wrap(0 - static_cast<uint64_t>(a)) : a / b;
+  }
+
+  int64_t moduloInt(int64_t a, int64_t b) {
+    if (b == 0) {
+      fail("Division by zero");
+    }
+    return b == -1 ? 0 : a % b;
+  }
+
+  static double moduloDouble(double a, double b) { return std::fmod(a, b); }
+
+protected:
+  std::string location() override {
+    return active ? std::string(" in '") + active + "'" : "";
+  }
+
+private:
+  std::vector<Value> stack;
+  size_t stackTop = 0;
+  int depth = 0;
+  int maxDepth;
+  const char *active = nullptr; // Name of the running function
+
+  Value invoke(ClosureObject *closure, const Value &receiver,
+               const Value *arguments, int argc) {
+    FunctionObject *function = closure->Function;
+    if (!function->Compiled) {
+      fail("'" + function->Name + "' was not compiled ahead of time");
+    }
+    checkArity(function->Name, function->Arity, argc);
+    return function->Compiled(*this, closure, receiver, arguments, argc);
+  }
+};
+
+#endif // AOT_RUNTIME_H
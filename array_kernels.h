@@ -0,0 +1,576 @@
+#ifndef ARRAY_KERNELS_H
+#define ARRAY_KERNELS_H
+
+#include "array_object.h"
+#include "bytecode.h"
+#include "closure_object.h"
+#include "function_object.h"
+#include "simd.h"
+#include "value.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Loops over the elements of packed arrays for the Array builtins, each
+// giving what applying the operators element by element would. Ints wrap
+// like the operators do; doubles are summed in four lanes, so a sum of
+// them can round differently than one taken in order.
+
+inline int64_t sumInt32s(const int32_t *data, size_t count) {
+  uint64_t sum = 0;
+  size_t i = 0;
+#if SODA_SIMD
+  __m128i low = _mm_setzero_si128();
+  __m128i high = _mm_setzero_si128();
+  for (; i + 4 <= count; i += 4) {
+    __m128i four = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    __m128i sign = _mm_srai_epi32(four, 31);
+    low = _mm_add_epi64(low, _mm_unpacklo_epi32(four, sign));
+    high = _mm_add_epi64(high, _mm_unpackhi_epi32(four, sign));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes),
+                   _mm_add_epi64(low, high));
+  sum = lanes[0] + lanes[1];
+#endif
+  for (; i < count; i++) {
+    sum += static_cast<uint64_t>(static_cast<int64_t>(data[i]));
+  }
+  return static_cast<int64_t>(sum);
+}
+
+inline int64_t sumInt64s(const int64_t *data, size_t count) {
+  uint64_t sum = 0;
+  size_t i = 0;
+#if SODA_SIMD
+  __m128i first = _mm_setzero_si128();
+  __m128i second = _mm_setzero_si128();
+  for (; i + 4 <= count; i += 4) {
+    first = _mm_add_epi64(
+        first, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+    second = _mm_add_epi64(
+        second,
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 2)));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes),
+                   _mm_add_epi64(first, second));
+  sum = lanes[0] + lanes[1];
+#endif
+  for (; i < count; i++) {
+    sum += static_cast<uint64_t>(data[i]);
+  }
+  return static_cast<int64_t>(sum);
+}
+
+inline double sumDoubles(const double *data, size_t count) {
+  double sum = 0;
+  size_t i = 0;
+#if SODA_SIMD
+  __m128d first = _mm_setzero_pd();
+  __m128d second = _mm_setzero_pd();
+  for (; i + 4 <= count; i += 4) {
+    first = _mm_add_pd(first, _mm_loadu_pd(data + i));
+    second = _mm_add_pd(second, _mm_loadu_pd(data + i + 2));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(first, second));
+  sum = lanes[0] + lanes[1];
+#endif
+  for (; i < count; i++) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+// The index of the first element equal to value, or count if none is
+
+inline size_t findInt32(const int32_t *data, size_t count, int32_t value) {
+  size_t i = 0;
+#if SODA_SIMD
+  __m128i needle = _mm_set1_epi32(value);
+  for (; i + 4 <= count; i += 4) {
+    __m128i four = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(four, needle)));
+    if (mask) {
+      while (!(mask & 1)) {
+        mask >>= 1;
+        i++;
+      }
+      return i;
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    if (data[i] == value) {
+      return i;
+    }
+  }
+  return count;
+}
+
+inline size_t findInt64(const int64_t *data, size_t count, int64_t value) {
+  size_t i = 0;
+#if SODA_SIMD
+  // SSE2 compares 32 bits at a time; both halves must match
+  __m128i needle = _mm_set1_epi64x(value);
+  for (; i + 2 <= count; i += 2) {
+    __m128i halves = _mm_cmpeq_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), needle);
+    __m128i both = _mm_and_si128(
+        halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(both));
+    if (mask) {
+      return i + (mask & 1 ? 0 : 1);
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    if (data[i] == value) {
+      return i;
+    }
+  }
+  return count;
+}
+
+inline size_t findDouble(const double *data, size_t count, double value) {
+  size_t i = 0;
+#if SODA_SIMD
+  __m128d needle = _mm_set1_pd(value);
+  for (; i + 2 <= count; i += 2) {
+    int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(data + i), needle));
+    if (mask) {
+      return i + (mask & 1 ? 0 : 1);
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    if (data[i] == value) {
+      return i;
+    }
+  }
+  return count;
+}
+
+// The index of the first element from from on where a and b differ, or
+// count if none does. Doubles that are NaN always differ.
+
+inline size_t mismatch(const int32_t *a, const int32_t *b, size_t from,
+                       size_t count) {
+  size_t i = from;
+#if SODA_SIMD
+  for (; i + 4 <= count; i += 4) {
+    __m128i same = _mm_cmpeq_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+    if (_mm_movemask_epi8(same) != 0xFFFF) {
+      break;
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    if (a[i] != b[i]) {
+      return i;
+    }
+  }
+  return count;
+}
+
+inline size_t mismatch(const int64_t *a, const int64_t *b, size_t from,
+                       size_t count) {
+  size_t i = from;
+#if SODA_SIMD
+  for (; i + 2 <= count; i += 2) {
+    __m128i same = _mm_cmpeq_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+    if (_mm_movemask_epi8(same) != 0xFFFF) {
+      break;
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    if (a[i] != b[i]) {
+      return i;
+    }
+  }
+  return count;
+}
+
+inline size_t mismatch(const double *a, const double *b, size_t from,
+                       size_t count) {
+  size_t i = from;
+#if SODA_SIMD
+  for (; i + 2 <= count; i += 2) {
+    __m128d same = _mm_cmpeq_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+    if (_mm_movemask_pd(same) != 3) {
+      break;
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    if (!(a[i] == b[i])) {
+      return i;
+    }
+  }
+  return count;
+}
+
+// The arithmetic of a simple lambda, like x -> x * 2 + k, run over a whole
+// packed array a block of elements at a time, in loops the compiler
+// vectorizes, instead of calling it for each element. Simple means one
+// parameter, no receiver, and a straight-line body of Add, Subtract,
+// Multiply, Divide, Modulo and ToDouble on the parameter and numbers read
+// from constants, globals or what the lambda captured, returning a number.
+// Ints only divide by a constant other than 0 and -1, which cannot fail.
+class ElementwiseKernel {
+public:
+  // Compiles closure for elements of kind, with the globals it would read.
+  // Returns false if it is not simple.
+  bool compile(const ClosureObject &closure, ElementKind kind,
+               const std::vector<Value> &globals) {
+    const FunctionObject &function = *closure.Function;
+    if (function.Arity != 1 || function.Async || function.Code.empty() ||
+        function.Code.size() > MaxCode || kind == ElementKind::Generic) {
+      return false;
+    }
+    steps.clear();
+    lanes = 1;
+    std::vector<Operand> registers(function.RegisterCount);
+    std::vector<bool> known(function.RegisterCount);
+    registers[0] = Operand::lane(0);
+    registers[0].IsInt = kind != ElementKind::Double;
+    known[0] = true;
+    for (uint32_t instruction : function.Code) {
+      int a = decodeA(instruction);
+      int b = decodeB(instruction);
+      int c = decodeC(instruction);
+      Value constant;
+      Opcode opcode = untypedOpcode(decodeOpcode(instruction));
+      switch (opcode) {
+      case Opcode::Move:
+        if (!known[b]) {
+          return false;
+        }
+        registers[a] = registers[b];
+        known[a] = true;
+        continue;
+      case Opcode::LoadInt:
+        registers[a] = Operand::integer(decodesBx(instruction));
+        known[a] = true;
+        continue;
+      case Opcode::LoadConstant:
+        constant = function.Constants[decodeBx(instruction)];
+        break;
+      case Opcode::GetGlobal:
+        if (static_cast<size_t>(decodeBx(instruction)) >= globals.size()) {
+          return false;
+        }
+        constant = globals[decodeBx(instruction)];
+        break;
+      case Opcode::GetEnvironment:
+        if (static_cast<size_t>(b) >= closure.Environment.size()) {
+          return false;
+        }
+        constant = closure.Environment[b];
+        break;
+      case Opcode::Add:
+      case Opcode::Subtract:
+      case Opcode::Multiply:
+      case Opcode::Divide:
+      case Opcode::Modulo:
+        if (!known[b] || !known[c] ||
+            !arithmetic(opcode, registers[b], registers[c], registers[a])) {
+          return false;
+        }
+        known[a] = true;
+        continue;
+      case Opcode::ToDouble:
+        if (!known[b]) {
+          return false;
+        }
+        registers[a] = toDouble(registers[b]);
+        known[a] = true;
+        continue;
+      case Opcode::Return:
+        if (b == 0 || !known[a]) {
+          return false;
+        }
+        result = registers[a];
+        return true;
+      default:
+        return false;
+      }
+      if (!constant.isNumber()) {
+        return false;
+      }
+      registers[a] = constant.isInt() ? Operand::integer(constant.asInt())
+                                      : Operand::number(constant.asDouble());
+      known[a] = true;
+    }
+    return false;
+  }
+
+  // Whether the results are ints, else doubles
+  bool returnsInts() const { return result.IsInt; }
+
+  // Runs over the elements of array, which has the kind compiled for,
+  // into ints or doubles as returnsInts says. Returns false if an int
+  // result needs more bits than a Value holds inline.
+  bool run(const ArrayObject &array, int64_t *ints, double *doubles) const {
+    std::vector<int64_t> intLanes(lanes * Block);
+    std::vector<double> doubleLanes(lanes * Block);
+    for (size_t begin = 0; begin < array.count(); begin += Block) {
+      size_t count = std::min(array.count() - begin, size_t(Block));
+      load(array, begin, count, intLanes.data(), doubleLanes.data());
+      for (const Step &step : steps) {
+        if (step.IsInt) {
+          apply(step, intLanes.data(), count);
+        } else {
+          apply(step, doubleLanes.data(), count, intLanes.data());
+        }
+      }
+      if (result.IsInt) {
+        int64_t *out = ints + begin;
+        for (size_t i = 0; i < count; i++) {
+          out[i] = result.Lane < 0 ? result.Int
+                                   : intLanes[result.Lane * Block + i];
+          if (!Value::fitsInline(out[i])) {
+            return false;
+          }
+        }
+      } else {
+        double *out = doubles + begin;
+        for (size_t i = 0; i < count; i++) {
+          out[i] = result.Lane < 0 ? result.Double
+                                   : doubleLanes[result.Lane * Block + i];
+        }
+      }
+    }
+    return true;
+  }
+
+private:
+  static const size_t Block = 256;  // Elements each step runs over at once
+  static const size_t MaxCode = 64; // Instructions of a simple body
+
+  // A lane of the block, or a constant
+  struct Operand {
+    int Lane = -1;
+    bool IsInt = true;
+    int64_t Int = 0;
+    double Double = 0;
+
+    static Operand lane(int lane) {
+      Operand operand;
+      operand.Lane = lane;
+      return operand;
+    }
+
+    static Operand integer(int64_t value) {
+      Operand operand;
+      operand.Int = value;
+      return operand;
+    }
+
+    static Operand number(double value) {
+      Operand operand;
+      operand.IsInt = false;
+      operand.Double = value;
+      return operand;
+    }
+
+    double asDouble() const {
+      return IsInt ? static_cast<double>(Int) : Double;
+    }
+  };
+
+  // Target = Left op Right, or with Convert, Target = Left as a double
+  struct Step {
+    Opcode Op;
+    bool IsInt;
+    bool Convert;
+    int Target;
+    Operand Left;
+    Operand Right;
+  };
+
+  std::vector<Step> steps;
+  size_t lanes = 0; // Of ints and of doubles, Block elements each
+  Operand result;
+
+  int newLane() { return static_cast<int>(lanes++); }
+
+  // Makes a double operand of an int one
+  Operand toDouble(const Operand &operand) {
+    if (!operand.IsInt) {
+      return operand;
+    }
+    if (operand.Lane < 0) {
+      return Operand::number(static_cast<double>(operand.Int));
+    }
+    Operand converted = Operand::lane(newLane());
+    converted.IsInt = false;
+    steps.push_back(
+        Step{Opcode::Move, false, true, converted.Lane, operand, operand});
+    return converted;
+  }
+
+  bool arithmetic(Opcode op, Operand left, Operand right, Operand &target) {
+    bool ints = left.IsInt && right.IsInt;
+    if (ints && (op == Opcode::Divide || op == Opcode::Modulo) &&
+        (right.Lane >= 0 || right.Int == 0 || right.Int == -1)) {
+      return false;
+    }
+    if (!ints) {
+      left = toDouble(left);
+      right = toDouble(right);
+    }
+    if (left.Lane < 0 && right.Lane < 0) {
+      target = ints ? Operand::integer(intOp(op, left.Int, right.Int))
+                    : Operand::number(doubleOp(op, left.Double, right.Double));
+      return true;
+    }
+    target = Operand::lane(newLane());
+    target.IsInt = ints;
+    steps.push_back(Step{op, ints, false, target.Lane, left, right});
+    return true;
+  }
+
+  static int64_t intOp(Opcode op, int64_t a, int64_t b) {
+    uint64_t x = static_cast<uint64_t>(a);
+    uint64_t y = static_cast<uint64_t>(b);
+    switch (op) {
+    case Opcode::Add:
+      return static_cast<int64_t>(x + y);
+    case Opcode::Subtract:
+      return static_cast<int64_t>(x - y);
+    case Opcode::Multiply:
+      return static_cast<int64_t>(x * y);
+    case Opcode::Divide:
+      return a / b;
+    default:
+      return a % b;
+    }
+  }
+
+  static double doubleOp(Opcode op, double a, double b) {
+    switch (op) {
+    case Opcode::Add:
+      return a + b;
+    case Opcode::Subtract:
+      return a - b;
+    case Opcode::Multiply:
+      return a * b;
+    case Opcode::Divide:
+      return a / b;
+    default:
+      return std::fmod(a, b);
+    }
+  }
+
+  void load(const ArrayObject &array, size_t begin, size_t count,
+            int64_t *ints, double *doubles) const {
+    switch (array.getElementKind()) {
+    case ElementKind::Int32:
+      std::copy(array.getInt32s() + begin, array.getInt32s() + begin + count,
+                ints);
+      break;
+    case ElementKind::Int64:
+      std::copy(array.getInt64s() + begin, array.getInt64s() + begin + count,
+                ints);
+      break;
+    default:
+      std::copy(array.getDoubles() + begin,
+                array.getDoubles() + begin + count, doubles);
+      break;
+    }
+  }
+
+  // Runs one step over count lanes, with each operator in a loop of its
+  // own so the compiler can vectorize it
+  template <typename T>
+  void apply(const Step &step, T *file, size_t count,
+             const int64_t *ints = nullptr) const {
+    T *target = file + step.Target * Block;
+    if (step.Convert) {
+      const int64_t *source = ints + step.Left.Lane * Block;
+      for (size_t i = 0; i < count; i++) {
+        target[i] = static_cast<T>(source[i]);
+      }
+      return;
+    }
+    switch (step.Op) {
+    case Opcode::Add:
+      each(step, file, target, count, [](T a, T b) { return add(a, b); });
+      break;
+    case Opcode::Subtract:
+      each(step, file, target, count,
+           [](T a, T b) { return subtract(a, b); });
+      break;
+    case Opcode::Multiply:
+      each(step, file, target, count,
+           [](T a, T b) { return multiply(a, b); });
+      break;
+    case Opcode::Divide:
+      each(step, file, target, count, [](T a, T b) { return a / b; });
+      break;
+    default:
+      each(step, file, target, count,
+           [](T a, T b) { return modulo(a, b); });
+      break;
+    }
+  }
+
+  template <typename T, typename F>
+  static void each(const Step &step, const T *file, T *target, size_t count,
+                   F f) {
+    const Operand &left = step.Left;
+    const Operand &right = step.Right;
+    if (left.Lane >= 0 && right.Lane >= 0) {
+      const T *x = file + left.Lane * Block;
+      const T *y = file + right.Lane * Block;
+      for (size_t i = 0; i < count; i++) {
+        target[i] = f(x[i], y[i]);
+      }
+    } else if (left.Lane >= 0) {
+      const T *x = file + left.Lane * Block;
+      T y = constant(right, T());
+      for (size_t i = 0; i < count; i++) {
+        target[i] = f(x[i], y);
+      }
+    } else {
+      T x = constant(left, T());
+      const T *y = file + right.Lane * Block;
+      for (size_t i = 0; i < count; i++) {
+        target[i] = f(x, y[i]);
+      }
+    }
+  }
+
+  static int64_t constant(const Operand &operand, int64_t) {
+    return operand.Int;
+  }
+  static double constant(const Operand &operand, double) {
+    return operand.Double;
+  }
+
+  static int64_t add(int64_t a, int64_t b) {
+    return intOp(Opcode::Add, a, b);
+  }
+  static int64_t subtract(int64_t a, int64_t b) {
+    return intOp(Opcode::Subtract, a, b);
+  }
+  static int64_t multiply(int64_t a, int64_t b) {
+    return intOp(Opcode::Multiply, a, b);
+  }
+  static int64_t modulo(int64_t a, int64_t b) { return a % b; }
+  static double add(double a, double b) { return a + b; }
+  static double subtract(double a, double b) { return a - b; }
+  static double multiply(double a, double b) { return a * b; }
+  static double modulo(double a, double b) { return std::fmod(a, b); }
+};
+
+#endif // ARRAY_KERNELS_H
@@ -0,0 +1,256 @@
+#ifndef ARRAY_OBJECT_H
+#define ARRAY_OBJECT_H
+
+#include "heap_object.h"
+#include "tracer.h"
+#include "value.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// How an array stores its elements, from the most packed to the most
+// general
+enum class ElementKind : uint8_t {
+  Int32,  // Ints within 32 bits, at half the size of a Value
+  Int64,  // Ints a Value holds inline
+  Double, // Doubles
+  Generic // Values of any type
+};
+
+// Elements of one kind in one buffer. An array starts out packed as tightly
+// as its elements allow and widens the whole buffer when one is stored that
+// does not fit, so arrays of numbers hold no tags and nothing for the
+// collector to trace. Only an empty array, or one filled with a single
+// value, changes to a narrower kind.
+class ArrayObject : public HeapObject {
+public:
+  static const bool Movable = true;
+
+  ArrayObject() : HeapObject(ObjectKind::Array) {}
+
+  ~ArrayObject() override { std::free(raw); }
+
+  size_t count() const { return length; }
+
+  ElementKind getElementKind() const { return kind; }
+
+  Value get(size_t index) const {
+    switch (kind) {
+    case ElementKind::Int32:
+      return Value::integer(int32s[index]);
+    case ElementKind::Int64:
+      return Value::integer(int64s[index]);
+    case ElementKind::Double:
+      return Value::number(doubles[index]);
+    default:
+      return values[index];
+    }
+  }
+
+  void set(size_t index, const Value &value) {
+    widen(kindOf(value));
+    put(index, value);
+  }
+
+  void append(const Value &value) {
+    widen(kindOf(value));
+    reserve(length + 1);
+    put(length++, value);
+  }
+
+  // Replaces the elements with count values
+  void assign(const Value *values, size_t count) {
+    length = 0;
+    rekind(count ? kindOf(values[0]) : ElementKind::Int32);
+    for (size_t i = 1; i < count; i++) {
+      widen(kindOf(values[i]));
+    }
+    reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      put(i, values[i]);
+    }
+    length = count;
+  }
+
+  // Replaces the elements with count copies of value
+  void assign(size_t count, const Value &value) {
+    length = count;
+    fill(value);
+  }
+
+  // Replaces the elements with count ints, each of which a Value holds
+  // inline
+  void assignInts(const int64_t *ints, size_t count) {
+    bool narrow = std::all_of(ints, ints + count, [](int64_t value) {
+      return value == static_cast<int32_t>(value);
+    });
+    length = 0;
+    rekind(narrow ? ElementKind::Int32 : ElementKind::Int64);
+    reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      if (narrow) {
+        int32s[i] = static_cast<int32_t>(ints[i]);
+      } else {
+        int64s[i] = ints[i];
+      }
+    }
+    length = count;
+  }
+
+  void assignDoubles(const double *numbers, size_t count) {
+    length = 0;
+    rekind(ElementKind::Double);
+    reserve(count);
+    std::copy(numbers, numbers + count, doubles);
+    length = count;
+  }
+
+  // Sets every element to value, packing the array as value allows
+  void fill(const Value &value) {
+    size_t count = length;
+    length = 0;
+    rekind(kindOf(value));
+    reserve(count);
+    length = count;
+    switch (kind) {
+    case ElementKind::Int32:
+      std::fill(int32s, int32s + length,
+                static_cast<int32_t>(value.asInt()));
+      break;
+    case ElementKind::Int64:
+      std::fill(int64s, int64s + length, value.asInt());
+      break;
+    case ElementKind::Double:
+      std::fill(doubles, doubles + length, value.asDouble());
+      break;
+    default:
+      std::fill(values, values + length, value);
+      break;
+    }
+  }
+
+  // The elements of a packed array of that kind, for kernels that work on
+  // them directly
+  const int32_t *getInt32s() const { return int32s; }
+  const int64_t *getInt64s() const { return int64s; }
+  const double *getDoubles() const { return doubles; }
+
+  static size_t elementSize(ElementKind kind) {
+    return kind == ElementKind::Int32 ? sizeof(int32_t) : sizeof(Value);
+  }
+
+  // The narrowest kind that holds value
+  static ElementKind kindOf(const Value &value) {
+    if (value.isInlineInt()) {
+      int64_t integer = value.asInt();
+      return integer == static_cast<int32_t>(integer) ? ElementKind::Int32
+                                                      : ElementKind::Int64;
+    }
+    return value.isDouble() ? ElementKind::Double : ElementKind::Generic;
+  }
+
+  size_t size() const override {
+    return sizeof(*this) + capacity * elementSize(kind);
+  }
+
+  void trace(Tracer &tracer) override {
+    if (kind == ElementKind::Generic) {
+      tracer.mark(values, length);
+    }
+  }
+
+  HeapObject *moveTo(void *memory) override {
+    auto *moved = new (memory) ArrayObject();
+    moved->kind = kind;
+    moved->length = length;
+    moved->capacity = capacity;
+    moved->raw = raw;
+    raw = nullptr;
+    length = 0;
+    capacity = 0;
+    return moved;
+  }
+
+private:
+  ElementKind kind = ElementKind::Int32;
+  size_t length = 0;
+  size_t capacity = 0; // Elements of kind the buffer has room for
+  union {
+    void *raw = nullptr;
+    int32_t *int32s;
+    int64_t *int64s;
+    double *doubles;
+    Value *values;
+  };
+
+  void reserve(size_t needed) {
+    if (needed <= capacity) {
+      return;
+    }
+    size_t grown = std::max(std::max(needed, capacity * 2), size_t(4));
+    void *memory = std::realloc(raw, grown * elementSize(kind));
+    if (!memory) {
+      throw std::bad_alloc();
+    }
+    raw = memory;
+    capacity = grown;
+  }
+
+  // Changes the kind of an array with no elements, keeping its buffer
+  void rekind(ElementKind to) {
+    capacity = capacity * elementSize(kind) / elementSize(to);
+    kind = to;
+  }
+
+  // Makes room for elements of kind needed, converting the buffer to the
+  // narrowest kind that holds both
+  void widen(ElementKind needed) {
+    if (needed == kind) {
+      return;
+    }
+    if (length == 0) {
+      rekind(needed);
+      return;
+    }
+    bool ints = needed <= ElementKind::Int64 && kind <= ElementKind::Int64;
+    ElementKind to = ints ? ElementKind::Int64 : ElementKind::Generic;
+    if (to == kind) {
+      return;
+    }
+    std::vector<Value> old(length);
+    for (size_t i = 0; i < length; i++) {
+      old[i] = get(i);
+    }
+    size_t count = length;
+    length = 0;
+    rekind(to);
+    reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      put(i, old[i]);
+    }
+    length = count;
+  }
+
+  // Stores value, which the kind holds, at index within the capacity
+  void put(size_t index, const Value &value) {
+    switch (kind) {
+    case ElementKind::Int32:
+      int32s[index] = static_cast<int32_t>(value.asInt());
+      break;
+    case ElementKind::Int64:
+      int64s[index] = value.asInt();
+      break;
+    case ElementKind::Double:
+      doubles[index] = value.asDouble();
+      break;
+    default:
+      new (&values[index]) Value(value);
+      break;
+    }
+  }
+};
+
+#endif // ARRAY_OBJECT_H
@@ -0,0 +1,694 @@
+#ifndef AST_INTERPRETER_H
+#define AST_INTERPRETER_H
+
+#include "ast_node.h"
+#include "binary_expression.h"
+#include "call_expression.h"
+#include "class_declaration.h"
+#include "class_object.h"
+#include "closure_expression.h"
+#include "closure_object.h"
+#include "concatenation_chain.h"
+#include "constructor_call_expression.h"
+#include "dot_access_expression.h"
+#include "for_statement.h"
+#include "function_declaration.h"
+#include "function_object.h"
+#include "if_statement.h"
+#include "lambda_expression.h"
+#include "literal_expression.h"
+#include "package.h"
+#include "parameter.h"
+#include "return_statement.h"
+#include "script_runtime.h"
+#include "tree_nodes.h"
+#include "value.h"
+#include "variable_binding.h"
+#include "variable_declaration.h"
+#include "variable_expression.h"
+#include "while_statement.h"
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Executable tree of a function, built from its declaration the first time
+// it is called
+class TreeFunction {
+public:
+  // FunctionDeclaration, ClosureExpression or LambdaExpression, or the
+  // ClassDeclaration whose field initializers this runs
+  std::shared_ptr<AstNode> Source;
+  StatementList Body;
+  bool Built = false;
+
+  explicit TreeFunction(std::shared_ptr<AstNode> source)
+      : Source(std::move(source)) {}
+};
+
+// Runs a resolved package straight from its AST, with no compile step.
+// Each function becomes a tree of nodes on its first call, and operator
+// and member nodes then rewrite themselves for the types they see. Needs
+// the ScopeResolver and ClosureConverter to have run, like the
+// BytecodeCompiler.
+class AstInterpreter : public ScriptRuntime {
+public:
+  explicit AstInterpreter(size_t stackSize = 1 << 16, int maxDepth = 1000)
+      : stack(stackSize), maxDepth(maxDepth) {}
+
+  // Returns false on a runtime error
+  bool run(const Package &package) {
+    Heap::StackScope scope(heap);
+    error.clear();
+    bindGlobals(package.Globals);
+    thisGlobal = findGlobal("this");
+    superGlobal = findGlobal("super");
+    classes.clear();
+    classDeclarations.clear();
+    for (const auto &member : package.Members) {
+      if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+        classDeclarations[cls->Name] = cls;
+      }
+    }
+
+    bool succeeded = true;
+    try {
+      FunctionObject *initializer = heap.allocate<FunctionObject>();
+      initializer->Name = package.Name.empty() ? "<package>" : package.Name;
+      initializer->RegisterCount = package.FrameSize;
+      initializer->Tree = std::make_shared<TreeFunction>(nullptr);
+      initializer->Tree->Built = true;
+
+      // Members are visible before any top-level code runs
+      building = initializer;
+      buildingCaptures = nullptr;
+      for (const auto &member : package.Members) {
+        if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+          globals[findGlobal(cls->Name)] = Value::object(defineClass(*cls));
+        } else if (auto func =
+                       std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+          globals[findGlobal(func->Name)] = Value::object(
+              heap.allocate<ClosureObject>(defineFunction(func, nullptr)));
+        } else {
+          buildStatement(member, initializer->Tree->Body);
+        }
+      }
+      call(Value::object(heap.allocate<ClosureObject>(initializer)), nullptr,
+           0);
+    } catch (const RuntimeError &e) {
+      error = e.what();
+      stackTop = 0;
+      depth = 0;
+      active = nullptr;
+      succeeded = false;
+    }
+    // Nothing executes inside replaced nodes any more
+    context.Retired.clear();
+    return succeeded;
+  }
+
+  Value call(const Value &callee, const Value *arguments, int count) override {
+    Heap::StackScope scope(heap, arguments, count);
+    if (callee.isObject()) {
+      switch (callee.asObject()->Kind) {
+      case ObjectKind::Closure: {
+        auto *closure = static_cast<ClosureObject *>(callee.asObject());
+        return invoke(closure, closure->Receiver, arguments, count);
+      }
+      case ObjectKind::Native:
+        return callNative(static_cast<NativeObject *>(callee.asObject()),
+                          arguments, count);
+      case ObjectKind::Class:
+        return construct(static_cast<ClassObject *>(callee.asObject()),
+                         arguments, count);
+      default:
+        break;
+      }
+    }
+    fail("Cannot call " + std::string(valueTypeName(callee)));
+  }
+
+  Value callMethod(const Value &method, const Value &receiver,
+                   const Value *arguments, int count) override {
+    Heap::StackScope scope(heap, arguments, count);
+    if (method.isObject() && method.asObject()->Kind == ObjectKind::Closure) {
+      return invoke(static_cast<ClosureObject *>(method.asObject()), receiver,
+                    arguments, count);
+    }
+    return call(method, arguments, count);
+  }
+
+  void traceRoots(Tracer &tracer) override {
+    ScriptRuntime::traceRoots(tracer);
+    tracer.mark(stack.data(), stackTop);
+  }
+
+  // Nodes that specialized on first execution
+  int getRewrites() const { return context.Rewrites; }
+
+  // Specialized nodes that fell back to generic ones
+  int getDeoptimizations() const { return context.Deoptimizations; }
+
+protected:
+  std::string location() override {
+    return active ? " in '" + active->Name + "'" : "";
+  }
+
+private:
+  std::vector<Value> stack;
+  size_t stackTop = 0;
+  int depth = 0;
+  int maxDepth;
+  FunctionObject *active = nullptr;
+  TreeContext context;
+  int thisGlobal = -1;
+  int superGlobal = -1;
+  std::unordered_map<std::string, ClassObject *> classes;
+  std::unordered_map<std::string, std::shared_ptr<ClassDeclaration>>
+      classDeclarations;
+  FunctionObject *building = nullptr;
+  const std::vector<CapturedVariable> *buildingCaptures = nullptr;
+
+  int findGlobal(const std::string &name) const {
+    auto found = std::find(globalNames.begin(), globalNames.end(), name);
+    return found == globalNames.end()
+               ? -1
+               : static_cast<int>(found - globalNames.begin());
+  }
+
+  // Calls
+
+  // Restores the caller's part of the slot stack when a call ends, also by
+  // a runtime error
+  struct CallScope {
+    AstInterpreter &interpreter;
+    size_t stackTop;
+    FunctionObject *active;
+
+    CallScope(AstInterpreter &interpreter, FunctionObject *function)
+        : interpreter(interpreter), stackTop(interpreter.stackTop),
+          active(interpreter.active) {
+      interpreter.depth++;
+      interpreter.active = function;
+    }
+
+    ~CallScope() {
+      interpreter.depth--;
+      interpreter.stackTop = stackTop;
+      interpreter.active = active;
+    }
+  };
+
+  Value invoke(ClosureObject *closure, const Value &receiver,
+               const Value *arguments, int argc) {
+    FunctionObject *function = closure->Function;
+    if (!function->Tree) {
+      fail("'" + function->Name + "' was compiled to bytecode");
+    }
+    checkArity(function->Name, function->Arity, argc);
+    if (!function->Tree->Built) {
+      buildFunction(function);
+    }
+    int frameSize = std::max(function->RegisterCount, argc);
+    if (depth == maxDepth || stackTop + frameSize > stack.size()) {
+      fail("Stack overflow");
+    }
+
+    CallScope scope(*this, function);
+    Value *slots = stack.data() + stackTop;
+    stackTop += frameSize;
+    for (int i = 0; i < argc; i++) {
+      slots[i] = arguments[i];
+    }
+    for (int i = argc; i < frameSize; i++) {
+      slots[i] = Value();
+    }
+    TreeFrame frame{this,   &context, globals.data(), stack.data(),
+                    slots,  closure,  receiver,       Value()};
+    executeAll(function->Tree->Body, frame);
+    return frame.Result;
+  }
+
+  // Declarations
+
+  FunctionObject *newFunction(const std::string &name, int arity,
+                              int frameSize, std::shared_ptr<AstNode> source,
+                              ClassObject *owner) {
+    FunctionObject *function = heap.allocate<FunctionObject>();
+    function->Name = name;
+    function->Arity = arity;
+    function->RegisterCount = frameSize;
+    function->Owner = owner;
+    function->Tree = std::make_shared<TreeFunction>(std::move(source));
+    return function;
+  }
+
+  FunctionObject *
+  defineFunction(const std::shared_ptr<FunctionDeclaration> &func,
+                 ClassObject *owner) {
+    return newFunction(owner ? owner->Name + "." + func->Name : func->Name,
+                       static_cast<int>(func->Parameters.size()),
+                       func->FrameSize, func, owner);
+  }
+
+  ClassObject *defineClass(ClassDeclaration &decl) {
+    auto existing = classes.find(decl.Name);
+    if (existing != classes.end()) {
+      return existing->second;
+    }
+    ClassObject *cls = heap.allocate<ClassObject>(decl.Name);
+    classes[decl.Name] = cls;
+    if (decl.BaseClass) {
+      auto base = classDeclarations.find(decl.BaseClass->Name);
+      if (base != classDeclarations.end()) {
+        cls->Base = defineClass(*base->second);
+        cls->Methods = cls->Base->Methods;
+      }
+    }
+    cls->FieldNames = decl.FieldNames;
+    cls->MethodNames = decl.MethodNames;
+    cls->Methods.resize(cls->MethodNames.size());
+    cls->indexMembers();
+
+    bool hasInitializers = false;
+    for (const auto &member : decl.Members) {
+      if (auto func = std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        Value method = Value::object(
+            heap.allocate<ClosureObject>(defineFunction(func, cls)));
+        heap.writeBarrier(cls);
+        cls->Methods[cls->findMethod(func->Name)] = method;
+      } else if (auto var =
+                     std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        hasInitializers = hasInitializers ||
+                          (var->Value && var->Binding.Kind == FieldBinding);
+      }
+    }
+    if (hasInitializers) {
+      Value initializer = Value::object(heap.allocate<ClosureObject>(
+          newFunction(decl.Name + ".<fields>", 0, 0,
+                      classDeclarations[decl.Name], cls)));
+      heap.writeBarrier(cls);
+      cls->Initializer = initializer;
+    }
+    return cls;
+  }
+
+  // Trees
+
+  void buildFunction(FunctionObject *function) {
+    FunctionObject *outerFunction = building;
+    const std::vector<CapturedVariable> *outerCaptures = buildingCaptures;
+    building = function;
+    buildingCaptures = nullptr;
+
+    TreeFunction &tree = *function->Tree;
+    tree.Body.clear();
+    if (auto func =
+            std::dynamic_pointer_cast<FunctionDeclaration>(tree.Source)) {
+      if (func->Async) {
+        fail("Async functions need the VirtualMachine");
+      }
+      buildParameters(func->Parameters, tree.Body);
+      buildStatements(func->Body, tree.Body);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(tree.Source)) {
+      buildingCaptures = &closure->Captures;
+      buildParameters(closure->Parameters, tree.Body);
+      buildStatements(closure->Body, tree.Body);
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(tree.Source)) {
+      buildingCaptures = &lambda->Captures;
+      buildParameters(lambda->Parameters, tree.Body);
+      // An expression body is the lambda's result
+      auto body = std::dynamic_pointer_cast<Expression>(lambda->Body);
+      auto binary = std::dynamic_pointer_cast<BinaryExpression>(body);
+      if (body && !(binary && binary->Op == BinaryOperator::Assign)) {
+        tree.Body.push_back(std::unique_ptr<StatementNode>(
+            new ReturnNode(buildExpression(body))));
+      } else {
+        buildStatement(lambda->Body, tree.Body);
+      }
+    } else if (auto cls =
+                   std::dynamic_pointer_cast<ClassDeclaration>(tree.Source)) {
+      for (const auto &member : cls->Members) {
+        auto var = std::dynamic_pointer_cast<VariableDeclaration>(member);
+        if (var && var->Value && var->Binding.Kind == FieldBinding) {
+          addExpression(tree.Body,
+                        std::make_shared<SetFieldNode>(
+                            var->Binding.Slot, buildExpression(var->Value)));
+        }
+      }
+    }
+    tree.Built = true;
+
+    building = outerFunction;
+    buildingCaptures = outerCaptures;
+  }
+
+  void
+  buildParameters(const std::vector<std::shared_ptr<Parameter>> &parameters,
+                  StatementList &out) {
+    for (const auto &parameter : parameters) {
+      if (parameter->Binding.IsBoxed) {
+        addExpression(out,
+                      std::make_shared<NewCellNode>(parameter->Binding.Slot));
+      }
+    }
+  }
+
+  static void addExpression(StatementList &out,
+                            std::shared_ptr<ExpressionNode> expression) {
+    out.push_back(std::unique_ptr<StatementNode>(
+        new ExpressionStatementNode(std::move(expression))));
+  }
+
+  // Statements
+
+  void buildStatements(const std::vector<std::shared_ptr<AstNode>> &body,
+                       StatementList &out) {
+    for (const auto &statement : body) {
+      buildStatement(statement, out);
+    }
+  }
+
+  void buildStatement(const std::shared_ptr<AstNode> &node,
+                      StatementList &out) {
+    if (!node) {
+      return;
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      const VariableBinding &binding = var->Binding;
+      if (binding.Kind == LocalBinding) {
+        addExpression(out, std::make_shared<SetLocalNode>(
+                               binding.Slot, buildExpression(var->Value)));
+        if (binding.IsBoxed) {
+          addExpression(out, std::make_shared<NewCellNode>(binding.Slot));
+        }
+      } else if (binding.Kind == GlobalBinding && var->Value) {
+        addExpression(out, std::make_shared<SetGlobalNode>(
+                               binding.Slot, buildExpression(var->Value)));
+      }
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      out.push_back(std::unique_ptr<StatementNode>(new ReturnNode(
+          ret->ReturnValue ? buildExpression(ret->ReturnValue) : nullptr)));
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      StatementList thenBody;
+      StatementList elseBody;
+      buildStatements(ifStmt->ThenBody, thenBody);
+      buildStatements(ifStmt->ElseBody, elseBody);
+      out.push_back(std::unique_ptr<StatementNode>(
+          new IfNode(buildExpression(ifStmt->Condition), std::move(thenBody),
+                     std::move(elseBody))));
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      StatementList body;
+      buildStatements(whileStmt->Body, body);
+      out.push_back(std::unique_ptr<StatementNode>(new LoopNode(
+          buildExpression(whileStmt->Condition), std::move(body), nullptr)));
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      buildStatement(forStmt->Initializer, out);
+      StatementList body;
+      buildStatements(forStmt->Body, body);
+      StatementList increment;
+      buildStatement(forStmt->Increment, increment);
+      out.push_back(std::unique_ptr<StatementNode>(new LoopNode(
+          forStmt->Condition ? buildExpression(forStmt->Condition) : nullptr,
+          std::move(body),
+          increment.empty() ? nullptr : std::move(increment.front()))));
+    } else if (std::dynamic_pointer_cast<FunctionDeclaration>(node) ||
+               std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      fail("Nested declarations are not supported");
+    } else if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      addExpression(out, buildExpression(expr));
+    }
+  }
+
+  // Expressions
+
+  std::shared_ptr<ExpressionNode>
+  buildExpression(const std::shared_ptr<Expression> &expr) {
+    std::shared_ptr<ExpressionNode> node = buildValue(expr);
+    if (!expr || !expr->ToDouble) {
+      return node;
+    }
+    // A constant is converted once, here
+    if (auto constant = std::dynamic_pointer_cast<ConstantNode>(node)) {
+      return std::make_shared<ConstantNode>(
+          ScriptRuntime::toDouble(constant->Constant));
+    }
+    return std::make_shared<ToDoubleNode>(std::move(node));
+  }
+
+  // The node of expr, without the conversion the TypeChecker asked for
+  std::shared_ptr<ExpressionNode>
+  buildValue(const std::shared_ptr<Expression> &expr) {
+    if (!expr) {
+      return std::make_shared<ConstantNode>(Value());
+    }
+    if (auto literal = std::dynamic_pointer_cast<LiteralExpression>(expr)) {
+      return std::make_shared<ConstantNode>(literalValue(*literal));
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      return buildLoad(var->Name, var->Binding);
+    }
+    if (auto binary = std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      return buildBinary(*binary);
+    }
+    if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      return buildDotAccess(*dot);
+    }
+    if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      return buildCall(*call);
+    }
+    if (auto closure = std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      return buildClosure(closure, *closure);
+    }
+    if (auto lambda = std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      return buildClosure(lambda, *lambda);
+    }
+    fail("Unsupported expression");
+  }
+
+  Value literalValue(const LiteralExpression &literal) {
+    switch (literal.Kind) {
+    case IntegerLiteral:
+    case LongLiteral: {
+      // Kept by the tree, which the collector neither traces nor updates
+      Heap::TenuredScope tenured(heap);
+      Value value =
+          heap.integer(std::strtoll(literal.Value.c_str(), nullptr, 10));
+      if (HeapObject *boxed = value.getReference()) {
+        boxed->addRef();
+      }
+      return value;
+    }
+    case FloatLiteral:
+    case DoubleLiteral:
+      return Value::number(std::strtod(literal.Value.c_str(), nullptr));
+    case BooleanLiteral:
+      return Value::boolean(literal.Value == "true");
+    default:
+      return Value::object(heap.intern(literal.Value));
+    }
+  }
+
+  const CapturedVariable *capturedVariable(const VariableBinding &binding) {
+    if (!buildingCaptures || binding.Capture < 0 ||
+        binding.Capture >= static_cast<int>(buildingCaptures->size())) {
+      return nullptr;
+    }
+    return &(*buildingCaptures)[binding.Capture];
+  }
+
+  std::shared_ptr<ExpressionNode> buildLoad(const std::string &name,
+                                            const VariableBinding &binding) {
+    switch (binding.Kind) {
+    case LocalBinding:
+      if (binding.Depth == 0) {
+        if (binding.IsBoxed) {
+          return std::make_shared<CellNode>(binding.Slot);
+        }
+        return std::make_shared<LocalNode>(binding.Slot);
+      }
+      if (const CapturedVariable *captured = capturedVariable(binding)) {
+        if (captured->ByReference) {
+          return std::make_shared<ReferenceNode>(binding.Capture);
+        }
+        return std::make_shared<EnvironmentNode>(binding.Capture,
+                                                 binding.IsBoxed);
+      }
+      fail("Cannot capture '" + name + "' across a named function");
+    case GlobalBinding:
+      if (binding.Slot == thisGlobal) {
+        return std::make_shared<ThisNode>();
+      }
+      return std::make_shared<GlobalNode>(binding.Slot);
+    case FieldBinding:
+      return std::make_shared<FieldNode>(binding.Slot);
+    case MethodBinding:
+      return std::make_shared<UninitializedMemberNode>(
+          std::make_shared<ThisNode>(), name);
+    default:
+      fail("Unresolved name '" + name + "'");
+    }
+  }
+
+  std::shared_ptr<ExpressionNode>
+  buildStore(const std::string &name, const VariableBinding &binding,
+             std::shared_ptr<ExpressionNode> value) {
+    switch (binding.Kind) {
+    case LocalBinding:
+      if (binding.Depth == 0) {
+        if (binding.IsBoxed) {
+          return std::make_shared<SetCellNode>(binding.Slot, std::move(value));
+        }
+        return std::make_shared<SetLocalNode>(binding.Slot, std::move(value));
+      }
+      if (const CapturedVariable *captured = capturedVariable(binding)) {
+        if (captured->ByReference) {
+          return std::make_shared<SetReferenceNode>(binding.Capture,
+                                                    std::move(value));
+        }
+        if (binding.IsBoxed) {
+          return std::make_shared<SetEnvironmentCellNode>(binding.Capture,
+                                                          std::move(value));
+        }
+        fail("Cannot assign to captured copy of '" + name + "'");
+      }
+      fail("Cannot capture '" + name + "' across a named function");
+    case GlobalBinding:
+      if (binding.Slot == thisGlobal || binding.Slot == superGlobal) {
+        fail("Cannot assign to '" + name + "'");
+      }
+      return std::make_shared<SetGlobalNode>(binding.Slot, std::move(value));
+    case FieldBinding:
+      return std::make_shared<SetFieldNode>(binding.Slot, std::move(value));
+    default:
+      fail("Cannot assign to '" + name + "'");
+    }
+  }
+
+  std::shared_ptr<ExpressionNode> buildBinary(const BinaryExpression &binary) {
+    if (binary.Op == BinaryOperator::Assign) {
+      if (auto var =
+              std::dynamic_pointer_cast<VariableExpression>(binary.Left)) {
+        return buildStore(var->Name, var->Binding,
+                          buildExpression(binary.Right));
+      }
+      auto dot = std::dynamic_pointer_cast<DotAccessExpression>(binary.Left);
+      auto member =
+          dot ? std::dynamic_pointer_cast<VariableExpression>(dot->Right)
+              : nullptr;
+      if (!member) {
+        fail("Invalid assignment target");
+      }
+      return std::make_shared<SetMemberNode>(buildExpression(dot->Left),
+                                             member->Name,
+                                             buildExpression(binary.Right));
+    }
+    if (isLogical(binary.Op)) {
+      return std::make_shared<LogicalNode>(binary.Op == BinaryOperator::And,
+                                           buildExpression(binary.Left),
+                                           buildExpression(binary.Right));
+    }
+    if (binary.Op == BinaryOperator::Unknown) {
+      fail("Unknown operator '" + binary.Operator + "'");
+    }
+    std::vector<std::shared_ptr<Expression>> parts;
+    if (concatenationParts(binary, parts) && parts.size() >= 3) {
+      return std::make_shared<ConcatChainNode>(buildArguments(parts));
+    }
+    return std::make_shared<UninitializedBinaryNode>(
+        binary.Op, buildExpression(binary.Left), buildExpression(binary.Right));
+  }
+
+  std::vector<std::shared_ptr<ExpressionNode>>
+  buildArguments(const std::vector<std::shared_ptr<Expression>> &arguments) {
+    std::vector<std::shared_ptr<ExpressionNode>> nodes;
+    nodes.reserve(arguments.size());
+    for (const auto &argument : arguments) {
+      nodes.push_back(buildExpression(argument));
+    }
+    return nodes;
+  }
+
+  bool isSuper(const VariableBinding &binding) const {
+    return binding.Kind == GlobalBinding && binding.Slot == superGlobal;
+  }
+
+  std::shared_ptr<ExpressionNode> buildCall(const CallExpression &call) {
+    const VariableBinding &binding = call.Binding;
+    if (dynamic_cast<const ConstructorCallExpression *>(&call)) {
+      return std::make_shared<NewNode>(buildLoad(call.FunctionName, binding),
+                                       buildArguments(call.Arguments));
+    }
+    if (isSuper(binding)) {
+      return std::make_shared<SuperCallNode>("constructor",
+                                             buildArguments(call.Arguments));
+    }
+    if (binding.Kind == MethodBinding && call.DirectSlot >= 0) {
+      return std::make_shared<FinalCallNode>(binding.Slot,
+                                             buildArguments(call.Arguments));
+    }
+    if (binding.Kind == MethodBinding) {
+      return std::make_shared<MethodCallNode>(binding.Slot,
+                                              buildArguments(call.Arguments));
+    }
+    return std::make_shared<CallNode>(buildLoad(call.FunctionName, binding),
+                                      buildArguments(call.Arguments));
+  }
+
+  std::shared_ptr<ExpressionNode>
+  buildDotAccess(const DotAccessExpression &dot) {
+    if (auto call = std::dynamic_pointer_cast<CallExpression>(dot.Right)) {
+      auto receiver = std::dynamic_pointer_cast<VariableExpression>(dot.Left);
+      if (receiver && isSuper(receiver->Binding)) {
+        return std::make_shared<SuperCallNode>(call->FunctionName,
+                                               buildArguments(call->Arguments));
+      }
+      if (call->DirectSlot >= 0 && receiver &&
+          receiver->Binding.Kind == GlobalBinding &&
+          receiver->Binding.Slot == thisGlobal) {
+        return std::make_shared<FinalCallNode>(call->DirectSlot,
+                                               buildArguments(call->Arguments));
+      }
+      if (call->DirectSlot >= 0) {
+        return std::make_shared<StaticCallNode>(
+            buildExpression(dot.Left), call->DirectSlot,
+            buildArguments(call->Arguments));
+      }
+      return std::make_shared<MemberCallNode>(buildExpression(dot.Left),
+                                              call->FunctionName,
+                                              buildArguments(call->Arguments));
+    }
+    if (auto member =
+            std::dynamic_pointer_cast<VariableExpression>(dot.Right)) {
+      return std::make_shared<UninitializedMemberNode>(
+          buildExpression(dot.Left), member->Name);
+    }
+    fail("Unsupported member access");
+  }
+
+  template <typename Closure>
+  std::shared_ptr<ExpressionNode>
+  buildClosure(const std::shared_ptr<Closure> &source, const Closure &closure) {
+    FunctionObject *function = newFunction(
+        building->Name + ".<closure>",
+        static_cast<int>(closure.Parameters.size()), closure.FrameSize, source,
+        building->Owner);
+    for (const auto &captured : closure.Captures) {
+      CaptureDescriptor descriptor;
+      descriptor.FromEnvironment = captured.From.Capture >= 0;
+      descriptor.Index = descriptor.FromEnvironment ? captured.From.Capture
+                                                    : captured.From.Slot;
+      descriptor.ByReference = captured.ByReference;
+      function->Captures.push_back(descriptor);
+    }
+    return std::make_shared<ClosureNode>(function);
+  }
+};
+
+#endif // AST_INTERPRETER_H
@@ -0,0 +1,19 @@
+#ifndef AWAIT_EXPRESSION_H
+#define AWAIT_EXPRESSION_H
+
+#include "expression.h"
+#include <memory>
+
+// Suspends the async function it is in until the task its operand
+// evaluates to is done, and evaluates to that task's result
+class AwaitExpression : public Expression {
+public:
+  std::shared_ptr<Expression> Operand;
+
+  explicit AwaitExpression(std::shared_ptr<Expression> operand)
+      : Operand(operand) {}
+
+  ~AwaitExpression() = default; // No need for manual memory management
+};
+
+#endif // AWAIT_EXPRESSION_H
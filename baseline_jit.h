@@ -0,0 +1,418 @@
+#ifndef BASELINE_JIT_H
+#define BASELINE_JIT_H
+
+#include "bytecode.h"
+#include "code_memory.h"
+#include "function_object.h"
+#include "inline_cache.h"
+#include "instance_object.h"
+#include "value.h"
+#include "x86_assembler.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Generated code is entered with the VM, the call frame and the address to
+// start at, which is the first instruction or, for on-stack replacement,
+// the head of a loop. Returns 0, or 1 after a runtime error.
+typedef int (*JitEntry)(void *vm, void *frame, const uint8_t *start);
+
+// Called by generated code with the VM, the frame and the address of the
+// instruction. Returns 0, or 1 after a runtime error, which the code passes
+// on.
+typedef int (*JitHelper)(void *vm, void *frame, const uint32_t *pc);
+
+struct JitHelpers {
+  JitHelper Operate;  // Any instruction that is not a call or control flow
+  JitHelper Invoke;   // A call, running the callee until it returns
+  JitHelper TailCall; // A tail call, after which the frame is done
+  JitHelper Return;   // Return, popping the frame
+  JitHelper Fuel;     // A jump back once the VM's fuel has run out
+  int RegistersOffset; // Of the register pointer within a call frame
+  int FuelOffset;      // Of the VM's fuel counter within the VM
+};
+
+struct JitOptions {
+  bool Enabled = true;
+  int CallThreshold = 1000;  // Calls before a function is compiled
+  int LoopThreshold = 10000; // Backward jumps before a running loop is
+                             // compiled and entered
+  bool PerfMap = false;      // Write /tmp/perf-<pid>.map for perf
+};
+
+// Machine code of one function
+struct JitFunction {
+  JitEntry Entry;
+  std::vector<const uint8_t *> Labels; // Each instruction, where a running
+                                       // frame can continue in machine code
+};
+
+// Translates each bytecode instruction into a fixed template of machine
+// code. Registers stay in the frame's stack window, so machine code and the
+// interpreter can take over a frame from each other at any instruction.
+// Moves, constants, jumps and integer arithmetic and comparisons are
+// inline, and so are member accesses that hit the shapes their inline cache
+// held when the function was compiled; everything else calls back into the
+// VM. Jumping back in a loop takes the loop's length from the VM's fuel
+// inline too, and calls back only once it runs out.
+class BaselineJit {
+public:
+  explicit BaselineJit(const JitHelpers &helpers) : helpers(helpers) {}
+
+  // Whether this build and host can run generated code
+  static bool isSupported() {
+#if SODA_JIT
+    // Templates move values around as their 64-bit encoding
+    return sizeof(Value) == ValueSize;
+#else
+    return false;
+#endif
+  }
+
+  void setPerfMap(bool enabled) { memory.setPerfMap(enabled); }
+
+  // Returns null if the code could not be installed
+  JitFunction *compile(const FunctionObject &function) {
+    typedef X86Assembler Asm;
+    Asm masm;
+    const std::vector<uint32_t> &code = function.Code;
+    std::vector<Asm::Label> labels(code.size());
+    Asm::Label exit;
+    Asm::Label error;
+
+    masm.push(Asm::RBP);
+    masm.move(Asm::RBP, Asm::RSP);
+    masm.push(Asm::RBX);
+    masm.push(Asm::R12);
+    masm.push(Asm::R13);
+    masm.push(Asm::R14);
+    masm.move(Asm::R12, Asm::RDI);
+    masm.move(Asm::R13, Asm::RSI);
+    masm.load(Asm::RBX, Asm::RSI, helpers.RegistersOffset);
+    masm.jump(Asm::RDX);
+
+    for (size_t i = 0; i < code.size(); i++) {
+      masm.bind(labels[i]);
+      uint32_t instruction = code[i];
+      int a = decodeA(instruction);
+      int b = decodeB(instruction);
+      int c = decodeC(instruction);
+      Asm::Label next;
+      switch (decodeOpcode(instruction)) {
+      case Opcode::Move:
+        masm.load(Asm::RAX, Asm::RBX, slot(b));
+        masm.store(Asm::RBX, slot(a), Asm::RAX);
+        break;
+      case Opcode::LoadConstant:
+        // Constants never change once compiled
+        storeValue(masm, a, function.Constants[decodeBx(instruction)]);
+        break;
+      case Opcode::LoadNull:
+        storeValue(masm, a, Value());
+        break;
+      case Opcode::LoadBool:
+        storeValue(masm, a, Value::boolean(b != 0));
+        break;
+      case Opcode::LoadInt:
+        storeValue(masm, a, Value::integer(decodesBx(instruction)));
+        break;
+      case Opcode::Add:
+      case Opcode::Subtract:
+      case Opcode::Multiply:
+      case Opcode::Equal:
+      case Opcode::NotEqual:
+      case Opcode::Less:
+      case Opcode::LessEqual:
+      case Opcode::Greater:
+      case Opcode::GreaterEqual:
+      case Opcode::LessInt:
+      case Opcode::LessEqualInt:
+      case Opcode::GreaterInt:
+      case Opcode::GreaterEqualInt: {
+        Asm::Label slow;
+        masm.load(Asm::RAX, Asm::RBX, slot(b));
+        loadInlineInt(masm, Asm::RAX, slow);
+        masm.load(Asm::RCX, Asm::RBX, slot(c));
+        loadInlineInt(masm, Asm::RCX, slow);
+        integerOperation(masm, decodeOpcode(instruction), slow);
+        masm.store(Asm::RBX, slot(a), Asm::RAX);
+        masm.jump(next);
+        masm.bind(slow);
+        callHelper(masm, helpers.Operate, &code[i], error);
+        break;
+      }
+      case Opcode::GetMember:
+      case Opcode::SetMember: {
+        Asm::Label slow;
+        bool get = decodeOpcode(instruction) == Opcode::GetMember;
+        const InlineCache &cache = function.Caches[decodeBx(code[i + 1])];
+        if (cache.getCount() > 0) {
+          accessField(masm, get ? b : a, get ? a : c, get, cache, next, slow);
+        }
+        masm.bind(slow);
+        callHelper(masm, helpers.Operate, &code[i], error);
+        break;
+      }
+      case Opcode::Jump:
+        if (decodesBx(instruction) < 0) {
+          burnFuel(masm, -decodesBx(instruction),
+                   labels[target(i, instruction)]);
+          callHelper(masm, helpers.Fuel, &code[i], error);
+        }
+        masm.jump(labels[target(i, instruction)]);
+        break;
+      case Opcode::JumpIfFalse:
+        // Only null and false are falsy
+        compareFalsy(masm, a, Value());
+        masm.jumpIf(Asm::Equal, labels[target(i, instruction)]);
+        compareFalsy(masm, a, Value::boolean(false));
+        masm.jumpIf(Asm::Equal, labels[target(i, instruction)]);
+        break;
+      case Opcode::JumpIfTrue:
+        compareFalsy(masm, a, Value());
+        masm.jumpIf(Asm::Equal, next);
+        compareFalsy(masm, a, Value::boolean(false));
+        masm.jumpIf(Asm::NotEqual, labels[target(i, instruction)]);
+        break;
+      case Opcode::Call:
+      case Opcode::CallMember:
+      case Opcode::CallMethod:
+      case Opcode::CallFinal:
+      case Opcode::CallStatic:
+      case Opcode::CallSuper:
+      case Opcode::New:
+        callHelper(masm, helpers.Invoke, &code[i], error);
+        break;
+      case Opcode::MemberCache:
+        break;
+      case Opcode::TailCall:
+      case Opcode::TailCallMethod:
+        // The callee runs outside this code, on the frame it took over
+        callHelper(masm, helpers.TailCall, &code[i], error);
+        masm.jump(exit);
+        break;
+      case Opcode::Return:
+        callHelper(masm, helpers.Return, &code[i], error);
+        masm.jump(exit);
+        break;
+      default:
+        callHelper(masm, helpers.Operate, &code[i], error);
+        break;
+      }
+      masm.bind(next);
+    }
+
+    masm.bind(error);
+    masm.moveImmediate32(Asm::RAX, 1);
+    masm.bind(exit);
+    masm.pop(Asm::R14);
+    masm.pop(Asm::R13);
+    masm.pop(Asm::R12);
+    masm.pop(Asm::RBX);
+    masm.pop(Asm::RBP);
+    masm.ret();
+
+    const uint8_t *start = memory.install(masm.getCode(), function.Name);
+    if (!start) {
+      return nullptr;
+    }
+    std::unique_ptr<JitFunction> compiled(new JitFunction());
+    compiled->Entry = reinterpret_cast<JitEntry>(
+        reinterpret_cast<uintptr_t>(start));
+    for (const auto &label : labels) {
+      compiled->Labels.push_back(start + label.Offset);
+    }
+    functions.push_back(std::move(compiled));
+    return functions.back().get();
+  }
+
+  size_t getCompiledCount() const { return functions.size(); }
+
+  size_t getCodeBytes() const { return memory.getBytesInstalled(); }
+
+private:
+  static const int ValueSize = 8;
+
+  JitHelpers helpers;
+  CodeMemory memory;
+  std::vector<std::unique_ptr<JitFunction>> functions;
+
+  static int32_t slot(int reg) { return reg * ValueSize; }
+
+  static size_t target(size_t index, uint32_t instruction) {
+    return index + 1 + decodesBx(instruction);
+  }
+
+  static void storeValue(X86Assembler &masm, int reg, const Value &value) {
+    masm.moveImmediate(X86Assembler::RAX, value.getBits());
+    masm.store(X86Assembler::RBX, slot(reg), X86Assembler::RAX);
+  }
+
+  // Sets the flags for comparing R[reg] with the falsy value
+  static void compareFalsy(X86Assembler &masm, int reg, const Value &falsy) {
+    typedef X86Assembler Asm;
+    masm.load(Asm::RAX, Asm::RBX, slot(reg));
+    masm.moveImmediate(Asm::RCX, falsy.getBits());
+    masm.compare(Asm::RAX, Asm::RCX);
+  }
+
+  // Replaces the value in reg with its integer, or goes to slow unless it
+  // is an inline int
+  static void loadInlineInt(X86Assembler &masm, X86Assembler::Register reg,
+                            X86Assembler::Label &slow) {
+    typedef X86Assembler Asm;
+    masm.move(Asm::RDX, reg);
+    masm.shiftRight(Asm::RDX, Value::TagShift);
+    masm.compareImmediate32(Asm::RDX, static_cast<uint32_t>(Value::IntTag));
+    masm.jumpIf(Asm::NotEqual, slow);
+    masm.shiftLeft(reg, 64 - Value::TagShift);
+    masm.shiftRightArithmetic(reg, 64 - Value::TagShift);
+  }
+
+  // rax = the value of rax op rcx, for two integers. Goes to slow if the
+  // result is an int too wide to be inline.
+  static void integerOperation(X86Assembler &masm, Opcode opcode,
+                               X86Assembler::Label &slow) {
+    typedef X86Assembler Asm;
+    uint64_t tag = Value::IntTag;
+    switch (opcode) {
+    case Opcode::Add:
+      masm.add(Asm::RAX, Asm::RCX);
+      break;
+    case Opcode::Subtract:
+      masm.subtract(Asm::RAX, Asm::RCX);
+      break;
+    case Opcode::Multiply:
+      masm.multiply(Asm::RAX, Asm::RCX);
+      masm.jumpIf(Asm::Overflow, slow);
+      break;
+    default:
+      masm.compare(Asm::RAX, Asm::RCX);
+      masm.setCondition(comparison(opcode));
+      tag = Value::BoolTag;
+      break;
+    }
+    if (tag == Value::IntTag) {
+      // Fits if sign-extending its low 48 bits gives it back
+      masm.move(Asm::RDX, Asm::RAX);
+      masm.shiftLeft(Asm::RDX, 64 - Value::TagShift);
+      masm.shiftRightArithmetic(Asm::RDX, 64 - Value::TagShift);
+      masm.compare(Asm::RDX, Asm::RAX);
+      masm.jumpIf(Asm::NotEqual, slow);
+      masm.moveImmediate(Asm::RDX, Value::PayloadMask);
+      masm.bitAnd(Asm::RAX, Asm::RDX);
+    }
+    masm.moveImmediate(Asm::RDX, tag << Value::TagShift);
+    masm.bitOr(Asm::RAX, Asm::RDX);
+  }
+
+  static X86Assembler::Condition comparison(Opcode opcode) {
+    switch (untypedOpcode(opcode)) {
+    case Opcode::Equal:
+      return X86Assembler::Equal;
+    case Opcode::NotEqual:
+      return X86Assembler::NotEqual;
+    case Opcode::Less:
+      return X86Assembler::Less;
+    case Opcode::LessEqual:
+      return X86Assembler::LessEqual;
+    case Opcode::Greater:
+      return X86Assembler::Greater;
+    default:
+      return X86Assembler::GreaterEqual;
+    }
+  }
+
+  // Reads or writes the field of the instance in R[object] for each shape
+  // in cache, with R[value] as the destination or the source, then goes to
+  // done. Goes to miss for any other value.
+  static void accessField(X86Assembler &masm, int object, int value, bool get,
+                          const InlineCache &cache, X86Assembler::Label &done,
+                          X86Assembler::Label &miss) {
+    typedef X86Assembler Asm;
+    masm.load(Asm::RAX, Asm::RBX, slot(object));
+    masm.move(Asm::RDX, Asm::RAX);
+    masm.shiftRight(Asm::RDX, Value::TagShift);
+    masm.compareImmediate32(Asm::RDX, static_cast<uint32_t>(Value::ObjectTag));
+    masm.jumpIf(Asm::NotEqual, miss);
+    masm.moveImmediate(Asm::RDX, Value::PayloadMask);
+    masm.bitAnd(Asm::RAX, Asm::RDX);
+    masm.load32(Asm::RDX, Asm::RAX, kindOffset());
+    masm.compareImmediate32(Asm::RDX,
+                            static_cast<uint32_t>(ObjectKind::Instance));
+    masm.jumpIf(Asm::NotEqual, miss);
+    if (!get) {
+      // A store into an object not yet remembered needs the write barrier
+      masm.load8(Asm::RDX, Asm::RAX, rememberedOffset());
+      masm.compareImmediate32(Asm::RDX, 0);
+      masm.jumpIf(Asm::Equal, miss);
+    }
+    masm.load(Asm::RCX, Asm::RAX, layoutOffset());
+    // Shapes never change, so what they held at compile time stays true
+    for (int i = 0; i < cache.getCount(); i++) {
+      const InlineCache::Entry &entry = cache.getEntry(i);
+      Asm::Label other;
+      masm.moveImmediate(Asm::RDX, reinterpret_cast<uint64_t>(entry.Key));
+      masm.compare(Asm::RCX, Asm::RDX);
+      masm.jumpIf(Asm::NotEqual, other);
+      int32_t field =
+          static_cast<int32_t>(InstanceObject::fieldOffset(entry.Slot));
+      if (get) {
+        masm.load(Asm::RDX, Asm::RAX, field);
+        masm.store(Asm::RBX, slot(value), Asm::RDX);
+      } else {
+        masm.load(Asm::RDX, Asm::RBX, slot(value));
+        masm.store(Asm::RAX, field, Asm::RDX);
+      }
+      masm.jump(done);
+      masm.bind(other);
+    }
+    masm.jump(miss);
+  }
+
+  // offsetof is only conditionally supported on classes with virtual
+  // functions; the compilers that build machine code support it
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+#endif
+  static int32_t kindOffset() {
+    return static_cast<int32_t>(offsetof(InstanceObject, Kind));
+  }
+
+  static int32_t layoutOffset() {
+    return static_cast<int32_t>(offsetof(InstanceObject, Layout));
+  }
+
+  static int32_t rememberedOffset() {
+    return static_cast<int32_t>(offsetof(InstanceObject, Remembered));
+  }
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+  // Takes cost from the VM's fuel and goes on to loop while some is left
+  void burnFuel(X86Assembler &masm, int cost, X86Assembler::Label &loop) {
+    typedef X86Assembler Asm;
+    masm.load(Asm::RAX, Asm::R12, helpers.FuelOffset);
+    masm.moveImmediate(Asm::RCX, static_cast<uint64_t>(cost));
+    masm.subtract(Asm::RAX, Asm::RCX);
+    masm.store(Asm::R12, helpers.FuelOffset, Asm::RAX);
+    masm.jumpIf(Asm::Greater, loop);
+  }
+
+  static void callHelper(X86Assembler &masm, JitHelper helper,
+                         const uint32_t *pc, X86Assembler::Label &error) {
+    typedef X86Assembler Asm;
+    masm.move(Asm::RDI, Asm::R12);
+    masm.move(Asm::RSI, Asm::R13);
+    masm.moveImmediate(Asm::RDX, reinterpret_cast<uint64_t>(pc));
+    masm.moveImmediate(Asm::RAX, reinterpret_cast<uint64_t>(helper));
+    masm.call(Asm::RAX);
+    masm.testEax();
+    masm.jumpIf(Asm::NotEqual, error);
+  }
+};
+
+#endif // BASELINE_JIT_H
@@ -1,6 +1,7 @@
 #ifndef BINARYEXPRESSION_H
 #define BINARYEXPRESSION_H
 
+#include "binary_operator.h"
 #include "expression.h"
 #include "ref_counted.h"
 
@@ -11,10 +12,15 @@ public:
   std::shared_ptr<Expression> Left;
   std::string Operator;
   std::shared_ptr<Expression> Right;
+  BinaryOperator Op;
+  // Type both operands are converted to before the operation runs. Any means
+  // the operation has to dispatch on the runtime types.
+  TypeKind OperandKind = TypeKind::Any;
 
   BinaryExpression(std::shared_ptr<Expression> left, const std::string &op,
                    std::shared_ptr<Expression> right)
-      : Left(left), Operator(op), Right(right) {}
+      : Left(left), Operator(op), Right(right),
+        Op(binaryOperatorFromString(op)) {}
 
   ~BinaryExpression() = default; // No need for manual memory management
 };
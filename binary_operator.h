@@ -0,0 +1,108 @@
+#ifndef BINARY_OPERATOR_H
+#define BINARY_OPERATOR_H
+
+#include <string>
+
+// Operators a BinaryExpression can carry, decoded from its Operator text
+enum class BinaryOperator {
+  Unknown,
+  Add,
+  Subtract,
+  Multiply,
+  Divide,
+  Modulo,
+  Equal,
+  NotEqual,
+  Less,
+  Greater,
+  LessEqual,
+  GreaterEqual,
+  And,
+  Or,
+  Assign,
+};
+
+inline BinaryOperator binaryOperatorFromString(const std::string &op) {
+  if (op == "+")
+    return BinaryOperator::Add;
+  if (op == "-")
+    return BinaryOperator::Subtract;
+  if (op == "*")
+    return BinaryOperator::Multiply;
+  if (op == "/")
+    return BinaryOperator::Divide;
+  if (op == "%")
+    return BinaryOperator::Modulo;
+  if (op == "==")
+    return BinaryOperator::Equal;
+  if (op == "!=")
+    return BinaryOperator::NotEqual;
+  if (op == "<")
+    return BinaryOperator::Less;
+  if (op == ">")
+    return BinaryOperator::Greater;
+  if (op == "<=")
+    return BinaryOperator::LessEqual;
+  if (op == ">=")
+    return BinaryOperator::GreaterEqual;
+  if (op == "&&")
+    return BinaryOperator::And;
+  if (op == "||")
+    return BinaryOperator::Or;
+  if (op == "=")
+    return BinaryOperator::Assign;
+  return BinaryOperator::Unknown;
+}
+
+inline const char *binaryOperatorSymbol(BinaryOperator op) {
+  switch (op) {
+  case BinaryOperator::Add:
+    return "+";
+  case BinaryOperator::Subtract:
+    return "-";
+  case BinaryOperator::Multiply:
+    return "*";
+  case BinaryOperator::Divide:
+    return "/";
+  case BinaryOperator::Modulo:
+    return "%";
+  case BinaryOperator::Equal:
+    return "==";
+  case BinaryOperator::NotEqual:
+    return "!=";
+  case BinaryOperator::Less:
+    return "<";
+  case BinaryOperator::Greater:
+    return ">";
+  case BinaryOperator::LessEqual:
+    return "<=";
+  case BinaryOperator::GreaterEqual:
+    return ">=";
+  case BinaryOperator::And:
+    return "&&";
+  case BinaryOperator::Or:
+    return "||";
+  case BinaryOperator::Assign:
+    return "=";
+  default:
+    return "?";
+  }
+}
+
+inline bool isArithmetic(BinaryOperator op) {
+  return op == BinaryOperator::Add || op == BinaryOperator::Subtract ||
+         op == BinaryOperator::Multiply || op == BinaryOperator::Divide ||
+         op == BinaryOperator::Modulo;
+}
+
+inline bool isComparison(BinaryOperator op) {
+  return op == BinaryOperator::Equal || op == BinaryOperator::NotEqual ||
+         op == BinaryOperator::Less || op == BinaryOperator::Greater ||
+         op == BinaryOperator::LessEqual || op == BinaryOperator::GreaterEqual;
+}
+
+inline bool isLogical(BinaryOperator op) {
+  return op == BinaryOperator::And || op == BinaryOperator::Or;
+}
+
+#endif // BINARY_OPERATOR_H
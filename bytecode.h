@@ -0,0 +1,182 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+
+// Register bytecode. Every instruction is one 32-bit word:
+//
+//   bits 0-7   opcode
+//   bits 8-15  A
+//   bits 16-23 B    } or together a 16-bit Bx,
+//   bits 24-31 C    } or a signed sBx jump offset
+//
+// R[n] is register n of the current frame; a function's locals occupy the
+// registers matching their frame slots and temporaries follow them. Calls
+// take the callee or receiver in R[A] and the arguments in R[A+1..A+B],
+// and leave the result in R[A]. Tail calls move the callee and arguments
+// over the calling frame's own window and reuse its frame, so a chain of
+// them runs in constant stack space. Each is followed by a Return of R[A],
+// which only runs where the compiler kept an ordinary call instead.
+// CallFinal and CallStatic are method calls the ClassHierarchy bound: they
+// take the method out of a known class's table, with no dispatch on the
+// receiver. Concat builds the string of a chain of + like "a" + b + "c"
+// in one allocation, where Add would make one string per +. Await only
+// appears in async functions, whose frames it can suspend.
+//
+// GetMember, SetMember and CallMember are each followed by a MemberCache
+// word naming the site's own inline cache in the function's Caches.
+//
+// The Int and Double forms of the operators are what the compiler emits
+// where the TypeChecker found both operands to be of that type. They give
+// the same results as the untyped ones, which they fall back to for any
+// other operands, but go straight to the machine operation for their own.
+// Add, Subtract and Multiply already do for two ints, so have no Int form.
+// ToDouble converts an int stored where the TypeChecker declared a Float
+// or Double.
+#define SODA_OPCODES(X)                                                        \
+  X(Move)           /* R[A] = R[B] */                                          \
+  X(LoadConstant)   /* R[A] = Constants[Bx] */                                 \
+  X(LoadNull)       /* R[A] = null */                                          \
+  X(LoadBool)       /* R[A] = B != 0 */                                        \
+  X(LoadInt)        /* R[A] = sBx */                                           \
+  X(GetGlobal)      /* R[A] = Globals[Bx] */                                   \
+  X(SetGlobal)      /* Globals[Bx] = R[A] */                                   \
+  X(GetEnvironment) /* R[A] = Environment[B] */                                \
+  X(GetReference)   /* R[A] = stack slot held by Environment[B] */             \
+  X(SetReference)   /* stack slot held by Environment[A] = R[B] */             \
+  X(NewCell)        /* R[A] = new cell holding R[A] */                         \
+  X(GetCell)        /* R[A] = contents of cell R[B] */                         \
+  X(SetCell)        /* contents of cell R[A] = R[B] */                         \
+  X(LoadThis)       /* R[A] = receiver of the frame */                         \
+  X(GetField)       /* R[A] = this.Fields[B] */                                \
+  X(SetField)       /* this.Fields[A] = R[B] */                                \
+  X(GetMember)      /* R[A] = R[B].Names[C] */                                 \
+  X(SetMember)      /* R[A].Names[B] = R[C] */                                 \
+  X(Add)            /* R[A] = R[B] + R[C] */                                   \
+  X(Subtract)                                                                  \
+  X(Multiply)                                                                  \
+  X(Divide)                                                                    \
+  X(Modulo)                                                                    \
+  X(Equal)                                                                     \
+  X(NotEqual)                                                                  \
+  X(Less)                                                                      \
+  X(LessEqual)                                                                 \
+  X(Greater)                                                                   \
+  X(GreaterEqual)                                                              \
+  X(DivideInt)      /* R[A] = R[B] / R[C], both statically ints */             \
+  X(ModuloInt)                                                                 \
+  X(LessInt)                                                                   \
+  X(LessEqualInt)                                                              \
+  X(GreaterInt)                                                                \
+  X(GreaterEqualInt)                                                           \
+  X(AddDouble)      /* R[A] = R[B] + R[C], both statically doubles */          \
+  X(SubtractDouble)                                                            \
+  X(MultiplyDouble)                                                            \
+  X(DivideDouble)                                                              \
+  X(ModuloDouble)                                                              \
+  X(LessDouble)                                                                \
+  X(LessEqualDouble)                                                           \
+  X(GreaterDouble)                                                             \
+  X(GreaterEqualDouble)                                                        \
+  X(ToDouble)       /* R[A] = R[B], made a double if an int */                 \
+  X(Concat)         /* R[A] = string of R[B..B+C-1] joined */                  \
+  X(Jump)           /* pc += sBx */                                            \
+  X(JumpIfFalse)    /* if R[A] is falsy, pc += sBx */                          \
+  X(JumpIfTrue)     /* if R[A] is truthy, pc += sBx */                         \
+  X(Call)           /* R[A] = R[A](B arguments) */                             \
+  X(CallMember)     /* R[A] = R[A].Names[C](B arguments) */                    \
+  X(CallMethod)     /* R[A] = this.Methods[C](B arguments) */                  \
+  X(CallFinal)      /* R[A] = Owner.Methods[C](B arguments) on this */         \
+  X(CallStatic)     /* R[A] = class R[A].Methods[C](B arguments) on R[A] */    \
+  X(CallSuper)      /* R[A] = base method Names[C] on this (B arguments) */    \
+  X(New)            /* R[A] = new instance of class R[A] (B arguments) */      \
+  X(TailCall)       /* return R[A](B arguments) in place of this frame */      \
+  X(TailCallMethod) /* return this.Methods[C](B arguments) likewise */         \
+  X(Closure)        /* R[A] = closure of Prototypes[Bx] */                     \
+  X(Return)         /* return B ? R[A] : null */                               \
+  X(Await)          /* R[A] = result of task R[B], suspending until done */    \
+  X(MemberCache)    /* not run: Caches[Bx] of the member access before it */
+
+enum class Opcode : uint8_t {
+#define SODA_OPCODE_ENUM(name) name,
+  SODA_OPCODES(SODA_OPCODE_ENUM)
+#undef SODA_OPCODE_ENUM
+      Count
+};
+
+const int MaxRegisters = 256;
+const int MaxJumpOffset = 32767;
+const int MaxConcatParts = 64;
+
+inline const char *opcodeName(Opcode opcode) {
+  static const char *names[] = {
+#define SODA_OPCODE_NAME(name) #name,
+      SODA_OPCODES(SODA_OPCODE_NAME)
+#undef SODA_OPCODE_NAME
+  };
+  return opcode < Opcode::Count ? names[static_cast<int>(opcode)] : "?";
+}
+
+// The operator a typed one is a form of, or opcode itself
+inline Opcode untypedOpcode(Opcode opcode) {
+  switch (opcode) {
+  case Opcode::AddDouble:
+    return Opcode::Add;
+  case Opcode::SubtractDouble:
+    return Opcode::Subtract;
+  case Opcode::MultiplyDouble:
+    return Opcode::Multiply;
+  case Opcode::DivideInt:
+  case Opcode::DivideDouble:
+    return Opcode::Divide;
+  case Opcode::ModuloInt:
+  case Opcode::ModuloDouble:
+    return Opcode::Modulo;
+  case Opcode::LessInt:
+  case Opcode::LessDouble:
+    return Opcode::Less;
+  case Opcode::LessEqualInt:
+  case Opcode::LessEqualDouble:
+    return Opcode::LessEqual;
+  case Opcode::GreaterInt:
+  case Opcode::GreaterDouble:
+    return Opcode::Greater;
+  case Opcode::GreaterEqualInt:
+  case Opcode::GreaterEqualDouble:
+    return Opcode::GreaterEqual;
+  default:
+    return opcode;
+  }
+}
+
+inline uint32_t encodeABC(Opcode opcode, int a, int b, int c) {
+  return static_cast<uint32_t>(opcode) | (static_cast<uint32_t>(a) << 8) |
+         (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(c) << 24);
+}
+
+inline uint32_t encodeABx(Opcode opcode, int a, int bx) {
+  return static_cast<uint32_t>(opcode) | (static_cast<uint32_t>(a) << 8) |
+         (static_cast<uint32_t>(bx) << 16);
+}
+
+inline uint32_t encodeAsBx(Opcode opcode, int a, int sbx) {
+  return encodeABx(opcode, a, sbx + MaxJumpOffset);
+}
+
+inline Opcode decodeOpcode(uint32_t instruction) {
+  return static_cast<Opcode>(instruction & 0xFF);
+}
+
+inline int decodeA(uint32_t instruction) { return (instruction >> 8) & 0xFF; }
+
+inline int decodeB(uint32_t instruction) { return (instruction >> 16) & 0xFF; }
+
+inline int decodeC(uint32_t instruction) { return instruction >> 24; }
+
+inline int decodeBx(uint32_t instruction) { return instruction >> 16; }
+
+inline int decodesBx(uint32_t instruction) {
+  return static_cast<int>(instruction >> 16) - MaxJumpOffset;
+}
+
+#endif // BYTECODE_H
@@ -0,0 +1,915 @@
+#ifndef BYTECODE_COMPILER_H
+#define BYTECODE_COMPILER_H
+
+#include "ast_node.h"
+#include "await_expression.h"
+#include "binary_expression.h"
+#include "bytecode.h"
+#include "call_expression.h"
+#include "class_declaration.h"
+#include "class_object.h"
+#include "closure_expression.h"
+#include "closure_object.h"
+#include "compiled_package.h"
+#include "concatenation_chain.h"
+#include "constructor_call_expression.h"
+#include "dot_access_expression.h"
+#include "for_statement.h"
+#include "function_declaration.h"
+#include "function_object.h"
+#include "heap.h"
+#include "if_statement.h"
+#include "lambda_expression.h"
+#include "literal_expression.h"
+#include "package.h"
+#include "parameter.h"
+#include "return_statement.h"
+#include "value.h"
+#include "variable_binding.h"
+#include "variable_declaration.h"
+#include "variable_expression.h"
+#include "while_statement.h"
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiles a resolved package to register bytecode. Locals live in the
+// registers numbered by their frame slots, so the ScopeResolver has to run
+// first, and the ClosureConverter too, since closures read their captures
+// from the flat environments it lays out. Calls the ClassHierarchy bound,
+// if it ran, become CallFinal and CallStatic, and operators the
+// TypeChecker typed, if it ran, their Int or Double forms; values it
+// marked ToDouble are converted.
+class BytecodeCompiler {
+public:
+  explicit BytecodeCompiler(Heap &heap) : heap(heap) {}
+
+  CompiledPackage compile(const Package &package) {
+    errors.clear();
+    classes.clear();
+    classDeclarations.clear();
+    states.clear();
+
+    CompiledPackage result;
+    result.Name = package.Name;
+    result.Globals = package.Globals;
+    globals = &result.Globals;
+    thisGlobal = findGlobal("this");
+    superGlobal = findGlobal("super");
+
+    for (const auto &member : package.Members) {
+      if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+        classDeclarations[cls->Name] = cls.get();
+      }
+    }
+
+    FunctionObject *initializer = heap.allocate<FunctionObject>();
+    initializer->Name = package.Name.empty() ? "<package>" : package.Name;
+    pushFunction(initializer, package.FrameSize, nullptr);
+
+    // Members are visible before any top-level code runs
+    for (const auto &member : package.Members) {
+      int mark = currentRegister();
+      if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+        int reg = allocateRegister();
+        emitABx(Opcode::LoadConstant, reg,
+                addConstant(Value::object(compileClass(*cls))));
+        emitABx(Opcode::SetGlobal, reg, findGlobal(cls->Name));
+      } else if (auto func =
+                     std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        int reg = allocateRegister();
+        emitABx(Opcode::Closure, reg,
+                addPrototype(compileFunction(*func, nullptr)));
+        emitABx(Opcode::SetGlobal, reg, findGlobal(func->Name));
+      }
+      freeRegisters(mark);
+    }
+    for (const auto &member : package.Members) {
+      if (!std::dynamic_pointer_cast<ClassDeclaration>(member) &&
+          !std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        compileStatement(member);
+      }
+    }
+    emitABC(Opcode::Return, 0, 0, 0);
+    popFunction();
+
+    result.Initializer = initializer;
+    globals = nullptr;
+    return result;
+  }
+
+  const std::vector<std::string> &getErrors() const { return errors; }
+
+private:
+  struct FunctionState {
+    FunctionObject *Function;
+    int FrameSize;    // Registers holding locals
+    int NextRegister; // First free temporary
+    const std::vector<CapturedVariable> *Captures; // Null outside closures
+    std::unordered_map<std::string, int> StringConstants;
+    std::unordered_map<std::string, int> NameIndex;
+  };
+
+  Heap &heap;
+  std::vector<std::string> errors;
+  std::vector<std::string> *globals = nullptr;
+  int thisGlobal = -1;
+  int superGlobal = -1;
+  std::unordered_map<std::string, ClassObject *> classes;
+  std::unordered_map<std::string, ClassDeclaration *> classDeclarations;
+  std::vector<FunctionState> states;
+
+  void error(const std::string &message) {
+    errors.push_back(message + " in '" + states.back().Function->Name + "'");
+  }
+
+  int findGlobal(const std::string &name) const {
+    auto found = std::find(globals->begin(), globals->end(), name);
+    return found == globals->end()
+               ? -1
+               : static_cast<int>(found - globals->begin());
+  }
+
+  // Functions and registers
+
+  FunctionState &current() { return states.back(); }
+
+  void pushFunction(FunctionObject *function, int frameSize,
+                    const std::vector<CapturedVariable> *captures) {
+    function->RegisterCount = frameSize;
+    states.push_back(
+        FunctionState{function, frameSize, frameSize, captures, {}, {}});
+    if (frameSize > MaxRegisters) {
+      error("Too many locals");
+    }
+  }
+
+  void popFunction() { states.pop_back(); }
+
+  int currentRegister() { return current().NextRegister; }
+
+  int allocateRegister() {
+    FunctionState &state = current();
+    int reg = state.NextRegister++;
+    if (reg == MaxRegisters) {
+      error("Expression needs too many registers");
+    }
+    state.Function->RegisterCount =
+        std::max(state.Function->RegisterCount, state.NextRegister);
+    return reg;
+  }
+
+  void freeRegisters(int mark) { current().NextRegister = mark; }
+
+  // Emitting
+
+  int emit(uint32_t instruction) {
+    current().Function->Code.push_back(instruction);
+    return static_cast<int>(current().Function->Code.size()) - 1;
+  }
+
+  int emitABC(Opcode opcode, int a, int b, int c) {
+    return emit(encodeABC(opcode, a, b, c));
+  }
+
+  // A member access, followed by the index of an inline cache of its own
+  void emitMember(Opcode opcode, int a, int b, int c) {
+    emitABC(opcode, a, b, c);
+    std::vector<InlineCache> &caches = current().Function->Caches;
+    if (caches.size() > 0xFFFF) {
+      error("Too many member accesses");
+    }
+    emitABx(Opcode::MemberCache, 0, static_cast<int>(caches.size()));
+    caches.emplace_back();
+  }
+
+  int emitABx(Opcode opcode, int a, int bx) {
+    return emit(encodeABx(opcode, a, bx));
+  }
+
+  void emitMove(int target, int source) {
+    if (target != source) {
+      emitABC(Opcode::Move, target, source, 0);
+    }
+  }
+
+  int here() { return static_cast<int>(current().Function->Code.size()); }
+
+  int emitJump(Opcode opcode, int reg) {
+    return emit(encodeAsBx(opcode, reg, 0));
+  }
+
+  int jumpOffset(int from, int to) {
+    int offset = to - (from + 1);
+    if (offset > MaxJumpOffset || offset < -MaxJumpOffset) {
+      error("Jump too far");
+    }
+    return offset;
+  }
+
+  // Points the jump at index at the next instruction to be emitted
+  void patchJump(int index) {
+    uint32_t &instruction = current().Function->Code[index];
+    instruction = encodeAsBx(decodeOpcode(instruction), decodeA(instruction),
+                             jumpOffset(index, here()));
+  }
+
+  void emitJumpBack(int target) {
+    emit(encodeAsBx(Opcode::Jump, 0, jumpOffset(here(), target)));
+  }
+
+  // Constant pool
+
+  int addConstant(const Value &value) {
+    auto &constants = current().Function->Constants;
+    for (size_t i = 0; i < constants.size(); i++) {
+      if (constants[i].isIdenticalTo(value)) {
+        return static_cast<int>(i);
+      }
+    }
+    if (constants.size() > 0xFFFF) {
+      error("Too many constants");
+    }
+    constants.push_back(value);
+    return static_cast<int>(constants.size()) - 1;
+  }
+
+  int addString(const std::string &text) {
+    auto found = current().StringConstants.find(text);
+    if (found != current().StringConstants.end()) {
+      return found->second;
+    }
+    int index = addConstant(Value::object(heap.intern(text)));
+    current().StringConstants[text] = index;
+    return index;
+  }
+
+  int addName(const std::string &name) {
+    auto found = current().NameIndex.find(name);
+    if (found != current().NameIndex.end()) {
+      return found->second;
+    }
+    auto &names = current().Function->Names;
+    if (names.size() > 0xFF) {
+      error("Too many member names");
+    }
+    names.push_back(name);
+    current().NameIndex[name] = static_cast<int>(names.size()) - 1;
+    return static_cast<int>(names.size()) - 1;
+  }
+
+  int addPrototype(FunctionObject *prototype) {
+    auto &prototypes = current().Function->Prototypes;
+    prototypes.push_back(prototype);
+    return static_cast<int>(prototypes.size()) - 1;
+  }
+
+  // Declarations
+
+  ClassObject *compileClass(ClassDeclaration &decl) {
+    auto existing = classes.find(decl.Name);
+    if (existing != classes.end()) {
+      return existing->second;
+    }
+    ClassObject *cls = heap.allocate<ClassObject>(decl.Name);
+    classes[decl.Name] = cls;
+    if (decl.BaseClass) {
+      auto base = classDeclarations.find(decl.BaseClass->Name);
+      if (base != classDeclarations.end()) {
+        cls->Base = compileClass(*base->second);
+        cls->Methods = cls->Base->Methods;
+      }
+    }
+    cls->FieldNames = decl.FieldNames;
+    cls->MethodNames = decl.MethodNames;
+    cls->Methods.resize(cls->MethodNames.size());
+    cls->indexMembers();
+
+    FunctionObject *fields = heap.allocate<FunctionObject>();
+    fields->Name = decl.Name + ".<fields>";
+    fields->Owner = cls;
+    pushFunction(fields, 0, nullptr);
+    for (const auto &member : decl.Members) {
+      if (auto func = std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        FunctionObject *method = compileFunction(*func, cls);
+        cls->Methods[cls->findMethod(func->Name)] =
+            Value::object(heap.allocate<ClosureObject>(method));
+      } else if (auto var =
+                     std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        if (var->Value && var->Binding.Kind == FieldBinding) {
+          int mark = currentRegister();
+          emitABC(Opcode::SetField, var->Binding.Slot,
+                  compileOperand(var->Value), 0);
+          freeRegisters(mark);
+        }
+      }
+    }
+    if (!fields->Code.empty()) {
+      emitABC(Opcode::Return, 0, 0, 0);
+      cls->Initializer = Value::object(heap.allocate<ClosureObject>(fields));
+    }
+    popFunction();
+    return cls;
+  }
+
+  FunctionObject *compileFunction(const FunctionDeclaration &func,
+                                  ClassObject *owner) {
+    FunctionObject *function = heap.allocate<FunctionObject>();
+    function->Name = owner ? owner->Name + "." + func.Name : func.Name;
+    function->Owner = owner;
+    function->Async = func.Async;
+    compileBody(function, func.Parameters, func.FrameSize, nullptr,
+                [&]() { compileStatements(func.Body); });
+    bool constructor = owner && func.Name == "constructor";
+    if (constructor && func.Async) {
+      errors.push_back("Constructor of '" + owner->Name + "' cannot be async");
+    }
+    if (constructor || func.Async) {
+      // A constructor evaluates to the new instance, not to what it
+      // returns, and the return of an async function settles its task
+      keepTailCallFrames(function);
+    }
+    return function;
+  }
+
+  template <typename Body>
+  void compileBody(FunctionObject *function,
+                   const std::vector<std::shared_ptr<Parameter>> &parameters,
+                   int frameSize,
+                   const std::vector<CapturedVariable> *captures,
+                   const Body &compileBodyStatements) {
+    function->Arity = static_cast<int>(parameters.size());
+    if (!states.empty()) {
+      function->Owner = function->Owner ? function->Owner
+                                        : current().Function->Owner;
+    }
+    pushFunction(function, frameSize, captures);
+    for (const auto &parameter : parameters) {
+      if (parameter->Binding.IsBoxed) {
+        emitABC(Opcode::NewCell, parameter->Binding.Slot, 0, 0);
+      }
+    }
+    compileBodyStatements();
+    emitABC(Opcode::Return, 0, 0, 0);
+    popFunction();
+    for (const FunctionObject *prototype : function->Prototypes) {
+      for (const CaptureDescriptor &captured : prototype->Captures) {
+        if (captured.ByReference && !captured.FromEnvironment) {
+          // A closure may still use the frame's registers
+          keepTailCallFrames(function);
+        }
+      }
+    }
+  }
+
+  // Turns the tail calls of a function whose frame must stay until the
+  // callee returns back into ordinary calls; the Return after each takes
+  // over
+  static void keepTailCallFrames(FunctionObject *function) {
+    for (uint32_t &instruction : function->Code) {
+      Opcode opcode = decodeOpcode(instruction);
+      if (opcode == Opcode::TailCall || opcode == Opcode::TailCallMethod) {
+        instruction = encodeABC(opcode == Opcode::TailCall
+                                    ? Opcode::Call
+                                    : Opcode::CallMethod,
+                                decodeA(instruction), decodeB(instruction),
+                                decodeC(instruction));
+      }
+    }
+  }
+
+  template <typename Closure, typename Body>
+  void compileClosure(const Closure &closure, int target,
+                      const Body &compileBodyStatements) {
+    FunctionObject *function = heap.allocate<FunctionObject>();
+    function->Name = current().Function->Name + ".<closure>";
+    for (const auto &captured : closure.Captures) {
+      CaptureDescriptor descriptor;
+      descriptor.FromEnvironment = captured.From.Capture >= 0;
+      descriptor.Index = descriptor.FromEnvironment ? captured.From.Capture
+                                                    : captured.From.Slot;
+      descriptor.ByReference = captured.ByReference;
+      function->Captures.push_back(descriptor);
+    }
+    compileBody(function, closure.Parameters, closure.FrameSize,
+                &closure.Captures, compileBodyStatements);
+    emitABx(Opcode::Closure, target, addPrototype(function));
+  }
+
+  // Statements
+
+  void compileStatements(const std::vector<std::shared_ptr<AstNode>> &body) {
+    for (const auto &statement : body) {
+      compileStatement(statement);
+    }
+  }
+
+  void compileStatement(const std::shared_ptr<AstNode> &node) {
+    if (!node) {
+      return;
+    }
+    int mark = currentRegister();
+    if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      compileVariableDeclaration(*var);
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      if (ret->ReturnValue) {
+        compileReturn(ret->ReturnValue);
+      } else {
+        emitABC(Opcode::Return, 0, 0, 0);
+      }
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      int skipThen =
+          emitJump(Opcode::JumpIfFalse, compileOperand(ifStmt->Condition));
+      freeRegisters(mark);
+      compileStatements(ifStmt->ThenBody);
+      if (ifStmt->ElseBody.empty()) {
+        patchJump(skipThen);
+      } else {
+        int skipElse = emitJump(Opcode::Jump, 0);
+        patchJump(skipThen);
+        compileStatements(ifStmt->ElseBody);
+        patchJump(skipElse);
+      }
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      int start = here();
+      int exit =
+          emitJump(Opcode::JumpIfFalse, compileOperand(whileStmt->Condition));
+      freeRegisters(mark);
+      compileStatements(whileStmt->Body);
+      emitJumpBack(start);
+      patchJump(exit);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      compileStatement(forStmt->Initializer);
+      int start = here();
+      int exit = -1;
+      if (forStmt->Condition) {
+        exit =
+            emitJump(Opcode::JumpIfFalse, compileOperand(forStmt->Condition));
+        freeRegisters(mark);
+      }
+      compileStatements(forStmt->Body);
+      compileStatement(forStmt->Increment);
+      emitJumpBack(start);
+      if (exit >= 0) {
+        patchJump(exit);
+      }
+    } else if (std::dynamic_pointer_cast<FunctionDeclaration>(node) ||
+               std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      error("Nested declarations are not supported");
+    } else if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      auto binary = std::dynamic_pointer_cast<BinaryExpression>(expr);
+      if (binary && binary->Op == BinaryOperator::Assign) {
+        compileAssignment(*binary, -1);
+      } else {
+        compileExpression(expr, allocateRegister());
+      }
+    }
+    freeRegisters(mark);
+  }
+
+  void compileVariableDeclaration(const VariableDeclaration &var) {
+    const VariableBinding &binding = var.Binding;
+    if (binding.Kind == LocalBinding) {
+      if (var.Value) {
+        compileExpression(var.Value, binding.Slot);
+      } else {
+        emitABC(Opcode::LoadNull, binding.Slot, 0, 0);
+      }
+      if (binding.IsBoxed) {
+        emitABC(Opcode::NewCell, binding.Slot, 0, 0);
+      }
+    } else if (binding.Kind == GlobalBinding && var.Value) {
+      emitABx(Opcode::SetGlobal, compileOperand(var.Value), binding.Slot);
+    }
+  }
+
+  // Expressions
+
+  // Returns a register holding the value, reusing the local's own register
+  // when the expression is a plain local it need not convert
+  int compileOperand(const std::shared_ptr<Expression> &expr) {
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      const VariableBinding &binding = var->Binding;
+      if (binding.Kind == LocalBinding && binding.Depth == 0 &&
+          !binding.IsBoxed && !var->ToDouble) {
+        return binding.Slot;
+      }
+    }
+    int reg = allocateRegister();
+    compileExpression(expr, reg);
+    return reg;
+  }
+
+  void compileExpression(const std::shared_ptr<Expression> &expr, int target) {
+    if (!expr) {
+      emitABC(Opcode::LoadNull, target, 0, 0);
+      return;
+    }
+    int mark = currentRegister();
+    if (auto literal = std::dynamic_pointer_cast<LiteralExpression>(expr)) {
+      compileLiteral(*literal, target, expr->ToDouble);
+    } else if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      compileLoad(var->Name, var->Binding, target);
+    } else if (auto binary =
+                   std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      compileBinary(*binary, target);
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      compileDotAccess(*dot, target);
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      compileCall(*call, target);
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(expr)) {
+      if (!current().Function->Async) {
+        error("'await' outside an async function");
+      }
+      emitABC(Opcode::Await, target, compileOperand(await->Operand), 0);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      compileClosure(*closure, target,
+                     [&]() { compileStatements(closure->Body); });
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      compileClosure(*lambda, target, [&]() {
+        // An expression body is the lambda's result
+        auto body = std::dynamic_pointer_cast<Expression>(lambda->Body);
+        auto binary = std::dynamic_pointer_cast<BinaryExpression>(body);
+        if (body && !(binary && binary->Op == BinaryOperator::Assign)) {
+          compileReturn(body);
+        } else {
+          compileStatement(lambda->Body);
+        }
+      });
+    } else {
+      error("Unsupported expression");
+    }
+    // Literals are converted as they are loaded
+    if (expr->ToDouble && !std::dynamic_pointer_cast<LiteralExpression>(expr)) {
+      emitABC(Opcode::ToDouble, target, target, 0);
+    }
+    freeRegisters(mark);
+  }
+
+  void compileLiteral(const LiteralExpression &literal, int target,
+                      bool toDouble = false) {
+    switch (literal.Kind) {
+    case IntegerLiteral:
+    case LongLiteral: {
+      long long value = std::strtoll(literal.Value.c_str(), nullptr, 10);
+      if (toDouble) {
+        emitABx(Opcode::LoadConstant, target,
+                addConstant(Value::number(static_cast<double>(value))));
+      } else if (value >= -MaxJumpOffset && value <= MaxJumpOffset) {
+        emit(encodeAsBx(Opcode::LoadInt, target, static_cast<int>(value)));
+      } else {
+        emitABx(Opcode::LoadConstant, target,
+                addConstant(heap.integer(value)));
+      }
+      break;
+    }
+    case FloatLiteral:
+    case DoubleLiteral:
+      emitABx(Opcode::LoadConstant, target,
+              addConstant(Value::number(
+                  std::strtod(literal.Value.c_str(), nullptr))));
+      break;
+    case BooleanLiteral:
+      emitABC(Opcode::LoadBool, target, literal.Value == "true", 0);
+      break;
+    default:
+      emitABx(Opcode::LoadConstant, target, addString(literal.Value));
+      break;
+    }
+  }
+
+  const CapturedVariable *capturedVariable(const VariableBinding &binding) {
+    const auto *captures = current().Captures;
+    if (!captures || binding.Capture < 0 ||
+        binding.Capture >= static_cast<int>(captures->size())) {
+      return nullptr;
+    }
+    return &(*captures)[binding.Capture];
+  }
+
+  void compileLoad(const std::string &name, const VariableBinding &binding,
+                   int target) {
+    switch (binding.Kind) {
+    case LocalBinding:
+      if (binding.Depth == 0) {
+        if (binding.IsBoxed) {
+          emitABC(Opcode::GetCell, target, binding.Slot, 0);
+        } else {
+          emitMove(target, binding.Slot);
+        }
+      } else if (const CapturedVariable *captured =
+                     capturedVariable(binding)) {
+        if (captured->ByReference) {
+          emitABC(Opcode::GetReference, target, binding.Capture, 0);
+        } else {
+          emitABC(Opcode::GetEnvironment, target, binding.Capture, 0);
+          if (binding.IsBoxed) {
+            emitABC(Opcode::GetCell, target, target, 0);
+          }
+        }
+      } else {
+        error("Cannot capture '" + name + "' across a named function");
+      }
+      break;
+    case GlobalBinding:
+      if (binding.Slot == thisGlobal) {
+        emitABC(Opcode::LoadThis, target, 0, 0);
+      } else {
+        emitABx(Opcode::GetGlobal, target, binding.Slot);
+      }
+      break;
+    case FieldBinding:
+      emitABC(Opcode::GetField, target, binding.Slot, 0);
+      break;
+    case MethodBinding:
+      emitABC(Opcode::LoadThis, target, 0, 0);
+      emitMember(Opcode::GetMember, target, target, addName(name));
+      break;
+    case UnresolvedBinding:
+      error("Unresolved name '" + name + "'");
+      break;
+    }
+  }
+
+  // Stores the value of the right side and, unless target is -1, also
+  // leaves it in target
+  void compileAssignment(const BinaryExpression &binary, int target) {
+    int mark = currentRegister();
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(binary.Left)) {
+      const VariableBinding &binding = var->Binding;
+      if (binding.Kind == LocalBinding && binding.Depth == 0 &&
+          !binding.IsBoxed) {
+        compileExpression(binary.Right, binding.Slot);
+        if (target >= 0) {
+          emitMove(target, binding.Slot);
+        }
+        freeRegisters(mark);
+        return;
+      }
+      int value = compileOperand(binary.Right);
+      compileStore(var->Name, binding, value);
+      if (target >= 0) {
+        emitMove(target, value);
+      }
+    } else if (auto dot =
+                   std::dynamic_pointer_cast<DotAccessExpression>(binary.Left)) {
+      auto member = std::dynamic_pointer_cast<VariableExpression>(dot->Right);
+      if (!member) {
+        error("Invalid assignment target");
+      } else {
+        int object = compileOperand(dot->Left);
+        int value = compileOperand(binary.Right);
+        emitMember(Opcode::SetMember, object, addName(member->Name), value);
+        if (target >= 0) {
+          emitMove(target, value);
+        }
+      }
+    } else {
+      error("Invalid assignment target");
+    }
+    freeRegisters(mark);
+  }
+
+  void compileStore(const std::string &name, const VariableBinding &binding,
+                    int value) {
+    switch (binding.Kind) {
+    case LocalBinding:
+      if (binding.Depth == 0) {
+        emitABC(Opcode::SetCell, binding.Slot, value, 0);
+      } else if (const CapturedVariable *captured =
+                     capturedVariable(binding)) {
+        if (captured->ByReference) {
+          emitABC(Opcode::SetReference, binding.Capture, value, 0);
+        } else if (binding.IsBoxed) {
+          int cell = allocateRegister();
+          emitABC(Opcode::GetEnvironment, cell, binding.Capture, 0);
+          emitABC(Opcode::SetCell, cell, value, 0);
+        } else {
+          error("Cannot assign to captured copy of '" + name + "'");
+        }
+      } else {
+        error("Cannot capture '" + name + "' across a named function");
+      }
+      break;
+    case GlobalBinding:
+      if (binding.Slot == thisGlobal || binding.Slot == superGlobal) {
+        error("Cannot assign to '" + name + "'");
+      } else {
+        emitABx(Opcode::SetGlobal, value, binding.Slot);
+      }
+      break;
+    case FieldBinding:
+      emitABC(Opcode::SetField, binding.Slot, value, 0);
+      break;
+    default:
+      error("Cannot assign to '" + name + "'");
+      break;
+    }
+  }
+
+  static Opcode arithmeticOpcode(BinaryOperator op) {
+    switch (op) {
+    case BinaryOperator::Add:
+      return Opcode::Add;
+    case BinaryOperator::Subtract:
+      return Opcode::Subtract;
+    case BinaryOperator::Multiply:
+      return Opcode::Multiply;
+    case BinaryOperator::Divide:
+      return Opcode::Divide;
+    case BinaryOperator::Modulo:
+      return Opcode::Modulo;
+    case BinaryOperator::Equal:
+      return Opcode::Equal;
+    case BinaryOperator::NotEqual:
+      return Opcode::NotEqual;
+    case BinaryOperator::Less:
+      return Opcode::Less;
+    case BinaryOperator::LessEqual:
+      return Opcode::LessEqual;
+    case BinaryOperator::Greater:
+      return Opcode::Greater;
+    default:
+      return Opcode::GreaterEqual;
+    }
+  }
+
+  // The form of opcode for operands the TypeChecker found to be of kind
+  static Opcode typedOpcode(Opcode opcode, TypeKind kind) {
+    bool ints = kind == TypeKind::Int || kind == TypeKind::Long;
+    bool doubles = kind == TypeKind::Float || kind == TypeKind::Double;
+    switch (opcode) {
+    case Opcode::Add:
+      return doubles ? Opcode::AddDouble : opcode;
+    case Opcode::Subtract:
+      return doubles ? Opcode::SubtractDouble : opcode;
+    case Opcode::Multiply:
+      return doubles ? Opcode::MultiplyDouble : opcode;
+    case Opcode::Divide:
+      return ints ? Opcode::DivideInt : doubles ? Opcode::DivideDouble : opcode;
+    case Opcode::Modulo:
+      return ints ? Opcode::ModuloInt : doubles ? Opcode::ModuloDouble : opcode;
+    case Opcode::Less:
+      return ints ? Opcode::LessInt : doubles ? Opcode::LessDouble : opcode;
+    case Opcode::LessEqual:
+      return ints      ? Opcode::LessEqualInt
+             : doubles ? Opcode::LessEqualDouble
+                       : opcode;
+    case Opcode::Greater:
+      return ints      ? Opcode::GreaterInt
+             : doubles ? Opcode::GreaterDouble
+                       : opcode;
+    case Opcode::GreaterEqual:
+      return ints      ? Opcode::GreaterEqualInt
+             : doubles ? Opcode::GreaterEqualDouble
+                       : opcode;
+    default:
+      return opcode;
+    }
+  }
+
+  void compileBinary(const BinaryExpression &binary, int target) {
+    if (binary.Op == BinaryOperator::Assign) {
+      compileAssignment(binary, target);
+    } else if (isLogical(binary.Op)) {
+      // The left value is the result when it decides the outcome
+      compileExpression(binary.Left, target);
+      int skip = emitJump(binary.Op == BinaryOperator::And ? Opcode::JumpIfFalse
+                                                           : Opcode::JumpIfTrue,
+                          target);
+      compileExpression(binary.Right, target);
+      patchJump(skip);
+    } else if (binary.Op == BinaryOperator::Unknown) {
+      error("Unknown operator '" + binary.Operator + "'");
+    } else if (!compileConcatenation(binary, target)) {
+      int left = compileOperand(binary.Left);
+      int right = compileOperand(binary.Right);
+      emitABC(typedOpcode(arithmeticOpcode(binary.Op), binary.OperandKind),
+              target, left, right);
+    }
+  }
+
+  // Builds the string of a chain like "a" + b + "c" with one Concat over
+  // its operands in consecutive registers. Returns false for a + that is
+  // not such a chain.
+  bool compileConcatenation(const BinaryExpression &binary, int target) {
+    std::vector<std::shared_ptr<Expression>> parts;
+    if (!concatenationParts(binary, parts) || parts.size() < 3) {
+      return false;
+    }
+    int mark = currentRegister();
+    int base = allocateRegister();
+    compileExpression(parts[0], base);
+    // A long chain goes on from the string so far every MaxConcatParts
+    // operands, which bounds the registers it takes
+    size_t next = 1;
+    while (next < parts.size()) {
+      size_t count = std::min(parts.size() - next, size_t(MaxConcatParts - 1));
+      for (size_t i = 0; i < count; i++) {
+        allocateRegister();
+      }
+      for (size_t i = 0; i < count; i++) {
+        compileExpression(parts[next + i], base + 1 + static_cast<int>(i));
+      }
+      next += count;
+      emitABC(Opcode::Concat, next == parts.size() ? target : base, base,
+              static_cast<int>(count) + 1);
+      freeRegisters(base + 1);
+    }
+    freeRegisters(mark);
+    return true;
+  }
+
+  // Reserves R[base] for the callee and evaluates the arguments into the
+  // registers after it. A target that is the newest temporary serves as
+  // base itself, which saves moving the result.
+  int compileArguments(const std::vector<std::shared_ptr<Expression>> &args,
+                       int target) {
+    int base = target == currentRegister() - 1 && target >= current().FrameSize
+                   ? target
+                   : allocateRegister();
+    for (size_t i = 0; i < args.size(); i++) {
+      allocateRegister();
+    }
+    if (args.size() > 0xFF) {
+      error("Too many arguments");
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+      compileExpression(args[i], base + 1 + static_cast<int>(i));
+    }
+    return base;
+  }
+
+  // Returns the value of expression. Calls of functions and methods are
+  // made tail calls, unless their result has to be converted.
+  void compileReturn(const std::shared_ptr<Expression> &expression) {
+    auto call = std::dynamic_pointer_cast<CallExpression>(expression);
+    if (call && !std::dynamic_pointer_cast<ConstructorCallExpression>(call) &&
+        !call->ToDouble) {
+      int result = allocateRegister();
+      compileCall(*call, result, true);
+      emitABC(Opcode::Return, result, 1, 0);
+    } else {
+      emitABC(Opcode::Return, compileOperand(expression), 1, 0);
+    }
+  }
+
+  void compileCall(const CallExpression &call, int target,
+                   bool tail = false) {
+    int argc = static_cast<int>(call.Arguments.size());
+    int base = compileArguments(call.Arguments, target);
+    const VariableBinding &binding = call.Binding;
+    if (dynamic_cast<const ConstructorCallExpression *>(&call)) {
+      compileLoad(call.FunctionName, binding, base);
+      emitABC(Opcode::New, base, argc, 0);
+    } else if (binding.Kind == GlobalBinding && binding.Slot == superGlobal) {
+      emitABC(Opcode::CallSuper, base, argc, addName("constructor"));
+    } else if (binding.Kind == MethodBinding && tail) {
+      emitABC(Opcode::TailCallMethod, base, argc, binding.Slot);
+    } else if (binding.Kind == MethodBinding) {
+      emitABC(call.DirectSlot >= 0 ? Opcode::CallFinal : Opcode::CallMethod,
+              base, argc, binding.Slot);
+    } else {
+      compileLoad(call.FunctionName, binding, base);
+      emitABC(tail ? Opcode::TailCall : Opcode::Call, base, argc, 0);
+    }
+    emitMove(target, base);
+  }
+
+  void compileDotAccess(const DotAccessExpression &dot, int target) {
+    if (auto call = std::dynamic_pointer_cast<CallExpression>(dot.Right)) {
+      int argc = static_cast<int>(call->Arguments.size());
+      int base = compileArguments(call->Arguments, target);
+      auto receiver = std::dynamic_pointer_cast<VariableExpression>(dot.Left);
+      if (receiver && receiver->Binding.Kind == GlobalBinding &&
+          receiver->Binding.Slot == superGlobal) {
+        emitABC(Opcode::CallSuper, base, argc, addName(call->FunctionName));
+      } else if (call->DirectSlot >= 0 && receiver &&
+                 receiver->Binding.Kind == GlobalBinding &&
+                 receiver->Binding.Slot == thisGlobal) {
+        emitABC(Opcode::CallFinal, base, argc, call->DirectSlot);
+      } else if (call->DirectSlot >= 0) {
+        compileExpression(dot.Left, base);
+        emitABC(Opcode::CallStatic, base, argc, call->DirectSlot);
+      } else {
+        compileExpression(dot.Left, base);
+        emitMember(Opcode::CallMember, base, argc, addName(call->FunctionName));
+      }
+      emitMove(target, base);
+    } else if (auto member =
+                   std::dynamic_pointer_cast<VariableExpression>(dot.Right)) {
+      int object = compileOperand(dot.Left);
+      emitMember(Opcode::GetMember, target, object, addName(member->Name));
+    } else {
+      error("Unsupported member access");
+    }
+  }
+};
+
+#endif // BYTECODE_COMPILER_H
@@ -3,6 +3,7 @@
 
 #include "expression.h"
 #include "type_reference.h"
+#include "variable_binding.h"
 #include <memory>
 #include <string>
 #include <vector>
@@ -12,6 +13,11 @@ public:
   std::string FunctionName;
   std::vector<std::shared_ptr<TypeReference>> GenericTypes;
   std::vector<std::shared_ptr<Expression>> Arguments;
+  VariableBinding Binding; // Binding of the callee
+  // Method table slot the ClassHierarchy bound the call to, of the class
+  // the call is in or of the class it is made on; -1 to dispatch on the
+  // receiver
+  int DirectSlot = -1;
 
   CallExpression(
       const std::string &functionName,
@@ -0,0 +1,29 @@
+#ifndef CELL_OBJECT_H
+#define CELL_OBJECT_H
+
+#include "heap_object.h"
+#include "tracer.h"
+#include "value.h"
+#include <new>
+
+// Box shared between a frame and the escaping closures that capture one of
+// its reassigned variables
+class CellObject : public HeapObject {
+public:
+  static const bool Movable = true;
+
+  Value Contents;
+
+  explicit CellObject(const Value &contents)
+      : HeapObject(ObjectKind::Cell), Contents(contents) {}
+
+  size_t size() const override { return sizeof(*this); }
+
+  void trace(Tracer &tracer) override { tracer.mark(Contents); }
+
+  HeapObject *moveTo(void *memory) override {
+    return new (memory) CellObject(Contents);
+  }
+};
+
+#endif // CELL_OBJECT_H
@@ -15,6 +15,8 @@ public:
   std::shared_ptr<TypeReference> BaseClass;
   std::vector<std::shared_ptr<TypeReference>> GenericTypes;
   std::vector<std::shared_ptr<AstNode>> Members;
+  std::vector<std::string> FieldNames;  // Field layout, base class first
+  std::vector<std::string> MethodNames; // Method table, base class first
 
   ClassDeclaration(
       const std::string &name, bool isStatic,
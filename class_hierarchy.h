@@ -0,0 +1,270 @@
+#ifndef CLASS_HIERARCHY_H
+#define CLASS_HIERARCHY_H
+
+#include "ast_node.h"
+#include "await_expression.h"
+#include "binary_expression.h"
+#include "call_expression.h"
+#include "class_declaration.h"
+#include "closure_expression.h"
+#include "dot_access_expression.h"
+#include "for_statement.h"
+#include "function_declaration.h"
+#include "if_statement.h"
+#include "lambda_expression.h"
+#include "package.h"
+#include "return_statement.h"
+#include "variable_binding.h"
+#include "variable_declaration.h"
+#include "variable_expression.h"
+#include "while_statement.h"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Class hierarchy analysis. The method tables the ScopeResolver lays out
+// give every method a fixed slot, shared with the methods overriding it,
+// and the whole hierarchy of a package is known once it is resolved. This
+// pass binds the calls whose callee that already decides, setting
+// CallExpression::DirectSlot:
+//
+// - Cls.name(...) on a class no code assigns over calls that class's own
+//   method, with the class as receiver, as static classes are used;
+// - name(...) and this.name(...) inside a class call the class's own
+//   method when no class derived from it overrides name.
+//
+// Evaluators then call the method straight out of the table instead of
+// dispatching on the receiver. Runs after the ScopeResolver.
+class ClassHierarchy {
+public:
+  void analyze(Package &package) {
+    directCalls = 0;
+    staticCalls = 0;
+    classes.clear();
+    derived.clear();
+    assigned.clear();
+    globals = &package.Globals;
+    thisGlobal = findGlobal("this");
+
+    for (const auto &member : package.Members) {
+      if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+        classes[cls->Name] = cls.get();
+      }
+    }
+    for (const auto &entry : classes) {
+      const ClassDeclaration *cls = entry.second;
+      if (cls->BaseClass && classes.count(cls->BaseClass->Name)) {
+        derived[cls->BaseClass->Name].push_back(cls);
+      }
+    }
+
+    // A package variable's initializer stores into its global too
+    for (const auto &member : package.Members) {
+      if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        if (var->Binding.Kind == GlobalBinding) {
+          assigned.insert(var->Binding.Slot);
+        }
+      }
+      visitNode(member, nullptr, &ClassHierarchy::findAssignments);
+    }
+    for (const auto &member : package.Members) {
+      visitNode(member, nullptr, &ClassHierarchy::bindCalls);
+    }
+    globals = nullptr;
+  }
+
+  // Calls bound to the method of the enclosing class
+  int getDirectCalls() const { return directCalls; }
+
+  // Calls bound to the method of a class named by the receiver
+  int getStaticCalls() const { return staticCalls; }
+
+private:
+  typedef void (ClassHierarchy::*Visitor)(Expression &expr,
+                                          const ClassDeclaration *owner);
+
+  int directCalls = 0;
+  int staticCalls = 0;
+  std::vector<std::string> *globals = nullptr;
+  int thisGlobal = -1;
+  std::unordered_map<std::string, ClassDeclaration *> classes;
+  std::unordered_map<std::string, std::vector<const ClassDeclaration *>>
+      derived;
+  std::unordered_set<int> assigned; // Globals stored into after creation
+
+  int findGlobal(const std::string &name) const {
+    auto found = std::find(globals->begin(), globals->end(), name);
+    return found == globals->end()
+               ? -1
+               : static_cast<int>(found - globals->begin());
+  }
+
+  static int findMethod(const ClassDeclaration &cls, const std::string &name) {
+    auto found =
+        std::find(cls.MethodNames.begin(), cls.MethodNames.end(), name);
+    return found == cls.MethodNames.end()
+               ? -1
+               : static_cast<int>(found - cls.MethodNames.begin());
+  }
+
+  static bool declaresMethod(const ClassDeclaration &cls,
+                             const std::string &name) {
+    for (const auto &member : cls.Members) {
+      auto func = std::dynamic_pointer_cast<FunctionDeclaration>(member);
+      if (func && func->Name == name) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Whether a class derived from cls, however indirectly, replaces name
+  bool isOverridden(const ClassDeclaration &cls,
+                    const std::string &name) const {
+    auto found = derived.find(cls.Name);
+    if (found == derived.end()) {
+      return false;
+    }
+    for (const ClassDeclaration *subclass : found->second) {
+      if (declaresMethod(*subclass, name) || isOverridden(*subclass, name)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The class a global holds for as long as the package runs, or null
+  ClassDeclaration *constantClass(const Expression &expr) const {
+    auto var = dynamic_cast<const VariableExpression *>(&expr);
+    if (!var || var->Binding.Kind != GlobalBinding ||
+        assigned.count(var->Binding.Slot)) {
+      return nullptr;
+    }
+    auto found = classes.find(var->Name);
+    return found == classes.end() || findGlobal(var->Name) != var->Binding.Slot
+               ? nullptr
+               : found->second;
+  }
+
+  void findAssignments(Expression &expr, const ClassDeclaration *) {
+    auto binary = dynamic_cast<BinaryExpression *>(&expr);
+    if (!binary || binary->Op != BinaryOperator::Assign) {
+      return;
+    }
+    auto target = std::dynamic_pointer_cast<VariableExpression>(binary->Left);
+    if (target && target->Binding.Kind == GlobalBinding) {
+      assigned.insert(target->Binding.Slot);
+    }
+  }
+
+  void bindCalls(Expression &expr, const ClassDeclaration *owner) {
+    if (auto call = dynamic_cast<CallExpression *>(&expr)) {
+      if (owner && call->Binding.Kind == MethodBinding &&
+          !isOverridden(*owner, call->FunctionName)) {
+        call->DirectSlot = call->Binding.Slot;
+        directCalls++;
+      }
+      return;
+    }
+    auto dot = dynamic_cast<DotAccessExpression *>(&expr);
+    auto call =
+        dot ? std::dynamic_pointer_cast<CallExpression>(dot->Right) : nullptr;
+    if (!call || !dot->Left) {
+      return;
+    }
+    auto receiver = std::dynamic_pointer_cast<VariableExpression>(dot->Left);
+    if (owner && receiver && receiver->Binding.Kind == GlobalBinding &&
+        receiver->Binding.Slot == thisGlobal) {
+      int slot = findMethod(*owner, call->FunctionName);
+      if (slot >= 0 && !isOverridden(*owner, call->FunctionName)) {
+        call->DirectSlot = slot;
+        directCalls++;
+      }
+    } else if (ClassDeclaration *cls = constantClass(*dot->Left)) {
+      int slot = findMethod(*cls, call->FunctionName);
+      if (slot >= 0) {
+        call->DirectSlot = slot;
+        staticCalls++;
+      }
+    }
+  }
+
+  // Walks the expressions under node, telling visitor which class each is
+  // in
+
+  void visitStatements(const std::vector<std::shared_ptr<AstNode>> &body,
+                       const ClassDeclaration *owner, Visitor visitor) {
+    for (const auto &statement : body) {
+      visitNode(statement, owner, visitor);
+    }
+  }
+
+  void visitNode(const std::shared_ptr<AstNode> &node,
+                 const ClassDeclaration *owner, Visitor visitor) {
+    if (!node) {
+      return;
+    }
+    if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      visitStatements(cls->Members, cls.get(), visitor);
+    } else if (auto func =
+                   std::dynamic_pointer_cast<FunctionDeclaration>(node)) {
+      visitStatements(func->Body, owner, visitor);
+    } else if (auto var =
+                   std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      visitExpression(var->Value, owner, visitor);
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      visitExpression(ret->ReturnValue, owner, visitor);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      visitExpression(ifStmt->Condition, owner, visitor);
+      visitStatements(ifStmt->ThenBody, owner, visitor);
+      visitStatements(ifStmt->ElseBody, owner, visitor);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      visitNode(forStmt->Initializer, owner, visitor);
+      visitExpression(forStmt->Condition, owner, visitor);
+      visitNode(forStmt->Increment, owner, visitor);
+      visitStatements(forStmt->Body, owner, visitor);
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      visitExpression(whileStmt->Condition, owner, visitor);
+      visitStatements(whileStmt->Body, owner, visitor);
+    } else if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      visitExpression(expr, owner, visitor);
+    }
+  }
+
+  void visitExpression(const std::shared_ptr<Expression> &expr,
+                       const ClassDeclaration *owner, Visitor visitor) {
+    if (!expr) {
+      return;
+    }
+    (this->*visitor)(*expr, owner);
+    if (auto binary = std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      visitExpression(binary->Left, owner, visitor);
+      visitExpression(binary->Right, owner, visitor);
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      visitExpression(dot->Left, owner, visitor);
+      if (auto call = std::dynamic_pointer_cast<CallExpression>(dot->Right)) {
+        for (const auto &argument : call->Arguments) {
+          visitExpression(argument, owner, visitor);
+        }
+      }
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      for (const auto &argument : call->Arguments) {
+        visitExpression(argument, owner, visitor);
+      }
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(expr)) {
+      visitExpression(await->Operand, owner, visitor);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      visitStatements(closure->Body, owner, visitor);
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      visitNode(lambda->Body, owner, visitor);
+    }
+  }
+};
+
+#endif // CLASS_HIERARCHY_H
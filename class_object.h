@@ -0,0 +1,66 @@
+#ifndef CLASS_OBJECT_H
+#define CLASS_OBJECT_H
+
+#include "heap_object.h"
+#include "shape.h"
+#include "tracer.h"
+#include "value.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Runtime class: field layout and method table in the order the
+// ScopeResolver assigned slots, base class entries first.
+class ClassObject : public HeapObject {
+public:
+  std::string Name;
+  ClassObject *Base = nullptr;
+  std::vector<std::string> FieldNames;
+  std::vector<std::string> MethodNames;
+  std::vector<Value> Methods;
+  Value Initializer; // Runs the field initializers declared by this class
+  Shape *InstanceLayout = nullptr; // Made on the first instantiation
+
+  explicit ClassObject(const std::string &name)
+      : HeapObject(ObjectKind::Class), Name(name) {}
+
+  int findField(const std::string &name) const {
+    auto found = fieldIndex.find(name);
+    return found == fieldIndex.end() ? -1 : found->second;
+  }
+
+  int findMethod(const std::string &name) const {
+    auto found = methodIndex.find(name);
+    return found == methodIndex.end() ? -1 : found->second;
+  }
+
+  // Rebuilds the name lookups after FieldNames or MethodNames change
+  void indexMembers() {
+    fieldIndex.clear();
+    methodIndex.clear();
+    for (size_t i = 0; i < FieldNames.size(); i++) {
+      fieldIndex[FieldNames[i]] = static_cast<int>(i);
+    }
+    for (size_t i = 0; i < MethodNames.size(); i++) {
+      methodIndex[MethodNames[i]] = static_cast<int>(i);
+    }
+  }
+
+  size_t size() const override {
+    return sizeof(*this) + Methods.capacity() * sizeof(Value) +
+           (FieldNames.size() + MethodNames.size()) * 2 * sizeof(std::string);
+  }
+
+  void trace(Tracer &tracer) override {
+    tracer.mark(Base);
+    tracer.mark(Methods.data(), Methods.size());
+    tracer.mark(Initializer);
+    tracer.mark(InstanceLayout);
+  }
+
+private:
+  std::unordered_map<std::string, int> fieldIndex;
+  std::unordered_map<std::string, int> methodIndex;
+};
+
+#endif // CLASS_OBJECT_H
@@ -0,0 +1,439 @@
+#ifndef CLOSURE_CONVERTER_H
+#define CLOSURE_CONVERTER_H
+
+#include "ast_node.h"
+#include "await_expression.h"
+#include "binary_expression.h"
+#include "call_expression.h"
+#include "class_declaration.h"
+#include "closure_expression.h"
+#include "dot_access_expression.h"
+#include "for_statement.h"
+#include "function_declaration.h"
+#include "if_statement.h"
+#include "lambda_expression.h"
+#include "package.h"
+#include "parameter.h"
+#include "return_statement.h"
+#include "variable_binding.h"
+#include "variable_declaration.h"
+#include "variable_expression.h"
+#include "while_statement.h"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Closure conversion. Gives every closure and lambda a flat environment
+// holding exactly the outer variables its body (or any closure nested in
+// it) refers to, and sets VariableBinding::Capture on those references.
+//
+// Escape analysis decides where environments live. A closure escapes
+// unless it is passed straight to a package function whose parameter is
+// only ever called or handed on to another such parameter, or it is kept
+// in a local with only those uses. Non-escaping environments can live on
+// the creator's stack and refer to its slots directly. Only variables that
+// are both captured by an escaping closure and assigned after their
+// declaration get boxed into a heap cell; everything else is copied.
+//
+// Runs after the ScopeResolver.
+class ClosureConverter {
+public:
+  void convert(Package &package) {
+    closures = 0;
+    stackEnvironments = 0;
+    boxedVariables = 0;
+    records.clear();
+    contexts.clear();
+
+    functions.clear();
+    for (const auto &member : package.Members) {
+      if (auto func = std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        auto global = std::find(package.Globals.begin(), package.Globals.end(),
+                                func->Name);
+        if (global != package.Globals.end()) {
+          functions[static_cast<int>(global - package.Globals.begin())] =
+              func.get();
+        }
+      }
+    }
+    analyzeParameters();
+
+    pushContext(nullptr, true, false, package.Members);
+    for (const auto &member : package.Members) {
+      visitNode(member);
+    }
+    popContext();
+    assignStorage();
+  }
+
+  int getClosures() const { return closures; }
+
+  int getStackEnvironments() const { return stackEnvironments; }
+
+  int getBoxedVariables() const { return boxedVariables; }
+
+private:
+  // One variable declaration and everything that refers to it
+  struct VariableRecord {
+    std::vector<VariableBinding *> Bindings;
+    std::vector<std::pair<std::vector<CapturedVariable> *, int>> Entries;
+    bool Assigned = false;           // Written after its declaration
+    bool CapturedByEscaping = false; // In the environment of an escaping closure
+  };
+
+  // A function frame being converted; named functions have no environment
+  struct Context {
+    std::vector<CapturedVariable> *Captures;
+    bool Escapes;
+    bool Async; // The frame moves to the heap while it awaits
+    std::vector<std::shared_ptr<AstNode>> Body;
+    std::unordered_map<int, int> Current;      // Slot -> record in scope
+    std::unordered_map<int, int> CaptureIndex; // Record -> environment index
+  };
+
+  int closures = 0;
+  int stackEnvironments = 0;
+  int boxedVariables = 0;
+  std::unordered_map<int, FunctionDeclaration *> functions; // By global slot
+  std::unordered_map<const FunctionDeclaration *, std::vector<bool>>
+      parameterEscapes;
+  std::vector<VariableRecord> records;
+  std::vector<Context> contexts;
+
+  // Escape analysis
+
+  bool isNonEscapingArgument(const CallExpression &call, size_t index) const {
+    if (call.Binding.Kind != GlobalBinding) {
+      return false;
+    }
+    auto func = functions.find(call.Binding.Slot);
+    if (func == functions.end()) {
+      return false;
+    }
+    auto escapes = parameterEscapes.find(func->second);
+    return escapes != parameterEscapes.end() &&
+           index < escapes->second.size() && !escapes->second[index];
+  }
+
+  static bool refersTo(const VariableBinding &binding, int slot, int depth) {
+    return binding.Kind == LocalBinding && binding.Depth == depth &&
+           binding.Slot == slot;
+  }
+
+  // Whether slot of the frame depth levels out may leak out of that frame
+  bool escapesIn(const std::shared_ptr<AstNode> &node, int slot,
+                 int depth) const {
+    if (!node) {
+      return false;
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(node)) {
+      // A bare reference anywhere else could store or return the value
+      return refersTo(var->Binding, slot, depth);
+    } else if (auto binary =
+                   std::dynamic_pointer_cast<BinaryExpression>(node)) {
+      return escapesIn(binary->Left, slot, depth) ||
+             escapesIn(binary->Right, slot, depth);
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(node)) {
+      return escapesIn(dot->Left, slot, depth) ||
+             escapesIn(dot->Right, slot, depth);
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+      // Calling the value is fine, unless a closure does it later
+      if (depth > 0 && refersTo(call->Binding, slot, depth)) {
+        return true;
+      }
+      for (size_t i = 0; i < call->Arguments.size(); i++) {
+        auto var =
+            std::dynamic_pointer_cast<VariableExpression>(call->Arguments[i]);
+        if (var && depth == 0 && refersTo(var->Binding, slot, depth) &&
+            isNonEscapingArgument(*call, i)) {
+          continue;
+        }
+        if (escapesIn(call->Arguments[i], slot, depth)) {
+          return true;
+        }
+      }
+      return false;
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(node)) {
+      return escapesIn(await->Operand, slot, depth);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(node)) {
+      return escapesIn(closure->Body, slot, depth + 1);
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(node)) {
+      return escapesIn(lambda->Body, slot, depth + 1);
+    } else if (auto var =
+                   std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      return escapesIn(var->Value, slot, depth);
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      return escapesIn(ret->ReturnValue, slot, depth);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      return escapesIn(ifStmt->Condition, slot, depth) ||
+             escapesIn(ifStmt->ThenBody, slot, depth) ||
+             escapesIn(ifStmt->ElseBody, slot, depth);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      return escapesIn(forStmt->Initializer, slot, depth) ||
+             escapesIn(forStmt->Condition, slot, depth) ||
+             escapesIn(forStmt->Increment, slot, depth) ||
+             escapesIn(forStmt->Body, slot, depth);
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      return escapesIn(whileStmt->Condition, slot, depth) ||
+             escapesIn(whileStmt->Body, slot, depth);
+    }
+    return false;
+  }
+
+  bool escapesIn(const std::vector<std::shared_ptr<AstNode>> &body, int slot,
+                 int depth) const {
+    for (const auto &node : body) {
+      if (escapesIn(node, slot, depth)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Starts from "no parameter escapes" and marks parameters until nothing
+  // changes, so mutually recursive helpers passing a callback along stay
+  // non-escaping. An async function runs after its caller has returned, so
+  // everything passed to one escapes.
+  void analyzeParameters() {
+    parameterEscapes.clear();
+    for (const auto &func : functions) {
+      parameterEscapes[func.second].assign(func.second->Parameters.size(),
+                                           func.second->Async);
+    }
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (const auto &func : functions) {
+        std::vector<bool> &escapes = parameterEscapes[func.second];
+        for (size_t i = 0; i < escapes.size(); i++) {
+          if (!escapes[i] &&
+              escapesIn(func.second->Body,
+                        func.second->Parameters[i]->Binding.Slot, 0)) {
+            escapes[i] = true;
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+
+  // Conversion
+
+  void pushContext(std::vector<CapturedVariable> *captures, bool escapes,
+                   bool async,
+                   const std::vector<std::shared_ptr<AstNode>> &body) {
+    contexts.push_back(Context{captures, escapes, async, body, {}, {}});
+  }
+
+  void popContext() { contexts.pop_back(); }
+
+  void declare(VariableBinding &binding) {
+    if (binding.Kind != LocalBinding) {
+      return;
+    }
+    records.push_back(VariableRecord());
+    records.back().Bindings.push_back(&binding);
+    contexts.back().Current[binding.Slot] =
+        static_cast<int>(records.size()) - 1;
+  }
+
+  int recordFor(int context, int slot) {
+    auto found = contexts[context].Current.find(slot);
+    if (found != contexts[context].Current.end()) {
+      return found->second;
+    }
+    records.push_back(VariableRecord());
+    contexts[context].Current[slot] = static_cast<int>(records.size()) - 1;
+    return static_cast<int>(records.size()) - 1;
+  }
+
+  // Adds the variable to the environment of context and of every closure
+  // between it and the defining frame. Returns its environment index.
+  int capture(int context, int defining, int record, const std::string &name,
+              int slot) {
+    Context &ctx = contexts[context];
+    if (!ctx.Captures) {
+      return -1;
+    }
+    auto found = ctx.CaptureIndex.find(record);
+    if (found != ctx.CaptureIndex.end()) {
+      return found->second;
+    }
+    CapturedVariable entry;
+    entry.Name = name;
+    entry.From.Kind = LocalBinding;
+    entry.From.Depth = context - 1 - defining;
+    entry.From.Slot = slot;
+    if (context - 1 > defining) {
+      entry.From.Capture = capture(context - 1, defining, record, name, slot);
+    }
+    int index = static_cast<int>(ctx.Captures->size());
+    ctx.Captures->push_back(entry);
+    ctx.CaptureIndex[record] = index;
+    records[record].Entries.push_back({ctx.Captures, index});
+    if (ctx.Escapes) {
+      records[record].CapturedByEscaping = true;
+    }
+    return index;
+  }
+
+  void reference(VariableBinding &binding, const std::string &name,
+                 bool assigned) {
+    if (binding.Kind != LocalBinding) {
+      return;
+    }
+    int current = static_cast<int>(contexts.size()) - 1;
+    int defining = current - binding.Depth;
+    if (defining < 0) {
+      return;
+    }
+    int record = recordFor(defining, binding.Slot);
+    records[record].Bindings.push_back(&binding);
+    if (assigned) {
+      records[record].Assigned = true;
+    }
+    binding.Capture = binding.Depth > 0
+                          ? capture(current, defining, record, name,
+                                    binding.Slot)
+                          : -1;
+  }
+
+  void visitFunction(FunctionDeclaration &func) {
+    pushContext(nullptr, true, func.Async, func.Body);
+    for (const auto &parameter : func.Parameters) {
+      declare(parameter->Binding);
+    }
+    visitStatements(func.Body);
+    popContext();
+  }
+
+  template <typename Closure>
+  void visitClosure(Closure &closure,
+                    const std::vector<std::shared_ptr<AstNode>> &body,
+                    bool escapes) {
+    // The slots of an async frame have no fixed place on the stack
+    escapes = escapes || contexts.back().Async;
+    closures++;
+    closure.Escapes = escapes;
+    if (!escapes) {
+      stackEnvironments++;
+    }
+    closure.Captures.clear();
+    pushContext(&closure.Captures, escapes, false, body);
+    for (const auto &parameter : closure.Parameters) {
+      declare(parameter->Binding);
+    }
+    visitStatements(body);
+    popContext();
+  }
+
+  void visitStatements(const std::vector<std::shared_ptr<AstNode>> &body) {
+    for (const auto &statement : body) {
+      visitNode(statement);
+    }
+  }
+
+  void visitNode(const std::shared_ptr<AstNode> &node) {
+    if (!node) {
+      return;
+    }
+    if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      for (const auto &member : cls->Members) {
+        visitNode(member);
+      }
+    } else if (auto func =
+                   std::dynamic_pointer_cast<FunctionDeclaration>(node)) {
+      visitFunction(*func);
+    } else if (auto var =
+                   std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      // A closure kept in a local escapes only if the local does
+      bool escapes = var->Binding.Kind != LocalBinding ||
+                     escapesIn(contexts.back().Body, var->Binding.Slot, 0);
+      visitExpression(var->Value, escapes);
+      declare(var->Binding);
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      visitExpression(ret->ReturnValue);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      visitExpression(ifStmt->Condition);
+      visitStatements(ifStmt->ThenBody);
+      visitStatements(ifStmt->ElseBody);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      visitNode(forStmt->Initializer);
+      visitExpression(forStmt->Condition);
+      visitNode(forStmt->Increment);
+      visitStatements(forStmt->Body);
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      visitExpression(whileStmt->Condition);
+      visitStatements(whileStmt->Body);
+    } else if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      visitExpression(expr);
+    }
+  }
+
+  void visitExpression(const std::shared_ptr<Expression> &expr,
+                       bool escapes = true) {
+    if (!expr) {
+      return;
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      reference(var->Binding, var->Name, false);
+    } else if (auto binary =
+                   std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      auto target = std::dynamic_pointer_cast<VariableExpression>(binary->Left);
+      if (binary->Op == BinaryOperator::Assign && target) {
+        reference(target->Binding, target->Name, true);
+      } else {
+        visitExpression(binary->Left);
+      }
+      visitExpression(binary->Right);
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      visitExpression(dot->Left);
+      if (auto call = std::dynamic_pointer_cast<CallExpression>(dot->Right)) {
+        for (const auto &argument : call->Arguments) {
+          visitExpression(argument);
+        }
+      }
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      reference(call->Binding, call->FunctionName, false);
+      for (size_t i = 0; i < call->Arguments.size(); i++) {
+        visitExpression(call->Arguments[i], !isNonEscapingArgument(*call, i));
+      }
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(expr)) {
+      visitExpression(await->Operand);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      visitClosure(*closure, closure->Body, escapes);
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      visitClosure(*lambda, {lambda->Body}, escapes);
+    }
+  }
+
+  void assignStorage() {
+    for (const auto &record : records) {
+      bool boxed = record.CapturedByEscaping && record.Assigned;
+      if (boxed) {
+        boxedVariables++;
+      }
+      for (VariableBinding *binding : record.Bindings) {
+        binding->IsBoxed = boxed;
+      }
+      // A variable nobody assigns can be copied; one only non-escaping
+      // closures see can be shared through a pointer into the frame
+      for (const auto &entry : record.Entries) {
+        CapturedVariable &captured = (*entry.first)[entry.second];
+        captured.From.IsBoxed = boxed;
+        captured.ByReference = !boxed && record.Assigned;
+      }
+    }
+  }
+};
+
+#endif // CLOSURE_CONVERTER_H
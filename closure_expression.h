@@ -5,6 +5,7 @@
 #include "expression.h"
 #include "parameter.h"
 #include "type_reference.h"
+#include "variable_binding.h"
 #include <memory>
 #include <string>
 #include <vector>
@@ -16,6 +17,9 @@ public:
   std::shared_ptr<TypeReference> ReturnType;
   std::vector<std::shared_ptr<AstNode>> Body;
   std::vector<std::shared_ptr<TypeReference>> GenericTypes;
+  int FrameSize = 0; // Slots needed by parameters and locals
+  std::vector<CapturedVariable> Captures; // Flat environment
+  bool Escapes = true; // Whether it may outlive the call that creates it
 
   ClosureExpression(
       const std::vector<std::shared_ptr<Parameter>> &parameters,
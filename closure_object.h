@@ -0,0 +1,41 @@
+#ifndef CLOSURE_OBJECT_H
+#define CLOSURE_OBJECT_H
+
+#include "function_object.h"
+#include "heap_object.h"
+#include "tracer.h"
+#include "value.h"
+#include <new>
+#include <utility>
+#include <vector>
+
+class ClosureObject : public HeapObject {
+public:
+  static const bool Movable = true;
+
+  FunctionObject *Function;
+  std::vector<Value> Environment; // Laid out by FunctionObject::Captures
+  Value Receiver; // this of the method that created the closure, if any
+
+  explicit ClosureObject(FunctionObject *function)
+      : HeapObject(ObjectKind::Closure), Function(function) {}
+
+  size_t size() const override {
+    return sizeof(*this) + Environment.capacity() * sizeof(Value);
+  }
+
+  void trace(Tracer &tracer) override {
+    tracer.mark(Function);
+    tracer.mark(Environment.data(), Environment.size());
+    tracer.mark(Receiver);
+  }
+
+  HeapObject *moveTo(void *memory) override {
+    auto *moved = new (memory) ClosureObject(Function);
+    moved->Environment = std::move(Environment);
+    moved->Receiver = Receiver;
+    return moved;
+  }
+};
+
+#endif // CLOSURE_OBJECT_H
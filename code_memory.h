@@ -0,0 +1,98 @@
+#ifndef CODE_MEMORY_H
+#define CODE_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Machine code needs an x86-64 Linux host; elsewhere, or in builds
+// defining SODA_NO_JIT, everything stays interpreted
+#if defined(__x86_64__) && defined(__linux__) && !defined(SODA_NO_JIT)
+#define SODA_JIT 1
+#else
+#define SODA_JIT 0
+#endif
+
+#if SODA_JIT
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Executable pages for generated code. Each install maps fresh pages,
+// writes them and only then makes them executable, so no page is ever
+// writable and executable at once. Optionally lists every installed
+// function in /tmp/perf-<pid>.map, where perf looks for symbols of JIT
+// code.
+class CodeMemory {
+public:
+  CodeMemory() = default;
+  CodeMemory(const CodeMemory &) = delete;
+  CodeMemory &operator=(const CodeMemory &) = delete;
+
+  ~CodeMemory() {
+#if SODA_JIT
+    for (const auto &region : regions) {
+      munmap(region.first, region.second);
+    }
+#endif
+    if (perfMap) {
+      std::fclose(perfMap);
+    }
+  }
+
+  void setPerfMap(bool enabled) {
+#if SODA_JIT
+    if (enabled && !perfMap) {
+      std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+      perfMap = std::fopen(path.c_str(), "a");
+    }
+#else
+    (void)enabled;
+#endif
+  }
+
+  // Returns the executable copy of code, or null if it cannot be mapped
+  const uint8_t *install(const std::vector<uint8_t> &code,
+                         const std::string &name) {
+#if SODA_JIT
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (code.size() + page - 1) / page * page;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+      return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(memory, size);
+      return nullptr;
+    }
+    regions.push_back({memory, size});
+    bytesInstalled += code.size();
+    if (perfMap) {
+      std::fprintf(perfMap, "%lx %zx soda:%s\n",
+                   reinterpret_cast<unsigned long>(memory), code.size(),
+                   name.c_str());
+      std::fflush(perfMap);
+    }
+    return static_cast<const uint8_t *>(memory);
+#else
+    (void)code;
+    (void)name;
+    return nullptr;
+#endif
+  }
+
+  size_t getBytesInstalled() const { return bytesInstalled; }
+
+private:
+  std::vector<std::pair<void *, size_t>> regions;
+  size_t bytesInstalled = 0;
+  std::FILE *perfMap = nullptr;
+};
+
+#endif // CODE_MEMORY_H
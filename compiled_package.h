@@ -0,0 +1,16 @@
+#ifndef COMPILED_PACKAGE_H
+#define COMPILED_PACKAGE_H
+
+#include "function_object.h"
+#include <string>
+#include <vector>
+
+// Output of the BytecodeCompiler for one package
+struct CompiledPackage {
+  std::string Name;
+  std::vector<std::string> Globals; // Names behind GlobalBinding slots
+  FunctionObject *Initializer = nullptr; // Defines the members, then runs
+                                         // the top-level code in order
+};
+
+#endif // COMPILED_PACKAGE_H
@@ -0,0 +1,41 @@
+#ifndef CONCATENATION_CHAIN_H
+#define CONCATENATION_CHAIN_H
+
+#include "binary_expression.h"
+#include "expression.h"
+#include "literal_expression.h"
+#include <memory>
+#include <vector>
+
+// Whether expr is known to be a string before it runs
+inline bool isStringOperand(const Expression &expr) {
+  auto literal = dynamic_cast<const LiteralExpression *>(&expr);
+  return (literal && literal->Kind == StringLiteral) ||
+         expr.StaticType.Kind == TypeKind::String;
+}
+
+// Collects the operands of a left-deep chain of + that is known to build a
+// string, like "a" + b + c: every + in it has a string on one side, so each
+// concatenates. The operands left of the first known string stay as one
+// expression, since they may add numbers. Returns false when binary itself
+// is not known to concatenate, leaving parts empty.
+inline bool
+concatenationParts(const BinaryExpression &binary,
+                   std::vector<std::shared_ptr<Expression>> &parts) {
+  if (binary.Op != BinaryOperator::Add) {
+    return false;
+  }
+  auto left = std::dynamic_pointer_cast<BinaryExpression>(binary.Left);
+  if (left && concatenationParts(*left, parts)) {
+    parts.push_back(binary.Right);
+    return true;
+  }
+  if (isStringOperand(*binary.Left) || isStringOperand(*binary.Right)) {
+    parts.push_back(binary.Left);
+    parts.push_back(binary.Right);
+    return true;
+  }
+  return false;
+}
+
+#endif // CONCATENATION_CHAIN_H
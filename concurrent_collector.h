@@ -0,0 +1,294 @@
+#ifndef CONCURRENT_COLLECTOR_H
+#define CONCURRENT_COLLECTOR_H
+
+#include "heap_object.h"
+#include "tracer.h"
+#include "value.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// The parts of a major collection that run on background threads beside
+// the mutator: marking the old generation, and sweeping what marking did
+// not reach.
+//
+// Marking keeps to the snapshot at the beginning. The Heap marks the roots
+// in a short pause, and before the first store into an old object while
+// marking runs, its write barrier traces the object through snapshot. So
+// every object reachable when marking began is reached even if the program
+// drops the reference, and objects allocated since are marked when made.
+// Threads take an object to trace through its Scan state, so no object is
+// read while another thread traces or changes it.
+class ConcurrentCollector {
+public:
+  // What the first round of marking finds roots in, which takes too long
+  // to do in the pause that starts it
+  struct Roots {
+    HeapObject *Objects = nullptr; // The old generation when marking began
+    std::vector<uint64_t> Words; // Copied from the native stack, taken for
+                                 // references where they could be ones
+  };
+
+  // The list sweeping kept, and what it left for the mutator
+  struct Swept {
+    HeapObject *Head = nullptr;
+    HeapObject *Tail = nullptr;
+    std::vector<HeapObject *> InBlocks; // Unreached objects in nursery
+                                        // blocks, which the Heap frees
+    size_t Freed = 0; // InBlocks included
+  };
+
+  ConcurrentCollector(uint8_t epoch, int threads)
+      : epoch(epoch), threadCount(std::max(threads, 1)) {}
+
+  ConcurrentCollector(const ConcurrentCollector &) = delete;
+  ConcurrentCollector &operator=(const ConcurrentCollector &) = delete;
+
+  ~ConcurrentCollector() { join(); }
+
+  // Starts a round of marking from gray, objects marked but not traced
+  void mark(std::vector<HeapObject *> gray) { mark(std::move(gray), Roots()); }
+
+  // The first round, which also marks from roots
+  void mark(std::vector<HeapObject *> gray, Roots roots) {
+    start();
+    queue = std::move(gray);
+    seed = std::move(roots);
+    for (int i = 0; i < threadCount; i++) {
+      threads.emplace_back([this, i] { work(i == 0); });
+    }
+  }
+
+  // Hands gray to the round running, unless it has finished
+  bool offer(std::vector<HeapObject *> &gray) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (finished) {
+      return false;
+    }
+    queue.insert(queue.end(), gray.begin(), gray.end());
+    gray.clear();
+    ready.notify_all();
+    return true;
+  }
+
+  // Traces object before the mutator changes it, if marking has not
+  // already, adding what that marks to gray
+  void snapshot(HeapObject *object, std::vector<HeapObject *> &gray) {
+    Marker marker(*this);
+    marker.scan(object);
+    marker.finish(gray);
+  }
+
+  // Frees the objects in the list from head that marking did not reach,
+  // and unmarks the rest
+  void sweep(HeapObject *head) {
+    start();
+    threads.emplace_back([this, head] {
+      HeapObject **link = &swept.Head;
+      for (HeapObject *object = head; object;) {
+        HeapObject *next = object->Next;
+        if (object->Mark.load(std::memory_order_relaxed) == epoch) {
+          object->Mark.store(0, std::memory_order_relaxed);
+          object->lock();
+          object->unlock(0);
+          *link = object;
+          link = &object->Next;
+          swept.Tail = object;
+        } else {
+          if (object->InBlock) {
+            swept.InBlocks.push_back(object);
+          } else {
+            delete object;
+          }
+          swept.Freed++;
+        }
+        object = next;
+      }
+      *link = nullptr;
+      done.store(true, std::memory_order_release);
+    });
+  }
+
+  // Whether the work started last has finished, so join returns at once
+  bool isDone() const { return done.load(std::memory_order_acquire); }
+
+  void join() {
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    threads.clear();
+  }
+
+  // What the objects marking traced take
+  size_t getMarkedBytes() const { return markedBytes.load(); }
+
+  Swept &getSwept() { return swept; }
+
+  // The object of addresses, which are sorted, that bits points into
+  static HeapObject *find(const std::vector<HeapObject *> &addresses,
+                          uint64_t bits) {
+    uintptr_t address = static_cast<uintptr_t>(bits);
+    if (addresses.empty() ||
+        address < reinterpret_cast<uintptr_t>(addresses.front())) {
+      return nullptr;
+    }
+    auto after = std::upper_bound(
+        addresses.begin(), addresses.end(), address,
+        [](uintptr_t address, const HeapObject *object) {
+          return address < reinterpret_cast<uintptr_t>(object);
+        });
+    HeapObject *object = *(after - 1);
+    return address < reinterpret_cast<uintptr_t>(object) + object->Extent
+               ? object
+               : nullptr;
+  }
+
+private:
+  static const size_t BatchSize = 64;
+
+  // Marks for one thread, tracing the objects it claims
+  class Marker : public Tracer {
+  public:
+    explicit Marker(ConcurrentCollector &collector) : collector(collector) {}
+
+    // Traces object unless another thread has this marking
+    void scan(HeapObject *object) {
+      uint8_t state = object->lock();
+      if (state == collector.epoch) {
+        object->unlock(state);
+        return;
+      }
+      object->trace(*this);
+      bytes += object->size();
+      object->unlock(collector.epoch);
+    }
+
+    // Traces everything pending, giving some to threads waiting for work
+    void run() {
+      size_t traced = 0;
+      while (!pending.empty()) {
+        HeapObject *object = pending.back();
+        pending.pop_back();
+        scan(object);
+        if (++traced % BatchSize == 0 && collector.threadCount > 1) {
+          collector.share(pending);
+        }
+      }
+    }
+
+    void take(std::vector<HeapObject *> &objects) {
+      pending.insert(pending.end(), objects.begin(), objects.end());
+    }
+
+    void finish(std::vector<HeapObject *> &gray) {
+      gray.insert(gray.end(), pending.begin(), pending.end());
+      pending.clear();
+      collector.markedBytes += bytes;
+      bytes = 0;
+    }
+
+  protected:
+    HeapObject *visit(HeapObject *object) override {
+      if (object->Mark.load(std::memory_order_relaxed) != collector.epoch &&
+          object->Mark.exchange(collector.epoch) != collector.epoch) {
+        pending.push_back(object);
+      }
+      return object;
+    }
+
+  private:
+    ConcurrentCollector &collector;
+    size_t bytes = 0;
+  };
+
+  const uint8_t epoch;
+  const int threadCount;
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::vector<HeapObject *> queue; // Marked objects for any thread to trace
+  int idle = 0;
+  bool finished = false; // Every thread ran out of work
+  std::atomic<bool> done{false};
+  std::atomic<size_t> markedBytes{0};
+  Roots seed;
+  Swept swept;
+
+  void start() {
+    join();
+    idle = 0;
+    finished = false;
+    done.store(false);
+  }
+
+  void work(bool seeding) {
+    Marker marker(*this);
+    if (seeding) {
+      findRoots(marker);
+    }
+    std::vector<HeapObject *> batch;
+    for (;;) {
+      marker.run();
+      marker.finish(batch);
+      std::unique_lock<std::mutex> lock(mutex);
+      idle++;
+      if (idle == threadCount && queue.empty()) {
+        finished = true;
+        ready.notify_all();
+      }
+      ready.wait(lock, [this] { return finished || !queue.empty(); });
+      if (finished) {
+        // The last thread out reports the round done
+        if (--idle == 0) {
+          done.store(true, std::memory_order_release);
+        }
+        return;
+      }
+      idle--;
+      size_t count = std::min(queue.size(), size_t(BatchSize));
+      batch.assign(queue.end() - count, queue.end());
+      queue.resize(queue.size() - count);
+      lock.unlock();
+      marker.take(batch);
+    }
+  }
+
+  // The objects with a reference count, and those the native stack may
+  // refer to
+  void findRoots(Marker &marker) {
+    std::vector<HeapObject *> addresses;
+    for (HeapObject *object = seed.Objects; object; object = object->Next) {
+      addresses.push_back(object);
+      if (object->getRefCount() > 0) {
+        marker.mark(object);
+      }
+    }
+    std::sort(addresses.begin(), addresses.end());
+    for (uint64_t word : seed.Words) {
+      marker.mark(find(addresses, word));
+      // The payload, in case the word is a Value
+      marker.mark(find(addresses, word & Value::PayloadMask));
+    }
+    seed = Roots();
+  }
+
+  // Moves half of pending to the queue if a thread is waiting for work
+  void share(std::vector<HeapObject *> &pending) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (idle == 0 || !queue.empty() || pending.size() < 2) {
+      return;
+    }
+    size_t half = pending.size() / 2;
+    queue.assign(pending.end() - half, pending.end());
+    pending.resize(pending.size() - half);
+    ready.notify_all();
+  }
+};
+
+#endif // CONCURRENT_COLLECTOR_H
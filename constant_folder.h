@@ -0,0 +1,682 @@
+#ifndef CONSTANT_FOLDER_H
+#define CONSTANT_FOLDER_H
+
+#include "ast_node.h"
+#include "await_expression.h"
+#include "binary_expression.h"
+#include "call_expression.h"
+#include "class_declaration.h"
+#include "closure_expression.h"
+#include "dot_access_expression.h"
+#include "for_statement.h"
+#include "function_declaration.h"
+#include "if_statement.h"
+#include "lambda_expression.h"
+#include "literal_expression.h"
+#include "package.h"
+#include "return_statement.h"
+#include "variable_declaration.h"
+#include "variable_expression.h"
+#include "while_statement.h"
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Folds literal arithmetic, comparisons and string concatenation, propagates
+// constants through locals that are never reassigned, removes unreachable
+// if/while branches and code after return, and drops unused local
+// declarations whose initializer has no side effects. Runs after the
+// ScopeResolver, since locals are tracked by frame slot; running the
+// TypeChecker first lets more expressions be treated as pure.
+class ConstantFolder {
+public:
+  void optimize(Package &package) {
+    foldedExpressions = 0;
+    removedStatements = 0;
+    constants.clear();
+    // Top-level variables are globals and stay, but blocks at package level
+    // allocate locals in the package initializer frame like any function.
+    optimizeFrame(package.Members, package.FrameSize);
+  }
+
+  int getFoldedExpressions() const { return foldedExpressions; }
+
+  int getRemovedStatements() const { return removedStatements; }
+
+private:
+  struct SlotUsage {
+    std::vector<int> Reads;
+    std::vector<int> Writes;
+  };
+
+  int foldedExpressions = 0;
+  int removedStatements = 0;
+  // Known constant value of each local slot, one map per function frame
+  std::vector<std::unordered_map<int, std::shared_ptr<LiteralExpression>>>
+      constants;
+  std::vector<SlotUsage> usages;
+
+  // Usage analysis
+
+  static void countSlot(std::vector<int> &counts, int slot) {
+    if (slot < 0) {
+      return;
+    }
+    if (slot >= static_cast<int>(counts.size())) {
+      counts.resize(slot + 1, 0);
+    }
+    counts[slot]++;
+  }
+
+  static int slotCount(const std::vector<int> &counts, int slot) {
+    return slot >= 0 && slot < static_cast<int>(counts.size()) ? counts[slot]
+                                                               : 0;
+  }
+
+  // Records reads and writes of the slots of one frame. depth counts the
+  // function literals between node and the frame being analyzed.
+  static void collectUsage(const std::shared_ptr<AstNode> &node, int depth,
+                           SlotUsage &usage) {
+    if (!node) {
+      return;
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(node)) {
+      if (var->Binding.Kind == LocalBinding && var->Binding.Depth == depth) {
+        countSlot(usage.Reads, var->Binding.Slot);
+      }
+    } else if (auto binary =
+                   std::dynamic_pointer_cast<BinaryExpression>(node)) {
+      auto target = std::dynamic_pointer_cast<VariableExpression>(binary->Left);
+      if (binary->Op == BinaryOperator::Assign && target) {
+        if (target->Binding.Kind == LocalBinding &&
+            target->Binding.Depth == depth) {
+          countSlot(usage.Writes, target->Binding.Slot);
+        }
+      } else {
+        collectUsage(binary->Left, depth, usage);
+      }
+      collectUsage(binary->Right, depth, usage);
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(node)) {
+      collectUsage(dot->Left, depth, usage);
+      if (auto call = std::dynamic_pointer_cast<CallExpression>(dot->Right)) {
+        collectUsageList(call->Arguments, depth, usage);
+      }
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+      if (call->Binding.Kind == LocalBinding && call->Binding.Depth == depth) {
+        countSlot(usage.Reads, call->Binding.Slot);
+      }
+      collectUsageList(call->Arguments, depth, usage);
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(node)) {
+      collectUsage(await->Operand, depth, usage);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(node)) {
+      collectUsageList(closure->Body, depth + 1, usage);
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(node)) {
+      collectUsage(lambda->Body, depth + 1, usage);
+    } else if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      collectUsage(var->Value, depth, usage);
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      collectUsage(ret->ReturnValue, depth, usage);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      collectUsage(ifStmt->Condition, depth, usage);
+      collectUsageList(ifStmt->ThenBody, depth, usage);
+      collectUsageList(ifStmt->ElseBody, depth, usage);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      collectUsage(forStmt->Initializer, depth, usage);
+      collectUsage(forStmt->Condition, depth, usage);
+      collectUsage(forStmt->Increment, depth, usage);
+      collectUsageList(forStmt->Body, depth, usage);
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      collectUsage(whileStmt->Condition, depth, usage);
+      collectUsageList(whileStmt->Body, depth, usage);
+    }
+  }
+
+  template <typename Node>
+  static void collectUsageList(const std::vector<std::shared_ptr<Node>> &nodes,
+                               int depth, SlotUsage &usage) {
+    for (const auto &node : nodes) {
+      collectUsage(node, depth, usage);
+    }
+  }
+
+  // Whether evaluating expr can be skipped without changing behaviour
+  static bool isPure(const std::shared_ptr<Expression> &expr) {
+    if (!expr || std::dynamic_pointer_cast<LiteralExpression>(expr) ||
+        std::dynamic_pointer_cast<VariableExpression>(expr) ||
+        std::dynamic_pointer_cast<ClosureExpression>(expr) ||
+        std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      return true;
+    }
+    if (auto binary = std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      // Statically typed operators cannot call into user code; integer
+      // division can still trap on zero.
+      bool integer = binary->OperandKind == TypeKind::Int ||
+                     binary->OperandKind == TypeKind::Long;
+      bool traps = integer && (binary->Op == BinaryOperator::Divide ||
+                               binary->Op == BinaryOperator::Modulo);
+      return binary->Op != BinaryOperator::Assign &&
+             binary->OperandKind != TypeKind::Any && !traps &&
+             isPure(binary->Left) && isPure(binary->Right);
+    }
+    return false;
+  }
+
+  // Frames and statements
+
+  void optimizeFrame(std::vector<std::shared_ptr<AstNode>> &body,
+                     int frameSize) {
+    SlotUsage usage;
+    collectUsageList(body, 0, usage);
+    usage.Reads.resize(frameSize, 0);
+    usage.Writes.resize(frameSize, 0);
+    usages.push_back(usage);
+    constants.emplace_back();
+    optimizeBody(body);
+    constants.pop_back();
+    usages.pop_back();
+
+    // Propagation may have removed the last reads of some locals
+    SlotUsage remaining;
+    collectUsageList(body, 0, remaining);
+    removeDeadDeclarations(body, remaining);
+  }
+
+  void removeDeadDeclarations(std::vector<std::shared_ptr<AstNode>> &body,
+                              const SlotUsage &usage) {
+    std::vector<std::shared_ptr<AstNode>> result;
+    for (const auto &node : body) {
+      if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+        int slot = var->Binding.Slot;
+        if (var->Binding.Kind == LocalBinding &&
+            slotCount(usage.Reads, slot) == 0 &&
+            slotCount(usage.Writes, slot) == 0 && isPure(var->Value)) {
+          removedStatements++;
+          continue;
+        }
+      } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+        removeDeadDeclarations(ifStmt->ThenBody, usage);
+        removeDeadDeclarations(ifStmt->ElseBody, usage);
+      } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+        removeDeadDeclarations(forStmt->Body, usage);
+      } else if (auto whileStmt =
+                     std::dynamic_pointer_cast<WhileStatement>(node)) {
+        removeDeadDeclarations(whileStmt->Body, usage);
+      }
+      result.push_back(node);
+    }
+    body = result;
+  }
+
+  void optimizeBody(std::vector<std::shared_ptr<AstNode>> &body) {
+    std::vector<std::shared_ptr<AstNode>> result;
+    for (auto &node : body) {
+      if (!node) {
+        continue;
+      }
+      if (!optimizeStatement(node, result)) {
+        removedStatements++;
+      }
+      // Nothing after a return can run
+      if (!result.empty() &&
+          std::dynamic_pointer_cast<ReturnStatement>(result.back()) &&
+          &node != &body.back()) {
+        removedStatements += static_cast<int>(&body.back() - &node);
+        break;
+      }
+    }
+    body = result;
+  }
+
+  // Appends the optimized statement (or its replacement statements) to out.
+  // Returns false if the statement was dropped entirely.
+  bool optimizeStatement(std::shared_ptr<AstNode> &node,
+                         std::vector<std::shared_ptr<AstNode>> &out) {
+    if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      for (auto &member : cls->Members) {
+        if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+          var->Value = foldExpression(var->Value);
+        } else {
+          std::vector<std::shared_ptr<AstNode>> ignored;
+          optimizeStatement(member, ignored);
+        }
+      }
+    } else if (auto func =
+                   std::dynamic_pointer_cast<FunctionDeclaration>(node)) {
+      optimizeFrame(func->Body, func->FrameSize);
+    } else if (auto var =
+                   std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      var->Value = foldExpression(var->Value);
+      // Globals and fields can be written from anywhere, so they stay
+      if (var->Binding.Kind != LocalBinding) {
+        out.push_back(node);
+        return true;
+      }
+      int slot = var->Binding.Slot;
+      const SlotUsage &usage = usages.back();
+      auto literal = std::dynamic_pointer_cast<LiteralExpression>(var->Value);
+      if (literal && slotCount(usage.Writes, slot) == 0) {
+        constants.back()[slot] = literal;
+      } else {
+        constants.back().erase(slot);
+      }
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      ret->ReturnValue = foldExpression(ret->ReturnValue);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      return optimizeIf(ifStmt, out);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      std::vector<std::shared_ptr<AstNode>> initializer;
+      if (forStmt->Initializer &&
+          optimizeStatement(forStmt->Initializer, initializer)) {
+        forStmt->Initializer = initializer.empty() ? nullptr : initializer[0];
+      } else {
+        forStmt->Initializer = nullptr;
+      }
+      forStmt->Condition = foldExpression(forStmt->Condition);
+      if (auto increment =
+              std::dynamic_pointer_cast<Expression>(forStmt->Increment)) {
+        forStmt->Increment = foldExpression(increment);
+      }
+      optimizeBody(forStmt->Body);
+      if (isFalse(forStmt->Condition)) {
+        // The body never runs but the initializer still does
+        if (forStmt->Initializer) {
+          out.push_back(forStmt->Initializer);
+        }
+        return false;
+      }
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      whileStmt->Condition = foldExpression(whileStmt->Condition);
+      if (isFalse(whileStmt->Condition)) {
+        return false;
+      }
+      optimizeBody(whileStmt->Body);
+    } else if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      auto folded = foldExpression(expr);
+      // A statement that only computes a value nobody reads is dead
+      if (isPure(folded)) {
+        return false;
+      }
+      node = folded;
+    }
+    out.push_back(node);
+    return true;
+  }
+
+  bool optimizeIf(const std::shared_ptr<IfStatement> &ifStmt,
+                  std::vector<std::shared_ptr<AstNode>> &out) {
+    ifStmt->Condition = foldExpression(ifStmt->Condition);
+    auto condition =
+        std::dynamic_pointer_cast<LiteralExpression>(ifStmt->Condition);
+    if (!condition || condition->Kind != BooleanLiteral) {
+      optimizeBody(ifStmt->ThenBody);
+      optimizeBody(ifStmt->ElseBody);
+      out.push_back(ifStmt);
+      return true;
+    }
+
+    bool taken = condition->Value == "true";
+    auto &live = taken ? ifStmt->ThenBody : ifStmt->ElseBody;
+    auto &dead = taken ? ifStmt->ElseBody : ifStmt->ThenBody;
+    removedStatements += static_cast<int>(dead.size());
+    dead.clear();
+    optimizeBody(live);
+    if (live.empty()) {
+      return false;
+    }
+
+    // Declarations keep their block so the scoping the resolver saw stays
+    // intact; anything else can be spliced straight into the parent.
+    for (const auto &statement : live) {
+      if (std::dynamic_pointer_cast<VariableDeclaration>(statement)) {
+        if (!taken) {
+          ifStmt->ThenBody.swap(ifStmt->ElseBody);
+          ifStmt->Condition = makeLiteral("true", BooleanLiteral,
+                                          TypeKind::Bool);
+        }
+        out.push_back(ifStmt);
+        return true;
+      }
+    }
+    out.insert(out.end(), live.begin(), live.end());
+    return true;
+  }
+
+  static bool isFalse(const std::shared_ptr<Expression> &expr) {
+    auto literal = std::dynamic_pointer_cast<LiteralExpression>(expr);
+    return literal && literal->Kind == BooleanLiteral &&
+           literal->Value == "false";
+  }
+
+  // Expressions
+
+  std::shared_ptr<Expression>
+  foldExpression(const std::shared_ptr<Expression> &expr) {
+    if (!expr) {
+      return expr;
+    }
+    auto folded = foldValue(expr);
+    if (!expr->ToDouble) {
+      return folded;
+    }
+    // Stored where a Float or Double is declared, so an integer literal
+    // becomes a double one, also for the locals it is propagated into
+    auto literal = std::dynamic_pointer_cast<LiteralExpression>(folded);
+    if (literal && isInteger(*literal)) {
+      long long value = std::strtoll(literal->Value.c_str(), nullptr, 10);
+      return makeLiteral(formatDouble(static_cast<double>(value)),
+                         DoubleLiteral, TypeKind::Double);
+    }
+    folded->ToDouble = true;
+    return folded;
+  }
+
+  std::shared_ptr<Expression>
+  foldValue(const std::shared_ptr<Expression> &expr) {
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      return propagate(var);
+    } else if (auto binary =
+                   std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      if (binary->Op != BinaryOperator::Assign) {
+        binary->Left = foldExpression(binary->Left);
+      }
+      binary->Right = foldExpression(binary->Right);
+      auto folded = foldBinary(*binary);
+      if (folded) {
+        foldedExpressions++;
+        return folded;
+      }
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      dot->Left = foldExpression(dot->Left);
+      if (auto call = std::dynamic_pointer_cast<CallExpression>(dot->Right)) {
+        foldArguments(call->Arguments);
+      }
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      foldArguments(call->Arguments);
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(expr)) {
+      await->Operand = foldExpression(await->Operand);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      optimizeFrame(closure->Body, closure->FrameSize);
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      if (auto body = std::dynamic_pointer_cast<Expression>(lambda->Body)) {
+        SlotUsage usage;
+        collectUsage(body, 0, usage);
+        usages.push_back(usage);
+        constants.emplace_back();
+        lambda->Body = foldExpression(body);
+        constants.pop_back();
+        usages.pop_back();
+      }
+    }
+    return expr;
+  }
+
+  void foldArguments(std::vector<std::shared_ptr<Expression>> &arguments) {
+    for (auto &argument : arguments) {
+      argument = foldExpression(argument);
+    }
+  }
+
+  std::shared_ptr<Expression>
+  propagate(const std::shared_ptr<VariableExpression> &var) {
+    if (var->Binding.Kind != LocalBinding) {
+      return var;
+    }
+    int frame = static_cast<int>(constants.size()) - 1 - var->Binding.Depth;
+    if (frame < 0) {
+      return var;
+    }
+    auto constant = constants[frame].find(var->Binding.Slot);
+    if (constant == constants[frame].end()) {
+      return var;
+    }
+    foldedExpressions++;
+    return makeLiteral(constant->second->Value, constant->second->Kind,
+                       constant->second->StaticType.Kind);
+  }
+
+  static std::shared_ptr<LiteralExpression>
+  makeLiteral(const std::string &value, SodaScriptToken kind, TypeKind type) {
+    auto literal = std::make_shared<LiteralExpression>(value, kind);
+    literal->StaticType = SodaType(type);
+    return literal;
+  }
+
+  static bool isInteger(const LiteralExpression &literal) {
+    return literal.Kind == IntegerLiteral || literal.Kind == LongLiteral;
+  }
+
+  static bool isFloating(const LiteralExpression &literal) {
+    return literal.Kind == FloatLiteral || literal.Kind == DoubleLiteral;
+  }
+
+  static std::string formatDouble(double value) {
+    std::ostringstream out;
+    out.precision(17);
+    out << value;
+    return out.str();
+  }
+
+  static std::shared_ptr<Expression> makeBool(bool value) {
+    return makeLiteral(value ? "true" : "false", BooleanLiteral,
+                       TypeKind::Bool);
+  }
+
+  std::shared_ptr<Expression> foldBinary(const BinaryExpression &binary) {
+    auto left = std::dynamic_pointer_cast<LiteralExpression>(binary.Left);
+    auto right = std::dynamic_pointer_cast<LiteralExpression>(binary.Right);
+    BinaryOperator op = binary.Op;
+
+    // false && x and true || x never look at x
+    if (left && left->Kind == BooleanLiteral && isLogical(op)) {
+      bool value = left->Value == "true";
+      if (op == BinaryOperator::And && !value) {
+        return makeBool(false);
+      }
+      if (op == BinaryOperator::Or && value) {
+        return makeBool(true);
+      }
+      if (binary.Right->StaticType.Kind == TypeKind::Bool) {
+        return binary.Right;
+      }
+    }
+    if (!left || !right || op == BinaryOperator::Assign) {
+      return nullptr;
+    }
+
+    if (left->Kind == BooleanLiteral && right->Kind == BooleanLiteral) {
+      bool a = left->Value == "true";
+      bool b = right->Value == "true";
+      switch (op) {
+      case BinaryOperator::And:
+        return makeBool(a && b);
+      case BinaryOperator::Or:
+        return makeBool(a || b);
+      case BinaryOperator::Equal:
+        return makeBool(a == b);
+      case BinaryOperator::NotEqual:
+        return makeBool(a != b);
+      default:
+        return nullptr;
+      }
+    }
+
+    if (left->Kind == StringLiteral || right->Kind == StringLiteral) {
+      return foldString(op, *left, *right);
+    }
+
+    if (isInteger(*left) && isInteger(*right)) {
+      return foldInteger(op, *left, *right);
+    }
+
+    if ((isInteger(*left) || isFloating(*left)) &&
+        (isInteger(*right) || isFloating(*right))) {
+      return foldFloating(op, *left, *right);
+    }
+    return nullptr;
+  }
+
+  std::shared_ptr<Expression> foldString(BinaryOperator op,
+                                         const LiteralExpression &left,
+                                         const LiteralExpression &right) {
+    // Only operands whose String() form is unambiguous are concatenated
+    auto printable = [](const LiteralExpression &literal) {
+      return literal.Kind == StringLiteral || literal.Kind == IntegerLiteral ||
+             literal.Kind == LongLiteral || literal.Kind == BooleanLiteral;
+    };
+    // An integer is joined as the runtime prints it, without leading zeros
+    auto printed = [](const LiteralExpression &literal) {
+      return isInteger(literal)
+                 ? std::to_string(std::strtoll(literal.Value.c_str(), nullptr,
+                                               10))
+                 : literal.Value;
+    };
+    if (op == BinaryOperator::Add && printable(left) && printable(right)) {
+      return makeLiteral(printed(left) + printed(right), StringLiteral,
+                         TypeKind::String);
+    }
+    if (left.Kind == StringLiteral && right.Kind == StringLiteral) {
+      switch (op) {
+      case BinaryOperator::Equal:
+        return makeBool(left.Value == right.Value);
+      case BinaryOperator::NotEqual:
+        return makeBool(left.Value != right.Value);
+      case BinaryOperator::Less:
+        return makeBool(left.Value < right.Value);
+      case BinaryOperator::Greater:
+        return makeBool(left.Value > right.Value);
+      case BinaryOperator::LessEqual:
+        return makeBool(left.Value <= right.Value);
+      case BinaryOperator::GreaterEqual:
+        return makeBool(left.Value >= right.Value);
+      default:
+        break;
+      }
+    }
+    return nullptr;
+  }
+
+  static bool multiplyOverflows(long long a, long long b) {
+    if (a == 0 || b == 0) {
+      return false;
+    }
+    if (a > 0) {
+      return b > 0 ? a > LLONG_MAX / b : b < LLONG_MIN / a;
+    }
+    return b > 0 ? a < LLONG_MIN / b : b < LLONG_MAX / a;
+  }
+
+  std::shared_ptr<Expression> foldInteger(BinaryOperator op,
+                                          const LiteralExpression &left,
+                                          const LiteralExpression &right) {
+    long long a = std::strtoll(left.Value.c_str(), nullptr, 10);
+    long long b = std::strtoll(right.Value.c_str(), nullptr, 10);
+    bool isLong = left.Kind == LongLiteral || right.Kind == LongLiteral ||
+                  a > INT_MAX || b > INT_MAX;
+    long long result = 0;
+    switch (op) {
+    case BinaryOperator::Add:
+      if ((b > 0 && a > LLONG_MAX - b) || (b < 0 && a < LLONG_MIN - b))
+        return nullptr;
+      result = a + b;
+      break;
+    case BinaryOperator::Subtract:
+      if ((b < 0 && a > LLONG_MAX + b) || (b > 0 && a < LLONG_MIN + b))
+        return nullptr;
+      result = a - b;
+      break;
+    case BinaryOperator::Multiply:
+      if (multiplyOverflows(a, b))
+        return nullptr;
+      result = a * b;
+      break;
+    case BinaryOperator::Divide:
+    case BinaryOperator::Modulo:
+      // Leave the runtime error in place
+      if (b == 0 || (a == LLONG_MIN && b == -1))
+        return nullptr;
+      result = op == BinaryOperator::Divide ? a / b : a % b;
+      break;
+    case BinaryOperator::Equal:
+      return makeBool(a == b);
+    case BinaryOperator::NotEqual:
+      return makeBool(a != b);
+    case BinaryOperator::Less:
+      return makeBool(a < b);
+    case BinaryOperator::Greater:
+      return makeBool(a > b);
+    case BinaryOperator::LessEqual:
+      return makeBool(a <= b);
+    case BinaryOperator::GreaterEqual:
+      return makeBool(a >= b);
+    default:
+      return nullptr;
+    }
+    // Int arithmetic that would wrap at runtime is left alone
+    if (!isLong && (result > INT_MAX || result < INT_MIN)) {
+      return nullptr;
+    }
+    return makeLiteral(std::to_string(result),
+                       isLong ? LongLiteral : IntegerLiteral,
+                       isLong ? TypeKind::Long : TypeKind::Int);
+  }
+
+  std::shared_ptr<Expression> foldFloating(BinaryOperator op,
+                                           const LiteralExpression &left,
+                                           const LiteralExpression &right) {
+    double a = std::strtod(left.Value.c_str(), nullptr);
+    double b = std::strtod(right.Value.c_str(), nullptr);
+    bool isDouble = left.Kind == DoubleLiteral || right.Kind == DoubleLiteral;
+    double result = 0;
+    switch (op) {
+    case BinaryOperator::Add:
+      result = a + b;
+      break;
+    case BinaryOperator::Subtract:
+      result = a - b;
+      break;
+    case BinaryOperator::Multiply:
+      result = a * b;
+      break;
+    case BinaryOperator::Divide:
+      result = a / b;
+      break;
+    case BinaryOperator::Modulo:
+      result = std::fmod(a, b);
+      break;
+    case BinaryOperator::Equal:
+      return makeBool(a == b);
+    case BinaryOperator::NotEqual:
+      return makeBool(a != b);
+    case BinaryOperator::Less:
+      return makeBool(a < b);
+    case BinaryOperator::Greater:
+      return makeBool(a > b);
+    case BinaryOperator::LessEqual:
+      return makeBool(a <= b);
+    case BinaryOperator::GreaterEqual:
+      return makeBool(a >= b);
+    default:
+      return nullptr;
+    }
+    // Every tier computes a Float in double precision too, so no rounding
+    if (!std::isfinite(result)) {
+      return nullptr;
+    }
+    return makeLiteral(formatDouble(result),
+                       isDouble ? DoubleLiteral : FloatLiteral,
+                       isDouble ? TypeKind::Double : TypeKind::Float);
+  }
+};
+
+#endif // CONSTANT_FOLDER_H
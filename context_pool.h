@@ -0,0 +1,156 @@
+#ifndef CONTEXT_POOL_H
+#define CONTEXT_POOL_H
+
+#include "script_context.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Runs the work of any number of contexts on a fixed set of threads. The
+// tasks posted to one context run one at a time, in the order posted; the
+// contexts take turns a task each, so a busy one does not hold the others
+// back, and different contexts run in parallel.
+//
+// With fewer scripts running at once than there are threads, the other
+// threads wait their turn with the next tasks, and a script that has burned
+// its slice of fuel gives its turn to the one that has waited longest, so a
+// long-running task cannot hold the short ones behind it back for more
+// than a slice.
+class ContextPool {
+public:
+  // Reports through the context, such as by its error; must not throw
+  typedef std::function<void(ScriptContext &)> Task;
+
+  // Scripts run on at most running threads at once; on every thread if it
+  // is 0
+  explicit ContextPool(int threads = std::thread::hardware_concurrency(),
+                       int running = 0)
+      : turns(running > 0 ? std::min(running, std::max(threads, 1))
+                          : std::max(threads, 1)) {
+    for (int i = 0; i < std::max(threads, 1); i++) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ContextPool(const ContextPool &) = delete;
+  ContextPool &operator=(const ContextPool &) = delete;
+
+  // Runs what is posted first
+  ~ContextPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    ready.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Queues task for context, which has to outlive it
+  void post(ScriptContext &context, Task task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Queue &queue = queues[&context];
+    queue.Tasks.push_back(std::move(task));
+    outstanding++;
+    if (!queue.Running && queue.Tasks.size() == 1) {
+      runnable.push_back(&context);
+      ready.notify_one();
+    }
+  }
+
+  // Waits until every task posted so far has run
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return outstanding == 0; });
+  }
+
+  int getThreadCount() const { return static_cast<int>(workers.size()); }
+
+private:
+  struct Queue {
+    std::deque<Task> Tasks;
+    bool Running = false; // On a thread, so not runnable
+  };
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::condition_variable idle;
+  std::condition_variable turn;
+  std::unordered_map<ScriptContext *, Queue> queues; // With tasks left
+  std::deque<ScriptContext *> runnable; // In turn, each with a task ready
+  size_t outstanding = 0;
+  bool stopping = false;
+  int turns;                    // Left for scripts to run in
+  std::deque<uint64_t> waiting; // Tickets of the threads after a turn
+  uint64_t nextTicket = 0;
+
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      ready.wait(lock, [this] { return stopping || !runnable.empty(); });
+      if (runnable.empty()) {
+        return;
+      }
+      ScriptContext *context = runnable.front();
+      runnable.pop_front();
+      Queue &queue = queues[context];
+      Task task = std::move(queue.Tasks.front());
+      queue.Tasks.pop_front();
+      queue.Running = true;
+      takeTurn(lock);
+      lock.unlock();
+      context->setYield([this] { yield(); });
+      task(*context);
+      context->setYield(nullptr);
+      lock.lock();
+      turns++;
+      turn.notify_all();
+      // The map may have rehashed while the task ran
+      Queue &after = queues[context];
+      after.Running = false;
+      if (after.Tasks.empty()) {
+        queues.erase(context);
+      } else {
+        runnable.push_back(context);
+        ready.notify_one();
+      }
+      if (--outstanding == 0) {
+        idle.notify_all();
+      }
+    }
+  }
+
+  // Waits for a turn to run a script in, behind the threads already waiting
+  void takeTurn(std::unique_lock<std::mutex> &lock) {
+    uint64_t ticket = nextTicket++;
+    waiting.push_back(ticket);
+    turn.wait(lock, [&] { return turns > 0 && waiting.front() == ticket; });
+    waiting.pop_front();
+    turns--;
+    turn.notify_all();
+  }
+
+  // Gives the turn to a thread waiting for one, if any, and waits for the
+  // next
+  void yield() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (waiting.empty()) {
+      return;
+    }
+    turns++;
+    turn.notify_all();
+    takeTurn(lock);
+  }
+};
+
+#endif // CONTEXT_POOL_H
@@ -0,0 +1,215 @@
+#ifndef DICTIONARY_OBJECT_H
+#define DICTIONARY_OBJECT_H
+
+#include "heap_object.h"
+#include "simd.h"
+#include "string_object.h"
+#include "tracer.h"
+#include "value.h"
+#include "value_hash.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Hash map that remembers insertion order, so foreach visits keys in the
+// order the script added them. The entries are kept in that order, and
+// found through an open-addressing table in the style of a Swiss table:
+// slots holding entry numbers, and a control byte for each that is either
+// Empty or seven bits of the hash of the key there. A lookup compares a
+// whole group of control bytes with those bits at once, and only looks at
+// the keys of the few slots that match, usually in the first group it
+// tries.
+class DictionaryObject : public HeapObject {
+public:
+  static const bool Movable = true;
+
+  DictionaryObject() : HeapObject(ObjectKind::Dictionary) {}
+
+  size_t count() const { return entries.size(); }
+
+  bool get(const Value &key, Value &value) const {
+    size_t found = find(key, hashValue(key));
+    if (found == NotFound) {
+      return false;
+    }
+    value = entries[found].second;
+    return true;
+  }
+
+  void set(const Value &key, const Value &value) {
+    size_t hash = hashValue(key);
+    size_t found = find(key, hash);
+    if (found != NotFound) {
+      entries[found].second = value;
+      return;
+    }
+    // At most seven of every eight slots are used, so probing ends soon
+    if ((entries.size() + 1) * 8 > slots.size() * 7) {
+      grow();
+    }
+    insert(hash, static_cast<uint32_t>(entries.size()));
+    entries.push_back({key, value});
+  }
+
+  const std::vector<std::pair<Value, Value>> &getEntries() const {
+    return entries;
+  }
+
+  size_t size() const override {
+    return sizeof(*this) +
+           entries.capacity() * sizeof(std::pair<Value, Value>) +
+           control.capacity() + slots.capacity() * sizeof(uint32_t);
+  }
+
+  void trace(Tracer &tracer) override {
+    bool moved = false;
+    for (auto &entry : entries) {
+      Value key = entry.first;
+      tracer.mark(entry.first);
+      moved = moved || (!key.isIdenticalTo(entry.first) && byAddress(key));
+      tracer.mark(entry.second);
+    }
+    // The table finds some keys by the hash of their address
+    if (moved) {
+      tracer.rehashLater(this);
+    }
+  }
+
+  HeapObject *moveTo(void *memory) override {
+    auto *moved = new (memory) DictionaryObject();
+    moved->entries = std::move(entries);
+    moved->control = std::move(control);
+    moved->slots = std::move(slots);
+    return moved;
+  }
+
+  void rehash() override {
+    std::fill(control.begin(), control.end(), int8_t(Empty));
+    for (size_t i = 0; i < entries.size(); i++) {
+      insert(hashValue(entries[i].first), static_cast<uint32_t>(i));
+    }
+  }
+
+private:
+  static const int GroupSize = 16; // Control bytes compared at once
+  static const int8_t Empty = -128;
+  static const size_t NotFound = ~size_t(0);
+
+  std::vector<std::pair<Value, Value>> entries;
+  std::vector<int8_t> control; // One byte for each slot
+  std::vector<uint32_t> slots; // The number of the entry in each full one
+
+  // Whether the key hashes by its address, which a move changes
+  static bool byAddress(const Value &key) {
+    return key.isObject() && key.asObject()->Kind != ObjectKind::String;
+  }
+
+  // The bits of the hash a full control byte keeps, and the group where
+  // probing for it starts
+  static int8_t tag(size_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+  size_t firstGroup(size_t hash) const {
+    return (hash >> 7) & (slots.size() / GroupSize - 1);
+  }
+
+  // Bit i is set for each control byte i of the group at bytes that is
+  // byte
+  static uint32_t matching(const int8_t *bytes, int8_t byte) {
+#if SODA_SIMD
+    __m128i group =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte))));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < GroupSize; i++) {
+      mask |= static_cast<uint32_t>(bytes[i] == byte) << i;
+    }
+    return mask;
+#endif
+  }
+
+  static int lowestBit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while (!(mask & 1)) {
+      mask >>= 1;
+      bit++;
+    }
+    return bit;
+#endif
+  }
+
+  // Like valuesEqual, trying first what settles the usual cases: the same
+  // bits, as for an interned string or an inline int, then different
+  // cached hashes
+  static bool keysEqual(const Value &a, const Value &b) {
+    if (a.getBits() == b.getBits()) {
+      return !a.isDouble() || a.asDouble() == a.asDouble(); // Not NaN
+    }
+    if (a.isObject() && b.isObject()) {
+      if (a.asObject()->Kind != ObjectKind::String ||
+          b.asObject()->Kind != ObjectKind::String) {
+        return false;
+      }
+      auto *x = static_cast<StringObject *>(a.asObject());
+      auto *y = static_cast<StringObject *>(b.asObject());
+      return x->hash() == y->hash() && x->equals(y);
+    }
+    return a.isNumber() && b.isNumber() && valuesEqual(a, b);
+  }
+
+  // The number of the entry with key, or NotFound. Groups are probed one,
+  // two, three and so on groups apart, which visits all of them as their
+  // count is a power of two.
+  size_t find(const Value &key, size_t hash) const {
+    if (slots.empty()) {
+      return NotFound;
+    }
+    size_t mask = slots.size() / GroupSize - 1;
+    for (size_t group = firstGroup(hash), step = 1;;
+         group = (group + step++) & mask) {
+      const int8_t *bytes = control.data() + group * GroupSize;
+      for (uint32_t matches = matching(bytes, tag(hash)); matches;
+           matches &= matches - 1) {
+        uint32_t entry = slots[group * GroupSize + lowestBit(matches)];
+        if (keysEqual(entries[entry].first, key)) {
+          return entry;
+        }
+      }
+      if (matching(bytes, Empty)) {
+        return NotFound;
+      }
+    }
+  }
+
+  // Puts entry, whose key has hash and is not in the table yet, in the
+  // first empty slot of its probe sequence
+  void insert(size_t hash, uint32_t entry) {
+    size_t mask = slots.size() / GroupSize - 1;
+    for (size_t group = firstGroup(hash), step = 1;;
+         group = (group + step++) & mask) {
+      uint32_t empty = matching(control.data() + group * GroupSize, Empty);
+      if (empty) {
+        size_t slot = group * GroupSize + lowestBit(empty);
+        control[slot] = tag(hash);
+        slots[slot] = entry;
+        return;
+      }
+    }
+  }
+
+  // Doubles the slots, or makes the first group of them
+  void grow() {
+    size_t count = slots.empty() ? size_t(GroupSize) : slots.size() * 2;
+    control.assign(count, int8_t(Empty));
+    slots.assign(count, 0);
+    rehash();
+  }
+};
+
+#endif // DICTIONARY_OBJECT_H
@@ -0,0 +1,64 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include "bytecode.h"
+#include "function_object.h"
+#include "value_format.h"
+#include <sstream>
+#include <string>
+
+// Human-readable listing of a function and the closures nested in it
+inline std::string disassemble(const FunctionObject &function) {
+  std::ostringstream out;
+  out << "function " << function.Name << " (" << function.Arity
+      << " params, " << function.RegisterCount << " registers)\n";
+  for (size_t i = 0; i < function.Code.size(); i++) {
+    uint32_t instruction = function.Code[i];
+    Opcode opcode = decodeOpcode(instruction);
+    out << "  " << i << "\t" << opcodeName(opcode) << "\t";
+    switch (opcode) {
+    case Opcode::LoadConstant:
+      out << decodeA(instruction) << " "
+          << valueToString(function.Constants[decodeBx(instruction)]);
+      break;
+    case Opcode::GetGlobal:
+    case Opcode::SetGlobal:
+    case Opcode::Closure:
+      out << decodeA(instruction) << " " << decodeBx(instruction);
+      break;
+    case Opcode::MemberCache:
+      out << decodeBx(instruction);
+      break;
+    case Opcode::LoadInt:
+      out << decodeA(instruction) << " " << decodesBx(instruction);
+      break;
+    case Opcode::Jump:
+    case Opcode::JumpIfFalse:
+    case Opcode::JumpIfTrue:
+      out << decodeA(instruction) << " -> "
+          << static_cast<int>(i) + 1 + decodesBx(instruction);
+      break;
+    case Opcode::GetMember:
+    case Opcode::CallMember:
+    case Opcode::CallSuper:
+      out << decodeA(instruction) << " " << decodeB(instruction) << " "
+          << function.Names[decodeC(instruction)];
+      break;
+    case Opcode::SetMember:
+      out << decodeA(instruction) << " " << function.Names[decodeB(instruction)]
+          << " " << decodeC(instruction);
+      break;
+    default:
+      out << decodeA(instruction) << " " << decodeB(instruction) << " "
+          << decodeC(instruction);
+      break;
+    }
+    out << "\n";
+  }
+  for (const FunctionObject *prototype : function.Prototypes) {
+    out << disassemble(*prototype);
+  }
+  return out.str();
+}
+
+#endif // DISASSEMBLER_H
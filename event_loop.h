@@ -0,0 +1,233 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "task_object.h"
+#include "tracer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+// The tasks of one VirtualMachine, all run on the thread running it: the
+// ones ready to continue, in the order they became ready, and the timers
+// and file descriptors the others wait on. Waiting blocks in epoll on
+// Linux; elsewhere it sleeps until the next timer, and file descriptors
+// cannot be waited on.
+class EventLoop {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  EventLoop() {}
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  ~EventLoop() {
+#if defined(__linux__)
+    if (poller >= 0) {
+      close(poller);
+    }
+#endif
+  }
+
+  void schedule(TaskObject *task) { ready.push_back(task); }
+
+  // The task to continue next, or null if none is ready
+  TaskObject *takeReady() {
+    if (ready.empty()) {
+      return nullptr;
+    }
+    TaskObject *task = ready.front();
+    ready.pop_front();
+    return task;
+  }
+
+  bool hasReady() const { return !ready.empty(); }
+
+  // Whether any task waits on a timer or a file descriptor
+  bool isWaiting() const { return !timers.empty() || !watches.empty(); }
+
+  void addTimer(TaskObject *task, double milliseconds) {
+    Clock::duration delay = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(
+            std::max(milliseconds, 0.0)));
+    timers.push_back(Timer{Clock::now() + delay, sequence++, task});
+    std::push_heap(timers.begin(), timers.end(), Timer::later);
+  }
+
+  // The task waiting for fd to become writable, or readable, if any
+  TaskObject *watching(int fd, bool write) const {
+    auto found = watches.find(fd);
+    if (found == watches.end()) {
+      return nullptr;
+    }
+    return write ? found->second.Write : found->second.Read;
+  }
+
+  // Has task wait until fd is writable, or readable. Returns false if fd
+  // cannot be waited on, like a regular file.
+  bool watch(int fd, bool write, TaskObject *task) {
+#if defined(__linux__)
+    if (poller < 0) {
+      poller = epoll_create1(EPOLL_CLOEXEC);
+      if (poller < 0) {
+        return false;
+      }
+    }
+    bool added = watches.find(fd) == watches.end();
+    Watch &watch = watches[fd];
+    (write ? watch.Write : watch.Read) = task;
+    if (!update(fd, watch, added ? EPOLL_CTL_ADD : EPOLL_CTL_MOD)) {
+      (write ? watch.Write : watch.Read) = nullptr;
+      if (added) {
+        watches.erase(fd);
+      }
+      return false;
+    }
+    return true;
+#else
+    (void)fd;
+    (void)write;
+    (void)task;
+    return false;
+#endif
+  }
+
+  // Blocks until a timer is due or a watched file descriptor is ready, for
+  // at most timeout milliseconds unless it is -1, and adds the tasks
+  // waiting for them to fired
+  void wait(int timeout, std::vector<TaskObject *> &fired) {
+    if (!timers.empty()) {
+      Clock::duration left = timers.front().Due - Clock::now();
+      // Rounded up, so the timer is due on waking
+      int until = left <= Clock::duration::zero()
+                      ? 0
+                      : static_cast<int>(
+                            std::chrono::duration_cast<
+                                std::chrono::milliseconds>(
+                                left + std::chrono::milliseconds(1) -
+                                Clock::duration(1))
+                                .count());
+      timeout = timeout < 0 ? until : std::min(timeout, until);
+    }
+#if defined(__linux__)
+    if (!watches.empty()) {
+      epoll_event events[MaxEvents];
+      int count = epoll_wait(poller, events, MaxEvents, timeout);
+      for (int i = 0; i < count; i++) {
+        auto found = watches.find(events[i].data.fd);
+        if (found == watches.end()) {
+          continue;
+        }
+        Watch &watch = found->second;
+        uint32_t flags = events[i].events;
+        uint32_t closed = EPOLLERR | EPOLLHUP;
+        if (watch.Read && (flags & (EPOLLIN | EPOLLRDHUP | closed))) {
+          fired.push_back(watch.Read);
+          watch.Read = nullptr;
+        }
+        if (watch.Write && (flags & (EPOLLOUT | closed))) {
+          fired.push_back(watch.Write);
+          watch.Write = nullptr;
+        }
+        if (!watch.Read && !watch.Write) {
+          update(found->first, watch, EPOLL_CTL_DEL);
+          watches.erase(found);
+        } else {
+          update(found->first, watch, EPOLL_CTL_MOD);
+        }
+      }
+      timeout = 0;
+    }
+#endif
+    if (timeout > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+    }
+    Clock::time_point now = Clock::now();
+    while (!timers.empty() && timers.front().Due <= now) {
+      std::pop_heap(timers.begin(), timers.end(), Timer::later);
+      fired.push_back(timers.back().Task);
+      timers.pop_back();
+    }
+  }
+
+  // Records a task that failed with nothing awaiting it yet
+  void addFailed(TaskObject *task) { failed.push_back(task); }
+
+  // Forgets task as failed unawaited, once something awaits it
+  void observe(TaskObject *task) {
+    failed.erase(std::remove(failed.begin(), failed.end(), task),
+                 failed.end());
+  }
+
+  // The first task that failed with nothing ever awaiting it, if any, and
+  // forgets them all
+  TaskObject *takeFailed() {
+    TaskObject *task = failed.empty() ? nullptr : failed.front();
+    failed.clear();
+    return task;
+  }
+
+  void trace(Tracer &tracer) {
+    for (TaskObject *&task : ready) {
+      tracer.mark(task);
+    }
+    for (Timer &timer : timers) {
+      tracer.mark(timer.Task);
+    }
+    for (auto &watch : watches) {
+      tracer.mark(watch.second.Read);
+      tracer.mark(watch.second.Write);
+    }
+    for (TaskObject *&task : failed) {
+      tracer.mark(task);
+    }
+  }
+
+private:
+  struct Timer {
+    Clock::time_point Due;
+    uint64_t Sequence; // Orders timers due at once by when they were set
+    TaskObject *Task;
+
+    static bool later(const Timer &a, const Timer &b) {
+      return a.Due != b.Due ? a.Due > b.Due : a.Sequence > b.Sequence;
+    }
+  };
+
+  struct Watch {
+    TaskObject *Read = nullptr;
+    TaskObject *Write = nullptr;
+  };
+
+  static const int MaxEvents = 64;
+
+  std::deque<TaskObject *> ready;
+  std::vector<Timer> timers; // A heap, the next one due first
+  uint64_t sequence = 0;
+  std::unordered_map<int, Watch> watches;
+  std::vector<TaskObject *> failed;
+
+#if defined(__linux__)
+  int poller = -1; // The epoll instance, made on the first watch
+
+  bool update(int fd, const Watch &watch, int operation) {
+    epoll_event event = {};
+    event.events = (watch.Read ? uint32_t(EPOLLIN | EPOLLRDHUP) : 0u) |
+                   (watch.Write ? uint32_t(EPOLLOUT) : 0u);
+    event.data.fd = fd;
+    return epoll_ctl(poller, operation, fd, &event) == 0;
+  }
+#endif
+};
+
+#endif // EVENT_LOOP_H
@@ -2,7 +2,14 @@
 #define EXPRESSION_H
 
 #include "ast_node.h"
+#include "soda_type.h"
 
-class Expression : public AstNode {};
+class Expression : public AstNode {
+public:
+  SodaType StaticType; // Filled in by the type checker
+  // Set by the type checker where the value is stored as a Float or
+  // Double, so an integer it evaluates to has to become a double first
+  bool ToDouble = false;
+};
 
 #endif
\ No newline at end of file
@@ -16,6 +16,8 @@ public:
   std::shared_ptr<TypeReference> ReturnType;
   std::vector<std::shared_ptr<AstNode>> Body;
   std::vector<std::shared_ptr<TypeReference>> GenericTypes;
+  int FrameSize = 0; // Slots needed by parameters and locals
+  bool Async = false; // Calling it starts a task, which it may await in
 
   FunctionDeclaration(
       const std::string &name,
@@ -0,0 +1,79 @@
+#ifndef FUNCTION_OBJECT_H
+#define FUNCTION_OBJECT_H
+
+#include "heap_object.h"
+#include "inline_cache.h"
+#include "tracer.h"
+#include "value.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class AotRuntime;
+class ClassObject;
+class ClosureObject;
+class TreeFunction;
+struct JitFunction;
+
+// Body of a function compiled ahead of time to C++
+typedef Value (*CompiledCode)(AotRuntime &runtime, ClosureObject *closure,
+                              const Value &receiver, const Value *arguments,
+                              int count);
+
+// How a new closure fills one entry of its environment from the frame that
+// creates it
+struct CaptureDescriptor {
+  bool FromEnvironment = false; // Index is an entry of the creator's own
+                                // environment rather than one of its registers
+  int Index = 0;
+  bool ByReference = false; // Keep the register's stack position, not a copy
+};
+
+// Bytecode and constant pool of one function, method, closure or package
+// initializer, the tree the AstInterpreter runs it from, or its compiled
+// C++. Shared by every closure created from it.
+class FunctionObject : public HeapObject {
+public:
+  std::string Name;
+  int Arity = 0;
+  int RegisterCount = 0; // Frame slots plus temporaries
+  std::vector<uint32_t> Code;
+  std::vector<Value> Constants;
+  std::vector<std::string> Names; // Member names, indexed by instructions
+  std::vector<InlineCache> Caches; // One per member access site
+  std::vector<FunctionObject *> Prototypes; // Closures created in the body
+  std::vector<CaptureDescriptor> Captures;
+  ClassObject *Owner = nullptr; // Declaring class of a method
+  std::shared_ptr<TreeFunction> Tree; // Set for the AstInterpreter instead
+                                      // of Code
+  CompiledCode Compiled = nullptr;     // Set for the AotRuntime instead
+  bool Async = false; // Calls start a task, see TaskObject
+  int Invocations = 0; // Profile the JIT uses to find hot functions
+  int BackEdges = 0;
+  JitFunction *Jit = nullptr; // Machine code, once compiled
+  std::atomic<uint8_t> Parallel{0}; // Whether parallel bodies can call it:
+                                    // 0 until checked, then 1 or 2 for not
+
+  FunctionObject() : HeapObject(ObjectKind::Function) {}
+
+  size_t size() const override {
+    size_t bytes = sizeof(*this) + Code.capacity() * sizeof(uint32_t) +
+                   Constants.capacity() * sizeof(Value) +
+                   Prototypes.capacity() * sizeof(FunctionObject *) +
+                   Captures.capacity() * sizeof(CaptureDescriptor) +
+                   Caches.capacity() * sizeof(InlineCache);
+    for (const auto &name : Names) {
+      bytes += sizeof(name) + name.capacity();
+    }
+    return bytes;
+  }
+
+  // Prototypes, Owner and the shapes in Caches live as long as the heap
+  void trace(Tracer &tracer) override {
+    tracer.mark(Constants.data(), Constants.size());
+  }
+};
+
+#endif // FUNCTION_OBJECT_H
@@ -0,0 +1,817 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "concurrent_collector.h"
+#include "heap_object.h"
+#include "integer_object.h"
+#include "string_object.h"
+#include "tracer.h"
+#include "value.h"
+#include <algorithm>
+#include <chrono>
+#include <csetjmp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SODA_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#define SODA_NO_SANITIZE_ADDRESS
+#endif
+
+struct HeapOptions {
+  bool Collect = true;
+  size_t Threshold = size_t(4) << 20; // Bytes the old generation grows by
+                                      // between major collections
+  double Growth = 1.0; // At least this times the bytes the last one kept
+  size_t NurserySize = size_t(1) << 20; // 0 makes every object old
+  bool Concurrent = true; // Mark and sweep the old generation on background
+                          // threads while scripts run
+  int MarkerThreads = 1;
+};
+
+// What the heap has done so far, for monitoring
+struct HeapStatistics {
+  size_t MinorCollections = 0;
+  size_t MajorCollections = 0;
+  double MinorPauseTotal = 0; // Seconds
+  double MinorPauseMax = 0;
+  double MajorPauseTotal = 0; // Each pause a major collection makes
+  double MajorPauseMax = 0;
+  double MarkingTotal = 0; // Concurrent marking, beside the scripts
+  size_t BytesPromoted = 0; // From the nursery to the old generation
+  size_t ObjectsFreed = 0;
+};
+
+// What a runtime holds outside the heap, such as its globals and stacks
+class RootSet {
+public:
+  virtual ~RootSet() {}
+
+  virtual void traceRoots(Tracer &tracer) = 0;
+};
+
+// Owns every object the runtime allocates, and frees the ones the program
+// can no longer reach. Objects are in one of two generations:
+//
+// - The nursery holds the movable objects made while a script runs, in
+//   blocks it allocates from by bumping a pointer. A minor collection
+//   empties it when it fills: the objects still reached move to the old
+//   generation, and the rest are destroyed where they are.
+// - The old generation holds everything else. A major collection marks
+//   and sweeps it when it has grown by the threshold, by default on a
+//   ConcurrentCollector while the script goes on; the script only stops
+//   to empty the nursery and mark the roots, and to hand over between the
+//   phases.
+//
+// A collection marks from:
+//
+// - the RootSet;
+// - objects with a reference count, held from outside the heap;
+// - any word on the native stack of the running script that points into
+//   an object, or is a Value that does. The C++ frames of every tier keep
+//   values in locals, and these are found without each tier listing them.
+//
+// A minor collection also traces the remembered set, the old objects
+// stored into since the last one, which writeBarrier records; no other old
+// object can refer to a young one. Young objects found from the native
+// stack, the host's arguments or a reference count stay where they are,
+// since those references cannot be updated, and the blocks they are in
+// join the old generation until everything in them is freed.
+//
+// Collections run only inside a StackScope, which tells where the native
+// stack of the script begins, and objects allocated outside one are old.
+//
+// Functions, natives, classes, shapes and interned strings are referenced
+// by compiled code and inline caches directly, so they hold a reference
+// for as long as the heap lives.
+class Heap {
+public:
+  static const size_t BlockSize = 64 * 1024;
+  static const size_t MaxYoungExtent = BlockSize / 8; // Larger are old
+
+  // Marks an entry from the host into scripts. The outermost one is the
+  // base of the native stack collections scan, and keeps what the
+  // arguments the host passed refer to, which may live anywhere.
+  class StackScope {
+  public:
+    explicit StackScope(Heap &heap, const Value *arguments = nullptr,
+                        size_t count = 0)
+        : heap(heap), outer(heap.stackBase), arguments(arguments),
+          count(count) {
+      if (!outer) {
+        heap.stackBase = this;
+      }
+    }
+
+    StackScope(const StackScope &) = delete;
+    StackScope &operator=(const StackScope &) = delete;
+
+    ~StackScope() {
+      if (!outer) {
+        heap.stackBase = nullptr;
+      }
+    }
+
+  private:
+    friend class Heap;
+
+    Heap &heap;
+    const StackScope *outer;
+    const Value *arguments;
+    size_t count;
+  };
+
+  // Values in memory collections do not otherwise see, such as a buffer on
+  // the C++ heap, rooted while the range is in scope
+  class RootRange {
+  public:
+    RootRange(Heap &heap, Value *values, size_t count) : heap(heap) {
+      heap.rootRanges.push_back({values, count});
+    }
+
+    RootRange(const RootRange &) = delete;
+    RootRange &operator=(const RootRange &) = delete;
+
+    ~RootRange() { heap.rootRanges.pop_back(); }
+
+  private:
+    Heap &heap;
+  };
+
+  // Makes the objects allocated inside it old, for those kept as long as
+  // the code using them, like the constants of a tree
+  class TenuredScope {
+  public:
+    explicit TenuredScope(Heap &heap) : heap(heap) { heap.tenuring++; }
+
+    TenuredScope(const TenuredScope &) = delete;
+    TenuredScope &operator=(const TenuredScope &) = delete;
+
+    ~TenuredScope() { heap.tenuring--; }
+
+  private:
+    Heap &heap;
+  };
+
+  Heap() = default;
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+
+  ~Heap() {
+    if (background) {
+      background->join();
+      if (!marking) {
+        finishSweeping();
+      }
+      background.reset();
+    }
+    for (Block &block : nursery) {
+      for (char *at = block.Start; at < block.Top;) {
+        auto *object = reinterpret_cast<HeapObject *>(at);
+        at += object->Extent;
+        object->~HeapObject();
+      }
+      ::operator delete(block.Start);
+    }
+    while (objects) {
+      HeapObject *next = objects->Next;
+      release(objects);
+      objects = next;
+    }
+  }
+
+  // The nursery size takes effect while nothing is in it
+  void setOptions(const HeapOptions &value) {
+    options = value;
+    threshold = options.Threshold;
+    if (youngBytes == 0) {
+      for (Block &block : nursery) {
+        ::operator delete(block.Start);
+      }
+      nursery.clear();
+    }
+  }
+
+  void setRoots(RootSet *value) { roots = value; }
+
+  template <typename T, typename... Args> T *allocate(Args &&...args) {
+    bool young = T::Movable && canBeYoung();
+    void *memory = reserve(sizeof(T), young);
+    return track(new (memory) T(std::forward<Args>(args)...), young,
+                 sizeof(T));
+  }
+
+  // For objects that size themselves, like instances with their fields
+  // after them: made by T::create instead of new
+  template <typename T, typename... Args> T *create(Args &&...args) {
+    return createIn<T>(T::Movable && canBeYoung(),
+                       std::forward<Args>(args)...);
+  }
+
+  // One shared object per distinct text, for constants and member names
+  StringObject *intern(const std::string &text) {
+    auto found = interned.find(text);
+    if (found != interned.end()) {
+      return found->second;
+    }
+    StringObject *string = createIn<StringObject>(false, text);
+    string->addRef();
+    interned[text] = string;
+    return string;
+  }
+
+  // Whether string is the one intern returns for its text
+  bool isInterned(StringObject *string) const {
+    auto found = interned.find(string->text());
+    return found != interned.end() && found->second == string;
+  }
+
+  // Boxes value if it is too wide for a Value to hold inline
+  Value integer(int64_t value) {
+    return Value::fitsInline(value)
+               ? Value::integer(value)
+               : Value::boxedInteger(allocate<IntegerObject>(value));
+  }
+
+  // Runs before a reference is stored into holder. The first store into an
+  // old object remembers it, so the next minor collection finds the young
+  // objects it may now refer to, and while marking runs traces it first,
+  // so marking still finds what it referred to.
+  void writeBarrier(HeapObject *holder) {
+    if (!holder->Remembered) {
+      if (marking) {
+        background->snapshot(holder, gray);
+      }
+      remember(holder);
+    }
+  }
+
+  void writeBarrier(const Value &holder) {
+    if (holder.isObject()) {
+      writeBarrier(holder.asObject());
+    }
+  }
+
+  // Frees every object the program can no longer reach, in both
+  // generations, without running any of it concurrently. Only safe inside
+  // a StackScope, or when no script is running.
+  void collect() {
+    finishCollection();
+    Clock::time_point start = Clock::now();
+    emptyNursery();
+    collectOld();
+    statistics.MajorCollections++;
+    record(start, statistics.MajorPauseTotal, statistics.MajorPauseMax);
+  }
+
+  // Empties the nursery, freeing what is no longer reached. Only safe
+  // where collect is.
+  void collectYoung() {
+    Clock::time_point start = Clock::now();
+    // Spills the callee-saved registers onto the stack, for the scan
+    std::jmp_buf registers;
+    setjmp(registers);
+
+    std::vector<HeapObject *> young = youngObjects();
+    Evacuator evacuator(*this);
+    for (HeapObject *object : young) {
+      if (object->getRefCount() > 0) {
+        evacuator.pin(object);
+      }
+    }
+    if (stackBase) {
+      for (size_t i = 0; i < stackBase->count; i++) {
+        evacuator.pin(stackBase->arguments[i].getReference());
+      }
+      scanStack(&registers, stackBase, [&](uint64_t word) {
+        evacuator.pin(ConcurrentCollector::find(young, word));
+        // The payload, in case the word is a Value
+        evacuator.pin(
+            ConcurrentCollector::find(young, word & Value::PayloadMask));
+      });
+    }
+    traceRoots(evacuator);
+    for (HeapObject *object : remembered) {
+      object->Remembered = false;
+      object->trace(evacuator);
+    }
+    remembered.clear();
+    evacuator.drain();
+    sweepNursery();
+    statistics.MinorCollections++;
+    record(start, statistics.MinorPauseTotal, statistics.MinorPauseMax);
+  }
+
+  // Waits for a concurrent major collection to finish
+  void finishCollection() {
+    while (background) {
+      Clock::time_point start = Clock::now();
+      background->join();
+      advance(start);
+    }
+  }
+
+  size_t getObjectCount() const { return objectCount; }
+
+  // Calls visit on each object of the old generation. Only while no
+  // collection runs.
+  template <typename Visit> void forEachOld(Visit visit) const {
+    for (HeapObject *object = objects; object; object = object->Next) {
+      visit(object);
+    }
+  }
+
+  // Everything ever allocated
+  size_t getBytesAllocated() const { return bytesAllocated; }
+
+  // Allocated in the nursery since it was last emptied
+  size_t getYoungSize() const { return youngBytes; }
+
+  // What the last major collection kept, and what was added since
+  size_t getOldSize() const { return keptBytes + oldSince; }
+
+  size_t getHeapSize() const { return getYoungSize() + getOldSize(); }
+
+  const HeapStatistics &getStatistics() const { return statistics; }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  static const uint8_t PinnedMark = 3; // Mark of a young object kept in place
+  static const size_t ShareSize = 256; // Gray objects worth handing over
+
+  struct Block {
+    char *Start;
+    char *Top; // Where the next object goes
+    char *End;
+    size_t Live; // Objects left in a block the old generation took over
+  };
+
+  // Marks for a major collection on the mutator
+  class Marker : public Tracer {
+  public:
+    explicit Marker(uint8_t epoch) : epoch(epoch) {}
+
+    std::vector<HeapObject *> take() { return std::move(pending); }
+
+  protected:
+    HeapObject *visit(HeapObject *object) override {
+      if (object->Mark.load(std::memory_order_relaxed) != epoch) {
+        object->Mark.store(epoch, std::memory_order_relaxed);
+        pending.push_back(object);
+      }
+      return object;
+    }
+
+  private:
+    uint8_t epoch;
+  };
+
+  // Moves the young objects a minor collection reaches, but the pinned
+  // ones, to the old generation, and traces them in turn. A moved object
+  // keeps its new address in Next until the nursery is swept.
+  class Evacuator : public Tracer {
+  public:
+    explicit Evacuator(Heap &heap) : heap(heap) {}
+
+    // Keeps object where it is, if it is young
+    void pin(HeapObject *object) {
+      if (object && object->Young &&
+          object->Mark.load(std::memory_order_relaxed) == 0) {
+        object->Mark.store(PinnedMark, std::memory_order_relaxed);
+        pending.push_back(object);
+      }
+    }
+
+  protected:
+    HeapObject *visit(HeapObject *object) override {
+      if (!object->Young ||
+          object->Mark.load(std::memory_order_relaxed) != 0) {
+        return object;
+      }
+      if (object->Next) {
+        return object->Next;
+      }
+      HeapObject *moved = object->moveTo(::operator new(object->Extent));
+      moved->Extent = object->Extent;
+      heap.adopt(moved);
+      object->Next = moved;
+      pending.push_back(moved);
+      return moved;
+    }
+
+  private:
+    Heap &heap;
+  };
+
+  HeapObject *objects = nullptr; // The old generation
+  size_t objectCount = 0;
+  size_t bytesAllocated = 0;
+  size_t oldSince = 0;  // Added to the old generation since the last major
+  size_t keptBytes = 0; // By the last major collection
+  size_t oldAtStart = 0; // Of oldSince, when the one running began
+  std::vector<Block> nursery;
+  size_t current = 0;    // The nursery block allocations come from
+  size_t youngBytes = 0; // Allocated in the nursery since it was emptied
+  std::vector<Block> retained; // Left by the nursery, by address
+  std::vector<HeapObject *> remembered;
+  uint8_t epoch = 1; // Of the last major collection, 1 or 2
+  bool marking = false;
+  std::unique_ptr<ConcurrentCollector> background; // Marking or sweeping
+  std::vector<HeapObject *> gray; // Marked by the write barrier, untraced
+  Clock::time_point markingStart;
+  HeapOptions options;
+  HeapStatistics statistics;
+  size_t threshold = HeapOptions().Threshold;
+  int tenuring = 0;
+  RootSet *roots = nullptr;
+  const StackScope *stackBase = nullptr;
+  std::vector<std::pair<Value *, size_t>> rootRanges;
+  std::unordered_map<std::string, StringObject *> interned;
+
+  static bool isPermanent(ObjectKind kind) {
+    return kind == ObjectKind::Function || kind == ObjectKind::Native ||
+           kind == ObjectKind::Class || kind == ObjectKind::Shape;
+  }
+
+  static size_t aligned(size_t bytes) { return (bytes + 7) & ~size_t(7); }
+
+  bool canBeYoung() const {
+    return stackBase && !tenuring && options.NurserySize > 0;
+  }
+
+  bool canCollect() const { return stackBase && options.Collect; }
+
+  template <typename T, typename... Args>
+  T *createIn(bool young, Args &&...args) {
+    size_t bytes = 0;
+    T *object = T::create(
+        [&](size_t size) {
+          bytes = size;
+          return reserve(size, young);
+        },
+        std::forward<Args>(args)...);
+    return track(object, young, bytes);
+  }
+
+  // Memory for an object of bytes, in the nursery if young. Clears young
+  // if the object has to be old after all.
+  void *reserve(size_t bytes, bool &young) {
+    if (young && aligned(bytes) <= MaxYoungExtent) {
+      void *memory = bump(aligned(bytes));
+      if (!memory && canCollect()) {
+        collectYoung();
+        collectIfNeeded();
+        memory = bump(aligned(bytes));
+      }
+      if (memory) {
+        return memory;
+      }
+    }
+    young = false;
+    collectIfNeeded();
+    return ::operator new(bytes);
+  }
+
+  void *bump(size_t extent) {
+    if (nursery.empty()) {
+      size_t count = std::max<size_t>(1, options.NurserySize / BlockSize);
+      for (size_t i = 0; i < count; i++) {
+        nursery.push_back(newBlock());
+      }
+      current = 0;
+    }
+    for (; current < nursery.size(); current++) {
+      Block &block = nursery[current];
+      if (static_cast<size_t>(block.End - block.Top) >= extent) {
+        void *memory = block.Top;
+        block.Top += extent;
+        youngBytes += extent;
+        return memory;
+      }
+    }
+    return nullptr;
+  }
+
+  static Block newBlock() {
+    char *start = static_cast<char *>(::operator new(BlockSize));
+    return Block{start, start, start + BlockSize, 0};
+  }
+
+  template <typename T> T *track(T *object, bool young, size_t extent) {
+    objectCount++;
+    size_t bytes = object->size();
+    bytesAllocated += bytes;
+    object->Extent = static_cast<uint32_t>(aligned(extent));
+    if (young) {
+      object->Young = true;
+      object->InBlock = true;
+      object->Remembered = true;
+      return object;
+    }
+    object->Next = objects;
+    objects = object;
+    oldSince += bytes;
+    if (isPermanent(object->Kind)) {
+      object->addRef();
+    }
+    // Allocated black while marking runs, so it needs no tracing
+    if (marking) {
+      object->Mark.store(epoch, std::memory_order_relaxed);
+      object->Scan.store(epoch, std::memory_order_relaxed);
+    }
+    // Whatever it is first given may be young
+    remember(object);
+    return object;
+  }
+
+  void remember(HeapObject *object) {
+    object->Remembered = true;
+    remembered.push_back(object);
+  }
+
+  // Makes a young object that was moved or pinned old, and black while
+  // marking runs
+  void adopt(HeapObject *object) {
+    object->Young = false;
+    object->Remembered = false;
+    object->Mark.store(marking ? epoch : 0, std::memory_order_relaxed);
+    object->Scan.store(marking ? epoch : 0, std::memory_order_relaxed);
+    object->Next = objects;
+    objects = object;
+    size_t bytes = object->size();
+    oldSince += bytes;
+    statistics.BytesPromoted += bytes;
+  }
+
+  // Every object in the nursery, in address order
+  std::vector<HeapObject *> youngObjects() {
+    std::sort(nursery.begin(), nursery.end(),
+              [](const Block &a, const Block &b) { return a.Start < b.Start; });
+    std::vector<HeapObject *> young;
+    for (const Block &block : nursery) {
+      for (char *at = block.Start; at < block.Top;) {
+        auto *object = reinterpret_cast<HeapObject *>(at);
+        young.push_back(object);
+        at += object->Extent;
+      }
+    }
+    return young;
+  }
+
+  void traceRoots(Tracer &tracer) {
+    if (roots) {
+      roots->traceRoots(tracer);
+    }
+    for (const auto &range : rootRanges) {
+      tracer.mark(range.first, range.second);
+    }
+  }
+
+  // Destroys the young objects that moved or were not reached. The pinned
+  // ones become old where they are, and keep their block.
+  void sweepNursery() {
+    for (Block &block : nursery) {
+      size_t live = 0;
+      for (char *at = block.Start; at < block.Top;) {
+        auto *object = reinterpret_cast<HeapObject *>(at);
+        at += object->Extent;
+        if (object->Mark.load(std::memory_order_relaxed) != 0) {
+          adopt(object);
+          live++;
+        } else {
+          if (!object->Next) {
+            objectCount--;
+            statistics.ObjectsFreed++;
+          }
+          object->~HeapObject();
+        }
+      }
+      if (live > 0) {
+        block.Live = live;
+        auto by = [](const Block &a, const Block &b) {
+          return a.Start < b.Start;
+        };
+        retained.insert(
+            std::upper_bound(retained.begin(), retained.end(), block, by),
+            block);
+        block = newBlock();
+      } else {
+        block.Top = block.Start;
+      }
+    }
+    current = 0;
+    youngBytes = 0;
+  }
+
+  // A minor collection, if there is anything for it to do. Major ones
+  // start with it, so the old generation refers to no young object and no
+  // old object is remembered.
+  void emptyNursery() {
+    if (youngBytes > 0) {
+      collectYoung();
+      return;
+    }
+    for (HeapObject *object : remembered) {
+      object->Remembered = false;
+    }
+    remembered.clear();
+  }
+
+  // Moves a concurrent major collection on, or starts one once the old
+  // generation has grown by the threshold, or runs one there and then
+  void collectIfNeeded() {
+    if (background) {
+      if (background->isDone()) {
+        advance(Clock::now());
+      } else if (oldSince - oldAtStart >= options.Threshold) {
+        // The script is outrunning the collection, so waits for it
+        finishCollection();
+      } else if (gray.size() >= ShareSize) {
+        background->offer(gray);
+      }
+    }
+    if (oldSince < threshold || background || !canCollect()) {
+      return;
+    }
+    if (options.Concurrent) {
+      startMarking();
+    } else {
+      collect();
+    }
+  }
+
+  // The pause that starts concurrent marking: marks the roots, and copies
+  // the native stack for the marking threads to find the rest in
+  void startMarking() {
+    Clock::time_point start = Clock::now();
+    emptyNursery();
+    std::jmp_buf registers;
+    setjmp(registers);
+
+    epoch = static_cast<uint8_t>(3 - epoch);
+    marking = true;
+    markingStart = start;
+    oldAtStart = oldSince;
+    Marker marker(epoch);
+    traceRoots(marker);
+    ConcurrentCollector::Roots seed;
+    seed.Objects = objects;
+    if (stackBase) {
+      for (size_t i = 0; i < stackBase->count; i++) {
+        marker.mark(stackBase->arguments[i].getReference());
+      }
+      scanStack(&registers, stackBase,
+                [&](uint64_t word) { seed.Words.push_back(word); });
+    }
+    background.reset(new ConcurrentCollector(epoch, options.MarkerThreads));
+    background->mark(marker.take(), std::move(seed));
+    statistics.MajorCollections++;
+    record(start, statistics.MajorPauseTotal, statistics.MajorPauseMax);
+  }
+
+  // Takes over from background work that is done: marks what the write
+  // barrier left in another round, or starts sweeping once there is
+  // nothing, or puts back what sweeping kept
+  void advance(Clock::time_point start) {
+    background->join();
+    if (marking && !gray.empty()) {
+      background->mark(std::move(gray));
+      gray.clear();
+    } else if (marking) {
+      marking = false;
+      statistics.MarkingTotal +=
+          std::chrono::duration<double>(start - markingStart).count();
+      // What marking traced, and what was allocated black since it began
+      keptBytes = background->getMarkedBytes() + oldSince - oldAtStart;
+      oldSince = 0;
+      oldAtStart = 0;
+      threshold = std::max(options.Threshold,
+                           static_cast<size_t>(keptBytes * options.Growth));
+      // Objects allocated from here on are not swept this time
+      HeapObject *swept = objects;
+      objects = nullptr;
+      background->sweep(swept);
+    } else {
+      finishSweeping();
+      background.reset();
+    }
+    record(start, statistics.MajorPauseTotal, statistics.MajorPauseMax);
+  }
+
+  // Frees what sweeping left for the mutator, and puts back what it kept
+  void finishSweeping() {
+    ConcurrentCollector::Swept &swept = background->getSwept();
+    for (HeapObject *object : swept.InBlocks) {
+      release(object);
+    }
+    if (swept.Head) {
+      swept.Tail->Next = objects;
+      objects = swept.Head;
+    }
+    objectCount -= swept.Freed;
+    statistics.ObjectsFreed += swept.Freed;
+  }
+
+  // Marks and sweeps the old generation, once the nursery is empty
+  void collectOld() {
+    std::jmp_buf registers;
+    setjmp(registers);
+
+    epoch = static_cast<uint8_t>(3 - epoch);
+    Marker marker(epoch);
+    std::vector<HeapObject *> addresses;
+    addresses.reserve(objectCount);
+    for (HeapObject *object = objects; object; object = object->Next) {
+      addresses.push_back(object);
+      if (object->getRefCount() > 0) {
+        marker.mark(object);
+      }
+    }
+    traceRoots(marker);
+    if (stackBase) {
+      for (size_t i = 0; i < stackBase->count; i++) {
+        marker.mark(stackBase->arguments[i].getReference());
+      }
+      std::sort(addresses.begin(), addresses.end());
+      scanStack(&registers, stackBase, [&](uint64_t word) {
+        marker.mark(ConcurrentCollector::find(addresses, word));
+        marker.mark(
+            ConcurrentCollector::find(addresses, word & Value::PayloadMask));
+      });
+    }
+    marker.drain();
+    sweep();
+  }
+
+  // Calls visit with each word from top up to base. Reads the frames of
+  // other functions, which address sanitizers would object to.
+  template <typename Visit>
+  SODA_NO_SANITIZE_ADDRESS static void scanStack(const void *top,
+                                                 const void *base,
+                                                 Visit visit) {
+    uintptr_t from = reinterpret_cast<uintptr_t>(top) & ~uintptr_t(7);
+    uintptr_t to = reinterpret_cast<uintptr_t>(base);
+    for (uintptr_t word = from; word + sizeof(uint64_t) <= to;
+         word += sizeof(uint64_t)) {
+      visit(*reinterpret_cast<const uint64_t *>(word));
+    }
+  }
+
+  void sweep() {
+    HeapObject **link = &objects;
+    keptBytes = 0;
+    while (HeapObject *object = *link) {
+      if (object->Mark.load(std::memory_order_relaxed) == epoch) {
+        object->Mark.store(0, std::memory_order_relaxed);
+        keptBytes += object->size();
+        link = &object->Next;
+      } else {
+        *link = object->Next;
+        release(object);
+        objectCount--;
+        statistics.ObjectsFreed++;
+      }
+    }
+    oldSince = 0;
+    threshold = std::max(options.Threshold,
+                         static_cast<size_t>(keptBytes * options.Growth));
+  }
+
+  // Frees an old object, and the block the nursery left it in once nothing
+  // else is
+  void release(HeapObject *object) {
+    if (!object->InBlock) {
+      delete object;
+      return;
+    }
+    char *at = reinterpret_cast<char *>(object);
+    object->~HeapObject();
+    auto block = std::upper_bound(retained.begin(), retained.end(), at,
+                                  [](const char *at, const Block &block) {
+                                    return at < block.Start;
+                                  }) -
+                 1;
+    if (--block->Live == 0) {
+      ::operator delete(block->Start);
+      retained.erase(block);
+    }
+  }
+
+  static void record(Clock::time_point start, double &total,
+                     double &longest) {
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    total += seconds;
+    longest = std::max(longest, seconds);
+  }
+};
+
+#endif // HEAP_H
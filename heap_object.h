@@ -0,0 +1,89 @@
+#ifndef HEAP_OBJECT_H
+#define HEAP_OBJECT_H
+
+#include "ref_counted.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum class ObjectKind {
+  String,
+  Array,
+  Dictionary,
+  Function, // Compiled bytecode of one function body
+  Closure,  // Function plus its captured environment
+  Native,   // Builtin implemented in C++
+  Class,
+  Instance,
+  Cell,    // Heap box for a captured variable that is reassigned
+  Integer, // Int beyond the range a Value holds inline
+  Shape,   // Field layout shared by instances
+  Task,    // Async function call, or other work finished later
+};
+
+class Tracer;
+
+// Header shared by everything the runtime allocates on its Heap. The
+// reference count counts the references from outside the heap, which keep
+// an object alive; the collector finds the rest by tracing.
+class HeapObject : public RefCounted {
+public:
+  // Whether the kind can be made in the nursery, which takes moveTo
+  static const bool Movable = false;
+
+  // Scan while a thread traces the object
+  static const uint8_t Scanning = 3;
+
+  const ObjectKind Kind;
+  std::atomic<uint8_t> Mark{0}; // Epoch of the collection that reached it,
+                                // or 0; set for a pinned young object
+  std::atomic<uint8_t> Scan{0}; // Epoch of the concurrent marking that
+                                // traced it, or Scanning
+  bool Young = false;      // In the nursery
+  bool Remembered = false; // Young, or in the heap's remembered set, so
+                           // storing into it needs no write barrier
+  bool InBlock = false;    // Allocated in a nursery block, not on its own
+  uint32_t Extent = 0;     // Bytes of its own memory
+  HeapObject *Next = nullptr; // Intrusive list of the old objects; where a
+                              // young object was moved to
+
+  explicit HeapObject(ObjectKind kind) : Kind(kind) {}
+
+  // Approximate bytes owned by the object, for heap accounting. At least
+  // the object's own extent.
+  virtual size_t size() const = 0;
+
+  // Marks the objects this one refers to
+  virtual void trace(Tracer &) {}
+
+  // Moves the object into memory of Extent bytes, leaving this one to be
+  // destroyed. Only for Movable kinds.
+  virtual HeapObject *moveTo(void *) { return nullptr; }
+
+  // Rebuilds whatever the object keeps by the address of what it refers to,
+  // once a collection has moved some of it
+  virtual void rehash() {}
+
+  // Waits for any thread tracing the object, then keeps others from it
+  // until unlock. For changing what it refers to without a write barrier,
+  // which marking on another thread could be reading. Returns the state
+  // to unlock with.
+  uint8_t lock() {
+    for (;;) {
+      uint8_t state = Scan.load(std::memory_order_acquire);
+      if (state != Scanning &&
+          Scan.compare_exchange_weak(state, Scanning,
+                                     std::memory_order_acquire)) {
+        return state;
+      }
+    }
+  }
+
+  void unlock(uint8_t state) { Scan.store(state, std::memory_order_release); }
+
+protected:
+  // The heap frees the object once the collector finds it unreachable
+  void destroy() override {}
+};
+
+#endif // HEAP_OBJECT_H
@@ -0,0 +1,718 @@
+#ifndef HEAP_SNAPSHOT_H
+#define HEAP_SNAPSHOT_H
+
+#include "array_object.h"
+#include "cell_object.h"
+#include "class_object.h"
+#include "closure_object.h"
+#include "dictionary_object.h"
+#include "function_object.h"
+#include "heap.h"
+#include "heap_object.h"
+#include "instance_object.h"
+#include "integer_object.h"
+#include "native_object.h"
+#include "script_runtime.h"
+#include "shape.h"
+#include "string_object.h"
+#include "tracer.h"
+#include "value.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SODA_SNAPSHOT_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define SODA_SNAPSHOT_MMAP 0
+#endif
+
+// The globals of a runtime that has run its package, and every object they
+// reach, as an image other runtimes start from instead of compiling and
+// running the package again. A reference in the image is the number of the
+// object it points to, so the image loads at any address: loading maps the
+// file, makes each object in one pass and fills in their references in a
+// second. Builtins are referred to by name and bound to the loading
+// runtime's own, so natives and what the host defined are never copied.
+// Bytecode is kept; machine code and inline caches are not.
+//
+// An image is for the build that wrote it. Tasks cannot be in one, and
+// neither can functions of the tiers that run trees or compiled C++.
+class HeapSnapshot {
+public:
+  HeapSnapshot(const HeapSnapshot &) = delete;
+  HeapSnapshot &operator=(const HeapSnapshot &) = delete;
+
+  ~HeapSnapshot() {
+#if SODA_SNAPSHOT_MMAP
+    if (mapped) {
+      munmap(const_cast<char *>(bytes), size);
+    }
+#endif
+  }
+
+  // Writes the image of runtime to path. Only while no script runs.
+  static bool save(ScriptRuntime &runtime, const std::string &path,
+                   std::string &error) {
+    std::string image;
+    try {
+      image = encode(runtime);
+    } catch (const RuntimeError &e) {
+      error = e.what();
+      return false;
+    }
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(image.data(), static_cast<std::streamsize>(image.size()));
+    if (!out) {
+      error = "Cannot write " + path;
+      return false;
+    }
+    return true;
+  }
+
+  // Maps the image at path read-only, so the processes loading it share
+  // its pages. Returns null if it cannot be read.
+  static std::shared_ptr<const HeapSnapshot> open(const std::string &path,
+                                                  std::string &error) {
+    std::shared_ptr<HeapSnapshot> snapshot(new HeapSnapshot());
+#if SODA_SNAPSHOT_MMAP
+    int file = ::open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (file >= 0 && fstat(file, &status) == 0 && status.st_size > 0) {
+      void *memory = mmap(nullptr, static_cast<size_t>(status.st_size),
+                          PROT_READ, MAP_PRIVATE, file, 0);
+      if (memory != MAP_FAILED) {
+        snapshot->bytes = static_cast<const char *>(memory);
+        snapshot->size = static_cast<size_t>(status.st_size);
+        snapshot->mapped = true;
+      }
+    }
+    if (file >= 0) {
+      close(file);
+    }
+#else
+    std::ifstream in(path, std::ios::binary);
+    snapshot->buffer.assign(std::istreambuf_iterator<char>(in),
+                            std::istreambuf_iterator<char>());
+    snapshot->bytes = snapshot->buffer.data();
+    snapshot->size = snapshot->buffer.size();
+#endif
+    if (!snapshot->bytes) {
+      error = "Cannot read " + path;
+      return nullptr;
+    }
+    if (snapshot->size < MagicLength + 8 ||
+        std::memcmp(snapshot->bytes, magic(), MagicLength) != 0) {
+      error = path + " is not a snapshot";
+      return nullptr;
+    }
+    return snapshot;
+  }
+
+  // Makes the image's objects in runtime's heap and its globals runtime's.
+  // Any number of runtimes can load one image at once, each before it has
+  // run anything.
+  bool restore(ScriptRuntime &runtime, std::string &error) const {
+    try {
+      decode(runtime);
+    } catch (const RuntimeError &e) {
+      error = e.what();
+      return false;
+    }
+    return true;
+  }
+
+  size_t getSize() const { return size; }
+
+private:
+  static const size_t MagicLength = 8;
+  static const uint32_t Version = 2; // Code is kept as is, so opcodes count
+  static const uint32_t Null = 0xFFFFFFFF; // A reference to no object
+
+  // Records that are not objects of their own: a builtin of the loading
+  // runtime, by name, and its empty shape
+  static const uint8_t Builtin = 0xFE;
+  static const uint8_t EmptyShape = 0xFF;
+
+  const char *bytes = nullptr;
+  size_t size = 0;
+  bool mapped = false;
+  std::vector<char> buffer; // The image where it cannot be mapped
+
+  HeapSnapshot() {}
+
+  // What an image starts with
+  static const char *magic() { return "SODASNAP"; }
+
+  // Writing
+
+  // Finds the objects the globals reach. Builtins and the empty shape are
+  // where it stops, and ropes are flattened, as their text is what is kept.
+  class Collector : public Tracer {
+  public:
+    std::vector<HeapObject *> Objects; // In the order found
+    std::unordered_map<const HeapObject *, std::string> Builtins;
+
+    explicit Collector(ScriptRuntime &runtime) : runtime(runtime) {
+      for (auto &builtin : runtime.builtins) {
+        if (HeapObject *object = builtin.second.getReference()) {
+          Builtins[object] = builtin.first;
+        }
+      }
+    }
+
+  protected:
+    // Prototypes, owners and parent shapes are not traced, so they are
+    // marked here
+    HeapObject *visit(HeapObject *object) override {
+      if (!found.insert(object).second) {
+        return object;
+      }
+      Objects.push_back(object);
+      if (Builtins.count(object) || object == runtime.emptyShape) {
+        return object;
+      }
+      switch (object->Kind) {
+      case ObjectKind::String:
+        static_cast<StringObject *>(object)->chars();
+        break;
+      case ObjectKind::Shape:
+        mark(static_cast<Shape *>(object)->Parent);
+        break;
+      case ObjectKind::Function: {
+        auto *function = static_cast<FunctionObject *>(object);
+        for (FunctionObject *prototype : function->Prototypes) {
+          mark(static_cast<HeapObject *>(prototype));
+        }
+        mark(static_cast<HeapObject *>(function->Owner));
+        break;
+      }
+      default:
+        break;
+      }
+      pending.push_back(object);
+      return object;
+    }
+
+  private:
+    ScriptRuntime &runtime;
+    std::unordered_set<const HeapObject *> found;
+  };
+
+  class Output {
+  public:
+    std::string Bytes;
+    std::unordered_map<const HeapObject *, uint32_t> Numbers;
+
+    template <typename T> void scalar(T value) {
+      Bytes.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void text(const std::string &value) {
+      scalar(static_cast<uint32_t>(value.size()));
+      Bytes.append(value);
+    }
+
+    void reference(const HeapObject *object) {
+      scalar(object ? Numbers.at(object) : uint32_t(Null));
+    }
+
+    // The value's bits, with the number of the object it refers to as the
+    // payload
+    void value(const Value &value) {
+      HeapObject *object = value.getReference();
+      scalar(object ? (value.getBits() & ~Value::PayloadMask) |
+                          Numbers.at(object)
+                    : value.getBits());
+    }
+
+    void values(const std::vector<Value> &values) {
+      scalar(static_cast<uint32_t>(values.size()));
+      for (const Value &each : values) {
+        value(each);
+      }
+    }
+
+    void texts(const std::vector<std::string> &values) {
+      scalar(static_cast<uint32_t>(values.size()));
+      for (const std::string &each : values) {
+        text(each);
+      }
+    }
+  };
+
+  // Objects are written in an order that has what each needs to be made
+  // before it: the parent of a shape, the function of a closure, and the
+  // class and layout of an instance
+  static int rank(const Collector &collector, const HeapObject *object) {
+    if (collector.Builtins.count(object)) {
+      return 0;
+    }
+    switch (object->Kind) {
+    case ObjectKind::String:
+    case ObjectKind::Integer:
+      return 1;
+    case ObjectKind::Shape:
+      return 2;
+    case ObjectKind::Class:
+    case ObjectKind::Function:
+      return 3;
+    default:
+      return 4;
+    }
+  }
+
+  static std::string encode(ScriptRuntime &runtime) {
+    Collector collector(runtime);
+    collector.mark(runtime.globals.data(), runtime.globals.size());
+    collector.drain();
+    std::vector<HeapObject *> objects = collector.Objects;
+    std::stable_sort(objects.begin(), objects.end(),
+                     [&](const HeapObject *a, const HeapObject *b) {
+                       int first = rank(collector, a);
+                       int second = rank(collector, b);
+                       if (first != second) {
+                         return first < second;
+                       }
+                       // Parents have fewer slots than their children
+                       return first == 2 &&
+                              static_cast<const Shape *>(a)->SlotCount <
+                                  static_cast<const Shape *>(b)->SlotCount;
+                     });
+    Output out;
+    for (size_t i = 0; i < objects.size(); i++) {
+      out.Numbers[objects[i]] = static_cast<uint32_t>(i);
+    }
+    out.Bytes.append(magic(), MagicLength);
+    out.scalar(Version);
+    out.scalar(static_cast<uint32_t>(objects.size()));
+    for (HeapObject *object : objects) {
+      size_t start = out.Bytes.size();
+      out.scalar(uint8_t(0));
+      out.scalar(uint32_t(0));
+      auto found = collector.Builtins.find(object);
+      uint8_t kind = found != collector.Builtins.end() ? Builtin
+                     : object == runtime.emptyShape
+                         ? EmptyShape
+                         : static_cast<uint8_t>(object->Kind);
+      if (kind == Builtin) {
+        out.text(found->second);
+      } else if (kind != EmptyShape) {
+        write(runtime, out, object);
+      }
+      uint32_t length =
+          static_cast<uint32_t>(out.Bytes.size() - start - 5);
+      out.Bytes[start] = static_cast<char>(kind);
+      std::memcpy(&out.Bytes[start + 1], &length, sizeof(length));
+    }
+    out.texts(runtime.globalNames);
+    out.values(runtime.globals);
+    return out.Bytes;
+  }
+
+  // What each object needs to be made comes first, then the rest
+  static void write(ScriptRuntime &runtime, Output &out, HeapObject *object) {
+    switch (object->Kind) {
+    case ObjectKind::String: {
+      auto *string = static_cast<StringObject *>(object);
+      out.scalar(uint8_t(runtime.heap.isInterned(string)));
+      out.text(string->text());
+      break;
+    }
+    case ObjectKind::Integer:
+      out.scalar(static_cast<IntegerObject *>(object)->Integer);
+      break;
+    case ObjectKind::Shape: {
+      auto *shape = static_cast<Shape *>(object);
+      out.reference(shape->Parent);
+      out.text(shape->Field);
+      break;
+    }
+    case ObjectKind::Class: {
+      auto *cls = static_cast<ClassObject *>(object);
+      out.text(cls->Name);
+      out.reference(cls->Base);
+      out.texts(cls->FieldNames);
+      out.texts(cls->MethodNames);
+      out.values(cls->Methods);
+      out.value(cls->Initializer);
+      out.reference(cls->InstanceLayout);
+      break;
+    }
+    case ObjectKind::Function: {
+      auto *function = static_cast<FunctionObject *>(object);
+      if (function->Tree || function->Compiled) {
+        throw RuntimeError("Cannot snapshot '" + function->Name +
+                           "', which is not bytecode");
+      }
+      out.text(function->Name);
+      out.scalar(static_cast<int32_t>(function->Arity));
+      out.scalar(static_cast<int32_t>(function->RegisterCount));
+      out.scalar(uint8_t(function->Async));
+      out.scalar(static_cast<uint32_t>(function->Code.size()));
+      out.Bytes.append(reinterpret_cast<const char *>(function->Code.data()),
+                       function->Code.size() * sizeof(uint32_t));
+      out.values(function->Constants);
+      out.texts(function->Names);
+      out.scalar(static_cast<uint32_t>(function->Caches.size()));
+      out.scalar(static_cast<uint32_t>(function->Prototypes.size()));
+      for (FunctionObject *prototype : function->Prototypes) {
+        out.reference(prototype);
+      }
+      out.scalar(static_cast<uint32_t>(function->Captures.size()));
+      for (const CaptureDescriptor &capture : function->Captures) {
+        out.scalar(uint8_t(capture.FromEnvironment));
+        out.scalar(static_cast<int32_t>(capture.Index));
+        out.scalar(uint8_t(capture.ByReference));
+      }
+      out.reference(function->Owner);
+      break;
+    }
+    case ObjectKind::Closure: {
+      auto *closure = static_cast<ClosureObject *>(object);
+      out.reference(closure->Function);
+      out.values(closure->Environment);
+      out.value(closure->Receiver);
+      break;
+    }
+    case ObjectKind::Instance: {
+      auto *instance = static_cast<InstanceObject *>(object);
+      out.reference(instance->Class);
+      out.reference(instance->Layout);
+      for (int i = 0; i < instance->Layout->SlotCount; i++) {
+        out.value(instance->fields()[i]);
+      }
+      break;
+    }
+    case ObjectKind::Array: {
+      auto *array = static_cast<ArrayObject *>(object);
+      out.scalar(static_cast<uint32_t>(array->count()));
+      for (size_t i = 0; i < array->count(); i++) {
+        out.value(array->get(i));
+      }
+      break;
+    }
+    case ObjectKind::Dictionary: {
+      auto &entries = static_cast<DictionaryObject *>(object)->getEntries();
+      out.scalar(static_cast<uint32_t>(entries.size()));
+      for (const auto &entry : entries) {
+        out.value(entry.first);
+        out.value(entry.second);
+      }
+      break;
+    }
+    case ObjectKind::Cell:
+      out.value(static_cast<CellObject *>(object)->Contents);
+      break;
+    case ObjectKind::Native:
+      throw RuntimeError("Cannot snapshot the native '" +
+                         static_cast<NativeObject *>(object)->Name +
+                         "', which is not a builtin");
+    case ObjectKind::Task:
+      throw RuntimeError("Cannot snapshot a task");
+    }
+  }
+
+  // Reading
+
+  class Input {
+  public:
+    Input(const char *at, const char *end) : at(at), end(end) {}
+
+    const char *position() const { return at; }
+
+    void seek(const char *position) { at = position; }
+
+    template <typename T> T scalar() {
+      T value;
+      std::memcpy(&value, take(sizeof(value)), sizeof(value));
+      return value;
+    }
+
+    size_t count() { return scalar<uint32_t>(); }
+
+    const char *take(size_t bytes) {
+      if (static_cast<size_t>(end - at) < bytes) {
+        corrupt();
+      }
+      const char *taken = at;
+      at += bytes;
+      return taken;
+    }
+
+    std::string text() {
+      size_t length = count();
+      return std::string(take(length), length);
+    }
+
+    std::vector<std::string> texts() {
+      std::vector<std::string> values(count());
+      for (std::string &value : values) {
+        value = text();
+      }
+      return values;
+    }
+
+    [[noreturn]] static void corrupt() {
+      throw RuntimeError("The snapshot is corrupt");
+    }
+
+  private:
+    const char *at;
+    const char *end;
+  };
+
+  // The objects made so far, and what their references are read with
+  class Loader {
+  public:
+    Input In;
+    std::vector<HeapObject *> Objects;
+
+    Loader(const char *at, const char *end, size_t count)
+        : In(at, end), Objects(count, nullptr) {}
+
+    // A reference to an object of kind made already, or null
+    template <typename T> T *reference(ObjectKind kind) {
+      uint32_t number = In.scalar<uint32_t>();
+      if (number == Null) {
+        return nullptr;
+      }
+      if (number >= Objects.size() || !Objects[number] ||
+          Objects[number]->Kind != kind) {
+        Input::corrupt();
+      }
+      return static_cast<T *>(Objects[number]);
+    }
+
+    Value value() {
+      uint64_t bits = In.scalar<uint64_t>();
+      uint64_t tag = bits >> Value::TagShift;
+      if (tag != Value::ObjectTag && tag != Value::BoxedIntTag) {
+        return Value::fromBits(bits);
+      }
+      uint64_t number = bits & Value::PayloadMask;
+      if (number >= Objects.size() || !Objects[number] ||
+          (tag == Value::BoxedIntTag) !=
+              (Objects[number]->Kind == ObjectKind::Integer)) {
+        Input::corrupt();
+      }
+      return Value::fromBits(
+          (bits & ~Value::PayloadMask) |
+          static_cast<uint64_t>(reinterpret_cast<uintptr_t>(Objects[number])));
+    }
+
+    std::vector<Value> values() {
+      std::vector<Value> values(In.count());
+      for (Value &each : values) {
+        each = value();
+      }
+      return values;
+    }
+  };
+
+  void decode(ScriptRuntime &runtime) const {
+    Heap &heap = runtime.heap;
+    heap.finishCollection();
+    Input header(bytes + MagicLength, bytes + size);
+    if (header.scalar<uint32_t>() != Version) {
+      throw RuntimeError("The snapshot is from another version");
+    }
+    size_t count = header.count();
+    Loader loader(header.position(), bytes + size, count);
+    Input &in = loader.In;
+    // Made first, each after what it needs
+    std::vector<const char *> rest(count);
+    for (size_t i = 0; i < count; i++) {
+      uint8_t kind = in.scalar<uint8_t>();
+      size_t length = in.count();
+      const char *start = in.position();
+      loader.Objects[i] = make(runtime, loader, kind);
+      size_t made = static_cast<size_t>(in.position() - start);
+      if (made > length) {
+        Input::corrupt();
+      }
+      // Builtins and the empty shape are not filled in
+      rest[i] = kind == Builtin || kind == EmptyShape ? nullptr : in.position();
+      in.take(length - made);
+    }
+    const char *globals = in.position();
+    // Then the references between them filled in
+    for (size_t i = 0; i < count; i++) {
+      if (rest[i]) {
+        in.seek(rest[i]);
+        fill(loader, loader.Objects[i]);
+      }
+    }
+    in.seek(globals);
+    std::vector<std::string> names = in.texts();
+    std::vector<Value> values = loader.values();
+    if (names.size() != values.size()) {
+      Input::corrupt();
+    }
+    runtime.globalNames = std::move(names);
+    runtime.globals = std::move(values);
+  }
+
+  static HeapObject *make(ScriptRuntime &runtime, Loader &loader,
+                          uint8_t kind) {
+    Heap &heap = runtime.heap;
+    Input &in = loader.In;
+    if (kind == Builtin) {
+      std::string name = in.text();
+      auto found = runtime.builtins.find(name);
+      if (found == runtime.builtins.end() ||
+          !found->second.getReference()) {
+        throw RuntimeError("The snapshot needs the builtin '" + name + "'");
+      }
+      return found->second.getReference();
+    }
+    if (kind == EmptyShape) {
+      return runtime.emptyShape;
+    }
+    switch (static_cast<ObjectKind>(kind)) {
+    case ObjectKind::String: {
+      bool interned = in.scalar<uint8_t>() != 0;
+      size_t length = in.count();
+      const char *text = in.take(length);
+      if (interned) {
+        return heap.intern(std::string(text, length));
+      }
+      StringObject *string = heap.create<StringObject>(length);
+      std::memcpy(string->data(), text, length);
+      return string;
+    }
+    case ObjectKind::Integer:
+      return heap.allocate<IntegerObject>(in.scalar<int64_t>());
+    case ObjectKind::Shape: {
+      Shape *parent = loader.reference<Shape>(ObjectKind::Shape);
+      std::string field = in.text();
+      if (!parent) {
+        Input::corrupt();
+      }
+      Shape *shape = parent->findTransition(field);
+      if (!shape) {
+        shape = heap.allocate<Shape>(parent, field);
+        parent->addTransition(field, shape);
+      }
+      return shape;
+    }
+    case ObjectKind::Class:
+      return heap.allocate<ClassObject>(in.text());
+    case ObjectKind::Function:
+      return heap.allocate<FunctionObject>();
+    case ObjectKind::Closure: {
+      auto *function = loader.reference<FunctionObject>(ObjectKind::Function);
+      if (!function) {
+        Input::corrupt();
+      }
+      return heap.allocate<ClosureObject>(function);
+    }
+    case ObjectKind::Instance: {
+      auto *cls = loader.reference<ClassObject>(ObjectKind::Class);
+      Shape *layout = loader.reference<Shape>(ObjectKind::Shape);
+      if (!cls || !layout) {
+        Input::corrupt();
+      }
+      return heap.create<InstanceObject>(cls, layout);
+    }
+    case ObjectKind::Array:
+      return heap.allocate<ArrayObject>();
+    case ObjectKind::Dictionary:
+      return heap.allocate<DictionaryObject>();
+    case ObjectKind::Cell:
+      return heap.allocate<CellObject>(Value());
+    default:
+      Input::corrupt();
+    }
+  }
+
+  static void fill(Loader &loader, HeapObject *object) {
+    Input &in = loader.In;
+    switch (object->Kind) {
+    case ObjectKind::Class: {
+      auto *cls = static_cast<ClassObject *>(object);
+      cls->Base = loader.reference<ClassObject>(ObjectKind::Class);
+      cls->FieldNames = in.texts();
+      cls->MethodNames = in.texts();
+      cls->Methods = loader.values();
+      cls->Initializer = loader.value();
+      cls->InstanceLayout = loader.reference<Shape>(ObjectKind::Shape);
+      cls->indexMembers();
+      break;
+    }
+    case ObjectKind::Function: {
+      auto *function = static_cast<FunctionObject *>(object);
+      function->Name = in.text();
+      function->Arity = in.scalar<int32_t>();
+      function->RegisterCount = in.scalar<int32_t>();
+      function->Async = in.scalar<uint8_t>() != 0;
+      function->Code.resize(in.count());
+      std::memcpy(function->Code.data(),
+                  in.take(function->Code.size() * sizeof(uint32_t)),
+                  function->Code.size() * sizeof(uint32_t));
+      function->Constants = loader.values();
+      function->Names = in.texts();
+      function->Caches.resize(in.count());
+      function->Prototypes.resize(in.count());
+      for (FunctionObject *&prototype : function->Prototypes) {
+        prototype = loader.reference<FunctionObject>(ObjectKind::Function);
+      }
+      function->Captures.resize(in.count());
+      for (CaptureDescriptor &capture : function->Captures) {
+        capture.FromEnvironment = in.scalar<uint8_t>() != 0;
+        capture.Index = in.scalar<int32_t>();
+        capture.ByReference = in.scalar<uint8_t>() != 0;
+      }
+      function->Owner = loader.reference<ClassObject>(ObjectKind::Class);
+      break;
+    }
+    case ObjectKind::Closure: {
+      auto *closure = static_cast<ClosureObject *>(object);
+      closure->Environment = loader.values();
+      closure->Receiver = loader.value();
+      break;
+    }
+    case ObjectKind::Instance: {
+      auto *instance = static_cast<InstanceObject *>(object);
+      for (int i = 0; i < instance->Layout->SlotCount; i++) {
+        instance->fields()[i] = loader.value();
+      }
+      break;
+    }
+    case ObjectKind::Array: {
+      std::vector<Value> elements = loader.values();
+      static_cast<ArrayObject *>(object)->assign(elements.data(),
+                                                 elements.size());
+      break;
+    }
+    case ObjectKind::Dictionary: {
+      auto *dictionary = static_cast<DictionaryObject *>(object);
+      size_t entries = in.count();
+      for (size_t i = 0; i < entries; i++) {
+        Value key = loader.value();
+        dictionary->set(key, loader.value());
+      }
+      break;
+    }
+    case ObjectKind::Cell:
+      static_cast<CellObject *>(object)->Contents = loader.value();
+      break;
+    default:
+      break;
+    }
+  }
+};
+
+#endif // HEAP_SNAPSHOT_H
@@ -0,0 +1,84 @@
+#ifndef INLINE_CACHE_H
+#define INLINE_CACHE_H
+
+#include "heap_object.h"
+#include "instance_object.h"
+#include "shape.h"
+#include "value.h"
+
+// What one member access site found on the receivers it has seen: the
+// field slot for each instance Shape, or the method slot for each class
+// whose methods it called. Keeps the first Ways of them; a site that sees
+// more is megamorphic and looks the rest up by name.
+class InlineCache {
+public:
+  static const int Ways = 4;
+
+  struct Entry {
+    const HeapObject *Key; // A Shape or a ClassObject
+    int Slot;
+  };
+
+  // Returns the slot found for key, or -1
+  int find(const HeapObject *key) const {
+    for (int i = 0; i < count; i++) {
+      if (entries[i].Key == key) {
+        return entries[i].Slot;
+      }
+    }
+    return -1;
+  }
+
+  void add(const HeapObject *key, int slot) {
+    if (count < Ways) {
+      entries[count++] = Entry{key, slot};
+    } else {
+      megamorphic = true;
+    }
+  }
+
+  int getCount() const { return count; }
+
+  const Entry &getEntry(int index) const { return entries[index]; }
+
+  bool isMegamorphic() const { return megamorphic; }
+
+  // The hits that need no lookup: a field of an instance whose shape was
+  // seen before. Each returns false, changing nothing, on anything else.
+
+  bool getField(const Value &receiver, Value &result) const {
+    InstanceObject *instance = asInstance(receiver);
+    int slot = instance ? find(instance->Layout) : -1;
+    if (slot < 0) {
+      return false;
+    }
+    result = instance->fields()[slot];
+    return true;
+  }
+
+  // Also fails for an instance a store would need the heap's write barrier
+  // for, which the caller runs before trying again
+  bool setField(const Value &receiver, const Value &value) const {
+    InstanceObject *instance = asInstance(receiver);
+    int slot = instance && instance->Remembered ? find(instance->Layout) : -1;
+    if (slot < 0) {
+      return false;
+    }
+    instance->fields()[slot] = value;
+    return true;
+  }
+
+private:
+  Entry entries[Ways];
+  int count = 0;
+  bool megamorphic = false;
+
+  static InstanceObject *asInstance(const Value &value) {
+    if (!value.isObject() || value.asObject()->Kind != ObjectKind::Instance) {
+      return nullptr;
+    }
+    return static_cast<InstanceObject *>(value.asObject());
+  }
+};
+
+#endif // INLINE_CACHE_H
@@ -0,0 +1,67 @@
+#ifndef INSTANCE_OBJECT_H
+#define INSTANCE_OBJECT_H
+
+#include "class_object.h"
+#include "heap_object.h"
+#include "shape.h"
+#include "tracer.h"
+#include "value.h"
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+// Instance of a script class. Its fields are stored right after the object,
+// in the slots its Layout gives them, which match Class->FieldNames.
+class InstanceObject : public HeapObject {
+public:
+  static const bool Movable = true;
+
+  ClassObject *Class;
+  Shape *const Layout;
+
+  // Allocates an instance with room for the fields of layout. The Heap
+  // makes instances through this, never with plain new, giving it a
+  // function that returns memory of the size asked for.
+  template <typename Allocate>
+  static InstanceObject *create(Allocate allocate, ClassObject *cls,
+                                Shape *layout) {
+    return new (allocate(fieldOffset(layout->SlotCount)))
+        InstanceObject(cls, layout);
+  }
+
+  static void operator delete(void *memory) { ::operator delete(memory); }
+
+  Value *fields() { return reinterpret_cast<Value *>(this + 1); }
+
+  // Bytes from the start of the object to a field, for generated code
+  static size_t fieldOffset(int slot) {
+    return sizeof(InstanceObject) + slot * sizeof(Value);
+  }
+
+  size_t size() const override { return fieldOffset(Layout->SlotCount); }
+
+  void trace(Tracer &tracer) override {
+    tracer.mark(Class);
+    tracer.mark(Layout);
+    tracer.mark(fields(), Layout->SlotCount);
+  }
+
+  HeapObject *moveTo(void *memory) override {
+    auto *moved = new (memory) InstanceObject(Class, Layout);
+    std::copy(fields(), fields() + Layout->SlotCount, moved->fields());
+    return moved;
+  }
+
+private:
+  InstanceObject(ClassObject *cls, Shape *layout)
+      : HeapObject(ObjectKind::Instance), Class(cls), Layout(layout) {
+    static_assert(sizeof(InstanceObject) % alignof(Value) == 0,
+                  "Fields must be aligned");
+    Value *slots = fields();
+    for (int i = 0; i < layout->SlotCount; i++) {
+      new (&slots[i]) Value();
+    }
+  }
+};
+
+#endif // INSTANCE_OBJECT_H
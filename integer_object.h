@@ -0,0 +1,25 @@
+#ifndef INTEGER_OBJECT_H
+#define INTEGER_OBJECT_H
+
+#include "heap_object.h"
+#include <cstdint>
+#include <new>
+
+// Int too wide for a Value to hold inline
+class IntegerObject : public HeapObject {
+public:
+  static const bool Movable = true;
+
+  const int64_t Integer;
+
+  explicit IntegerObject(int64_t integer)
+      : HeapObject(ObjectKind::Integer), Integer(integer) {}
+
+  size_t size() const override { return sizeof(*this); }
+
+  HeapObject *moveTo(void *memory) override {
+    return new (memory) IntegerObject(Integer);
+  }
+};
+
+#endif // INTEGER_OBJECT_H
@@ -2,13 +2,17 @@
 #define LITERAL_EXPRESSION_H
 
 #include "expression.h"
+#include "token.h"
 #include <string>
 
 class LiteralExpression : public Expression {
 public:
   std::string Value;
+  SodaScriptToken Kind; // StringLiteral, IntegerLiteral, BooleanLiteral...
 
-  LiteralExpression(const std::string &value) : Value(value) {}
+  LiteralExpression(const std::string &value,
+                    SodaScriptToken kind = StringLiteral)
+      : Value(value), Kind(kind) {}
 };
 
 #endif // LITERAL_EXPRESSION_H
\ No newline at end of file
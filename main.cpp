@@ -1,9 +1,13 @@
 #include "package.h"
 #include "parser.h"
+#include "program.h"
+#include "script_context.h"
 #include "tokenizer.h"
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
 
 int main() {
   // Read from file or string input
@@ -33,5 +37,21 @@ int main() {
   // Print out the package
   std::cout << "Package: " << package.Name << std::endl;
 
+  // Analyzed once; every context running it shares this
+  auto program = std::make_shared<const Program>(std::move(package));
+  if (!program->getErrors().empty()) {
+    for (const auto &error : program->getErrors()) {
+      std::cerr << error << std::endl;
+    }
+    return 1;
+  }
+
+  // Compile and run
+  ScriptContext context(program);
+  if (!context.run()) {
+    std::cerr << context.getError() << std::endl;
+    return 1;
+  }
+
   return 0;
 }
@@ -0,0 +1,457 @@
+#ifndef MONOMORPHIZER_H
+#define MONOMORPHIZER_H
+
+#include "ast_node.h"
+#include "await_expression.h"
+#include "binary_expression.h"
+#include "call_expression.h"
+#include "class_declaration.h"
+#include "closure_expression.h"
+#include "constructor_call_expression.h"
+#include "dot_access_expression.h"
+#include "for_statement.h"
+#include "function_declaration.h"
+#include "if_statement.h"
+#include "lambda_expression.h"
+#include "literal_expression.h"
+#include "package.h"
+#include "parameter.h"
+#include "return_statement.h"
+#include "soda_type.h"
+#include "type_reference.h"
+#include "variable_declaration.h"
+#include "variable_expression.h"
+#include "while_statement.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Monomorphization of generic package functions and classes. A use such
+// as f<Int>(...), new Box<Double>(...) or a Box<Double> annotation whose
+// type arguments are all primitive is given its own copy of the generic
+// declaration, named after the instantiation ("Box<Double>"), with the
+// type parameters replaced by the arguments. Evaluators then see concrete
+// types there: each copy gets its own inline caches and machine code, and
+// the AotCompiler gives copies over Int, Double or Bool a native variant
+// on unboxed values.
+//
+// Copies are made on demand, once per instantiation, for the uses found in
+// the package and in the copies themselves. Their AST nodes count against
+// a budget; instantiations past it, and those with other type arguments,
+// keep using the generic declaration, whose type parameters mean Any at
+// runtime. Runs before the ScopeResolver, since it adds package members
+// and renames uses to them.
+class Monomorphizer {
+public:
+  explicit Monomorphizer(int budget = 4096) : budget(budget) {}
+
+  void specialize(Package &package) {
+    instantiations = 0;
+    erasedInstantiations = 0;
+    copiedNodes = 0;
+    functions.clear();
+    classes.clear();
+    instances.clear();
+    pending.clear();
+
+    for (const auto &member : package.Members) {
+      if (auto func = std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        if (!func->GenericTypes.empty()) {
+          functions[func->Name] = func.get();
+        }
+      } else if (auto cls =
+                     std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+        if (!cls->GenericTypes.empty()) {
+          classes[cls->Name] = cls.get();
+        }
+      }
+    }
+    if (functions.empty() && classes.empty()) {
+      return;
+    }
+
+    for (const auto &member : package.Members) {
+      rewriteNode(member);
+    }
+    // Copies can instantiate further generics in turn
+    while (!pending.empty()) {
+      std::shared_ptr<AstNode> copy = pending.back();
+      pending.pop_back();
+      rewriteNode(copy);
+      package.Members.push_back(copy);
+    }
+  }
+
+  // Instantiations given a copy
+  int getInstantiations() const { return instantiations; }
+
+  // Instantiations left on the generic declaration by the budget
+  int getErasedInstantiations() const { return erasedInstantiations; }
+
+  int getCopiedNodes() const { return copiedNodes; }
+
+private:
+  typedef std::unordered_map<std::string, std::shared_ptr<TypeReference>>
+      Substitution;
+
+  int budget;
+  int instantiations = 0;
+  int erasedInstantiations = 0;
+  int copiedNodes = 0;
+  std::unordered_map<std::string, FunctionDeclaration *> functions;
+  std::unordered_map<std::string, ClassDeclaration *> classes;
+  // Name of the copy made for each instantiation, empty if none was
+  std::unordered_map<std::string, std::string> instances;
+  std::vector<std::shared_ptr<AstNode>> pending; // Copies not rewritten yet
+  const Substitution *substitution = nullptr;   // Applied while copying
+
+  static std::string typeName(const TypeReference &type) {
+    std::string name = type.Name;
+    if (!type.GenericTypes.empty()) {
+      name += "<";
+      for (size_t i = 0; i < type.GenericTypes.size(); i++) {
+        name += (i > 0 ? ", " : "") + typeName(*type.GenericTypes[i]);
+      }
+      name += ">";
+    }
+    return name;
+  }
+
+  static bool allPrimitive(
+      const std::vector<std::shared_ptr<TypeReference>> &arguments) {
+    for (const auto &argument : arguments) {
+      if (!argument || !argument->GenericTypes.empty() ||
+          !SodaType::fromReference(argument).isPrimitive()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Returns the name of the copy of the generic declaration name, made for
+  // arguments if there is room, or an empty string to keep the generic one
+  std::string
+  instantiate(const std::string &name,
+              const std::vector<std::shared_ptr<TypeReference>> &arguments) {
+    auto func = functions.find(name);
+    auto cls = classes.find(name);
+    const auto &parameters = func != functions.end()
+                                 ? func->second->GenericTypes
+                                 : cls->second->GenericTypes;
+    if (parameters.size() != arguments.size() || !allPrimitive(arguments)) {
+      return "";
+    }
+    std::string instance = typeName(TypeReference(name, arguments));
+    auto existing = instances.find(instance);
+    if (existing != instances.end()) {
+      return existing->second;
+    }
+
+    Substitution replacements;
+    for (size_t i = 0; i < parameters.size(); i++) {
+      replacements[parameters[i]->Name] = arguments[i];
+    }
+    int copiedBefore = copiedNodes;
+    substitution = &replacements;
+    std::shared_ptr<AstNode> copy;
+    if (func != functions.end()) {
+      auto function = copyFunction(*func->second);
+      function->Name = instance;
+      function->GenericTypes.clear();
+      copy = function;
+    } else {
+      auto copied = copyClass(*cls->second);
+      copied->Name = instance;
+      copied->GenericTypes.clear();
+      copy = copied;
+    }
+    substitution = nullptr;
+
+    if (copiedNodes > budget) {
+      copiedNodes = copiedBefore;
+      erasedInstantiations++;
+      instances[instance] = "";
+      return "";
+    }
+    instantiations++;
+    instances[instance] = instance;
+    pending.push_back(copy);
+    return instance;
+  }
+
+  // Rewriting uses of instantiations to their copies
+
+  void rewriteType(const std::shared_ptr<TypeReference> &type) {
+    if (!type) {
+      return;
+    }
+    for (const auto &argument : type->GenericTypes) {
+      rewriteType(argument);
+    }
+    if (!type->GenericTypes.empty() && classes.count(type->Name)) {
+      std::string instance = instantiate(type->Name, type->GenericTypes);
+      if (!instance.empty()) {
+        type->Name = instance;
+        type->GenericTypes.clear();
+      }
+    }
+  }
+
+  void rewriteParameters(const std::vector<std::shared_ptr<Parameter>> &list) {
+    for (const auto &parameter : list) {
+      rewriteType(parameter->Type);
+    }
+  }
+
+  void rewriteStatements(const std::vector<std::shared_ptr<AstNode>> &body) {
+    for (const auto &statement : body) {
+      rewriteNode(statement);
+    }
+  }
+
+  void rewriteNode(const std::shared_ptr<AstNode> &node) {
+    if (!node) {
+      return;
+    }
+    if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      rewriteType(cls->BaseClass);
+      rewriteStatements(cls->Members);
+    } else if (auto func =
+                   std::dynamic_pointer_cast<FunctionDeclaration>(node)) {
+      rewriteParameters(func->Parameters);
+      rewriteType(func->ReturnType);
+      rewriteStatements(func->Body);
+    } else if (auto var =
+                   std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      rewriteType(var->Type);
+      rewriteExpression(var->Value);
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      rewriteExpression(ret->ReturnValue);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      rewriteExpression(ifStmt->Condition);
+      rewriteStatements(ifStmt->ThenBody);
+      rewriteStatements(ifStmt->ElseBody);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      rewriteNode(forStmt->Initializer);
+      rewriteExpression(forStmt->Condition);
+      rewriteNode(forStmt->Increment);
+      rewriteStatements(forStmt->Body);
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      rewriteExpression(whileStmt->Condition);
+      rewriteStatements(whileStmt->Body);
+    } else if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      rewriteExpression(expr);
+    }
+  }
+
+  void rewriteExpression(const std::shared_ptr<Expression> &expr) {
+    if (!expr) {
+      return;
+    }
+    if (auto binary = std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      rewriteExpression(binary->Left);
+      rewriteExpression(binary->Right);
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      rewriteExpression(dot->Left);
+      // Members are looked up by name, so only the arguments can change
+      if (auto call = std::dynamic_pointer_cast<CallExpression>(dot->Right)) {
+        for (const auto &argument : call->Arguments) {
+          rewriteExpression(argument);
+        }
+      }
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      for (const auto &argument : call->GenericTypes) {
+        rewriteType(argument);
+      }
+      for (const auto &argument : call->Arguments) {
+        rewriteExpression(argument);
+      }
+      bool constructor =
+          std::dynamic_pointer_cast<ConstructorCallExpression>(call) != nullptr;
+      if (!call->GenericTypes.empty() &&
+          (constructor ? classes.count(call->FunctionName)
+                       : functions.count(call->FunctionName))) {
+        std::string instance =
+            instantiate(call->FunctionName, call->GenericTypes);
+        if (!instance.empty()) {
+          call->FunctionName = instance;
+          call->GenericTypes.clear();
+        }
+      }
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(expr)) {
+      rewriteExpression(await->Operand);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      rewriteParameters(closure->Parameters);
+      rewriteType(closure->ReturnType);
+      rewriteStatements(closure->Body);
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      rewriteParameters(lambda->Parameters);
+      rewriteType(lambda->ReturnType);
+      rewriteNode(lambda->Body);
+    }
+  }
+
+  // Copying declarations with the type parameters substituted. Copies are
+  // made before the ScopeResolver runs, so there are no bindings to copy.
+
+  std::shared_ptr<TypeReference>
+  copyType(const std::shared_ptr<TypeReference> &type) {
+    if (!type) {
+      return nullptr;
+    }
+    copiedNodes++;
+    if (type->GenericTypes.empty()) {
+      auto replacement = substitution->find(type->Name);
+      if (replacement != substitution->end()) {
+        return std::make_shared<TypeReference>(
+            replacement->second->Name, replacement->second->GenericTypes);
+      }
+    }
+    std::vector<std::shared_ptr<TypeReference>> arguments;
+    for (const auto &argument : type->GenericTypes) {
+      arguments.push_back(copyType(argument));
+    }
+    return std::make_shared<TypeReference>(type->Name, arguments);
+  }
+
+  std::vector<std::shared_ptr<TypeReference>>
+  copyTypes(const std::vector<std::shared_ptr<TypeReference>> &types) {
+    std::vector<std::shared_ptr<TypeReference>> copies;
+    for (const auto &type : types) {
+      copies.push_back(copyType(type));
+    }
+    return copies;
+  }
+
+  std::vector<std::shared_ptr<Parameter>>
+  copyParameters(const std::vector<std::shared_ptr<Parameter>> &parameters) {
+    std::vector<std::shared_ptr<Parameter>> copies;
+    for (const auto &parameter : parameters) {
+      copiedNodes++;
+      copies.push_back(std::make_shared<Parameter>(parameter->Name,
+                                                   copyType(parameter->Type)));
+    }
+    return copies;
+  }
+
+  std::shared_ptr<ClassDeclaration> copyClass(const ClassDeclaration &cls) {
+    copiedNodes++;
+    return std::make_shared<ClassDeclaration>(
+        cls.Name, cls.IsStatic, copyType(cls.BaseClass),
+        copyTypes(cls.GenericTypes), copyStatements(cls.Members));
+  }
+
+  std::shared_ptr<FunctionDeclaration>
+  copyFunction(const FunctionDeclaration &func) {
+    copiedNodes++;
+    auto copy = std::make_shared<FunctionDeclaration>(
+        func.Name, copyParameters(func.Parameters), copyType(func.ReturnType),
+        copyStatements(func.Body), copyTypes(func.GenericTypes));
+    copy->Async = func.Async;
+    return copy;
+  }
+
+  std::vector<std::shared_ptr<AstNode>>
+  copyStatements(const std::vector<std::shared_ptr<AstNode>> &body) {
+    std::vector<std::shared_ptr<AstNode>> copies;
+    for (const auto &statement : body) {
+      copies.push_back(copyNode(statement));
+    }
+    return copies;
+  }
+
+  std::shared_ptr<AstNode> copyNode(const std::shared_ptr<AstNode> &node) {
+    if (!node) {
+      return nullptr;
+    }
+    if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      return copyExpression(expr);
+    }
+    if (auto func = std::dynamic_pointer_cast<FunctionDeclaration>(node)) {
+      return copyFunction(*func);
+    }
+    copiedNodes++;
+    if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      return std::make_shared<VariableDeclaration>(
+          var->Name, copyType(var->Type), copyExpression(var->Value));
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      return std::make_shared<ReturnStatement>(
+          copyExpression(ret->ReturnValue));
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      return std::make_shared<IfStatement>(copyExpression(ifStmt->Condition),
+                                           copyStatements(ifStmt->ThenBody),
+                                           copyStatements(ifStmt->ElseBody));
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      return std::make_shared<ForStatement>(
+          copyNode(forStmt->Initializer), copyExpression(forStmt->Condition),
+          copyNode(forStmt->Increment), copyStatements(forStmt->Body));
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      return std::make_shared<WhileStatement>(
+          copyExpression(whileStmt->Condition),
+          copyStatements(whileStmt->Body));
+    }
+    // Nothing else carries types, so it can be shared
+    return node;
+  }
+
+  std::shared_ptr<Expression>
+  copyExpression(const std::shared_ptr<Expression> &expr) {
+    if (!expr) {
+      return nullptr;
+    }
+    copiedNodes++;
+    if (auto literal = std::dynamic_pointer_cast<LiteralExpression>(expr)) {
+      return std::make_shared<LiteralExpression>(literal->Value,
+                                                 literal->Kind);
+    } else if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      return std::make_shared<VariableExpression>(var->Name);
+    } else if (auto binary =
+                   std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      return std::make_shared<BinaryExpression>(copyExpression(binary->Left),
+                                                binary->Operator,
+                                                copyExpression(binary->Right));
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      return std::make_shared<DotAccessExpression>(copyExpression(dot->Left),
+                                                   copyExpression(dot->Right));
+    } else if (auto constructor =
+                   std::dynamic_pointer_cast<ConstructorCallExpression>(
+                       expr)) {
+      return std::make_shared<ConstructorCallExpression>(
+          constructor->FunctionName, copyTypes(constructor->GenericTypes),
+          copyArguments(constructor->Arguments));
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      return std::make_shared<CallExpression>(call->FunctionName,
+                                              copyTypes(call->GenericTypes),
+                                              copyArguments(call->Arguments));
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(expr)) {
+      return std::make_shared<AwaitExpression>(copyExpression(await->Operand));
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      return std::make_shared<ClosureExpression>(
+          copyParameters(closure->Parameters), copyType(closure->ReturnType),
+          copyStatements(closure->Body), copyTypes(closure->GenericTypes));
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      return std::make_shared<LambdaExpression>(
+          copyParameters(lambda->Parameters), copyNode(lambda->Body),
+          copyType(lambda->ReturnType), copyTypes(lambda->GenericTypes));
+    }
+    return expr;
+  }
+
+  std::vector<std::shared_ptr<Expression>>
+  copyArguments(const std::vector<std::shared_ptr<Expression>> &arguments) {
+    std::vector<std::shared_ptr<Expression>> copies;
+    for (const auto &argument : arguments) {
+      copies.push_back(copyExpression(argument));
+    }
+    return copies;
+  }
+};
+
+#endif // MONOMORPHIZER_H
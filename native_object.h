@@ -0,0 +1,29 @@
+#ifndef NATIVE_OBJECT_H
+#define NATIVE_OBJECT_H
+
+#include "heap_object.h"
+#include "value.h"
+#include <string>
+
+class ScriptRuntime;
+
+typedef Value (*NativeFunction)(ScriptRuntime &runtime,
+                                const Value *arguments, int count);
+
+class NativeObject : public HeapObject {
+public:
+  std::string Name;
+  NativeFunction Function;
+  int Arity; // -1 accepts any number of arguments
+  bool Pure; // Changes nothing but what it allocates, so a parallel body
+             // can call it
+
+  NativeObject(const std::string &name, NativeFunction function, int arity,
+               bool pure = false)
+      : HeapObject(ObjectKind::Native), Name(name), Function(function),
+        Arity(arity), Pure(pure) {}
+
+  size_t size() const override { return sizeof(*this) + Name.capacity(); }
+};
+
+#endif // NATIVE_OBJECT_H
@@ -15,6 +15,8 @@ public:
   std::vector<std::shared_ptr<AstNode>> Members;
   std::vector<std::shared_ptr<PackageImportStatement>> PackageImports;
   std::vector<std::shared_ptr<MemberImportStatement>> MemberImports;
+  std::vector<std::string> Globals; // Global names, indexed by GlobalBinding
+  int FrameSize = 0; // Slots needed by locals in top-level blocks
 
   Package(
       const std::string &name,
@@ -3,6 +3,7 @@
 
 #include "ast_node.h"
 #include "type_reference.h"
+#include "variable_binding.h"
 #include <memory>
 #include <string>
 #include <vector>
@@ -12,6 +13,7 @@ class Parameter : public AstNode {
 public:
   std::string Name;
   std::shared_ptr<TypeReference> Type;
+  VariableBinding Binding;
 
   Parameter(const std::string &name, std::shared_ptr<TypeReference> type)
       : Name(name), Type(type) {}
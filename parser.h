@@ -2,6 +2,7 @@
 #define PARSER_H
 
 #include "ast_node.h"
+#include "await_expression.h"
 #include "binary_expression.h"
 #include "call_expression.h"
 #include "class_declaration.h"
@@ -151,6 +152,8 @@ private:
       return parseClass();
     } else if (isFunction(current)) {
       return parseFunction();
+    } else if (isAsync(current)) {
+      return parseAsyncFunction();
     } else if (isVariable(current)) {
       return parseVariable();
     } else if (isReturn(current)) {
@@ -248,6 +251,20 @@ private:
         std::vector<std::shared_ptr<TypeReference>>());
   }
 
+  std::shared_ptr<FunctionDeclaration> parseAsyncFunction() {
+    std::cout << "Parsing async function declaration, current token: "
+              << peek().value << " Type: " << peek().type
+              << " Line: " << peek().line << " Column: " << peek().column
+              << std::endl;
+    consume(); // Consume 'async'
+    if (!isFunction(peek())) {
+      error("Expected 'function' after 'async'");
+    }
+    auto function = parseFunction();
+    function->Async = true;
+    return function;
+  }
+
   std::shared_ptr<VariableDeclaration> parseVariable() {
     std::cout << "Parsing variable declaration, current token: " << peek().value
               << " Type: " << peek().type << " Line: " << peek().line
@@ -394,12 +411,16 @@ private:
               << " Type: " << current.type << " Line: " << current.line
               << " Column: " << current.column << std::endl;
 
-    if (isBinaryOperator(current)) {
+    if (isAwait(current)) {
+      consume(); // Consume 'await'
+      return std::make_shared<AwaitExpression>(parseExpression());
+    } else if (isBinaryOperator(current)) {
       return parseBinary();
     } else if (isCallExpression(current)) {
       return parseCall();
     } else if (isLiteralExpression(current)) {
-      return std::make_shared<LiteralExpression>(consume().value);
+      Token literal = consume();
+      return std::make_shared<LiteralExpression>(literal.value, literal.type);
     } else if (isVariableExpression(current)) {
       return std::make_shared<VariableExpression>(consume().value);
     } else if (isDotAccessExpression(current)) {
@@ -630,7 +651,9 @@ private:
   }
 
   bool isLiteralExpression(Token token) const {
-    return token.type == StringLiteral || token.type == IntegerLiteral;
+    return token.type == StringLiteral || token.type == IntegerLiteral ||
+           token.type == FloatLiteral || token.type == LongLiteral ||
+           token.type == DoubleLiteral || token.type == BooleanLiteral;
   }
 
   bool isVariableExpression(Token token) const {
@@ -649,6 +672,10 @@ private:
 
   bool isFunction(Token token) const { return token.type == FunctionKeyword; }
 
+  bool isAsync(Token token) const { return token.type == AsyncKeyword; }
+
+  bool isAwait(Token token) const { return token.type == AwaitKeyword; }
+
   bool isVariable(Token token) const { return token.type == VarKeyword; }
 
   bool isReturn(Token token) const { return token.type == ReturnKeyword; }
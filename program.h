@@ -0,0 +1,62 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "class_hierarchy.h"
+#include "closure_converter.h"
+#include "constant_folder.h"
+#include "monomorphizer.h"
+#include "package.h"
+#include "parser.h"
+#include "scope_resolver.h"
+#include "type_checker.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A package parsed and taken through the passes every tier runs after, so
+// it is ready to compile. Nothing changes it afterward: contexts on any
+// number of threads compile it into their own heaps at once, sharing one
+// copy of the source's tree and analysis.
+class Program {
+public:
+  // Programs are shared between contexts by pointer, and never copied
+  static std::shared_ptr<const Program> load(const std::string &source) {
+    return std::make_shared<const Program>(Parser(source).parse());
+  }
+
+  explicit Program(Package parsed) : package(std::move(parsed)) {
+    Monomorphizer monomorphizer;
+    monomorphizer.specialize(package);
+    ScopeResolver resolver;
+    if (!resolver.resolve(package)) {
+      errors = resolver.getErrors();
+      return;
+    }
+    TypeChecker checker;
+    if (!checker.check(package)) {
+      errors = checker.getErrors();
+      return;
+    }
+    ConstantFolder folder;
+    folder.optimize(package);
+    ClosureConverter converter;
+    converter.convert(package);
+    ClassHierarchy hierarchy;
+    hierarchy.analyze(package);
+  }
+
+  Program(const Program &) = delete;
+  Program &operator=(const Program &) = delete;
+
+  const Package &getPackage() const { return package; }
+
+  // Why the package cannot run; empty if it can
+  const std::vector<std::string> &getErrors() const { return errors; }
+
+private:
+  Package package;
+  std::vector<std::string> errors;
+};
+
+#endif // PROGRAM_H
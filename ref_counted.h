@@ -1,20 +1,78 @@
 #ifndef REF_COUNTED_H
 #define REF_COUNTED_H
 
+#include <atomic>
+#include <cstdint>
+
+// Intrusive reference count. The count is atomic, so references can be
+// taken and dropped on any thread. Dropping the last one calls destroy(),
+// which deletes the object through its virtual destructor unless the class
+// manages its lifetime another way.
 class RefCounted {
 public:
   RefCounted() : refCount(0) {}
+  RefCounted(const RefCounted &) = delete;
+  RefCounted &operator=(const RefCounted &) = delete;
+
+  virtual ~RefCounted() = default;
+
+  void addRef() const { refCount.fetch_add(1, std::memory_order_relaxed); }
+
+  void release() const {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      const_cast<RefCounted *>(this)->destroy();
+    }
+  }
+
+  uint32_t getRefCount() const {
+    return refCount.load(std::memory_order_acquire);
+  }
+
+protected:
+  virtual void destroy() { delete this; }
+
+private:
+  mutable std::atomic<uint32_t> refCount;
+};
 
-  void addRef() { ++refCount; }
+// Owning pointer to a RefCounted object
+template <typename T> class Ref {
+public:
+  Ref() : object(nullptr) {}
+
+  Ref(T *object) : object(object) {
+    if (object) {
+      object->addRef();
+    }
+  }
+
+  Ref(const Ref &other) : Ref(other.object) {}
+
+  Ref(Ref &&other) : object(other.object) { other.object = nullptr; }
 
-  void release() {
-    if (--refCount == 0) {
-      delete this;
+  ~Ref() {
+    if (object) {
+      object->release();
     }
   }
 
+  Ref &operator=(Ref other) {
+    T *previous = object;
+    object = other.object;
+    other.object = previous;
+    return *this;
+  }
+
+  T *get() const { return object; }
+
+  T *operator->() const { return object; }
+
+  T &operator*() const { return *object; }
+
+  explicit operator bool() const { return object != nullptr; }
+
 private:
-  int refCount;
+  T *object;
 };
 
-#endif // REF_COUNTED_H
\ No newline at end of file
+#endif // REF_COUNTED_H
@@ -0,0 +1,362 @@
+#ifndef SCOPE_RESOLVER_H
+#define SCOPE_RESOLVER_H
+
+#include "ast_node.h"
+#include "await_expression.h"
+#include "binary_expression.h"
+#include "call_expression.h"
+#include "class_declaration.h"
+#include "closure_expression.h"
+#include "dot_access_expression.h"
+#include "for_statement.h"
+#include "function_declaration.h"
+#include "if_statement.h"
+#include "lambda_expression.h"
+#include "package.h"
+#include "parameter.h"
+#include "return_statement.h"
+#include "variable_binding.h"
+#include "variable_declaration.h"
+#include "variable_expression.h"
+#include "while_statement.h"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Names every package can see without importing anything
+static const std::vector<std::string> DefaultBuiltinNames = {
+    "print", "String", "Int",      "Long",    "Float",
+    "Double", "Bool",  "Any",      "super",   "this",
+    "sleep", "readable", "writable", "parallelMap", "arrayOf"};
+
+// Builds lexical scopes for packages, classes, functions and blocks, and
+// binds every variable reference to a frame slot, global index or class
+// member slot so evaluators never have to look names up by string.
+class ScopeResolver {
+public:
+  ScopeResolver(const std::vector<std::string> &builtins = DefaultBuiltinNames)
+      : builtinNames(builtins) {}
+
+  // Resolves the whole package. Returns false if any name was unresolved.
+  bool resolve(Package &package) {
+    errors.clear();
+    classes.clear();
+    scopes.clear();
+    frames.clear();
+    globals = &package.Globals;
+    globals->clear();
+
+    pushFrame();
+    pushScope(PackageScope);
+
+    for (const auto &name : builtinNames) {
+      declareGlobal(name);
+    }
+    for (const auto &import : package.PackageImports) {
+      declareGlobal(import->PackageName);
+    }
+    for (const auto &import : package.MemberImports) {
+      declareGlobal(import->MemberName);
+    }
+
+    // Package members are visible everywhere in the package, so declare them
+    // all before resolving any bodies.
+    for (const auto &member : package.Members) {
+      if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+        classes[cls->Name] = cls.get();
+        declareGlobal(cls->Name);
+      } else if (auto func =
+                     std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        declareGlobal(func->Name);
+      } else if (auto var =
+                     std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        var->Binding = declareGlobal(var->Name);
+      }
+    }
+
+    for (const auto &member : package.Members) {
+      if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        resolveExpression(var->Value);
+      } else {
+        resolveNode(member);
+      }
+    }
+
+    package.FrameSize = frames.back().MaxSlot;
+    popScope();
+    popFrame();
+    globals = nullptr;
+    return errors.empty();
+  }
+
+  const std::vector<std::string> &getErrors() const { return errors; }
+
+private:
+  enum ScopeKind { PackageScope, ClassScope, FunctionScope, BlockScope };
+
+  struct Scope {
+    ScopeKind Kind;
+    int FrameDepth; // Index of the function frame this scope allocates in
+    int FirstSlot;  // Frame slot to rewind to when the scope closes
+    std::unordered_map<std::string, VariableBinding> Names;
+  };
+
+  struct Frame {
+    int NextSlot = 0;
+    int MaxSlot = 0;
+  };
+
+  std::vector<std::string> builtinNames;
+  std::vector<std::string> errors;
+  std::vector<std::string> *globals = nullptr;
+  std::unordered_map<std::string, ClassDeclaration *> classes;
+  std::vector<Scope> scopes;
+  std::vector<Frame> frames;
+
+  void pushScope(ScopeKind kind) {
+    int frameDepth = static_cast<int>(frames.size()) - 1;
+    int firstSlot = kind == BlockScope ? frames.back().NextSlot : 0;
+    scopes.push_back(Scope{kind, frameDepth, firstSlot, {}});
+  }
+
+  void popScope() {
+    // Block locals are dead once the block ends, so later blocks reuse them
+    if (scopes.back().Kind == BlockScope) {
+      frames.back().NextSlot = scopes.back().FirstSlot;
+    }
+    scopes.pop_back();
+  }
+
+  void pushFrame() { frames.push_back(Frame()); }
+
+  void popFrame() { frames.pop_back(); }
+
+  VariableBinding declareGlobal(const std::string &name) {
+    VariableBinding binding;
+    binding.Kind = GlobalBinding;
+    auto existing = std::find(globals->begin(), globals->end(), name);
+    if (existing != globals->end()) {
+      binding.Slot = static_cast<int>(existing - globals->begin());
+    } else {
+      binding.Slot = static_cast<int>(globals->size());
+      globals->push_back(name);
+    }
+    scopes.front().Names[name] = binding;
+    return binding;
+  }
+
+  VariableBinding declareLocal(const std::string &name) {
+    Frame &frame = frames.back();
+    VariableBinding binding;
+    binding.Kind = LocalBinding;
+    binding.Slot = frame.NextSlot++;
+    frame.MaxSlot = std::max(frame.MaxSlot, frame.NextSlot);
+    scopes.back().Names[name] = binding;
+    return binding;
+  }
+
+  VariableBinding lookup(const std::string &name) const {
+    int currentDepth = static_cast<int>(frames.size()) - 1;
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+      auto found = scope->Names.find(name);
+      if (found == scope->Names.end()) {
+        continue;
+      }
+      VariableBinding binding = found->second;
+      if (binding.Kind == LocalBinding) {
+        binding.Depth = currentDepth - scope->FrameDepth;
+      } else if (binding.Kind == FieldBinding ||
+                 binding.Kind == MethodBinding) {
+        // Members are reached through the receiver of the enclosing method
+        binding.Depth = currentDepth - (scope->FrameDepth + 1);
+      }
+      return binding;
+    }
+    return VariableBinding();
+  }
+
+  VariableBinding resolveName(const std::string &name) {
+    VariableBinding binding = lookup(name);
+    if (!binding.isResolved()) {
+      errors.push_back("Unresolved name '" + name + "'");
+    }
+    return binding;
+  }
+
+  // Computes the field and method layout of a class, base class first, so
+  // that a subclass instance can be used wherever its base is expected.
+  void layoutClass(ClassDeclaration &cls, std::vector<std::string> &visiting) {
+    if (!cls.FieldNames.empty() || !cls.MethodNames.empty()) {
+      return;
+    }
+    if (std::find(visiting.begin(), visiting.end(), cls.Name) !=
+        visiting.end()) {
+      errors.push_back("Class '" + cls.Name + "' inherits from itself");
+      return;
+    }
+    visiting.push_back(cls.Name);
+    if (cls.BaseClass) {
+      auto base = classes.find(cls.BaseClass->Name);
+      if (base == classes.end()) {
+        errors.push_back("Unresolved base class '" + cls.BaseClass->Name +
+                         "' of class '" + cls.Name + "'");
+      } else {
+        layoutClass(*base->second, visiting);
+        cls.FieldNames = base->second->FieldNames;
+        cls.MethodNames = base->second->MethodNames;
+      }
+    }
+    for (const auto &member : cls.Members) {
+      if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        if (std::find(cls.FieldNames.begin(), cls.FieldNames.end(),
+                      var->Name) == cls.FieldNames.end()) {
+          cls.FieldNames.push_back(var->Name);
+        }
+      } else if (auto func =
+                     std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        // An override takes over the slot of the method it replaces
+        if (std::find(cls.MethodNames.begin(), cls.MethodNames.end(),
+                      func->Name) == cls.MethodNames.end()) {
+          cls.MethodNames.push_back(func->Name);
+        }
+      }
+    }
+    visiting.pop_back();
+  }
+
+  void resolveClass(ClassDeclaration &cls) {
+    std::vector<std::string> visiting;
+    layoutClass(cls, visiting);
+
+    pushScope(ClassScope);
+    for (size_t i = 0; i < cls.FieldNames.size(); i++) {
+      VariableBinding binding;
+      binding.Kind = FieldBinding;
+      binding.Slot = static_cast<int>(i);
+      scopes.back().Names[cls.FieldNames[i]] = binding;
+    }
+    for (size_t i = 0; i < cls.MethodNames.size(); i++) {
+      VariableBinding binding;
+      binding.Kind = MethodBinding;
+      binding.Slot = static_cast<int>(i);
+      scopes.back().Names[cls.MethodNames[i]] = binding;
+    }
+
+    for (const auto &member : cls.Members) {
+      if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        var->Binding = scopes.back().Names[var->Name];
+        resolveExpression(var->Value);
+      } else {
+        resolveNode(member);
+      }
+    }
+    popScope();
+  }
+
+  // Opens a new frame for a function-like body and returns its size
+  template <typename Body>
+  int resolveFunctionBody(
+      const std::vector<std::shared_ptr<Parameter>> &parameters,
+      const Body &resolveBody) {
+    pushFrame();
+    pushScope(FunctionScope);
+    for (const auto &parameter : parameters) {
+      parameter->Binding = declareLocal(parameter->Name);
+    }
+    resolveBody();
+    int frameSize = frames.back().MaxSlot;
+    popScope();
+    popFrame();
+    return frameSize;
+  }
+
+  void resolveBlock(const std::vector<std::shared_ptr<AstNode>> &body) {
+    pushScope(BlockScope);
+    resolveStatements(body);
+    popScope();
+  }
+
+  void resolveStatements(const std::vector<std::shared_ptr<AstNode>> &body) {
+    for (const auto &statement : body) {
+      resolveNode(statement);
+    }
+  }
+
+  void resolveNode(const std::shared_ptr<AstNode> &node) {
+    if (!node) {
+      return;
+    }
+    if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      resolveClass(*cls);
+    } else if (auto func =
+                   std::dynamic_pointer_cast<FunctionDeclaration>(node)) {
+      func->FrameSize = resolveFunctionBody(
+          func->Parameters, [&]() { resolveStatements(func->Body); });
+    } else if (auto var =
+                   std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      // The initializer cannot see the variable it initializes
+      resolveExpression(var->Value);
+      var->Binding = declareLocal(var->Name);
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      resolveExpression(ret->ReturnValue);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      resolveExpression(ifStmt->Condition);
+      resolveBlock(ifStmt->ThenBody);
+      resolveBlock(ifStmt->ElseBody);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      // The loop variable lives in its own scope around the body
+      pushScope(BlockScope);
+      resolveNode(forStmt->Initializer);
+      resolveExpression(forStmt->Condition);
+      resolveNode(forStmt->Increment);
+      resolveBlock(forStmt->Body);
+      popScope();
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      resolveExpression(whileStmt->Condition);
+      resolveBlock(whileStmt->Body);
+    } else if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      resolveExpression(expr);
+    }
+  }
+
+  void resolveExpression(const std::shared_ptr<Expression> &expr) {
+    if (!expr) {
+      return;
+    }
+    if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      var->Binding = resolveName(var->Name);
+    } else if (auto binary =
+                   std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      resolveExpression(binary->Left);
+      resolveExpression(binary->Right);
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      // Only the receiver is a name in scope, the right side is a member
+      resolveExpression(dot->Left);
+      if (auto call = std::dynamic_pointer_cast<CallExpression>(dot->Right)) {
+        for (const auto &argument : call->Arguments) {
+          resolveExpression(argument);
+        }
+      }
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      call->Binding = resolveName(call->FunctionName);
+      for (const auto &argument : call->Arguments) {
+        resolveExpression(argument);
+      }
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(expr)) {
+      resolveExpression(await->Operand);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      closure->FrameSize = resolveFunctionBody(
+          closure->Parameters, [&]() { resolveStatements(closure->Body); });
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      lambda->FrameSize = resolveFunctionBody(
+          lambda->Parameters, [&]() { resolveNode(lambda->Body); });
+    }
+  }
+};
+
+#endif // SCOPE_RESOLVER_H
@@ -0,0 +1,145 @@
+#ifndef SCRIPT_CONTEXT_H
+#define SCRIPT_CONTEXT_H
+
+#include "baseline_jit.h"
+#include "bytecode_compiler.h"
+#include "compiled_package.h"
+#include "heap.h"
+#include "heap_snapshot.h"
+#include "program.h"
+#include "value.h"
+#include "virtual_machine.h"
+#include "work_stealing_pool.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+struct ContextOptions {
+  HeapOptions Heap;
+  JitOptions Jit;
+  FuelOptions Fuel;
+  size_t MaxStack = 1 << 20; // Registers, as for the VirtualMachine
+  size_t MaxDepth = 10000;
+  WorkStealingPool *Workers = nullptr; // For parallelMap; the shared pool
+                                       // if null
+};
+
+// One running instance of a Program, for one tenant or request: its own
+// heap, globals and compiled code, so contexts share nothing a script can
+// change, and any number run at once on different threads. A context
+// itself is used by one thread at a time, which the ContextPool takes
+// care of.
+class ScriptContext {
+public:
+  explicit ScriptContext(std::shared_ptr<const Program> program,
+                         const ContextOptions &options = ContextOptions())
+      : program(std::move(program)),
+        machine(options.MaxStack, options.MaxDepth) {
+    machine.setJitOptions(options.Jit);
+    machine.getHeap().setOptions(options.Heap);
+    machine.setWorkPool(options.Workers);
+    machine.setFuelOptions(options.Fuel);
+  }
+
+  ScriptContext(const ScriptContext &) = delete;
+  ScriptContext &operator=(const ScriptContext &) = delete;
+
+  // Compiles the program into this context's heap and runs its top-level
+  // code, then the tasks it started until they are done. Returns false on
+  // an error, which getError describes.
+  bool run() {
+    if (!program->getErrors().empty()) {
+      error = program->getErrors().front();
+      return false;
+    }
+    BytecodeCompiler compiler(machine.getHeap());
+    CompiledPackage compiled = compiler.compile(program->getPackage());
+    if (!compiler.getErrors().empty()) {
+      error = compiler.getErrors().front();
+      return false;
+    }
+    if (!machine.run(compiled)) {
+      error = machine.getError();
+      return false;
+    }
+    started = true;
+    return runLoop();
+  }
+
+  // Starts the context from a snapshot of one that ran the same program,
+  // instead of running it. Much faster than run, as nothing is compiled and
+  // no initializer runs.
+  bool restore(const HeapSnapshot &snapshot) {
+    if (started) {
+      error = "The program has already run";
+      return false;
+    }
+    if (!snapshot.restore(machine, error)) {
+      return false;
+    }
+    started = true;
+    return true;
+  }
+
+  // Writes a snapshot of the context to path once its program has run and
+  // its tasks are done, for new contexts to restore
+  bool save(const std::string &path) {
+    if (!started) {
+      error = "The program has not run";
+      return false;
+    }
+    if (machine.hasTasks()) {
+      error = "Cannot snapshot a context with tasks left";
+      return false;
+    }
+    return HeapSnapshot::save(machine, path, error);
+  }
+
+  // Runs the tasks the program started, such as by calling async
+  // functions, until none is left, or for about timeout milliseconds unless
+  // it is -1. Every task of the context runs on the calling thread.
+  bool runLoop(int timeout = -1) {
+    if (!machine.runLoop(timeout)) {
+      error = machine.getError();
+      return false;
+    }
+    return true;
+  }
+
+  // Calls a global function the program defines, once it has run. The
+  // arguments and result belong to this context's heap.
+  bool call(const std::string &name, const Value *arguments, int count,
+            Value &result) {
+    if (!started) {
+      error = "The program has not run";
+      return false;
+    }
+    if (!machine.callGlobal(name, arguments, count, result)) {
+      error = machine.getError();
+      return false;
+    }
+    return true;
+  }
+
+  // Called whenever a script has burned its slice of fuel, on the thread
+  // running it, which the ContextPool uses to let other contexts run
+  void setYield(std::function<void()> yield) {
+    machine.setYield(std::move(yield));
+  }
+
+  const std::string &getError() const { return error; }
+
+  const Program &getProgram() const { return *program; }
+
+  // For defining natives and globals before run, and reading results
+  VirtualMachine &getRuntime() { return machine; }
+
+private:
+  std::shared_ptr<const Program> program;
+  VirtualMachine machine;
+  bool started = false;
+  std::string error;
+};
+
+#endif // SCRIPT_CONTEXT_H
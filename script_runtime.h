@@ -0,0 +1,881 @@
+#ifndef SCRIPT_RUNTIME_H
+#define SCRIPT_RUNTIME_H
+
+#include "array_kernels.h"
+#include "array_object.h"
+#include "binary_operator.h"
+#include "class_object.h"
+#include "closure_object.h"
+#include "dictionary_object.h"
+#include "heap.h"
+#include "inline_cache.h"
+#include "instance_object.h"
+#include "native_object.h"
+#include "shape.h"
+#include "string_object.h"
+#include "tracer.h"
+#include "value.h"
+#include "value_format.h"
+#include "value_hash.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class RuntimeError : public std::runtime_error {
+public:
+  explicit RuntimeError(const std::string &message)
+      : std::runtime_error(message) {}
+};
+
+// State and semantics shared by the execution tiers: the heap, globals and
+// builtins, and what each operator and member access means. A tier decides
+// how frames are laid out, so it supplies the calls.
+class ScriptRuntime : public RootSet {
+public:
+  ScriptRuntime() {
+    heap.setRoots(this);
+    defineNatives();
+  }
+
+  virtual ~ScriptRuntime() {}
+
+  Heap &getHeap() { return heap; }
+
+  void setOutput(std::ostream &stream) { output = &stream; }
+
+  std::ostream &getOutput() { return *output; }
+
+  // Makes value visible to packages that refer to name, such as an
+  // imported package; must happen before run
+  void defineGlobal(const std::string &name, const Value &value) {
+    builtins[name] = value;
+  }
+
+  void defineNative(const std::string &name, NativeFunction function,
+                    int arity, bool pure = false) {
+    defineGlobal(name, Value::object(heap.allocate<NativeObject>(
+                           name, function, arity, pure)));
+  }
+
+  const std::string &getError() const { return error; }
+
+  // Globals and builtins; each tier adds the frames it keeps
+  void traceRoots(Tracer &tracer) override {
+    tracer.mark(globals.data(), globals.size());
+    for (auto &builtin : builtins) {
+      tracer.mark(builtin.second);
+    }
+  }
+
+  Value getGlobal(const std::string &name) const {
+    for (size_t i = 0; i < globalNames.size(); i++) {
+      if (globalNames[i] == name) {
+        return globals[i];
+      }
+    }
+    return Value();
+  }
+
+  // Calls a script function, native or class from the host or from a
+  // native. Throws RuntimeError.
+  virtual Value call(const Value &callee, const Value *arguments,
+                     int count) = 0;
+
+  // Calls method with receiver as this
+  virtual Value callMethod(const Value &method, const Value &receiver,
+                           const Value *arguments, int count) = 0;
+
+  StringObject *newString(const std::string &text) {
+    return heap.create<StringObject>(text);
+  }
+
+  [[noreturn]] void fail(const std::string &message) {
+    throw RuntimeError(message + location());
+  }
+
+  // Operators
+
+  static bool isString(const Value &value) {
+    return value.isObject() && value.asObject()->Kind == ObjectKind::String;
+  }
+
+  static StringObject *asString(const Value &value) {
+    return static_cast<StringObject *>(value.asObject());
+  }
+
+  // Integers wrap around like the two's complement hardware they run on
+  static int64_t wrap(uint64_t value) { return static_cast<int64_t>(value); }
+
+  [[noreturn]] void operandError(const char *op, const Value &a,
+                                 const Value &b) {
+    fail(std::string("Cannot apply '") + op + "' to " + valueTypeName(a) +
+         " and " + valueTypeName(b));
+  }
+
+  // a + b where either is a string. A long result is a rope over the two,
+  // so appending to a string in a loop copies nothing until it is read.
+  Value concatenate(const Value &a, const Value &b) {
+    StringObject *left = isString(a) ? asString(a) : nullptr;
+    StringObject *right = isString(b) ? asString(b) : nullptr;
+    size_t length = (left ? left->Length : 0) + (right ? right->Length : 0);
+    if (length < StringObject::MinRopeLength) {
+      Value parts[] = {a, b};
+      return concatenateAll(parts, 2);
+    }
+    if (!left) {
+      left = newString(valueToString(a));
+    }
+    if (!right) {
+      right = newString(valueToString(b));
+    }
+    return Value::object(heap.create<StringObject>(left, right));
+  }
+
+  // The parts of a chain of + known to build a string, such as
+  // "a" + b + "c", in one string allocated at its final length. A long
+  // string the chain starts with is kept as a rope instead of copied.
+  Value concatenateAll(const Value *parts, int count) {
+    std::vector<std::string> formatted; // Parts that are not strings
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+      if (isString(parts[i])) {
+        length += asString(parts[i])->Length;
+      } else {
+        formatted.push_back(valueToString(parts[i]));
+        length += formatted.back().size();
+      }
+    }
+    StringObject *head = nullptr;
+    if (count > 2 && isString(parts[0]) &&
+        asString(parts[0])->Length >= StringObject::MinRopeLength) {
+      head = asString(parts[0]);
+      length -= head->Length;
+      parts++;
+      count--;
+    }
+    StringObject *result = heap.create<StringObject>(length);
+    char *out = result->data();
+    size_t next = 0;
+    for (int i = 0; i < count; i++) {
+      if (isString(parts[i])) {
+        StringObject *part = asString(parts[i]);
+        std::memcpy(out, part->chars(), part->Length);
+        out += part->Length;
+      } else {
+        const std::string &text = formatted[next++];
+        std::memcpy(out, text.data(), text.size());
+        out += text.size();
+      }
+    }
+    return Value::object(head ? heap.create<StringObject>(head, result)
+                              : result);
+  }
+
+  Value add(const Value &a, const Value &b) {
+    if (a.isInt() && b.isInt()) {
+      return heap.integer(wrap(static_cast<uint64_t>(a.asInt()) +
+                               static_cast<uint64_t>(b.asInt())));
+    }
+    if (a.isNumber() && b.isNumber()) {
+      return Value::number(a.asNumber() + b.asNumber());
+    }
+    if (isString(a) || isString(b)) {
+      return concatenate(a, b);
+    }
+    operandError("+", a, b);
+  }
+
+  // Subtract, Multiply, Divide and Modulo
+  Value arithmetic(BinaryOperator op, const Value &a, const Value &b) {
+    if (!a.isNumber() || !b.isNumber()) {
+      operandError(binaryOperatorSymbol(op), a, b);
+    }
+    if (a.isInt() && b.isInt()) {
+      uint64_t x = static_cast<uint64_t>(a.asInt());
+      uint64_t y = static_cast<uint64_t>(b.asInt());
+      switch (op) {
+      case BinaryOperator::Subtract:
+        return heap.integer(wrap(x - y));
+      case BinaryOperator::Multiply:
+        return heap.integer(wrap(x * y));
+      default:
+        if (b.asInt() == 0) {
+          fail("Division by zero");
+        }
+        // INT64_MIN / -1 overflows, and wraps back to INT64_MIN
+        if (b.asInt() == -1) {
+          return heap.integer(op == BinaryOperator::Divide ? wrap(0 - x) : 0);
+        }
+        return heap.integer(op == BinaryOperator::Divide
+                                ? a.asInt() / b.asInt()
+                                : a.asInt() % b.asInt());
+      }
+    }
+    double x = a.asNumber();
+    double y = b.asNumber();
+    switch (op) {
+    case BinaryOperator::Subtract:
+      return Value::number(x - y);
+    case BinaryOperator::Multiply:
+      return Value::number(x * y);
+    case BinaryOperator::Divide:
+      return Value::number(x / y);
+    default:
+      return Value::number(std::fmod(x, y));
+    }
+  }
+
+  // An integer as a double, where a Float or Double is declared; any
+  // other value as it is
+  static Value toDouble(const Value &value) {
+    return value.isInt() ? Value::number(value.asNumber()) : value;
+  }
+
+  // What compare gives when either side is NaN, which is in no order
+  static const int Unordered = 2;
+
+  // Negative, zero or positive like strcmp, or Unordered
+  int compare(BinaryOperator op, const Value &a, const Value &b) {
+    if (a.isInt() && b.isInt()) {
+      return a.asInt() < b.asInt() ? -1 : a.asInt() > b.asInt() ? 1 : 0;
+    }
+    if (a.isNumber() && b.isNumber()) {
+      double x = a.asNumber();
+      double y = b.asNumber();
+      return x < y ? -1 : x > y ? 1 : x == y ? 0 : Unordered;
+    }
+    if (isString(a) && isString(b)) {
+      return asString(a)->compare(asString(b));
+    }
+    operandError(binaryOperatorSymbol(op), a, b);
+  }
+
+  // Less, LessEqual, Greater or GreaterEqual, all of which are false when
+  // either side is NaN, as they are on doubles
+  bool relation(BinaryOperator op, const Value &a, const Value &b) {
+    int order = compare(op, a, b);
+    switch (op) {
+    case BinaryOperator::Less:
+      return order < 0;
+    case BinaryOperator::LessEqual:
+      return order <= 0;
+    case BinaryOperator::Greater:
+      return order > 0 && order != Unordered;
+    default:
+      return order >= 0 && order != Unordered;
+    }
+  }
+
+  // Any operator except the short-circuiting And and Or
+  Value binary(BinaryOperator op, const Value &a, const Value &b) {
+    switch (op) {
+    case BinaryOperator::Add:
+      return add(a, b);
+    case BinaryOperator::Subtract:
+    case BinaryOperator::Multiply:
+    case BinaryOperator::Divide:
+    case BinaryOperator::Modulo:
+      return arithmetic(op, a, b);
+    case BinaryOperator::Equal:
+      return Value::boolean(valuesEqual(a, b));
+    case BinaryOperator::NotEqual:
+      return Value::boolean(!valuesEqual(a, b));
+    case BinaryOperator::Less:
+    case BinaryOperator::LessEqual:
+    case BinaryOperator::Greater:
+    case BinaryOperator::GreaterEqual:
+      return Value::boolean(relation(op, a, b));
+    default:
+      fail(std::string("Unsupported operator '") + binaryOperatorSymbol(op) +
+           "'");
+    }
+  }
+
+  // Members
+
+  bool builtinMember(const Value &receiver, const std::string &name,
+                     Value &result) {
+    HeapObject *object = receiver.asObject();
+    if (name == "length") {
+      switch (object->Kind) {
+      case ObjectKind::String:
+        result = Value::integer(static_cast<int64_t>(
+            static_cast<StringObject *>(object)->Length));
+        return true;
+      case ObjectKind::Array:
+        result = Value::integer(static_cast<int64_t>(
+            static_cast<ArrayObject *>(object)->count()));
+        return true;
+      case ObjectKind::Dictionary:
+        result = Value::integer(static_cast<int64_t>(
+            static_cast<DictionaryObject *>(object)->count()));
+        return true;
+      default:
+        return false;
+      }
+    }
+    return false;
+  }
+
+  Value getMember(const Value &receiver, const std::string &name) {
+    Value result;
+    if (receiver.isObject()) {
+      HeapObject *object = receiver.asObject();
+      if (builtinMember(receiver, name, result)) {
+        return result;
+      }
+      if (object->Kind == ObjectKind::Instance) {
+        auto *instance = static_cast<InstanceObject *>(object);
+        int field = instance->Layout->findField(name);
+        if (field >= 0) {
+          return instance->fields()[field];
+        }
+        int method = instance->Class->findMethod(name);
+        if (method >= 0) {
+          // Detached methods remember their receiver
+          auto *original =
+              static_cast<ClosureObject *>(instance->Class->Methods[method]
+                                               .asObject());
+          auto *bound = heap.allocate<ClosureObject>(original->Function);
+          bound->Receiver = receiver;
+          return Value::object(bound);
+        }
+      } else if (object->Kind == ObjectKind::Class) {
+        auto *cls = static_cast<ClassObject *>(object);
+        int method = cls->findMethod(name);
+        if (method >= 0) {
+          return cls->Methods[method];
+        }
+      } else if (object->Kind == ObjectKind::Dictionary) {
+        if (static_cast<DictionaryObject *>(object)->get(
+                Value::object(heap.intern(name)), result)) {
+          return result;
+        }
+      }
+    }
+    fail("Undefined member '" + name + "' on " + valueTypeName(receiver));
+  }
+
+  void setMember(const Value &receiver, const std::string &name,
+                 const Value &value) {
+    if (receiver.isObject()) {
+      HeapObject *object = receiver.asObject();
+      if (object->Kind == ObjectKind::Instance) {
+        auto *instance = static_cast<InstanceObject *>(object);
+        int field = instance->Layout->findField(name);
+        if (field >= 0) {
+          heap.writeBarrier(instance);
+          instance->fields()[field] = value;
+          return;
+        }
+      } else if (object->Kind == ObjectKind::Dictionary) {
+        heap.writeBarrier(object);
+        static_cast<DictionaryObject *>(object)->set(
+            Value::object(heap.intern(name)), value);
+        return;
+      }
+    }
+    fail("Cannot set member '" + name + "' on " + valueTypeName(receiver));
+  }
+
+  // The same for one access site, remembering in its cache where the field
+  // was found so the next access with that shape needs no lookup
+
+  Value getMember(const Value &receiver, const std::string &name,
+                  InlineCache &cache) {
+    Value result;
+    if (cache.getField(receiver, result)) {
+      return result;
+    }
+    if (receiver.isObject() &&
+        receiver.asObject()->Kind == ObjectKind::Instance) {
+      auto *instance = static_cast<InstanceObject *>(receiver.asObject());
+      int field = instance->Layout->findField(name);
+      if (field >= 0) {
+        cache.add(instance->Layout, field);
+        return instance->fields()[field];
+      }
+    }
+    return getMember(receiver, name);
+  }
+
+  void setMember(const Value &receiver, const std::string &name,
+                 const Value &value, InlineCache &cache) {
+    heap.writeBarrier(receiver);
+    if (cache.setField(receiver, value)) {
+      return;
+    }
+    if (receiver.isObject() &&
+        receiver.asObject()->Kind == ObjectKind::Instance) {
+      auto *instance = static_cast<InstanceObject *>(receiver.asObject());
+      int field = instance->Layout->findField(name);
+      if (field >= 0) {
+        cache.add(instance->Layout, field);
+        instance->fields()[field] = value;
+        return;
+      }
+    }
+    setMember(receiver, name, value);
+  }
+
+  // Array and Dictionary methods. Returns false if name is not one.
+  bool callBuiltinMethod(const Value &receiver, const std::string &name,
+                         const Value *arguments, int argc, Value &result) {
+    HeapObject *object = receiver.asObject();
+    if (object->Kind == ObjectKind::Array) {
+      return callArrayMethod(static_cast<ArrayObject *>(object), name,
+                             arguments, argc, result);
+    }
+    if (object->Kind == ObjectKind::Dictionary && name == "keys" &&
+        argc == 0) {
+      auto *keys = heap.allocate<ArrayObject>();
+      for (const auto &entry :
+           static_cast<DictionaryObject *>(object)->getEntries()) {
+        keys->append(entry.first);
+      }
+      result = Value::object(keys);
+      return true;
+    }
+    return false;
+  }
+
+  // Packed arrays run the methods through the kernels of array_kernels.h,
+  // and others element by element, with the same results
+  bool callArrayMethod(ArrayObject *array, const std::string &name,
+                       const Value *arguments, int argc, Value &result) {
+    if (name == "append" && argc == 1) {
+      heap.writeBarrier(array);
+      array->append(arguments[0]);
+      result = Value();
+    } else if (name == "fill" && argc == 1) {
+      heap.writeBarrier(array);
+      array->fill(arguments[0]);
+      result = Value();
+    } else if (name == "sum" && argc == 0) {
+      result = sumArray(array);
+    } else if (name == "indexOf" && argc == 1) {
+      result = Value::integer(indexOf(array, arguments[0]));
+    } else if (name == "compare" && argc == 1) {
+      result = Value::integer(compareArrays(array, arguments[0]));
+    } else if (name == "map" && argc == 1) {
+      result = mapArray(array, arguments[0]);
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  Value sumArray(ArrayObject *array) {
+    switch (array->getElementKind()) {
+    case ElementKind::Int32:
+      return heap.integer(sumInt32s(array->getInt32s(), array->count()));
+    case ElementKind::Int64:
+      return heap.integer(sumInt64s(array->getInt64s(), array->count()));
+    case ElementKind::Double:
+      return Value::number(sumDoubles(array->getDoubles(), array->count()));
+    default:
+      break;
+    }
+    // The sum so far, then the elements, which + can move
+    std::vector<Value> values(array->count() + 1);
+    values[0] = Value::integer(0);
+    for (size_t i = 0; i < array->count(); i++) {
+      values[i + 1] = array->get(i);
+    }
+    Heap::RootRange root(heap, values.data(), values.size());
+    for (size_t i = 1; i < values.size(); i++) {
+      values[0] = add(values[0], values[i]);
+    }
+    return values[0];
+  }
+
+  // The index of the first element equal to value, or -1
+  int64_t indexOf(ArrayObject *array, const Value &value) {
+    size_t count = array->count();
+    size_t found = count;
+    int64_t integer;
+    switch (array->getElementKind()) {
+    case ElementKind::Int32:
+      if (exactInt(value, integer) &&
+          integer == static_cast<int32_t>(integer)) {
+        found = findInt32(array->getInt32s(), count,
+                          static_cast<int32_t>(integer));
+      }
+      break;
+    case ElementKind::Int64:
+      if (value.isInt()) {
+        found = findInt64(array->getInt64s(), count, value.asInt());
+        break;
+      }
+      // Ints past 53 bits can round to the double they are compared with
+      for (found = 0; found < count; found++) {
+        if (valuesEqual(array->get(found), value)) {
+          break;
+        }
+      }
+      break;
+    case ElementKind::Double:
+      if (value.isNumber()) {
+        found = findDouble(array->getDoubles(), count, value.asNumber());
+      }
+      break;
+    default:
+      for (found = 0; found < count; found++) {
+        if (valuesEqual(array->get(found), value)) {
+          break;
+        }
+      }
+      break;
+    }
+    return found == count ? -1 : static_cast<int64_t>(found);
+  }
+
+  // Negative, zero or positive as array comes before, with or after other,
+  // comparing elements like < does and then lengths. NaN, which < puts in
+  // no order, comes after every other number.
+  int compareArrays(ArrayObject *array, const Value &other) {
+    if (!other.isObject() || other.asObject()->Kind != ObjectKind::Array) {
+      fail("compare expects an Array");
+    }
+    auto *with = static_cast<ArrayObject *>(other.asObject());
+    size_t count = std::min(array->count(), with->count());
+    for (size_t i = mismatch(array, with, 0, count); i < count;
+         i = mismatch(array, with, i + 1, count)) {
+      Value a = array->get(i);
+      Value b = with->get(i);
+      int order = compare(BinaryOperator::Less, a, b);
+      if (order == Unordered) {
+        bool first = a.asNumber() != a.asNumber();
+        bool second = b.asNumber() != b.asNumber();
+        order = first == second ? 0 : first ? 1 : -1;
+      }
+      if (order != 0) {
+        return order < 0 ? -1 : 1;
+      }
+    }
+    return array->count() < with->count()   ? -1
+           : array->count() > with->count() ? 1
+                                            : 0;
+  }
+
+  // The first index from from on where the elements of a and b may
+  // differ; only arrays of one packed kind skip any
+  static size_t mismatch(ArrayObject *a, ArrayObject *b, size_t from,
+                         size_t count) {
+    if (a->getElementKind() != b->getElementKind()) {
+      return from;
+    }
+    switch (a->getElementKind()) {
+    case ElementKind::Int32:
+      return ::mismatch(a->getInt32s(), b->getInt32s(), from, count);
+    case ElementKind::Int64:
+      return ::mismatch(a->getInt64s(), b->getInt64s(), from, count);
+    case ElementKind::Double:
+      return ::mismatch(a->getDoubles(), b->getDoubles(), from, count);
+    default:
+      return from;
+    }
+  }
+
+  // A new array of function called with each element. A simple lambda
+  // over a packed array runs as an ElementwiseKernel instead.
+  Value mapArray(ArrayObject *array, const Value &function) {
+    size_t count = array->count();
+    ElementwiseKernel kernel;
+    if (function.isObject() &&
+        function.asObject()->Kind == ObjectKind::Closure &&
+        kernel.compile(*static_cast<ClosureObject *>(function.asObject()),
+                       array->getElementKind(), globals)) {
+      bool ints = kernel.returnsInts();
+      std::vector<int64_t> integers(ints ? count : 0);
+      std::vector<double> numbers(ints ? 0 : count);
+      if (kernel.run(*array, integers.data(), numbers.data())) {
+        auto *mapped = heap.allocate<ArrayObject>();
+        heap.writeBarrier(mapped);
+        if (ints) {
+          mapped->assignInts(integers.data(), count);
+        } else {
+          mapped->assignDoubles(numbers.data(), count);
+        }
+        return Value::object(mapped);
+      }
+    }
+    // The function, then the elements, each replaced by its result
+    std::vector<Value> values(count + 1);
+    values[0] = function;
+    for (size_t i = 0; i < count; i++) {
+      values[i + 1] = array->get(i);
+    }
+    Heap::RootRange root(heap, values.data(), values.size());
+    for (size_t i = 1; i < values.size(); i++) {
+      values[i] = call(values[0], &values[i], 1);
+    }
+    auto *mapped = heap.allocate<ArrayObject>();
+    heap.writeBarrier(mapped);
+    mapped->assign(values.data() + 1, count);
+    return Value::object(mapped);
+  }
+
+  // The int equal to value, if there is one
+  static bool exactInt(const Value &value, int64_t &integer) {
+    if (value.isInt()) {
+      integer = value.asInt();
+      return true;
+    }
+    if (!value.isDouble()) {
+      return false;
+    }
+    double number = value.asDouble();
+    if (!(number >= -9223372036854775808.0 && number < 9223372036854775808.0) ||
+        std::trunc(number) != number) {
+      return false;
+    }
+    integer = static_cast<int64_t>(number);
+    return true;
+  }
+
+  // The class whose methods calls on receiver run: an instance's class,
+  // or the class itself for a static call. Null for anything else.
+  static ClassObject *methodTable(const Value &receiver) {
+    if (!receiver.isObject()) {
+      return nullptr;
+    }
+    HeapObject *object = receiver.asObject();
+    if (object->Kind == ObjectKind::Instance) {
+      return static_cast<InstanceObject *>(object)->Class;
+    }
+    if (object->Kind == ObjectKind::Class) {
+      return static_cast<ClassObject *>(object);
+    }
+    return nullptr;
+  }
+
+  // Finds the method or callable member receiver.name for the call site
+  // cache belongs to; methods are cached by class. Returns true if callee
+  // must be called with receiver as this.
+  bool findCallable(const Value &receiver, const std::string &name,
+                    Value &callee, InlineCache &cache) {
+    if (!receiver.isObject()) {
+      fail("Cannot call member '" + name + "' on " + valueTypeName(receiver));
+    }
+    if (ClassObject *cls = methodTable(receiver)) {
+      int method = cache.find(cls);
+      if (method < 0) {
+        method = cls->findMethod(name);
+        if (method >= 0) {
+          cache.add(cls, method);
+        }
+      }
+      if (method >= 0) {
+        callee = cls->Methods[method];
+        return true;
+      }
+    }
+    // A field or dictionary entry holding something callable
+    callee = getMember(receiver, name, cache);
+    return false;
+  }
+
+  Value invokeMember(const Value &receiver, const std::string &name,
+                     const Value *arguments, int argc, InlineCache &cache) {
+    Value result;
+    if (receiver.isObject() &&
+        receiver.asObject()->Kind != ObjectKind::Instance &&
+        receiver.asObject()->Kind != ObjectKind::Class &&
+        callBuiltinMethod(receiver, name, arguments, argc, result)) {
+      return result;
+    }
+    Value callee;
+    if (findCallable(receiver, name, callee, cache)) {
+      return callMethod(callee, receiver, arguments, argc);
+    }
+    return call(callee, arguments, argc);
+  }
+
+  // Objects
+
+  // Allocates an instance and runs the field initializers, base class
+  // first
+  Value instantiate(ClassObject *cls) {
+    Value instance =
+        Value::object(heap.create<InstanceObject>(cls, instanceLayout(cls)));
+    std::vector<ClassObject *> chain;
+    for (ClassObject *walk = cls; walk; walk = walk->Base) {
+      chain.push_back(walk);
+    }
+    for (auto walk = chain.rbegin(); walk != chain.rend(); ++walk) {
+      if (!(*walk)->Initializer.isNull()) {
+        callMethod((*walk)->Initializer, instance, nullptr, 0);
+      }
+    }
+    return instance;
+  }
+
+  // Shape of the instances of cls: its base class's, extended by the
+  // transitions for its own fields
+  Shape *instanceLayout(ClassObject *cls) {
+    if (!cls->InstanceLayout) {
+      Shape *layout = cls->Base ? instanceLayout(cls->Base) : emptyShape;
+      for (size_t i = layout->SlotCount; i < cls->FieldNames.size(); i++) {
+        const std::string &field = cls->FieldNames[i];
+        Shape *next = layout->findTransition(field);
+        if (!next) {
+          next = heap.allocate<Shape>(layout, field);
+          layout->addTransition(field, next);
+        }
+        layout = next;
+      }
+      cls->InstanceLayout = layout;
+    }
+    return cls->InstanceLayout;
+  }
+
+  Value construct(ClassObject *cls, const Value *arguments, int argc) {
+    Value instance = instantiate(cls);
+    int constructor = cls->findMethod("constructor");
+    if (constructor >= 0 && !cls->Methods[constructor].isNull()) {
+      callMethod(cls->Methods[constructor], instance, arguments, argc);
+    }
+    return instance;
+  }
+
+protected:
+  friend class HeapSnapshot; // Reads and restores the state below
+
+  Heap heap;
+  Shape *emptyShape = heap.allocate<Shape>(); // Root of every instance shape
+  std::vector<Value> globals;
+  std::vector<std::string> globalNames;
+  std::unordered_map<std::string, Value> builtins;
+  std::ostream *output = &std::cout;
+  std::string error;
+
+  // Appended to runtime error messages, naming where they happened
+  virtual std::string location() { return ""; }
+
+  // Creates the globals of a package, filling in the builtins it uses
+  void bindGlobals(const std::vector<std::string> &names) {
+    globalNames = names;
+    globals.assign(globalNames.size(), Value());
+    for (size_t i = 0; i < globalNames.size(); i++) {
+      auto builtin = builtins.find(globalNames[i]);
+      if (builtin != builtins.end()) {
+        globals[i] = builtin->second;
+      }
+    }
+  }
+
+  void checkArity(const std::string &name, int expected, int argc) {
+    if (argc != expected) {
+      fail("'" + name + "' expects " + std::to_string(expected) +
+           " arguments but got " + std::to_string(argc));
+    }
+  }
+
+  Value callNative(NativeObject *native, const Value *arguments, int argc) {
+    if (native->Arity >= 0) {
+      checkArity(native->Name, native->Arity, argc);
+    }
+    return native->Function(*this, arguments, argc);
+  }
+
+  // Builtins
+
+  void defineNatives() {
+    defineNative("print", nativePrint, -1);
+    defineNative("String", nativeString, 1, true);
+    defineNative("Int", nativeInt, 1, true);
+    defineNative("Long", nativeInt, 1, true);
+    defineNative("Float", nativeDouble, 1, true);
+    defineNative("Double", nativeDouble, 1, true);
+    defineNative("Bool", nativeBool, 1, true);
+    defineNative("Any", nativeAny, 1, true);
+    defineNative("arrayOf", nativeArrayOf, 2, true);
+
+    // Sys is imported by name; print is its only member so far
+    auto *sys = heap.allocate<DictionaryObject>();
+    sys->set(Value::object(heap.intern("print")), builtins["print"]);
+    defineGlobal("Sys", Value::object(sys));
+  }
+
+  static Value nativePrint(ScriptRuntime &runtime, const Value *arguments,
+                           int count) {
+    for (int i = 0; i < count; i++) {
+      runtime.getOutput() << (i ? " " : "") << valueToString(arguments[i]);
+    }
+    runtime.getOutput() << "\n";
+    return Value();
+  }
+
+  static Value nativeString(ScriptRuntime &runtime, const Value *arguments,
+                            int) {
+    if (isString(arguments[0])) {
+      return arguments[0];
+    }
+    return Value::object(runtime.newString(valueToString(arguments[0])));
+  }
+
+  static Value nativeInt(ScriptRuntime &runtime, const Value *arguments, int) {
+    const Value &value = arguments[0];
+    if (value.isInt()) {
+      return value;
+    }
+    if (value.isDouble()) {
+      return runtime.heap.integer(static_cast<int64_t>(value.asDouble()));
+    }
+    if (value.isBool()) {
+      return Value::integer(value.asBool() ? 1 : 0);
+    }
+    if (isString(value)) {
+      return runtime.heap.integer(
+          std::strtoll(asString(value)->chars(), nullptr, 10));
+    }
+    runtime.fail("Cannot convert " + std::string(valueTypeName(value)) +
+                 " to Int");
+  }
+
+  static Value nativeDouble(ScriptRuntime &runtime, const Value *arguments,
+                            int) {
+    const Value &value = arguments[0];
+    if (value.isNumber()) {
+      return Value::number(value.asNumber());
+    }
+    if (value.isBool()) {
+      return Value::number(value.asBool() ? 1 : 0);
+    }
+    if (isString(value)) {
+      return Value::number(std::strtod(asString(value)->chars(), nullptr));
+    }
+    runtime.fail("Cannot convert " + std::string(valueTypeName(value)) +
+                 " to Double");
+  }
+
+  static Value nativeBool(ScriptRuntime &, const Value *arguments, int) {
+    return Value::boolean(arguments[0].isTruthy());
+  }
+
+  static Value nativeAny(ScriptRuntime &, const Value *arguments, int) {
+    return arguments[0];
+  }
+
+  // A new array of arguments[0] elements, each arguments[1]
+  static Value nativeArrayOf(ScriptRuntime &runtime, const Value *arguments,
+                             int) {
+    if (!arguments[0].isInt() || arguments[0].asInt() < 0) {
+      runtime.fail("arrayOf expects a count");
+    }
+    auto *array = runtime.heap.allocate<ArrayObject>();
+    runtime.heap.writeBarrier(array);
+    array->assign(static_cast<size_t>(arguments[0].asInt()), arguments[1]);
+    return Value::object(array);
+  }
+};
+
+#endif // SCRIPT_RUNTIME_H
@@ -0,0 +1,53 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include "heap_object.h"
+#include <string>
+#include <unordered_map>
+
+// Layout of an instance: the slot each of its fields is stored in. Shapes
+// form a tree rooted at the empty shape, each adding one field to its
+// parent. The transitions out of a shape are kept, so classes declaring
+// the same fields in the same order share shapes, and a derived class's
+// shape extends its base class's.
+class Shape : public HeapObject {
+public:
+  Shape *const Parent;
+  const int SlotCount;
+  const std::string Field; // The one added to the parent's, if any
+
+  Shape() : HeapObject(ObjectKind::Shape), Parent(nullptr), SlotCount(0) {}
+
+  Shape(Shape *parent, const std::string &field)
+      : HeapObject(ObjectKind::Shape), Parent(parent),
+        SlotCount(parent->SlotCount + 1), Field(field),
+        fieldIndex(parent->fieldIndex) {
+    fieldIndex[field] = parent->SlotCount;
+  }
+
+  int findField(const std::string &name) const {
+    auto found = fieldIndex.find(name);
+    return found == fieldIndex.end() ? -1 : found->second;
+  }
+
+  // The shape reached by adding field, or null if none was made yet
+  Shape *findTransition(const std::string &field) const {
+    auto found = transitions.find(field);
+    return found == transitions.end() ? nullptr : found->second;
+  }
+
+  void addTransition(const std::string &field, Shape *shape) {
+    transitions[field] = shape;
+  }
+
+  size_t size() const override {
+    return sizeof(*this) + Field.capacity() +
+           (fieldIndex.size() + transitions.size()) * 2 * sizeof(std::string);
+  }
+
+private:
+  std::unordered_map<std::string, int> fieldIndex;
+  std::unordered_map<std::string, Shape *> transitions;
+};
+
+#endif // SHAPE_H
@@ -0,0 +1,13 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SSE2 is part of every x86-64; elsewhere, or in builds defining
+// SODA_NO_SIMD, code using it runs its scalar loops alone
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(SODA_NO_SIMD)
+#define SODA_SIMD 1
+#include <emmintrin.h>
+#else
+#define SODA_SIMD 0
+#endif
+
+#endif // SIMD_H
@@ -0,0 +1,178 @@
+#ifndef SODA_TYPE_H
+#define SODA_TYPE_H
+
+#include "type_reference.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Static type kinds known to the type checker. Any means the value is only
+// known at runtime and operations on it need dynamic dispatch.
+enum class TypeKind {
+  Unknown,
+  Void,
+  Bool,
+  Int,
+  Long,
+  Float,
+  Double,
+  Number,
+  String,
+  Any,
+  Array,
+  Dictionary,
+  Class,
+  Function,
+};
+
+struct SodaType {
+  TypeKind Kind = TypeKind::Unknown;
+  std::string ClassName; // Set for Class types
+  // Element type for Array, key and value types for Dictionary, parameter
+  // types followed by the return type for Function
+  std::vector<SodaType> Arguments;
+
+  SodaType() = default;
+  SodaType(TypeKind kind) : Kind(kind) {}
+
+  static SodaType classType(const std::string &name) {
+    SodaType type(TypeKind::Class);
+    type.ClassName = name;
+    return type;
+  }
+
+  static SodaType arrayOf(const SodaType &element) {
+    SodaType type(TypeKind::Array);
+    type.Arguments.push_back(element);
+    return type;
+  }
+
+  static SodaType dictionaryOf(const SodaType &key, const SodaType &value) {
+    SodaType type(TypeKind::Dictionary);
+    type.Arguments.push_back(key);
+    type.Arguments.push_back(value);
+    return type;
+  }
+
+  // Builds a type from a source annotation. Unknown names become Class types
+  // and are validated by the type checker against the declared classes.
+  static SodaType fromReference(const std::shared_ptr<TypeReference> &ref) {
+    if (!ref) {
+      return SodaType(TypeKind::Any);
+    }
+    const std::string &name = ref->Name;
+    std::vector<SodaType> arguments;
+    for (const auto &generic : ref->GenericTypes) {
+      arguments.push_back(fromReference(generic));
+    }
+    if (name == "Void")
+      return SodaType(TypeKind::Void);
+    if (name == "Bool")
+      return SodaType(TypeKind::Bool);
+    if (name == "Int")
+      return SodaType(TypeKind::Int);
+    if (name == "Long")
+      return SodaType(TypeKind::Long);
+    if (name == "Float")
+      return SodaType(TypeKind::Float);
+    if (name == "Double")
+      return SodaType(TypeKind::Double);
+    if (name == "Number")
+      return SodaType(TypeKind::Number);
+    if (name == "String")
+      return SodaType(TypeKind::String);
+    if (name == "Any")
+      return SodaType(TypeKind::Any);
+    if (name == "Array") {
+      return arrayOf(arguments.empty() ? SodaType(TypeKind::Any)
+                                       : arguments[0]);
+    }
+    if (name == "Dictionary") {
+      return dictionaryOf(
+          arguments.size() > 0 ? arguments[0] : SodaType(TypeKind::Any),
+          arguments.size() > 1 ? arguments[1] : SodaType(TypeKind::Any));
+    }
+    SodaType type = classType(name);
+    type.Arguments = arguments;
+    return type;
+  }
+
+  bool isDynamic() const {
+    return Kind == TypeKind::Any || Kind == TypeKind::Unknown;
+  }
+
+  // Types with a fixed machine representation that never need boxing
+  bool isPrimitive() const {
+    return Kind == TypeKind::Bool || isNumeric();
+  }
+
+  bool isNumeric() const {
+    return Kind == TypeKind::Int || Kind == TypeKind::Long ||
+           Kind == TypeKind::Float || Kind == TypeKind::Double;
+  }
+
+  // Widening order used when numeric operands are mixed
+  int numericRank() const {
+    switch (Kind) {
+    case TypeKind::Int:
+      return 1;
+    case TypeKind::Long:
+      return 2;
+    case TypeKind::Float:
+      return 3;
+    case TypeKind::Double:
+      return 4;
+    default:
+      return 0;
+    }
+  }
+
+  bool operator==(const SodaType &other) const {
+    return Kind == other.Kind && ClassName == other.ClassName &&
+           Arguments == other.Arguments;
+  }
+
+  bool operator!=(const SodaType &other) const { return !(*this == other); }
+
+  std::string toString() const {
+    switch (Kind) {
+    case TypeKind::Unknown:
+      return "<unknown>";
+    case TypeKind::Void:
+      return "Void";
+    case TypeKind::Bool:
+      return "Bool";
+    case TypeKind::Int:
+      return "Int";
+    case TypeKind::Long:
+      return "Long";
+    case TypeKind::Float:
+      return "Float";
+    case TypeKind::Double:
+      return "Double";
+    case TypeKind::Number:
+      return "Number";
+    case TypeKind::String:
+      return "String";
+    case TypeKind::Any:
+      return "Any";
+    case TypeKind::Array:
+      return "Array<" + Arguments[0].toString() + ">";
+    case TypeKind::Dictionary:
+      return "Dictionary<" + Arguments[0].toString() + ", " +
+             Arguments[1].toString() + ">";
+    case TypeKind::Class:
+      return ClassName;
+    case TypeKind::Function: {
+      std::string result = "(";
+      for (size_t i = 0; i + 1 < Arguments.size(); i++) {
+        result += (i > 0 ? ", " : "") + Arguments[i].toString();
+      }
+      return result + ") => " + Arguments.back().toString();
+    }
+    }
+    return "<unknown>";
+  }
+};
+
+#endif // SODA_TYPE_H
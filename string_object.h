@@ -0,0 +1,180 @@
+#ifndef STRING_OBJECT_H
+#define STRING_OBJECT_H
+
+#include "heap_object.h"
+#include "tracer.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Script string. A flat string keeps its characters right after the
+// object, so it takes one allocation however short or long it is. A rope
+// only points at the two strings it concatenates, and copies them into a
+// buffer of its own the first time its characters are read, so appending
+// to a long string in a loop copies nothing until the result is used.
+class StringObject : public HeapObject {
+public:
+  static const bool Movable = true;
+  static const size_t MinRopeLength = 64; // Shorter results are copied
+
+  const size_t Length;
+
+  // Allocates a flat string of length characters, to be filled in through
+  // data() before anything reads it. The Heap makes strings through the
+  // create functions, never with plain new, giving them a function that
+  // returns memory of the size asked for.
+  template <typename Allocate>
+  static StringObject *create(Allocate allocate, size_t length) {
+    return new (allocate(sizeof(StringObject) + length + 1))
+        StringObject(length);
+  }
+
+  template <typename Allocate>
+  static StringObject *create(Allocate allocate, const std::string &text) {
+    StringObject *string = create(allocate, text.size());
+    std::memcpy(string->data(), text.data(), text.size());
+    return string;
+  }
+
+  // The rope of left followed by right
+  template <typename Allocate>
+  static StringObject *create(Allocate allocate, StringObject *left,
+                              StringObject *right) {
+    return new (allocate(sizeof(StringObject))) StringObject(left, right);
+  }
+
+  static void operator delete(void *memory) { ::operator delete(memory); }
+
+  // The characters, null-terminated. Flattens a rope, which threads
+  // reading it at once can do.
+  const char *chars() {
+    char *text = characters.load(std::memory_order_acquire);
+    return text ? text : flatten();
+  }
+
+  // The characters of a flat string made to be filled in
+  char *data() { return characters.load(std::memory_order_relaxed); }
+
+  std::string text() { return std::string(chars(), Length); }
+
+  bool isRope() const { return left != nullptr; }
+
+  bool equals(StringObject *other) {
+    return Length == other->Length &&
+           std::memcmp(chars(), other->chars(), Length) == 0;
+  }
+
+  // Negative, zero or positive like strcmp
+  int compare(StringObject *other) {
+    size_t common = Length < other->Length ? Length : other->Length;
+    int order = std::memcmp(chars(), other->chars(), common);
+    if (order != 0) {
+      return order;
+    }
+    return Length < other->Length ? -1 : Length > other->Length ? 1 : 0;
+  }
+
+  // FNV-1a over the characters, worked out the first time it is asked
+  // for. A hash of 0 is made 1, so 0 can mean not yet known.
+  size_t hash() {
+    uint64_t hash = hashCode.load(std::memory_order_relaxed);
+    if (hash == 0) {
+      const char *text = chars();
+      hash = 14695981039346656037ull;
+      for (size_t i = 0; i < Length; i++) {
+        hash = (hash ^ static_cast<unsigned char>(text[i])) * 1099511628211ull;
+      }
+      hash += hash == 0;
+      hashCode.store(hash, std::memory_order_relaxed);
+    }
+    return static_cast<size_t>(hash);
+  }
+
+  size_t size() const override {
+    if (left || flattened) {
+      return sizeof(*this) + (flattened ? Length + 1 : 0);
+    }
+    return sizeof(*this) + Length + 1;
+  }
+
+  void trace(Tracer &tracer) override {
+    tracer.mark(left);
+    tracer.mark(right);
+  }
+
+  HeapObject *moveTo(void *memory) override {
+    return new (memory) StringObject(std::move(*this));
+  }
+
+private:
+  std::atomic<char *> characters; // Null in a rope until it is flattened
+  StringObject *left = nullptr;
+  StringObject *right = nullptr;
+  std::unique_ptr<char[]> flattened; // A flattened rope's characters
+  std::atomic<uint64_t> hashCode{0};  // Once hash has worked it out
+
+  explicit StringObject(size_t length)
+      : HeapObject(ObjectKind::String), Length(length),
+        characters(reinterpret_cast<char *>(this + 1)) {
+    data()[length] = '\0';
+  }
+
+  StringObject(StringObject *left, StringObject *right)
+      : HeapObject(ObjectKind::String), Length(left->Length + right->Length),
+        characters(nullptr), left(left), right(right) {}
+
+  // Into memory as large as other's
+  StringObject(StringObject &&other)
+      : HeapObject(ObjectKind::String), Length(other.Length),
+        characters(other.data()), left(other.left), right(other.right),
+        flattened(std::move(other.flattened)),
+        hashCode(other.hashCode.load(std::memory_order_relaxed)) {
+    if (data() && !flattened) {
+      characters = reinterpret_cast<char *>(this + 1);
+      std::memcpy(data(), other.data(), Length + 1);
+    }
+  }
+
+  // Copies the leaves of the rope in order, without recursing, since
+  // appending in a loop makes ropes as deep as the loop ran. Returns the
+  // characters, which another thread may have copied first.
+  char *flatten() {
+    uint8_t state = lock();
+    if (char *text = data()) {
+      unlock(state);
+      return text;
+    }
+    flattened.reset(new char[Length + 1]);
+    char *out = flattened.get();
+    std::vector<StringObject *> pending{right, left};
+    while (!pending.empty()) {
+      StringObject *next = pending.back();
+      pending.pop_back();
+      // Locked, as a thread reading it may be flattening it too
+      uint8_t held = next->lock();
+      const char *text = next->data();
+      if (text) {
+        std::memcpy(out, text, next->Length);
+        out += next->Length;
+      } else {
+        pending.push_back(next->right);
+        pending.push_back(next->left);
+      }
+      next->unlock(held);
+    }
+    *out = '\0';
+    // The parts are no longer needed
+    left = nullptr;
+    right = nullptr;
+    characters.store(flattened.get(), std::memory_order_release);
+    unlock(state);
+    return flattened.get();
+  }
+};
+
+#endif // STRING_OBJECT_H
@@ -0,0 +1,58 @@
+#ifndef TASK_OBJECT_H
+#define TASK_OBJECT_H
+
+#include "closure_object.h"
+#include "heap_object.h"
+#include "tracer.h"
+#include "value.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TaskState {
+  Pending,
+  Done,   // Result holds what it returned
+  Failed, // Error holds the runtime error that ended it
+};
+
+// A call of an async function, or other work the event loop finishes
+// later, like a timer. While the function awaits, its frame lives here
+// rather than on the register stack: the registers it uses and where to
+// continue, so a suspended task costs only that much memory.
+//
+// Never moves, so the event loop and the frame running it can hold it.
+class TaskObject : public HeapObject {
+public:
+  TaskState State = TaskState::Pending;
+  Value Result;
+  std::string Error;
+  ClosureObject *Closure = nullptr; // Null if it runs no script
+  Value Receiver;
+  std::vector<Value> Registers; // The arguments until it starts, then the
+                                // frame while it awaits
+  const uint32_t *Pc = nullptr; // Where it continues, once it has started
+  int ResultRegister = 0;       // Receives the result of Awaited
+  TaskObject *Awaited = nullptr;
+  std::vector<TaskObject *> Waiters; // Awaiting this one
+
+  TaskObject() : HeapObject(ObjectKind::Task) {}
+
+  size_t size() const override {
+    return sizeof(*this) + Error.capacity() +
+           Registers.capacity() * sizeof(Value) +
+           Waiters.capacity() * sizeof(TaskObject *);
+  }
+
+  void trace(Tracer &tracer) override {
+    tracer.mark(Result);
+    tracer.mark(Closure);
+    tracer.mark(Receiver);
+    tracer.mark(Registers.data(), Registers.size());
+    tracer.mark(Awaited);
+    for (TaskObject *&waiter : Waiters) {
+      tracer.mark(waiter);
+    }
+  }
+};
+
+#endif // TASK_OBJECT_H
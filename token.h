@@ -28,6 +28,8 @@ enum SodaScriptToken {
   ConstructorKeyword, // Example : "constructor"
   StaticKeyword,      // Example : "static"
   NewKeyword,         // Example : "new"
+  AsyncKeyword,       // Example : "async"
+  AwaitKeyword,       // Example : "await"
 
   // Data Types
   StringType,     // Example : "String"
@@ -128,6 +128,10 @@ SodaScriptToken Tokenizer::getKeywordToken(const std::string &word) {
     return StaticKeyword;
   if (word == "new")
     return NewKeyword;
+  if (word == "async")
+    return AsyncKeyword;
+  if (word == "await")
+    return AwaitKeyword;
   if (word == "return")
     return ReturnKeyword;
   if (word == "if")
@@ -150,6 +154,8 @@ SodaScriptToken Tokenizer::getKeywordToken(const std::string &word) {
     return IsKeyword;
   if (word == "var")
     return VarKeyword;
+  if (word == "true" || word == "false")
+    return BooleanLiteral;
   // Add other keywords...
   return Identifier;
 }
@@ -0,0 +1,83 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include "heap_object.h"
+#include "value.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Marks the objects a collection reaches. Each object is traced once, from
+// a worklist rather than recursively, so long chains of references cannot
+// overflow the native stack.
+//
+// A collection that moves objects updates the references it is handed, so
+// objects pass every reference they hold that can point to a young object
+// by reference.
+class Tracer {
+public:
+  virtual ~Tracer() {}
+
+  // Writes the reference only if the object moved, since concurrent
+  // marking must not write what the mutator reads
+  template <typename T> void mark(T *&object) {
+    if (object) {
+      HeapObject *moved = visit(object);
+      if (moved != object) {
+        object = static_cast<T *>(moved);
+      }
+    }
+  }
+
+  // For references to objects that never move, like shapes
+  void mark(HeapObject *object) {
+    if (object) {
+      visit(object);
+    }
+  }
+
+  void mark(Value &value) {
+    HeapObject *object = value.getReference();
+    if (object) {
+      HeapObject *moved = visit(object);
+      if (moved != object) {
+        value = Value::fromBits(
+            (value.getBits() & ~Value::PayloadMask) |
+            static_cast<uint64_t>(reinterpret_cast<uintptr_t>(moved)));
+      }
+    }
+  }
+
+  void mark(Value *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      mark(values[i]);
+    }
+  }
+
+  // Has object rehashed once everything has moved
+  void rehashLater(HeapObject *object) { rehashed.push_back(object); }
+
+  // Traces the marked objects, and what they reach in turn
+  void drain() {
+    while (!pending.empty()) {
+      HeapObject *object = pending.back();
+      pending.pop_back();
+      object->trace(*this);
+    }
+    for (HeapObject *object : rehashed) {
+      object->rehash();
+    }
+    rehashed.clear();
+  }
+
+protected:
+  std::vector<HeapObject *> pending;
+
+  // Marks object, queueing it to be traced, and returns where it is now
+  virtual HeapObject *visit(HeapObject *object) = 0;
+
+private:
+  std::vector<HeapObject *> rehashed;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,1011 @@
+#ifndef TREE_NODES_H
+#define TREE_NODES_H
+
+#include "binary_operator.h"
+#include "cell_object.h"
+#include "class_object.h"
+#include "closure_object.h"
+#include "function_object.h"
+#include "heap.h"
+#include "inline_cache.h"
+#include "instance_object.h"
+#include "script_runtime.h"
+#include "shape.h"
+#include "value.h"
+#include "value_format.h"
+#include "value_hash.h"
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Executable nodes of the AstInterpreter. They are built from the AST of a
+// function the first time it runs and then specialize themselves on the
+// values they see, replacing themselves in their parent.
+
+class ExpressionNode;
+
+// How often nodes rewrote themselves. Replaced nodes are kept until no
+// execution can still be inside them.
+struct TreeContext {
+  int Rewrites = 0;
+  int Deoptimizations = 0;
+  std::vector<std::shared_ptr<ExpressionNode>> Retired;
+};
+
+struct TreeFrame {
+  ScriptRuntime *Runtime;
+  TreeContext *Context;
+  Value *Globals;
+  Value *Stack; // Bottom of the slot stack, where references point
+  Value *Slots;
+  ClosureObject *Closure;
+  Value Receiver;
+  Value Result; // Set by return
+};
+
+class ExpressionNode {
+public:
+  // The parent's pointer to this node, which a rewrite overwrites
+  std::shared_ptr<ExpressionNode> *Owner = nullptr;
+
+  virtual ~ExpressionNode() {}
+
+  virtual Value evaluate(TreeFrame &frame) = 0;
+
+protected:
+  // Puts replacement where this node is in the tree. Executions already
+  // inside this node finish on it.
+  void replace(TreeFrame &frame, std::shared_ptr<ExpressionNode> replacement);
+
+  // The node now in this node's place, which differs from this once an
+  // execution that was still inside this node has rewritten it, as a
+  // recursive call does
+  ExpressionNode *current() const { return Owner->get(); }
+};
+
+inline void adopt(std::shared_ptr<ExpressionNode> &slot,
+                  std::shared_ptr<ExpressionNode> node) {
+  slot = std::move(node);
+  if (slot) {
+    slot->Owner = &slot;
+  }
+}
+
+inline void adoptAll(std::vector<std::shared_ptr<ExpressionNode>> &slots) {
+  for (auto &slot : slots) {
+    slot->Owner = &slot;
+  }
+}
+
+inline void
+ExpressionNode::replace(TreeFrame &frame,
+                        std::shared_ptr<ExpressionNode> replacement) {
+  frame.Context->Retired.push_back(*Owner);
+  adopt(*Owner, std::move(replacement));
+}
+
+// Statements return true once the function has returned
+class StatementNode {
+public:
+  virtual ~StatementNode() {}
+
+  virtual bool execute(TreeFrame &frame) = 0;
+};
+
+typedef std::vector<std::unique_ptr<StatementNode>> StatementList;
+
+inline bool executeAll(const StatementList &statements, TreeFrame &frame) {
+  for (const auto &statement : statements) {
+    if (statement->execute(frame)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Variables
+
+class ConstantNode : public ExpressionNode {
+public:
+  Value Constant;
+
+  explicit ConstantNode(const Value &constant) : Constant(constant) {}
+
+  Value evaluate(TreeFrame &) override { return Constant; }
+};
+
+class LocalNode : public ExpressionNode {
+public:
+  int Slot;
+
+  explicit LocalNode(int slot) : Slot(slot) {}
+
+  Value evaluate(TreeFrame &frame) override { return frame.Slots[Slot]; }
+};
+
+class SetLocalNode : public ExpressionNode {
+public:
+  int Slot;
+  std::shared_ptr<ExpressionNode> Assigned;
+
+  SetLocalNode(int slot, std::shared_ptr<ExpressionNode> assigned)
+      : Slot(slot) {
+    adopt(Assigned, std::move(assigned));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    return frame.Slots[Slot] = Assigned->evaluate(frame);
+  }
+};
+
+// A boxed local, whose slot holds its cell
+class CellNode : public ExpressionNode {
+public:
+  int Slot;
+
+  explicit CellNode(int slot) : Slot(slot) {}
+
+  Value evaluate(TreeFrame &frame) override {
+    return static_cast<CellObject *>(frame.Slots[Slot].asObject())->Contents;
+  }
+};
+
+class SetCellNode : public ExpressionNode {
+public:
+  int Slot;
+  std::shared_ptr<ExpressionNode> Assigned;
+
+  SetCellNode(int slot, std::shared_ptr<ExpressionNode> assigned)
+      : Slot(slot) {
+    adopt(Assigned, std::move(assigned));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value value = Assigned->evaluate(frame);
+    HeapObject *cell = frame.Slots[Slot].asObject();
+    frame.Runtime->getHeap().writeBarrier(cell);
+    static_cast<CellObject *>(cell)->Contents = value;
+    return value;
+  }
+};
+
+// Moves the value a local was initialized with into a new cell
+class NewCellNode : public ExpressionNode {
+public:
+  int Slot;
+
+  explicit NewCellNode(int slot) : Slot(slot) {}
+
+  Value evaluate(TreeFrame &frame) override {
+    Value &slot = frame.Slots[Slot];
+    slot = Value::object(
+        frame.Runtime->getHeap().allocate<CellObject>(slot));
+    return Value();
+  }
+};
+
+// A captured copy, or a captured cell when Boxed
+class EnvironmentNode : public ExpressionNode {
+public:
+  int Index;
+  bool Boxed;
+
+  EnvironmentNode(int index, bool boxed) : Index(index), Boxed(boxed) {}
+
+  Value evaluate(TreeFrame &frame) override {
+    const Value &captured = frame.Closure->Environment[Index];
+    if (Boxed) {
+      return static_cast<CellObject *>(captured.asObject())->Contents;
+    }
+    return captured;
+  }
+};
+
+class SetEnvironmentCellNode : public ExpressionNode {
+public:
+  int Index;
+  std::shared_ptr<ExpressionNode> Assigned;
+
+  SetEnvironmentCellNode(int index, std::shared_ptr<ExpressionNode> assigned)
+      : Index(index) {
+    adopt(Assigned, std::move(assigned));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value value = Assigned->evaluate(frame);
+    HeapObject *cell = frame.Closure->Environment[Index].asObject();
+    frame.Runtime->getHeap().writeBarrier(cell);
+    static_cast<CellObject *>(cell)->Contents = value;
+    return value;
+  }
+};
+
+// A variable of a frame that outlives the closure, captured by position
+class ReferenceNode : public ExpressionNode {
+public:
+  int Index;
+
+  explicit ReferenceNode(int index) : Index(index) {}
+
+  Value evaluate(TreeFrame &frame) override {
+    return frame.Stack[frame.Closure->Environment[Index].asInt()];
+  }
+};
+
+class SetReferenceNode : public ExpressionNode {
+public:
+  int Index;
+  std::shared_ptr<ExpressionNode> Assigned;
+
+  SetReferenceNode(int index, std::shared_ptr<ExpressionNode> assigned)
+      : Index(index) {
+    adopt(Assigned, std::move(assigned));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    return frame.Stack[frame.Closure->Environment[Index].asInt()] =
+               Assigned->evaluate(frame);
+  }
+};
+
+class GlobalNode : public ExpressionNode {
+public:
+  int Index;
+
+  explicit GlobalNode(int index) : Index(index) {}
+
+  Value evaluate(TreeFrame &frame) override { return frame.Globals[Index]; }
+};
+
+class SetGlobalNode : public ExpressionNode {
+public:
+  int Index;
+  std::shared_ptr<ExpressionNode> Assigned;
+
+  SetGlobalNode(int index, std::shared_ptr<ExpressionNode> assigned)
+      : Index(index) {
+    adopt(Assigned, std::move(assigned));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    return frame.Globals[Index] = Assigned->evaluate(frame);
+  }
+};
+
+class ThisNode : public ExpressionNode {
+public:
+  Value evaluate(TreeFrame &frame) override { return frame.Receiver; }
+};
+
+inline InstanceObject *receiverInstance(TreeFrame &frame) {
+  if (!frame.Receiver.isObject() ||
+      frame.Receiver.asObject()->Kind != ObjectKind::Instance) {
+    frame.Runtime->fail("Field access without an instance");
+  }
+  return static_cast<InstanceObject *>(frame.Receiver.asObject());
+}
+
+class FieldNode : public ExpressionNode {
+public:
+  int Slot;
+
+  explicit FieldNode(int slot) : Slot(slot) {}
+
+  Value evaluate(TreeFrame &frame) override {
+    return receiverInstance(frame)->fields()[Slot];
+  }
+};
+
+class SetFieldNode : public ExpressionNode {
+public:
+  int Slot;
+  std::shared_ptr<ExpressionNode> Assigned;
+
+  SetFieldNode(int slot, std::shared_ptr<ExpressionNode> assigned)
+      : Slot(slot) {
+    adopt(Assigned, std::move(assigned));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value value = Assigned->evaluate(frame);
+    InstanceObject *instance = receiverInstance(frame);
+    frame.Runtime->getHeap().writeBarrier(instance);
+    instance->fields()[Slot] = value;
+    return value;
+  }
+};
+
+// Members. A member read specializes on the shape of the first instance
+// it reads a field of, and deoptimizes to the generic lookup when an
+// instance of another shape comes along. Generic reads, writes and member
+// calls go through an inline cache of their own.
+
+class MemberNode : public ExpressionNode {
+public:
+  std::shared_ptr<ExpressionNode> Object;
+  std::string Name;
+
+  MemberNode(std::shared_ptr<ExpressionNode> object, const std::string &name)
+      : Name(name) {
+    adopt(Object, std::move(object));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    return read(frame, Object->evaluate(frame));
+  }
+
+  virtual Value read(TreeFrame &frame, const Value &object) = 0;
+};
+
+class GenericMemberNode : public MemberNode {
+public:
+  using MemberNode::MemberNode;
+
+  Value read(TreeFrame &frame, const Value &object) override {
+    return frame.Runtime->getMember(object, Name, cache);
+  }
+
+private:
+  InlineCache cache;
+};
+
+class InstanceFieldNode : public MemberNode {
+public:
+  Shape *Layout;
+  int Field;
+
+  InstanceFieldNode(std::shared_ptr<ExpressionNode> object,
+                    const std::string &name, Shape *layout, int field)
+      : MemberNode(std::move(object), name), Layout(layout), Field(field) {}
+
+  Value read(TreeFrame &frame, const Value &object) override {
+    if (object.isObject() &&
+        object.asObject()->Kind == ObjectKind::Instance &&
+        static_cast<InstanceObject *>(object.asObject())->Layout == Layout) {
+      return static_cast<InstanceObject *>(object.asObject())
+          ->fields()[Field];
+    }
+    if (current() != this) {
+      return static_cast<MemberNode *>(current())->read(frame, object);
+    }
+    frame.Context->Deoptimizations++;
+    auto generic = std::make_shared<GenericMemberNode>(Object, Name);
+    replace(frame, generic);
+    return generic->read(frame, object);
+  }
+};
+
+class UninitializedMemberNode : public MemberNode {
+public:
+  using MemberNode::MemberNode;
+
+  Value read(TreeFrame &frame, const Value &object) override {
+    if (current() != this) {
+      return static_cast<MemberNode *>(current())->read(frame, object);
+    }
+    std::shared_ptr<MemberNode> specialized;
+    if (object.isObject() && object.asObject()->Kind == ObjectKind::Instance) {
+      Shape *layout = static_cast<InstanceObject *>(object.asObject())->Layout;
+      int field = layout->findField(Name);
+      if (field >= 0) {
+        specialized =
+            std::make_shared<InstanceFieldNode>(Object, Name, layout, field);
+      }
+    }
+    if (!specialized) {
+      specialized = std::make_shared<GenericMemberNode>(Object, Name);
+    }
+    frame.Context->Rewrites++;
+    replace(frame, specialized);
+    return specialized->read(frame, object);
+  }
+};
+
+class SetMemberNode : public ExpressionNode {
+public:
+  std::shared_ptr<ExpressionNode> Object;
+  std::string Name;
+  std::shared_ptr<ExpressionNode> Assigned;
+
+  SetMemberNode(std::shared_ptr<ExpressionNode> object, const std::string &name,
+                std::shared_ptr<ExpressionNode> assigned)
+      : Name(name) {
+    adopt(Object, std::move(object));
+    adopt(Assigned, std::move(assigned));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value object = Object->evaluate(frame);
+    Value value = Assigned->evaluate(frame);
+    frame.Runtime->setMember(object, Name, value, cache);
+    return value;
+  }
+
+private:
+  InlineCache cache;
+};
+
+// Operators. A new operator node rewrites itself on its first operands
+// into a variant for their types: Int for two integers, Number once a
+// double is involved, Concat for + with a string. A variant whose guard
+// fails deoptimizes to the Generic node, which handles any operands.
+
+enum class BinarySpecialization { Uninitialized, Int, Number, Concat, Generic };
+
+class BinaryNode : public ExpressionNode {
+public:
+  BinaryOperator Op;
+  std::shared_ptr<ExpressionNode> Left;
+  std::shared_ptr<ExpressionNode> Right;
+
+  BinaryNode(BinaryOperator op, std::shared_ptr<ExpressionNode> left,
+             std::shared_ptr<ExpressionNode> right)
+      : Op(op) {
+    adopt(Left, std::move(left));
+    adopt(Right, std::move(right));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value left = Left->evaluate(frame);
+    Value right = Right->evaluate(frame);
+    return apply(frame, left, right);
+  }
+
+  virtual BinarySpecialization getSpecialization() const = 0;
+
+  // Operates on operands that have already been evaluated
+  virtual Value apply(TreeFrame &frame, const Value &left,
+                      const Value &right) = 0;
+
+protected:
+  // Replaces this node with a variant of the given kind, which then
+  // operates on left and right
+  Value respecialize(TreeFrame &frame, BinarySpecialization specialization,
+                     const Value &left, const Value &right);
+
+  static Value integerOperation(TreeFrame &frame, BinaryOperator op,
+                                int64_t x, int64_t y) {
+    Heap &heap = frame.Runtime->getHeap();
+    switch (op) {
+    case BinaryOperator::Add:
+      return heap.integer(ScriptRuntime::wrap(static_cast<uint64_t>(x) +
+                                              static_cast<uint64_t>(y)));
+    case BinaryOperator::Subtract:
+      return heap.integer(ScriptRuntime::wrap(static_cast<uint64_t>(x) -
+                                              static_cast<uint64_t>(y)));
+    case BinaryOperator::Multiply:
+      return heap.integer(ScriptRuntime::wrap(static_cast<uint64_t>(x) *
+                                              static_cast<uint64_t>(y)));
+    case BinaryOperator::Divide:
+    case BinaryOperator::Modulo:
+      if (y == 0 || y == -1) {
+        return frame.Runtime->arithmetic(op, heap.integer(x), heap.integer(y));
+      }
+      return heap.integer(op == BinaryOperator::Divide ? x / y : x % y);
+    case BinaryOperator::Equal:
+      return Value::boolean(x == y);
+    case BinaryOperator::NotEqual:
+      return Value::boolean(x != y);
+    case BinaryOperator::Less:
+      return Value::boolean(x < y);
+    case BinaryOperator::LessEqual:
+      return Value::boolean(x <= y);
+    case BinaryOperator::Greater:
+      return Value::boolean(x > y);
+    default:
+      return Value::boolean(x >= y);
+    }
+  }
+
+  static Value doubleOperation(BinaryOperator op, double x, double y) {
+    switch (op) {
+    case BinaryOperator::Add:
+      return Value::number(x + y);
+    case BinaryOperator::Subtract:
+      return Value::number(x - y);
+    case BinaryOperator::Multiply:
+      return Value::number(x * y);
+    case BinaryOperator::Divide:
+      return Value::number(x / y);
+    case BinaryOperator::Modulo:
+      return Value::number(std::fmod(x, y));
+    case BinaryOperator::Equal:
+      return Value::boolean(x == y);
+    case BinaryOperator::NotEqual:
+      return Value::boolean(x != y);
+    case BinaryOperator::Less:
+      return Value::boolean(x < y);
+    case BinaryOperator::LessEqual:
+      return Value::boolean(x <= y);
+    case BinaryOperator::Greater:
+      return Value::boolean(x > y);
+    default:
+      return Value::boolean(x >= y);
+    }
+  }
+};
+
+class UninitializedBinaryNode : public BinaryNode {
+public:
+  using BinaryNode::BinaryNode;
+
+  BinarySpecialization getSpecialization() const override {
+    return BinarySpecialization::Uninitialized;
+  }
+
+  Value apply(TreeFrame &frame, const Value &left,
+              const Value &right) override {
+    BinarySpecialization specialization = BinarySpecialization::Generic;
+    if (left.isInt() && right.isInt()) {
+      specialization = BinarySpecialization::Int;
+    } else if (left.isNumber() && right.isNumber()) {
+      specialization = BinarySpecialization::Number;
+    } else if (Op == BinaryOperator::Add &&
+               (ScriptRuntime::isString(left) ||
+                ScriptRuntime::isString(right))) {
+      specialization = BinarySpecialization::Concat;
+    }
+    return respecialize(frame, specialization, left, right);
+  }
+};
+
+class IntBinaryNode : public BinaryNode {
+public:
+  using BinaryNode::BinaryNode;
+
+  BinarySpecialization getSpecialization() const override {
+    return BinarySpecialization::Int;
+  }
+
+  Value apply(TreeFrame &frame, const Value &left,
+              const Value &right) override {
+    if (left.isInt() && right.isInt()) {
+      return integerOperation(frame, Op, left.asInt(), right.asInt());
+    }
+    return respecialize(frame, BinarySpecialization::Generic, left, right);
+  }
+};
+
+// Integers or doubles; two integers still give an integer result
+class NumberBinaryNode : public BinaryNode {
+public:
+  using BinaryNode::BinaryNode;
+
+  BinarySpecialization getSpecialization() const override {
+    return BinarySpecialization::Number;
+  }
+
+  Value apply(TreeFrame &frame, const Value &left,
+              const Value &right) override {
+    if (left.isInt() && right.isInt()) {
+      return integerOperation(frame, Op, left.asInt(), right.asInt());
+    }
+    if (left.isNumber() && right.isNumber()) {
+      return doubleOperation(Op, left.asNumber(), right.asNumber());
+    }
+    return respecialize(frame, BinarySpecialization::Generic, left, right);
+  }
+};
+
+class ConcatNode : public BinaryNode {
+public:
+  using BinaryNode::BinaryNode;
+
+  BinarySpecialization getSpecialization() const override {
+    return BinarySpecialization::Concat;
+  }
+
+  Value apply(TreeFrame &frame, const Value &left,
+              const Value &right) override {
+    if (ScriptRuntime::isString(left) || ScriptRuntime::isString(right)) {
+      return frame.Runtime->concatenate(left, right);
+    }
+    return respecialize(frame, BinarySpecialization::Generic, left, right);
+  }
+};
+
+class GenericBinaryNode : public BinaryNode {
+public:
+  using BinaryNode::BinaryNode;
+
+  BinarySpecialization getSpecialization() const override {
+    return BinarySpecialization::Generic;
+  }
+
+  Value apply(TreeFrame &frame, const Value &left,
+              const Value &right) override {
+    return frame.Runtime->binary(Op, left, right);
+  }
+};
+
+inline Value BinaryNode::respecialize(TreeFrame &frame,
+                                      BinarySpecialization specialization,
+                                      const Value &left, const Value &right) {
+  if (current() != this) {
+    return static_cast<BinaryNode *>(current())->apply(frame, left, right);
+  }
+  if (getSpecialization() == BinarySpecialization::Uninitialized) {
+    frame.Context->Rewrites++;
+  } else {
+    frame.Context->Deoptimizations++;
+  }
+  std::shared_ptr<BinaryNode> replacement;
+  switch (specialization) {
+  case BinarySpecialization::Int:
+    replacement = std::make_shared<IntBinaryNode>(Op, Left, Right);
+    break;
+  case BinarySpecialization::Number:
+    replacement = std::make_shared<NumberBinaryNode>(Op, Left, Right);
+    break;
+  case BinarySpecialization::Concat:
+    replacement = std::make_shared<ConcatNode>(Op, Left, Right);
+    break;
+  default:
+    replacement = std::make_shared<GenericBinaryNode>(Op, Left, Right);
+    break;
+  }
+  replace(frame, replacement);
+  return replacement->apply(frame, left, right);
+}
+
+// && and ||, which leave the deciding operand as the result
+class LogicalNode : public ExpressionNode {
+public:
+  bool IsAnd;
+  std::shared_ptr<ExpressionNode> Left;
+  std::shared_ptr<ExpressionNode> Right;
+
+  LogicalNode(bool isAnd, std::shared_ptr<ExpressionNode> left,
+              std::shared_ptr<ExpressionNode> right)
+      : IsAnd(isAnd) {
+    adopt(Left, std::move(left));
+    adopt(Right, std::move(right));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value left = Left->evaluate(frame);
+    if (left.isTruthy() != IsAnd) {
+      return left;
+    }
+    return Right->evaluate(frame);
+  }
+};
+
+// A value stored where the TypeChecker declared a Float or Double, an
+// integer being made a double
+class ToDoubleNode : public ExpressionNode {
+public:
+  std::shared_ptr<ExpressionNode> Operand;
+
+  explicit ToDoubleNode(std::shared_ptr<ExpressionNode> operand) {
+    adopt(Operand, std::move(operand));
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    return ScriptRuntime::toDouble(Operand->evaluate(frame));
+  }
+};
+
+// Calls
+
+// Evaluates arguments into a buffer on the C++ stack, spilling to the heap
+// for long argument lists
+class ArgumentValues {
+public:
+  ArgumentValues(TreeFrame &frame,
+                 const std::vector<std::shared_ptr<ExpressionNode>> &nodes)
+      : count(static_cast<int>(nodes.size())) {
+    if (nodes.size() > InlineCount) {
+      spilled.resize(nodes.size());
+      rooted.reset(new Heap::RootRange(frame.Runtime->getHeap(),
+                                       spilled.data(), spilled.size()));
+    }
+    Value *values = data();
+    for (int i = 0; i < count; i++) {
+      values[i] = nodes[i]->evaluate(frame);
+    }
+  }
+
+  Value *data() { return spilled.empty() ? inlined : spilled.data(); }
+
+  int size() const { return count; }
+
+private:
+  static const size_t InlineCount = 8;
+  Value inlined[InlineCount];
+  std::vector<Value> spilled;
+  std::unique_ptr<Heap::RootRange> rooted; // Out of the collector's sight
+  int count;
+};
+
+// A chain of + known to build a string, like "a" + b + "c", evaluated
+// operand by operand and joined in one allocation
+class ConcatChainNode : public ExpressionNode {
+public:
+  std::vector<std::shared_ptr<ExpressionNode>> Parts;
+
+  explicit ConcatChainNode(std::vector<std::shared_ptr<ExpressionNode>> parts)
+      : Parts(std::move(parts)) {
+    adoptAll(Parts);
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    ArgumentValues parts(frame, Parts);
+    return frame.Runtime->concatenateAll(parts.data(), parts.size());
+  }
+};
+
+class CallNode : public ExpressionNode {
+public:
+  std::shared_ptr<ExpressionNode> Callee;
+  std::vector<std::shared_ptr<ExpressionNode>> Arguments;
+
+  CallNode(std::shared_ptr<ExpressionNode> callee,
+           std::vector<std::shared_ptr<ExpressionNode>> arguments)
+      : Arguments(std::move(arguments)) {
+    adopt(Callee, std::move(callee));
+    adoptAll(Arguments);
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value callee = Callee->evaluate(frame);
+    ArgumentValues arguments(frame, Arguments);
+    return frame.Runtime->call(callee, arguments.data(), arguments.size());
+  }
+};
+
+// A method of this called by its unqualified name
+class MethodCallNode : public ExpressionNode {
+public:
+  int Slot;
+  std::vector<std::shared_ptr<ExpressionNode>> Arguments;
+
+  MethodCallNode(int slot,
+                 std::vector<std::shared_ptr<ExpressionNode>> arguments)
+      : Slot(slot), Arguments(std::move(arguments)) {
+    adoptAll(Arguments);
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    ClassObject *cls = ScriptRuntime::methodTable(frame.Receiver);
+    if (!cls) {
+      frame.Runtime->fail("Method call without an instance");
+    }
+    ArgumentValues arguments(frame, Arguments);
+    return frame.Runtime->callMethod(cls->Methods[Slot], frame.Receiver,
+                                     arguments.data(), arguments.size());
+  }
+};
+
+// A method of this no subclass overrides, taken from the class the
+// function is in
+class FinalCallNode : public ExpressionNode {
+public:
+  int Slot;
+  std::vector<std::shared_ptr<ExpressionNode>> Arguments;
+
+  FinalCallNode(int slot,
+                std::vector<std::shared_ptr<ExpressionNode>> arguments)
+      : Slot(slot), Arguments(std::move(arguments)) {
+    adoptAll(Arguments);
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    ClassObject *owner = frame.Closure->Function->Owner;
+    ArgumentValues arguments(frame, Arguments);
+    return frame.Runtime->callMethod(owner->Methods[Slot], frame.Receiver,
+                                     arguments.data(), arguments.size());
+  }
+};
+
+// Cls.name(...) on a class the package never assigns over
+class StaticCallNode : public ExpressionNode {
+public:
+  std::shared_ptr<ExpressionNode> Class;
+  int Slot;
+  std::vector<std::shared_ptr<ExpressionNode>> Arguments;
+
+  StaticCallNode(std::shared_ptr<ExpressionNode> cls, int slot,
+                 std::vector<std::shared_ptr<ExpressionNode>> arguments)
+      : Slot(slot), Arguments(std::move(arguments)) {
+    adopt(Class, std::move(cls));
+    adoptAll(Arguments);
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value cls = Class->evaluate(frame);
+    if (!cls.isObject() || cls.asObject()->Kind != ObjectKind::Class) {
+      frame.Runtime->fail("Cannot call a static method on " +
+                          std::string(valueTypeName(cls)));
+    }
+    ArgumentValues arguments(frame, Arguments);
+    return frame.Runtime->callMethod(
+        static_cast<ClassObject *>(cls.asObject())->Methods[Slot], cls,
+        arguments.data(), arguments.size());
+  }
+};
+
+class MemberCallNode : public ExpressionNode {
+public:
+  std::shared_ptr<ExpressionNode> Object;
+  std::string Name;
+  std::vector<std::shared_ptr<ExpressionNode>> Arguments;
+
+  MemberCallNode(std::shared_ptr<ExpressionNode> object,
+                 const std::string &name,
+                 std::vector<std::shared_ptr<ExpressionNode>> arguments)
+      : Name(name), Arguments(std::move(arguments)) {
+    adopt(Object, std::move(object));
+    adoptAll(Arguments);
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value object = Object->evaluate(frame);
+    ArgumentValues arguments(frame, Arguments);
+    return frame.Runtime->invokeMember(object, Name, arguments.data(),
+                                       arguments.size(), cache);
+  }
+
+private:
+  InlineCache cache;
+};
+
+// super(...) or super.name(...) on this
+class SuperCallNode : public ExpressionNode {
+public:
+  std::string Name;
+  std::vector<std::shared_ptr<ExpressionNode>> Arguments;
+
+  SuperCallNode(const std::string &name,
+                std::vector<std::shared_ptr<ExpressionNode>> arguments)
+      : Name(name), Arguments(std::move(arguments)) {
+    adoptAll(Arguments);
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    ClassObject *owner = frame.Closure->Function->Owner;
+    int method = owner && owner->Base ? owner->Base->findMethod(Name) : -1;
+    ArgumentValues arguments(frame, Arguments);
+    if (method >= 0 && !owner->Base->Methods[method].isNull()) {
+      return frame.Runtime->callMethod(owner->Base->Methods[method],
+                                       frame.Receiver, arguments.data(),
+                                       arguments.size());
+    }
+    if (Name != "constructor") {
+      frame.Runtime->fail("No base class method '" + Name + "'");
+    }
+    // Nothing to run, the base fields were initialized on allocation
+    return Value();
+  }
+};
+
+class NewNode : public ExpressionNode {
+public:
+  std::shared_ptr<ExpressionNode> Class;
+  std::vector<std::shared_ptr<ExpressionNode>> Arguments;
+
+  NewNode(std::shared_ptr<ExpressionNode> cls,
+          std::vector<std::shared_ptr<ExpressionNode>> arguments)
+      : Arguments(std::move(arguments)) {
+    adopt(Class, std::move(cls));
+    adoptAll(Arguments);
+  }
+
+  Value evaluate(TreeFrame &frame) override {
+    Value cls = Class->evaluate(frame);
+    if (!cls.isObject() || cls.asObject()->Kind != ObjectKind::Class) {
+      frame.Runtime->fail("Cannot instantiate " +
+                          std::string(valueTypeName(cls)));
+    }
+    ArgumentValues arguments(frame, Arguments);
+    return frame.Runtime->construct(static_cast<ClassObject *>(cls.asObject()),
+                                    arguments.data(), arguments.size());
+  }
+};
+
+class ClosureNode : public ExpressionNode {
+public:
+  FunctionObject *Prototype;
+
+  explicit ClosureNode(FunctionObject *prototype) : Prototype(prototype) {}
+
+  Value evaluate(TreeFrame &frame) override {
+    auto *closure =
+        frame.Runtime->getHeap().allocate<ClosureObject>(Prototype);
+    closure->Receiver = frame.Receiver;
+    closure->Environment.reserve(Prototype->Captures.size());
+    for (const CaptureDescriptor &captured : Prototype->Captures) {
+      if (captured.FromEnvironment) {
+        closure->Environment.push_back(
+            frame.Closure->Environment[captured.Index]);
+      } else if (captured.ByReference) {
+        closure->Environment.push_back(
+            Value::integer(&frame.Slots[captured.Index] - frame.Stack));
+      } else {
+        closure->Environment.push_back(frame.Slots[captured.Index]);
+      }
+    }
+    return Value::object(closure);
+  }
+};
+
+// Statements
+
+class ExpressionStatementNode : public StatementNode {
+public:
+  std::shared_ptr<ExpressionNode> Expression;
+
+  explicit ExpressionStatementNode(std::shared_ptr<ExpressionNode> expression) {
+    adopt(Expression, std::move(expression));
+  }
+
+  bool execute(TreeFrame &frame) override {
+    Expression->evaluate(frame);
+    return false;
+  }
+};
+
+class ReturnNode : public StatementNode {
+public:
+  std::shared_ptr<ExpressionNode> Result; // Null returns null
+
+  explicit ReturnNode(std::shared_ptr<ExpressionNode> result) {
+    adopt(Result, std::move(result));
+  }
+
+  bool execute(TreeFrame &frame) override {
+    frame.Result = Result ? Result->evaluate(frame) : Value();
+    return true;
+  }
+};
+
+class IfNode : public StatementNode {
+public:
+  std::shared_ptr<ExpressionNode> Condition;
+  StatementList ThenBody;
+  StatementList ElseBody;
+
+  IfNode(std::shared_ptr<ExpressionNode> condition, StatementList thenBody,
+         StatementList elseBody)
+      : ThenBody(std::move(thenBody)), ElseBody(std::move(elseBody)) {
+    adopt(Condition, std::move(condition));
+  }
+
+  bool execute(TreeFrame &frame) override {
+    if (Condition->evaluate(frame).isTruthy()) {
+      return executeAll(ThenBody, frame);
+    }
+    return executeAll(ElseBody, frame);
+  }
+};
+
+// while loops, and for loops with their initializer hoisted out
+class LoopNode : public StatementNode {
+public:
+  std::shared_ptr<ExpressionNode> Condition; // Null loops forever
+  StatementList Body;
+  std::unique_ptr<StatementNode> Increment;
+
+  LoopNode(std::shared_ptr<ExpressionNode> condition, StatementList body,
+           std::unique_ptr<StatementNode> increment)
+      : Body(std::move(body)), Increment(std::move(increment)) {
+    adopt(Condition, std::move(condition));
+  }
+
+  bool execute(TreeFrame &frame) override {
+    while (!Condition || Condition->evaluate(frame).isTruthy()) {
+      if (executeAll(Body, frame)) {
+        return true;
+      }
+      if (Increment && Increment->execute(frame)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif // TREE_NODES_H
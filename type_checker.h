@@ -0,0 +1,789 @@
+#ifndef TYPE_CHECKER_H
+#define TYPE_CHECKER_H
+
+#include "ast_node.h"
+#include "await_expression.h"
+#include "binary_expression.h"
+#include "call_expression.h"
+#include "class_declaration.h"
+#include "closure_expression.h"
+#include "constructor_call_expression.h"
+#include "dot_access_expression.h"
+#include "for_statement.h"
+#include "function_declaration.h"
+#include "if_statement.h"
+#include "lambda_expression.h"
+#include "literal_expression.h"
+#include "package.h"
+#include "parameter.h"
+#include "return_statement.h"
+#include "soda_type.h"
+#include "variable_declaration.h"
+#include "variable_expression.h"
+#include "while_statement.h"
+#include <climits>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Infers and validates static types over a package that has already been
+// through the ScopeResolver. The typed IR is the annotated tree itself:
+// every Expression gets a StaticType, every VariableDeclaration its declared
+// or inferred type, and every BinaryExpression the OperandKind it operates
+// on. An OperandKind of Int, Long, Float, Double or Bool means both operands
+// are statically known to convert to that machine type, so an evaluator can
+// run the operation unboxed; Any means it has to dispatch at runtime. A
+// value stored where a Float or Double is declared, by an initializer,
+// assignment, argument or return, is marked ToDouble unless it already is
+// one, so an integer it gives is converted as it would be in the type.
+class TypeChecker {
+public:
+  // Checks the whole package. Returns false if any type error was found.
+  bool check(Package &package) {
+    errors.clear();
+    classes.clear();
+    globalFunctions.clear();
+    frames.clear();
+    classStack.clear();
+    globalNames = &package.Globals;
+    globalTypes.assign(package.Globals.size(), SodaType(TypeKind::Any));
+
+    for (size_t i = 0; i < globalTypes.size(); i++) {
+      globalTypes[i] = builtinType(package.Globals[i]);
+    }
+
+    // Signatures first, so bodies can call anything declared in the package
+    for (const auto &member : package.Members) {
+      if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(member)) {
+        classes[cls->Name] = cls.get();
+        setGlobal(cls->Name, SodaType::classType(cls->Name));
+      } else if (auto func =
+                     std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        globalFunctions[func->Name] = func.get();
+        setGlobal(func->Name, functionType(*func));
+      } else if (auto var =
+                     std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        if (var->Type) {
+          var->StaticType = SodaType::fromReference(var->Type);
+          setGlobal(var->Name, var->StaticType);
+        }
+      }
+    }
+    for (const auto &entry : classes) {
+      declareFields(*entry.second);
+    }
+
+    // Top-level code runs in the package initializer frame
+    pushFrame(package.FrameSize, SodaType(TypeKind::Void));
+    for (const auto &member : package.Members) {
+      if (!std::dynamic_pointer_cast<ClassDeclaration>(member) &&
+          !std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        checkNode(member);
+      }
+    }
+    for (const auto &member : package.Members) {
+      if (std::dynamic_pointer_cast<ClassDeclaration>(member) ||
+          std::dynamic_pointer_cast<FunctionDeclaration>(member)) {
+        checkNode(member);
+      }
+    }
+    frames.pop_back();
+
+    globalNames = nullptr;
+    return errors.empty();
+  }
+
+  const std::vector<std::string> &getErrors() const { return errors; }
+
+  // Whether a value of type source may be stored where target is expected.
+  // Any on either side is accepted and left to a runtime check.
+  bool isAssignable(const SodaType &target, const SodaType &source) const {
+    if (target.isDynamic() || source.isDynamic() || target == source) {
+      return true;
+    }
+    if (target.Kind == TypeKind::Number) {
+      return source.isNumeric();
+    }
+    if (target.isNumeric() && source.isNumeric()) {
+      return source.numericRank() <= target.numericRank();
+    }
+    if (target.Kind == TypeKind::Class && source.Kind == TypeKind::Class) {
+      return isSubclass(source.ClassName, target.ClassName);
+    }
+    if ((target.Kind == TypeKind::Array ||
+         target.Kind == TypeKind::Dictionary) &&
+        target.Kind == source.Kind) {
+      for (size_t i = 0; i < target.Arguments.size(); i++) {
+        if (!target.Arguments[i].isDynamic() &&
+            target.Arguments[i] != source.Arguments[i]) {
+          return false;
+        }
+      }
+      return true;
+    }
+    return target.Kind == TypeKind::Function &&
+           source.Kind == TypeKind::Function;
+  }
+
+private:
+  struct FunctionFrame {
+    std::vector<SodaType> Locals;
+    SodaType ReturnType;
+  };
+
+  std::vector<std::string> errors;
+  const std::vector<std::string> *globalNames = nullptr;
+  std::vector<SodaType> globalTypes;
+  std::unordered_map<std::string, ClassDeclaration *> classes;
+  std::unordered_map<std::string, FunctionDeclaration *> globalFunctions;
+  std::vector<FunctionFrame> frames;
+  std::vector<ClassDeclaration *> classStack;
+
+  void error(const std::string &message) { errors.push_back(message); }
+
+  static SodaType builtinType(const std::string &name) {
+    SodaType type(TypeKind::Function);
+    SodaType result(TypeKind::Any);
+    if (name == "print") {
+      result = SodaType(TypeKind::Void);
+    } else if (name == "String") {
+      result = SodaType(TypeKind::String);
+    } else if (name == "Int") {
+      result = SodaType(TypeKind::Int);
+    } else if (name == "Long") {
+      result = SodaType(TypeKind::Long);
+    } else if (name == "Float") {
+      result = SodaType(TypeKind::Float);
+    } else if (name == "Double") {
+      result = SodaType(TypeKind::Double);
+    } else if (name == "Bool") {
+      result = SodaType(TypeKind::Bool);
+    } else {
+      return SodaType(TypeKind::Any);
+    }
+    type.Arguments.push_back(SodaType(TypeKind::Any));
+    type.Arguments.push_back(result);
+    return type;
+  }
+
+  void setGlobal(const std::string &name, const SodaType &type) {
+    for (size_t i = 0; i < globalNames->size(); i++) {
+      if ((*globalNames)[i] == name) {
+        globalTypes[i] = type;
+        return;
+      }
+    }
+  }
+
+  void pushFrame(int size, const SodaType &returnType) {
+    FunctionFrame frame;
+    frame.Locals.assign(size, SodaType(TypeKind::Any));
+    frame.ReturnType = returnType;
+    frames.push_back(frame);
+  }
+
+  SodaType *bindingSlot(const VariableBinding &binding) {
+    if (binding.Kind == LocalBinding) {
+      int index = static_cast<int>(frames.size()) - 1 - binding.Depth;
+      if (index >= 0 && binding.Slot >= 0 &&
+          binding.Slot < static_cast<int>(frames[index].Locals.size())) {
+        return &frames[index].Locals[binding.Slot];
+      }
+    } else if (binding.Kind == GlobalBinding) {
+      if (binding.Slot >= 0 &&
+          binding.Slot < static_cast<int>(globalTypes.size())) {
+        return &globalTypes[binding.Slot];
+      }
+    }
+    return nullptr;
+  }
+
+  static bool hasValueReturn(const std::vector<std::shared_ptr<AstNode>> &body) {
+    for (const auto &node : body) {
+      if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+        if (ret->ReturnValue) {
+          return true;
+        }
+      } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+        if (hasValueReturn(ifStmt->ThenBody) ||
+            hasValueReturn(ifStmt->ElseBody)) {
+          return true;
+        }
+      } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+        if (hasValueReturn(forStmt->Body)) {
+          return true;
+        }
+      } else if (auto whileStmt =
+                     std::dynamic_pointer_cast<WhileStatement>(node)) {
+        if (hasValueReturn(whileStmt->Body)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Functions without a return annotation return Void, unless they return
+  // a value somewhere, in which case the result is left dynamic.
+  static SodaType returnTypeOf(const FunctionDeclaration &func) {
+    if (func.ReturnType) {
+      return SodaType::fromReference(func.ReturnType);
+    }
+    return hasValueReturn(func.Body) ? SodaType(TypeKind::Any)
+                                     : SodaType(TypeKind::Void);
+  }
+
+  // What a call evaluates to: an async function's task, whatever it returns
+  static SodaType callResultOf(const FunctionDeclaration &func) {
+    return func.Async ? SodaType(TypeKind::Any) : returnTypeOf(func);
+  }
+
+  static SodaType functionType(const FunctionDeclaration &func) {
+    SodaType type(TypeKind::Function);
+    for (const auto &parameter : func.Parameters) {
+      type.Arguments.push_back(SodaType::fromReference(parameter->Type));
+    }
+    type.Arguments.push_back(callResultOf(func));
+    return type;
+  }
+
+  bool isSubclass(const std::string &name, const std::string &base) const {
+    std::string current = name;
+    for (size_t guard = 0; guard <= classes.size(); guard++) {
+      if (current == base) {
+        return true;
+      }
+      auto cls = classes.find(current);
+      if (cls == classes.end() || !cls->second->BaseClass) {
+        return false;
+      }
+      current = cls->second->BaseClass->Name;
+    }
+    return false;
+  }
+
+  bool validateType(const SodaType &type, const std::string &context) {
+    bool valid = true;
+    if (type.Kind == TypeKind::Class && !classes.count(type.ClassName)) {
+      // Classes brought in by imports are opaque but valid
+      valid = false;
+      for (const auto &name : *globalNames) {
+        if (name == type.ClassName) {
+          valid = true;
+        }
+      }
+      if (!valid) {
+        error("Unknown type '" + type.ClassName + "' in " + context);
+      }
+    }
+    for (const auto &argument : type.Arguments) {
+      valid = validateType(argument, context) && valid;
+    }
+    return valid;
+  }
+
+  ClassDeclaration *findClass(const std::string &name) const {
+    auto cls = classes.find(name);
+    return cls == classes.end() ? nullptr : cls->second;
+  }
+
+  ClassDeclaration *baseOf(const ClassDeclaration *cls) const {
+    return cls->BaseClass ? findClass(cls->BaseClass->Name) : nullptr;
+  }
+
+  VariableDeclaration *findField(ClassDeclaration *cls,
+                                 const std::string &name) const {
+    for (size_t guard = 0; cls && guard <= classes.size(); guard++) {
+      for (const auto &member : cls->Members) {
+        auto var = std::dynamic_pointer_cast<VariableDeclaration>(member);
+        if (var && var->Name == name) {
+          return var.get();
+        }
+      }
+      cls = baseOf(cls);
+    }
+    return nullptr;
+  }
+
+  FunctionDeclaration *findMethod(ClassDeclaration *cls,
+                                  const std::string &name) const {
+    for (size_t guard = 0; cls && guard <= classes.size(); guard++) {
+      for (const auto &member : cls->Members) {
+        auto func = std::dynamic_pointer_cast<FunctionDeclaration>(member);
+        if (func && func->Name == name) {
+          return func.get();
+        }
+      }
+      cls = baseOf(cls);
+    }
+    return nullptr;
+  }
+
+  void declareFields(ClassDeclaration &cls) {
+    for (const auto &member : cls.Members) {
+      if (auto var = std::dynamic_pointer_cast<VariableDeclaration>(member)) {
+        if (var->Type) {
+          var->StaticType = SodaType::fromReference(var->Type);
+        } else if (auto literal = std::dynamic_pointer_cast<LiteralExpression>(
+                       var->Value)) {
+          var->StaticType = literalType(*literal);
+        } else {
+          var->StaticType = SodaType(TypeKind::Any);
+        }
+      }
+    }
+  }
+
+  static SodaType literalType(const LiteralExpression &literal) {
+    switch (literal.Kind) {
+    case IntegerLiteral: {
+      long long value = std::strtoll(literal.Value.c_str(), nullptr, 10);
+      return SodaType(value > INT_MAX ? TypeKind::Long : TypeKind::Int);
+    }
+    case LongLiteral:
+      return SodaType(TypeKind::Long);
+    case FloatLiteral:
+      return SodaType(TypeKind::Float);
+    case DoubleLiteral:
+      return SodaType(TypeKind::Double);
+    case BooleanLiteral:
+      return SodaType(TypeKind::Bool);
+    default:
+      return SodaType(TypeKind::String);
+    }
+  }
+
+  void checkBody(const std::vector<std::shared_ptr<AstNode>> &body) {
+    for (const auto &node : body) {
+      checkNode(node);
+    }
+  }
+
+  void checkCondition(const std::shared_ptr<Expression> &condition,
+                      const std::string &statement) {
+    SodaType type = checkExpression(condition);
+    if (condition && !type.isDynamic() && type.Kind != TypeKind::Bool) {
+      error("Condition of '" + statement + "' must be Bool, got " +
+            type.toString());
+    }
+  }
+
+  void checkFunction(FunctionDeclaration &func) {
+    pushFrame(func.FrameSize, returnTypeOf(func));
+    for (const auto &parameter : func.Parameters) {
+      SodaType type = SodaType::fromReference(parameter->Type);
+      validateType(type, "parameter '" + parameter->Name + "' of '" +
+                             func.Name + "'");
+      if (SodaType *slot = bindingSlot(parameter->Binding)) {
+        *slot = type;
+      }
+    }
+    validateType(frames.back().ReturnType, "return type of '" + func.Name + "'");
+    checkBody(func.Body);
+    frames.pop_back();
+  }
+
+  void checkNode(const std::shared_ptr<AstNode> &node) {
+    if (!node) {
+      return;
+    }
+    if (auto cls = std::dynamic_pointer_cast<ClassDeclaration>(node)) {
+      if (cls->BaseClass && !findClass(cls->BaseClass->Name)) {
+        error("Unknown base class '" + cls->BaseClass->Name + "' of '" +
+              cls->Name + "'");
+      }
+      classStack.push_back(cls.get());
+      checkBody(cls->Members);
+      classStack.pop_back();
+    } else if (auto func =
+                   std::dynamic_pointer_cast<FunctionDeclaration>(node)) {
+      checkFunction(*func);
+    } else if (auto var =
+                   std::dynamic_pointer_cast<VariableDeclaration>(node)) {
+      checkVariable(*var);
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+      SodaType expected = frames.back().ReturnType;
+      SodaType actual = ret->ReturnValue ? checkExpression(ret->ReturnValue)
+                                         : SodaType(TypeKind::Void);
+      if (expected.Kind == TypeKind::Void && ret->ReturnValue) {
+        error("Cannot return a value from a Void function");
+      } else if (!isAssignable(expected, actual)) {
+        error("Cannot return " + actual.toString() + " from a function "
+              "returning " + expected.toString());
+      } else if (ret->ReturnValue) {
+        convert(expected, actual, *ret->ReturnValue);
+      }
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStatement>(node)) {
+      checkCondition(ifStmt->Condition, "if");
+      checkBody(ifStmt->ThenBody);
+      checkBody(ifStmt->ElseBody);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ForStatement>(node)) {
+      checkNode(forStmt->Initializer);
+      checkCondition(forStmt->Condition, "for");
+      checkNode(forStmt->Increment);
+      checkBody(forStmt->Body);
+    } else if (auto whileStmt =
+                   std::dynamic_pointer_cast<WhileStatement>(node)) {
+      checkCondition(whileStmt->Condition, "while");
+      checkBody(whileStmt->Body);
+    } else if (auto expr = std::dynamic_pointer_cast<Expression>(node)) {
+      checkExpression(expr);
+    }
+  }
+
+  void checkVariable(VariableDeclaration &var) {
+    SodaType valueType = var.Value ? checkExpression(var.Value)
+                                   : SodaType(TypeKind::Any);
+    if (var.Type) {
+      var.StaticType = SodaType::fromReference(var.Type);
+      if (validateType(var.StaticType, "variable '" + var.Name + "'") &&
+          !isAssignable(var.StaticType, valueType)) {
+        error("Cannot initialize '" + var.Name + "' of type " +
+              var.StaticType.toString() + " with " + valueType.toString());
+      } else if (var.Value) {
+        convert(var.StaticType, valueType, *var.Value);
+      }
+    } else if (var.Binding.Kind != FieldBinding) {
+      var.StaticType = valueType;
+    }
+    if (SodaType *slot = bindingSlot(var.Binding)) {
+      *slot = var.StaticType;
+    }
+  }
+
+  SodaType checkExpression(const std::shared_ptr<Expression> &expr) {
+    if (!expr) {
+      return SodaType(TypeKind::Void);
+    }
+    SodaType type = inferExpression(expr);
+    expr->StaticType = type;
+    return type;
+  }
+
+  SodaType inferExpression(const std::shared_ptr<Expression> &expr) {
+    if (auto literal = std::dynamic_pointer_cast<LiteralExpression>(expr)) {
+      return literalType(*literal);
+    } else if (auto var = std::dynamic_pointer_cast<VariableExpression>(expr)) {
+      return variableType(var->Name, var->Binding);
+    } else if (auto binary =
+                   std::dynamic_pointer_cast<BinaryExpression>(expr)) {
+      return checkBinary(*binary);
+    } else if (auto dot = std::dynamic_pointer_cast<DotAccessExpression>(expr)) {
+      return checkDotAccess(*dot);
+    } else if (auto ctor =
+                   std::dynamic_pointer_cast<ConstructorCallExpression>(expr)) {
+      ClassDeclaration *cls = findClass(ctor->FunctionName);
+      if (cls) {
+        checkArguments("constructor of '" + cls->Name + "'",
+                       findMethod(cls, "constructor"), ctor->Arguments);
+      } else {
+        validateType(SodaType::classType(ctor->FunctionName), "new");
+        checkArguments(ctor->FunctionName, nullptr, ctor->Arguments);
+      }
+      return SodaType::classType(ctor->FunctionName);
+    } else if (auto call = std::dynamic_pointer_cast<CallExpression>(expr)) {
+      return checkCall(*call);
+    } else if (auto await = std::dynamic_pointer_cast<AwaitExpression>(expr)) {
+      // Tasks are not typed by their result
+      checkExpression(await->Operand);
+      return SodaType(TypeKind::Any);
+    } else if (auto closure =
+                   std::dynamic_pointer_cast<ClosureExpression>(expr)) {
+      SodaType returnType = closure->ReturnType
+                                ? SodaType::fromReference(closure->ReturnType)
+                            : hasValueReturn(closure->Body)
+                                ? SodaType(TypeKind::Any)
+                                : SodaType(TypeKind::Void);
+      SodaType type = beginFunctionLiteral(closure->Parameters,
+                                           closure->FrameSize, returnType);
+      checkBody(closure->Body);
+      frames.pop_back();
+      return type;
+    } else if (auto lambda =
+                   std::dynamic_pointer_cast<LambdaExpression>(expr)) {
+      SodaType returnType = lambda->ReturnType
+                                ? SodaType::fromReference(lambda->ReturnType)
+                                : SodaType(TypeKind::Any);
+      SodaType type = beginFunctionLiteral(lambda->Parameters,
+                                           lambda->FrameSize, returnType);
+      // An expression body is the result of the lambda, unless it is an
+      // assignment, which the compilers run as a statement
+      auto body = std::dynamic_pointer_cast<Expression>(lambda->Body);
+      auto binary = std::dynamic_pointer_cast<BinaryExpression>(body);
+      if (body && !(binary && binary->Op == BinaryOperator::Assign)) {
+        SodaType bodyType = checkExpression(body);
+        if (!lambda->ReturnType) {
+          type.Arguments.back() = bodyType;
+        } else if (!isAssignable(returnType, bodyType)) {
+          error("Lambda returning " + returnType.toString() +
+                " cannot produce " + bodyType.toString());
+        } else {
+          convert(returnType, bodyType, *body);
+        }
+      } else {
+        checkNode(lambda->Body);
+      }
+      frames.pop_back();
+      return type;
+    }
+    return SodaType(TypeKind::Any);
+  }
+
+  SodaType beginFunctionLiteral(
+      const std::vector<std::shared_ptr<Parameter>> &parameters,
+      int frameSize, const SodaType &returnType) {
+    SodaType type(TypeKind::Function);
+    pushFrame(frameSize, returnType);
+    for (const auto &parameter : parameters) {
+      SodaType parameterType = SodaType::fromReference(parameter->Type);
+      if (SodaType *slot = bindingSlot(parameter->Binding)) {
+        *slot = parameterType;
+      }
+      type.Arguments.push_back(parameterType);
+    }
+    type.Arguments.push_back(returnType);
+    return type;
+  }
+
+  SodaType variableType(const std::string &name,
+                        const VariableBinding &binding) {
+    if (binding.Kind == FieldBinding || binding.Kind == MethodBinding) {
+      ClassDeclaration *cls = classStack.empty() ? nullptr : classStack.back();
+      if (binding.Kind == FieldBinding) {
+        VariableDeclaration *field = findField(cls, name);
+        return field ? field->StaticType : SodaType(TypeKind::Any);
+      }
+      FunctionDeclaration *method = findMethod(cls, name);
+      return method ? functionType(*method) : SodaType(TypeKind::Any);
+    }
+    if (name == "this" && !classStack.empty()) {
+      return SodaType::classType(classStack.back()->Name);
+    }
+    SodaType *slot = bindingSlot(binding);
+    return slot ? *slot : SodaType(TypeKind::Any);
+  }
+
+  void checkArguments(const std::string &callee, FunctionDeclaration *func,
+                      const std::vector<std::shared_ptr<Expression>> &args) {
+    std::vector<SodaType> parameterTypes;
+    if (func) {
+      for (const auto &parameter : func->Parameters) {
+        parameterTypes.push_back(SodaType::fromReference(parameter->Type));
+      }
+    }
+    checkArguments(callee, func != nullptr, parameterTypes, args);
+  }
+
+  void checkArguments(const std::string &callee, bool hasSignature,
+                      const std::vector<SodaType> &parameterTypes,
+                      const std::vector<std::shared_ptr<Expression>> &args) {
+    if (hasSignature && parameterTypes.size() != args.size()) {
+      error("'" + callee + "' expects " +
+            std::to_string(parameterTypes.size()) + " arguments, got " +
+            std::to_string(args.size()));
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+      SodaType argumentType = checkExpression(args[i]);
+      if (!hasSignature || i >= parameterTypes.size()) {
+        continue;
+      }
+      if (!isAssignable(parameterTypes[i], argumentType)) {
+        error("Argument " + std::to_string(i + 1) + " of '" + callee +
+              "' expects " + parameterTypes[i].toString() + ", got " +
+              argumentType.toString());
+      } else {
+        convert(parameterTypes[i], argumentType, *args[i]);
+      }
+    }
+  }
+
+  SodaType checkCall(CallExpression &call) {
+    SodaType callee = variableType(call.FunctionName, call.Binding);
+    if (call.Binding.Kind == GlobalBinding &&
+        globalFunctions.count(call.FunctionName)) {
+      FunctionDeclaration *func = globalFunctions[call.FunctionName];
+      checkArguments(call.FunctionName, func, call.Arguments);
+      return callResultOf(*func);
+    }
+    if (call.Binding.Kind == MethodBinding) {
+      ClassDeclaration *cls = classStack.empty() ? nullptr : classStack.back();
+      FunctionDeclaration *method = findMethod(cls, call.FunctionName);
+      checkArguments(call.FunctionName, method, call.Arguments);
+      return method ? callResultOf(*method) : SodaType(TypeKind::Any);
+    }
+    if (callee.Kind == TypeKind::Function && !callee.Arguments.empty()) {
+      // Builtins take anything; only user functions have fixed arity
+      bool builtin = call.Binding.Kind == GlobalBinding &&
+                     builtinType(call.FunctionName).Kind == TypeKind::Function;
+      std::vector<SodaType> parameters(callee.Arguments.begin(),
+                                       callee.Arguments.end() - 1);
+      checkArguments(call.FunctionName, !builtin, parameters, call.Arguments);
+      return callee.Arguments.back();
+    }
+    if (callee.Kind == TypeKind::Class) {
+      error("Class '" + callee.ClassName + "' must be created with 'new'");
+    } else if (!callee.isDynamic()) {
+      error("'" + call.FunctionName + "' of type " + callee.toString() +
+            " is not callable");
+    }
+    checkArguments(call.FunctionName, false, {}, call.Arguments);
+    return SodaType(TypeKind::Any);
+  }
+
+  SodaType checkDotAccess(DotAccessExpression &dot) {
+    SodaType receiver = checkExpression(dot.Left);
+    auto call = std::dynamic_pointer_cast<CallExpression>(dot.Right);
+    auto var = std::dynamic_pointer_cast<VariableExpression>(dot.Right);
+    std::string member = call ? call->FunctionName : var ? var->Name : "";
+    SodaType result(TypeKind::Any);
+    bool hasSignature = false;
+    std::vector<SodaType> parameterTypes;
+
+    if (receiver.Kind == TypeKind::Class) {
+      ClassDeclaration *cls = findClass(receiver.ClassName);
+      if (FunctionDeclaration *method = cls ? findMethod(cls, member) : nullptr) {
+        SodaType type = functionType(*method);
+        if (call) {
+          result = type.Arguments.back();
+          hasSignature = true;
+          parameterTypes.assign(type.Arguments.begin(),
+                                type.Arguments.end() - 1);
+        } else {
+          result = type;
+        }
+      } else if (VariableDeclaration *field =
+                     cls ? findField(cls, member) : nullptr) {
+        result = field->StaticType;
+      } else if (cls) {
+        error("Class '" + cls->Name + "' has no member '" + member + "'");
+      }
+    } else if (receiver.Kind == TypeKind::Array) {
+      if (member == "length") {
+        result = SodaType(TypeKind::Int);
+      } else if (member == "append" || member == "fill") {
+        result = SodaType(TypeKind::Void);
+        hasSignature = true;
+        parameterTypes.push_back(receiver.Arguments[0]);
+      } else if (member == "sum") {
+        SodaType element = receiver.Arguments[0];
+        result = element.isNumeric() ? element : SodaType(TypeKind::Any);
+      } else if (member == "indexOf" || member == "compare") {
+        result = SodaType(TypeKind::Int);
+      }
+    } else if (receiver.Kind == TypeKind::Dictionary) {
+      if (member == "length") {
+        result = SodaType(TypeKind::Int);
+      } else if (member == "keys") {
+        result = SodaType::arrayOf(receiver.Arguments[0]);
+      }
+    } else if (receiver.Kind == TypeKind::String) {
+      if (member == "length") {
+        result = SodaType(TypeKind::Int);
+      }
+    }
+
+    if (call) {
+      checkArguments(member, hasSignature, parameterTypes, call->Arguments);
+      call->StaticType = result;
+    } else if (var) {
+      var->StaticType = result;
+    }
+    return result;
+  }
+
+  SodaType checkBinary(BinaryExpression &binary) {
+    SodaType left = checkExpression(binary.Left);
+    SodaType right = checkExpression(binary.Right);
+    BinaryOperator op = binary.Op;
+    binary.OperandKind = TypeKind::Any;
+
+    if (op == BinaryOperator::Assign) {
+      if (!isAssignable(left, right)) {
+        error("Cannot assign " + right.toString() + " to " + left.toString());
+      } else {
+        convert(left, right, *binary.Right);
+      }
+      if (left.isPrimitive()) {
+        binary.OperandKind = left.Kind;
+      }
+      return left;
+    }
+
+    if (op == BinaryOperator::Unknown) {
+      error("Unknown operator '" + binary.Operator + "'");
+      return SodaType(TypeKind::Any);
+    }
+
+    if (isLogical(op)) {
+      if ((!left.isDynamic() && left.Kind != TypeKind::Bool) ||
+          (!right.isDynamic() && right.Kind != TypeKind::Bool)) {
+        error("Operator '" + binary.Operator + "' expects Bool operands");
+      }
+      if (left.Kind == TypeKind::Bool && right.Kind == TypeKind::Bool) {
+        binary.OperandKind = TypeKind::Bool;
+      }
+      return SodaType(TypeKind::Bool);
+    }
+
+    if (op == BinaryOperator::Add &&
+        (left.Kind == TypeKind::String || right.Kind == TypeKind::String)) {
+      binary.OperandKind = TypeKind::String;
+      return SodaType(TypeKind::String);
+    }
+
+    if (left.isNumeric() && right.isNumeric()) {
+      binary.OperandKind = left.numericRank() >= right.numericRank()
+                               ? left.Kind
+                               : right.Kind;
+      if (isArithmetic(op)) {
+        return SodaType(binary.OperandKind);
+      }
+      return SodaType(TypeKind::Bool);
+    }
+
+    if (isComparison(op)) {
+      bool equality =
+          op == BinaryOperator::Equal || op == BinaryOperator::NotEqual;
+      if (left == right && (left.Kind == TypeKind::String ||
+                            (equality && left.Kind == TypeKind::Bool))) {
+        binary.OperandKind = left.Kind;
+      } else if (!equality && !isDynamicNumber(left) &&
+                 !isDynamicNumber(right)) {
+        error("Operator '" + binary.Operator + "' cannot compare " +
+              left.toString() + " and " + right.toString());
+      }
+      return SodaType(TypeKind::Bool);
+    }
+
+    if (isArithmetic(op) && (isDynamicNumber(left) || isDynamicNumber(right)) &&
+        (isDynamicNumber(left) || left.isNumeric()) &&
+        (isDynamicNumber(right) || right.isNumeric())) {
+      return SodaType(left.Kind == TypeKind::Number ||
+                              right.Kind == TypeKind::Number
+                          ? TypeKind::Number
+                          : TypeKind::Any);
+    }
+
+    error("Operator '" + binary.Operator + "' cannot be applied to " +
+          left.toString() + " and " + right.toString());
+    return SodaType(TypeKind::Any);
+  }
+
+  // Marks value, of type source and stored where target is declared, to be
+  // made a double if target is a Float or Double and source is not
+  static void convert(const SodaType &target, const SodaType &source,
+                      Expression &value) {
+    bool floating =
+        target.Kind == TypeKind::Float || target.Kind == TypeKind::Double;
+    value.ToDouble = floating && source.Kind != TypeKind::Float &&
+                     source.Kind != TypeKind::Double;
+  }
+
+  static bool isDynamicNumber(const SodaType &type) {
+    return type.isDynamic() || type.Kind == TypeKind::Number;
+  }
+};
+
+#endif // TYPE_CHECKER_H
@@ -0,0 +1,203 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include "integer_object.h"
+#include <cstdint>
+#include <cstring>
+
+enum class ValueType { Null, Bool, Int, Double, Object };
+
+// Runtime value in 8 bytes. Int and Long share a 64-bit integer, Float and
+// Double a double; everything else lives on the heap.
+//
+// A double is stored as its own bits, with every NaN made the one positive
+// quiet NaN. That leaves the negative quiet NaNs free for the other types:
+// their top 16 bits are a tag and the low 48 bits the payload, an integer
+// or a pointer. Ints outside 48 bits are boxed in an IntegerObject, which
+// Heap::integer takes care of.
+class Value {
+public:
+  static constexpr int TagShift = 48;
+  static constexpr uint64_t PayloadMask = (uint64_t(1) << TagShift) - 1;
+  static constexpr uint64_t NullTag = 0xFFF9;
+  static constexpr uint64_t BoolTag = 0xFFFA;
+  static constexpr uint64_t IntTag = 0xFFFB;
+  static constexpr uint64_t BoxedIntTag = 0xFFFC;
+  static constexpr uint64_t ObjectTag = 0xFFFD;
+  static constexpr uint64_t CanonicalNaN = 0x7FF8000000000000;
+  static constexpr int64_t MinInline = -(int64_t(1) << (TagShift - 1));
+  static constexpr int64_t MaxInline = (int64_t(1) << (TagShift - 1)) - 1;
+
+  Value() : bits(NullTag << TagShift) {}
+
+  static Value null() { return Value(); }
+
+  static Value boolean(bool value) {
+    return fromBits(BoolTag << TagShift | (value ? 1 : 0));
+  }
+
+  // Value must fit inline; Heap::integer takes any
+  static Value integer(int64_t value) {
+    return fromBits(IntTag << TagShift |
+                    (static_cast<uint64_t>(value) & PayloadMask));
+  }
+
+  static Value boxedInteger(IntegerObject *value) {
+    return fromBits(BoxedIntTag << TagShift | pointerBits(value));
+  }
+
+  static Value number(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return fromBits(value != value ? CanonicalNaN : bits);
+  }
+
+  static Value object(HeapObject *value) {
+    return fromBits(ObjectTag << TagShift | pointerBits(value));
+  }
+
+  static bool fitsInline(int64_t value) {
+    return value >= MinInline && value <= MaxInline;
+  }
+
+  // The encoding, for generated code that tests and builds values itself
+  uint64_t getBits() const { return bits; }
+
+  static Value fromBits(uint64_t bits) {
+    Value result;
+    result.bits = bits;
+    return result;
+  }
+
+  ValueType getType() const {
+    switch (tag()) {
+    case NullTag:
+      return ValueType::Null;
+    case BoolTag:
+      return ValueType::Bool;
+    case IntTag:
+    case BoxedIntTag:
+      return ValueType::Int;
+    case ObjectTag:
+      return ValueType::Object;
+    default:
+      return ValueType::Double;
+    }
+  }
+
+  bool isNull() const { return bits == NullTag << TagShift; }
+  bool isBool() const { return tag() == BoolTag; }
+  bool isInt() const { return tag() - IntTag <= BoxedIntTag - IntTag; }
+  bool isInlineInt() const { return tag() == IntTag; }
+  bool isDouble() const { return bits < NullTag << TagShift; }
+  bool isNumber() const { return isDouble() || isInt(); }
+  bool isObject() const { return tag() == ObjectTag; }
+
+  bool asBool() const { return (bits & 1) != 0; }
+
+  int64_t asInt() const {
+    if (tag() == BoxedIntTag) {
+      return static_cast<IntegerObject *>(pointer())->Integer;
+    }
+    return inlineInt();
+  }
+
+  double asDouble() const {
+    double number;
+    std::memcpy(&number, &bits, sizeof(number));
+    return number;
+  }
+
+  HeapObject *asObject() const { return pointer(); }
+
+  // The heap object the value refers to, a boxed integer included, or null
+  HeapObject *getReference() const {
+    return tag() == ObjectTag || tag() == BoxedIntTag ? pointer() : nullptr;
+  }
+
+  // Either numeric representation, widened to double
+  double asNumber() const {
+    return isInt() ? static_cast<double>(asInt()) : asDouble();
+  }
+
+  // Only null and false are falsy
+  bool isTruthy() const {
+    return bits != NullTag << TagShift && bits != BoolTag << TagShift;
+  }
+
+  // Fast paths for two inline ints. Each returns false without touching
+  // result if an operand is anything else or the result is too wide, which
+  // leaves the operation to the general path.
+
+  static bool addInline(const Value &a, const Value &b, Value &result) {
+    if (!a.isInlineInt() || !b.isInlineInt()) {
+      return false;
+    }
+    int64_t sum = a.inlineInt() + b.inlineInt();
+    if (!fitsInline(sum)) {
+      return false;
+    }
+    result = integer(sum);
+    return true;
+  }
+
+  static bool subtractInline(const Value &a, const Value &b, Value &result) {
+    if (!a.isInlineInt() || !b.isInlineInt()) {
+      return false;
+    }
+    int64_t difference = a.inlineInt() - b.inlineInt();
+    if (!fitsInline(difference)) {
+      return false;
+    }
+    result = integer(difference);
+    return true;
+  }
+
+  static bool multiplyInline(const Value &a, const Value &b, Value &result) {
+    if (!a.isInlineInt() || !b.isInlineInt()) {
+      return false;
+    }
+    int64_t x = a.inlineInt();
+    int64_t y = b.inlineInt();
+    // Factors of 32 bits cannot overflow 64
+    if (x != static_cast<int32_t>(x) || y != static_cast<int32_t>(y) ||
+        !fitsInline(x * y)) {
+      return false;
+    }
+    result = integer(x * y);
+    return true;
+  }
+
+  // Same type and same value; strings with equal text are not identical
+  bool isIdenticalTo(const Value &other) const {
+    if (isInt() || isDouble()) {
+      if (isInt() != other.isInt() || isDouble() != other.isDouble()) {
+        return false;
+      }
+      return isInt() ? asInt() == other.asInt()
+                     : asDouble() == other.asDouble();
+    }
+    return bits == other.bits;
+  }
+
+private:
+  uint64_t bits;
+
+  uint64_t tag() const { return bits >> TagShift; }
+
+  // Sign-extends the 48-bit payload
+  int64_t inlineInt() const {
+    return static_cast<int64_t>(bits << (64 - TagShift)) >> (64 - TagShift);
+  }
+
+  HeapObject *pointer() const {
+    return reinterpret_cast<HeapObject *>(
+        static_cast<uintptr_t>(bits & PayloadMask));
+  }
+
+  static uint64_t pointerBits(const HeapObject *object) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(object));
+  }
+};
+
+#endif // VALUE_H
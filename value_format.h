@@ -0,0 +1,114 @@
+#ifndef VALUE_FORMAT_H
+#define VALUE_FORMAT_H
+
+#include "array_object.h"
+#include "class_object.h"
+#include "closure_object.h"
+#include "dictionary_object.h"
+#include "heap_object.h"
+#include "instance_object.h"
+#include "integer_object.h"
+#include "native_object.h"
+#include "string_object.h"
+#include "value.h"
+#include <cstdio>
+#include <string>
+
+inline const char *valueTypeName(const Value &value) {
+  switch (value.getType()) {
+  case ValueType::Null:
+    return "Null";
+  case ValueType::Bool:
+    return "Bool";
+  case ValueType::Int:
+    return "Int";
+  case ValueType::Double:
+    return "Double";
+  case ValueType::Object:
+    break;
+  }
+  switch (value.asObject()->Kind) {
+  case ObjectKind::String:
+    return "String";
+  case ObjectKind::Array:
+    return "Array";
+  case ObjectKind::Dictionary:
+    return "Dictionary";
+  case ObjectKind::Class:
+    return "Class";
+  case ObjectKind::Instance:
+    return "Instance";
+  case ObjectKind::Cell:
+    return "Cell";
+  case ObjectKind::Task:
+    return "Task";
+  default:
+    return "Function";
+  }
+}
+
+inline std::string formatNumber(double number) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.15g", number);
+  return buffer;
+}
+
+// What print and String() show for a value
+inline std::string valueToString(const Value &value) {
+  switch (value.getType()) {
+  case ValueType::Null:
+    return "null";
+  case ValueType::Bool:
+    return value.asBool() ? "true" : "false";
+  case ValueType::Int:
+    return std::to_string(value.asInt());
+  case ValueType::Double:
+    return formatNumber(value.asDouble());
+  case ValueType::Object:
+    break;
+  }
+  HeapObject *object = value.asObject();
+  switch (object->Kind) {
+  case ObjectKind::String:
+    return static_cast<StringObject *>(object)->text();
+  case ObjectKind::Array: {
+    std::string text = "[";
+    auto *array = static_cast<ArrayObject *>(object);
+    for (size_t i = 0; i < array->count(); i++) {
+      text += (i ? ", " : "") + valueToString(array->get(i));
+    }
+    return text + "]";
+  }
+  case ObjectKind::Dictionary: {
+    std::string text = "{";
+    const auto &entries =
+        static_cast<DictionaryObject *>(object)->getEntries();
+    for (size_t i = 0; i < entries.size(); i++) {
+      text += (i ? ", " : "") + valueToString(entries[i].first) + " : " +
+              valueToString(entries[i].second);
+    }
+    return text + "}";
+  }
+  case ObjectKind::Class:
+    return "class " + static_cast<ClassObject *>(object)->Name;
+  case ObjectKind::Instance:
+    return static_cast<InstanceObject *>(object)->Class->Name + " instance";
+  case ObjectKind::Closure:
+    return "func " + static_cast<ClosureObject *>(object)->Function->Name;
+  case ObjectKind::Native:
+    return "func " + static_cast<NativeObject *>(object)->Name;
+  case ObjectKind::Function:
+    return "func " + static_cast<FunctionObject *>(object)->Name;
+  case ObjectKind::Cell:
+    return "cell";
+  case ObjectKind::Integer:
+    return std::to_string(static_cast<IntegerObject *>(object)->Integer);
+  case ObjectKind::Shape:
+    return "shape";
+  case ObjectKind::Task:
+    return "task";
+  }
+  return "?";
+}
+
+#endif // VALUE_FORMAT_H
@@ -0,0 +1,61 @@
+#ifndef VALUE_HASH_H
+#define VALUE_HASH_H
+
+#include "heap_object.h"
+#include "string_object.h"
+#include "value.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Script equality: numbers compare by value across Int and Double, strings
+// by text, everything else by identity.
+inline bool valuesEqual(const Value &a, const Value &b) {
+  if (a.isNumber() && b.isNumber()) {
+    if (a.isInt() && b.isInt()) {
+      return a.asInt() == b.asInt();
+    }
+    return a.asNumber() == b.asNumber();
+  }
+  if (a.isObject() && b.isObject() &&
+      a.asObject()->Kind == ObjectKind::String &&
+      b.asObject()->Kind == ObjectKind::String) {
+    return static_cast<StringObject *>(a.asObject())->equals(
+        static_cast<StringObject *>(b.asObject()));
+  }
+  return a.isIdenticalTo(b);
+}
+
+// Consistent with valuesEqual, so 1 and 1.0 land on the same key: a
+// number hashes as the bits of its double, a string as its characters and
+// anything else as its own bits. Mixed so every bit of the result depends
+// on all of them, as open addressing takes some from each end.
+inline size_t hashValue(const Value &value) {
+  uint64_t bits = value.getBits();
+  if (value.isInt()) {
+    double number = static_cast<double>(value.asInt());
+    std::memcpy(&bits, &number, sizeof(bits));
+  } else if (value.isDouble() && value.asDouble() == 0) {
+    bits = 0; // -0.0 too
+  } else if (value.isObject() &&
+             value.asObject()->Kind == ObjectKind::String) {
+    bits = static_cast<StringObject *>(value.asObject())->hash();
+  }
+  bits ^= bits >> 33;
+  bits *= 0xFF51AFD7ED558CCDull;
+  bits ^= bits >> 33;
+  return static_cast<size_t>(bits);
+}
+
+struct ValueHash {
+  size_t operator()(const Value &value) const { return hashValue(value); }
+};
+
+struct ValueEqual {
+  bool operator()(const Value &a, const Value &b) const {
+    return valuesEqual(a, b);
+  }
+};
+
+#endif // VALUE_HASH_H
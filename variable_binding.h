@@ -0,0 +1,32 @@
+#ifndef VARIABLE_BINDING_H
+#define VARIABLE_BINDING_H
+
+#include <string>
+
+// Where a name lives once the scope resolver has run
+enum BindingKind {
+  UnresolvedBinding, // Not resolved yet, or not found in any scope
+  LocalBinding,      // Slot in a function frame, Depth frames up
+  GlobalBinding,     // Index into the package globals
+  FieldBinding,      // Slot in the instance field layout of the class
+  MethodBinding,     // Slot in the method table of the class
+};
+
+struct VariableBinding {
+  BindingKind Kind = UnresolvedBinding;
+  int Depth = 0; // Number of enclosing function frames to walk up
+  int Slot = -1; // Frame slot, global index, field or method index
+  int Capture = -1;     // Index in the environment of the innermost closure
+  bool IsBoxed = false; // Lives in a heap cell shared with escaping closures
+
+  bool isResolved() const { return Kind != UnresolvedBinding; }
+};
+
+// One entry of the flat environment a closure copies in when it is created
+struct CapturedVariable {
+  std::string Name;
+  VariableBinding From;     // Where the creating function finds the value
+  bool ByReference = false; // Points at the creator's slot instead of a copy
+};
+
+#endif // VARIABLE_BINDING_H
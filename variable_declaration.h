@@ -4,6 +4,7 @@
 #include "ast_node.h"
 #include "expression.h"
 #include "type_reference.h"
+#include "variable_binding.h"
 #include <memory>
 
 class VariableDeclaration : public AstNode {
@@ -11,6 +12,8 @@ public:
   std::string Name;
   std::shared_ptr<TypeReference> Type;
   std::shared_ptr<Expression> Value;
+  VariableBinding Binding;
+  SodaType StaticType; // Declared or inferred type, set by the type checker
 
   VariableDeclaration(const std::string &name,
                       std::shared_ptr<TypeReference> type,
@@ -2,11 +2,13 @@
 #define VARIABLE_EXPRESSION_H
 
 #include "expression.h"
+#include "variable_binding.h"
 #include <string>
 
 class VariableExpression : public Expression {
 public:
   std::string Name;
+  VariableBinding Binding;
 
   VariableExpression(const std::string &name) : Name(name) {}
 };
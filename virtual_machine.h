@@ -0,0 +1,1591 @@
+#ifndef VIRTUAL_MACHINE_H
+#define VIRTUAL_MACHINE_H
+
+#include "baseline_jit.h"
+#include "bytecode.h"
+#include "cell_object.h"
+#include "class_object.h"
+#include "closure_object.h"
+#include "compiled_package.h"
+#include "event_loop.h"
+#include "function_object.h"
+#include "inline_cache.h"
+#include "instance_object.h"
+#include "native_object.h"
+#include "script_runtime.h"
+#include "task_object.h"
+#include "value.h"
+#include "value_format.h"
+#include "value_hash.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// How much a script runs before giving way. Fuel is taken at the two places
+// a script can keep running from: a backward jump takes the length of the
+// loop, and a call takes one.
+struct FuelOptions {
+  int64_t Slice = 0; // Fuel between yields to the host's yield function;
+                     // 0 never yields
+  int64_t Limit = 0; // Fuel for each call from the host, past which the
+                     // script fails; 0 is no limit
+};
+
+// Direct-threaded dispatch needs the labels-as-values extension; other
+// compilers, or builds defining SODA_NO_COMPUTED_GOTO, get a switch
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(SODA_NO_COMPUTED_GOTO)
+#define SODA_COMPUTED_GOTO 1
+#else
+#define SODA_COMPUTED_GOTO 0
+#endif
+
+// Executes compiled packages. All frames share one contiguous register
+// stack, and call frames live in a contiguous frame stack, so calls between
+// script functions never allocate. Both grow as deeper calls need them, up
+// to the sizes given, within space reserved up front: frames and registers
+// never move. Functions that are called often or loop long enough are
+// compiled to machine code by the BaselineJit, which works on the same
+// frames.
+//
+// Calling an async function starts a task on the machine's EventLoop and
+// evaluates to the task. Each time the loop runs a task, its frame goes on
+// top of the stack until it awaits a task not done yet; then the frame's
+// registers move into the task, so it no longer holds any stack, and the
+// task continues in a frame wherever the stack top is once the awaited one
+// is done. Async functions are always interpreted.
+//
+// parallelMap runs a function over an array on a WorkStealingPool, each
+// thread in a worker machine of its own that shares this one's code and
+// reads its objects but allocates in a heap of its own. Every function a
+// body calls is checked to assign no globals, captured variables or
+// members, so nothing another thread reads changes while they run.
+//
+// Running scripts burn fuel, which the interpreter and machine code alike
+// keep in one counter and only check as it runs out, so a runaway loop can
+// be made to yield its thread, or be stopped.
+class VirtualMachine : public ScriptRuntime {
+public:
+  explicit VirtualMachine(size_t maxStack = 1 << 20, size_t maxDepth = 10000)
+      : jit(JitHelpers{jitOperate, jitInvoke, jitTailCall, jitReturn, jitFuel,
+                       static_cast<int>(offsetof(CallFrame, Registers)),
+                       fuelOffset()}) {
+    stack.reserve(maxStack);
+    stack.resize(std::min<size_t>(InitialStack, maxStack));
+    frames.reserve(maxDepth);
+    frames.resize(std::min<size_t>(InitialDepth, maxDepth));
+    setJitOptions(JitOptions());
+    defineNative("sleep", nativeSleep, 1);
+    defineNative("readable", nativeReadable, 1);
+    defineNative("writable", nativeWritable, 1);
+    defineNative("parallelMap", nativeParallelMap, 2, true);
+  }
+
+  void setJitOptions(const JitOptions &options) {
+    jitOptions = options;
+    jitEnabled = options.Enabled && BaselineJit::isSupported();
+    jit.setPerfMap(jitEnabled && options.PerfMap);
+  }
+
+  const BaselineJit &getJit() const { return jit; }
+
+  // Where parallelMap runs; the shared pool unless one is set
+  void setWorkPool(WorkStealingPool *pool) { workPool = pool; }
+
+  void setFuelOptions(const FuelOptions &options) {
+    fuelOptions = options;
+    grant();
+  }
+
+  // Called each time a script has burned a slice of fuel, on the thread
+  // running it; must not throw
+  void setYield(std::function<void()> yield) { yieldHook = std::move(yield); }
+
+  // Runs the package initializer. Returns false on a runtime error.
+  bool run(const CompiledPackage &package) {
+    Heap::StackScope scope(heap);
+    error.clear();
+    startFuel();
+    bindGlobals(package.Globals);
+    try {
+      call(Value::object(heap.allocate<ClosureObject>(package.Initializer)),
+           nullptr, 0);
+    } catch (const RuntimeError &e) {
+      error = e.what();
+      frameCount = 0;
+      nesting = 0;
+      return false;
+    }
+    return true;
+  }
+
+  // Calls the global name from the host once the package has run. Returns
+  // false on a runtime error, leaving the machine ready for another call.
+  bool callGlobal(const std::string &name, const Value *arguments, int count,
+                  Value &result) {
+    Heap::StackScope scope(heap, arguments, count);
+    error.clear();
+    startFuel();
+    int floor = frameCount;
+    int depth = nesting;
+    try {
+      result = call(getGlobal(name), arguments, count);
+    } catch (const RuntimeError &e) {
+      error = e.what();
+      frameCount = floor;
+      nesting = depth;
+      return false;
+    }
+    return true;
+  }
+
+  // Runs the tasks on the event loop until none is left, or for about
+  // timeout milliseconds unless it is -1. Returns false on a runtime error
+  // in a task that nothing awaited; the others can go on in another run.
+  bool runLoop(int timeout = -1) {
+    Heap::StackScope scope(heap);
+    error.clear();
+    startFuel();
+    EventLoop::Clock::time_point deadline =
+        EventLoop::Clock::now() + std::chrono::milliseconds(timeout);
+    std::vector<TaskObject *> fired;
+    bool expired = false;
+    for (;;) {
+      while (TaskObject *task = loop.takeReady()) {
+        resume(task);
+      }
+      if (!loop.isWaiting() || expired) {
+        break;
+      }
+      int wait = -1;
+      if (timeout >= 0) {
+        wait = static_cast<int>(std::max<int64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - EventLoop::Clock::now())
+                .count(),
+            0));
+        // What is due by now still runs
+        expired = wait == 0;
+      }
+      loop.wait(wait, fired);
+      for (TaskObject *task : fired) {
+        settle(task, Value(), nullptr);
+      }
+      fired.clear();
+    }
+    if (TaskObject *failed = loop.takeFailed()) {
+      error = failed->Error;
+      return false;
+    }
+    return true;
+  }
+
+  // Whether the event loop has tasks left to run
+  bool hasTasks() const { return loop.hasReady() || loop.isWaiting(); }
+
+  Value call(const Value &callee, const Value *arguments, int count) override {
+    Heap::StackScope scope(heap, arguments, count);
+    Value *window = stackTop();
+    ensureStack(window, count + 1);
+    window[0] = callee;
+    for (int i = 0; i < count; i++) {
+      window[i + 1] = arguments[i];
+    }
+    int floor = frameCount;
+    if (callValue(window, count)) {
+      return executeNested(floor);
+    }
+    return window[0];
+  }
+
+  Value callMethod(const Value &method, const Value &receiver,
+                   const Value *arguments, int count) override {
+    Heap::StackScope scope(heap, arguments, count);
+    Value *window = stackTop();
+    ensureStack(window, count + 1);
+    for (int i = 0; i < count; i++) {
+      window[i + 1] = arguments[i];
+    }
+    int floor = frameCount;
+    if (pushMethod(method, receiver, window, count)) {
+      return executeNested(floor);
+    }
+    return window[0];
+  }
+
+  // The whole register stack, past the innermost frame too: what it holds
+  // there is stale, but never dangling
+  void traceRoots(Tracer &tracer) override {
+    ScriptRuntime::traceRoots(tracer);
+    tracer.mark(stack.data(), stack.size());
+    for (int i = 0; i < frameCount; i++) {
+      tracer.mark(frames[i].Closure);
+      tracer.mark(frames[i].Receiver);
+      tracer.mark(frames[i].Task);
+    }
+    tracer.mark(returned);
+    loop.trace(tracer);
+  }
+
+protected:
+  std::string location() override {
+    if (frameCount == 0) {
+      return "";
+    }
+    return " in '" + frames[frameCount - 1].Closure->Function->Name + "'";
+  }
+
+private:
+  struct CallFrame {
+    ClosureObject *Closure;
+    const uint32_t *Pc; // Saved while the frame is not the innermost
+    Value *Registers;
+    Value Receiver;
+    bool ReturnsReceiver; // Constructors evaluate to the new instance
+    TaskObject *Task;     // Settled by the return of an async function
+  };
+
+  static constexpr size_t InitialStack = 1 << 12;
+  static constexpr size_t InitialDepth = 64;
+  // Interpreter loops and machine code frames nested on the native stack,
+  // past which machine code is no longer entered and natives can no longer
+  // call back into scripts
+  static constexpr int MaxNesting = 200;
+
+  std::vector<Value> stack;      // Capacity is the most it grows to
+  std::vector<CallFrame> frames; // Likewise
+  int frameCount = 0;
+  int nesting = 0;
+  BaselineJit jit;
+  JitOptions jitOptions;
+  bool jitEnabled = false;
+  std::string jitError; // Raised in machine code, rethrown outside it
+  Value returned;       // Result of the last frame machine code returned from
+  EventLoop loop;
+  WorkStealingPool *workPool = nullptr;
+  bool worker = false;      // Runs parallel bodies for another machine
+  InlineCache scratchCache; // What a worker fills in instead of the caches
+  int64_t fuel = std::numeric_limits<int64_t>::max(); // Left of the slice
+  int64_t granted = fuel; // The slice fuel counts down from
+  int64_t burned = 0;     // Since the host called, before this slice
+  FuelOptions fuelOptions;
+  std::function<void()> yieldHook;
+
+  // Fuel
+
+  // Where machine code finds the counter
+  int fuelOffset() const {
+    return static_cast<int>(reinterpret_cast<const char *>(&fuel) -
+                            reinterpret_cast<const char *>(this));
+  }
+
+  // Fuel for a call from the host
+  void startFuel() {
+    burned = 0;
+    grant();
+  }
+
+  void grant() {
+    int64_t slice = fuelOptions.Slice > 0
+                        ? fuelOptions.Slice
+                        : std::numeric_limits<int64_t>::max();
+    if (fuelOptions.Limit > 0) {
+      slice = std::min(slice, fuelOptions.Limit - burned);
+    }
+    fuel = granted = slice;
+  }
+
+  // Called once the slice has run out: fails if the limit has too, and
+  // otherwise yields and starts the next slice
+  void refuel() {
+    burned += granted - fuel;
+    granted = fuel;
+    if (fuelOptions.Limit > 0 && burned >= fuelOptions.Limit) {
+      fail("Out of fuel");
+    }
+    if (yieldHook && fuelOptions.Slice > 0) {
+      yieldHook();
+    }
+    grant();
+  }
+
+  // Frames
+
+  // First register past the innermost frame, where new windows start
+  Value *stackTop() {
+    if (frameCount == 0) {
+      return stack.data();
+    }
+    const CallFrame &frame = frames[frameCount - 1];
+    return frame.Registers + frame.Closure->Function->RegisterCount;
+  }
+
+  void ensureStack(Value *from, int count) {
+    size_t needed = static_cast<size_t>(from - stack.data()) + count;
+    if (needed > stack.size()) {
+      if (needed > stack.capacity()) {
+        fail("Stack overflow");
+      }
+      // Within the reserved capacity, so no register moves
+      stack.resize(std::min(std::max(needed, stack.size() * 2),
+                            stack.capacity()));
+    }
+  }
+
+  void pushFrame(ClosureObject *closure, Value *registers, int argc,
+                 const Value &receiver, bool returnsReceiver) {
+    FunctionObject *function = closure->Function;
+    checkArity(function->Name, function->Arity, argc);
+    if (--fuel <= 0) {
+      refuel();
+    }
+    reserveFrame();
+    ensureStack(registers, function->RegisterCount);
+    for (int i = argc; i < function->RegisterCount; i++) {
+      registers[i] = Value();
+    }
+    if (jitEnabled && !function->Jit &&
+        ++function->Invocations == jitOptions.CallThreshold) {
+      compileHot(function);
+    }
+    CallFrame &frame = frames[frameCount++];
+    frame.Closure = closure;
+    frame.Pc = function->Code.data();
+    frame.Registers = registers;
+    frame.Receiver = receiver;
+    frame.ReturnsReceiver = returnsReceiver;
+    frame.Task = nullptr;
+  }
+
+  void reserveFrame() {
+    if (frameCount == static_cast<int>(frames.size())) {
+      if (frames.size() == frames.capacity()) {
+        fail("Stack overflow");
+      }
+      frames.resize(std::min(frames.size() * 2, frames.capacity()));
+    }
+  }
+
+  // Pushes a frame for closure with the argc arguments in registers, or
+  // starts a task for it if it is async, leaving the task in registers[-1].
+  // Returns true if a frame was pushed.
+  bool enter(ClosureObject *closure, Value *registers, int argc,
+             const Value &receiver) {
+    if (worker) {
+      requireParallel(closure->Function);
+    }
+    if (closure->Function->Async) {
+      registers[-1] = spawn(closure, registers, argc, receiver);
+      return false;
+    }
+    pushFrame(closure, registers, argc, receiver, false);
+    return true;
+  }
+
+  // Calls window[0] with the argc values after it. Returns true if a
+  // script frame was pushed, false if the result is already in window[0].
+  bool callValue(Value *window, int argc) {
+    const Value &callee = window[0];
+    if (callee.isObject()) {
+      switch (callee.asObject()->Kind) {
+      case ObjectKind::Closure: {
+        auto *closure = static_cast<ClosureObject *>(callee.asObject());
+        return enter(closure, window + 1, argc, closure->Receiver);
+      }
+      case ObjectKind::Native: {
+        auto *native = static_cast<NativeObject *>(callee.asObject());
+        if (worker && !native->Pure) {
+          fail("'" + native->Name + "' cannot be called in parallel");
+        }
+        window[0] = callNative(native, window + 1, argc);
+        return false;
+      }
+      case ObjectKind::Class:
+        return construct(window, argc);
+      default:
+        break;
+      }
+    }
+    fail("Cannot call " + std::string(valueTypeName(callee)));
+  }
+
+  bool pushMethod(const Value &method, const Value &receiver, Value *window,
+                  int argc) {
+    if (method.isObject() && method.asObject()->Kind == ObjectKind::Closure) {
+      return enter(static_cast<ClosureObject *>(method.asObject()), window + 1,
+                   argc, receiver);
+    }
+    window[0] = method;
+    return callValue(window, argc);
+  }
+
+  bool construct(Value *window, int argc) {
+    if (worker) {
+      fail("Instances cannot be created in parallel");
+    }
+    auto *cls = static_cast<ClassObject *>(window[0].asObject());
+    Value instance = instantiate(cls);
+
+    int constructor = cls->findMethod("constructor");
+    if (constructor < 0 || cls->Methods[constructor].isNull()) {
+      window[0] = instance;
+      return false;
+    }
+    const Value &method = cls->Methods[constructor];
+    pushFrame(static_cast<ClosureObject *>(method.asObject()), window + 1, argc,
+              instance, true);
+    return true;
+  }
+
+  // Calls receiver.name with the arguments after window[0], which holds the
+  // receiver. Returns true if a script frame was pushed.
+  bool invokeMember(Value *window, int argc, const std::string &name,
+                    InlineCache &cache) {
+    Value receiver = window[0];
+    if (receiver.isObject() &&
+        receiver.asObject()->Kind != ObjectKind::Instance &&
+        receiver.asObject()->Kind != ObjectKind::Class) {
+      Value result;
+      if (callBuiltinMethod(receiver, name, window + 1, argc, result)) {
+        window[0] = result;
+        return false;
+      }
+    }
+    Value callee;
+    if (findCallable(receiver, name, callee, cache)) {
+      return pushMethod(callee, receiver, window, argc);
+    }
+    window[0] = callee;
+    return callValue(window, argc);
+  }
+
+  // Runs the call instruction at pc in frame. Returns true if a script
+  // frame was pushed.
+  bool invoke(CallFrame *frame, const uint32_t *pc) {
+    uint32_t instruction = *pc;
+    Value *window = &frame->Registers[decodeA(instruction)];
+    int argc = decodeB(instruction);
+    const std::vector<std::string> &names = frame->Closure->Function->Names;
+    switch (decodeOpcode(instruction)) {
+    case Opcode::Call:
+      return callValue(window, argc);
+    case Opcode::CallMember:
+      return invokeMember(window, argc, names[decodeC(instruction)],
+                          fillCache(frame, pc));
+    case Opcode::CallMethod:
+      return pushMethod(ownMethod(frame, decodeC(instruction)),
+                        frame->Receiver, window, argc);
+    case Opcode::CallFinal:
+      return pushMethod(
+          frame->Closure->Function->Owner->Methods[decodeC(instruction)],
+          frame->Receiver, window, argc);
+    case Opcode::CallStatic:
+      if (!window[0].isObject() ||
+          window[0].asObject()->Kind != ObjectKind::Class) {
+        fail("Cannot call a static method on " +
+             std::string(valueTypeName(window[0])));
+      }
+      return pushMethod(static_cast<ClassObject *>(window[0].asObject())
+                            ->Methods[decodeC(instruction)],
+                        window[0], window, argc);
+    case Opcode::CallSuper: {
+      const std::string &name = names[decodeC(instruction)];
+      ClassObject *owner = frame->Closure->Function->Owner;
+      int method = owner && owner->Base ? owner->Base->findMethod(name) : -1;
+      if (method >= 0 && !owner->Base->Methods[method].isNull()) {
+        return pushMethod(owner->Base->Methods[method], frame->Receiver,
+                          window, argc);
+      }
+      if (name != "constructor") {
+        fail("No base class method '" + name + "'");
+      }
+      // Nothing to run, the base fields were initialized on allocation
+      window[0] = Value();
+      return false;
+    }
+    case Opcode::New:
+      if (!window[0].isObject() ||
+          window[0].asObject()->Kind != ObjectKind::Class) {
+        fail("Cannot instantiate " + std::string(valueTypeName(window[0])));
+      }
+      return construct(window, argc);
+    default:
+      fail("Invalid opcode");
+    }
+  }
+
+  // The method in slot of the method table of the frame's receiver
+  Value ownMethod(CallFrame *frame, int slot) {
+    ClassObject *cls = methodTable(frame->Receiver);
+    if (!cls) {
+      fail("Method call without an instance");
+    }
+    return cls->Methods[slot];
+  }
+
+  // Runs the tail call at pc in frame, the innermost one: moves the
+  // callee's arguments over the frame's own window and pops the frame, so
+  // a callee frame takes its place. Returns true if one did, false if the
+  // call already finished, which counts as the frame returning.
+  bool tailCall(CallFrame *frame, const uint32_t *pc) {
+    uint32_t instruction = *pc;
+    const Value *window = &frame->Registers[decodeA(instruction)];
+    int argc = decodeB(instruction);
+    bool method = decodeOpcode(instruction) == Opcode::TailCallMethod;
+    Value callee = method ? ownMethod(frame, decodeC(instruction)) : window[0];
+    Value receiver = frame->Receiver;
+    Value *base = frame->Registers - 1;
+    for (int i = 1; i <= argc; i++) {
+      base[i] = window[i];
+    }
+    frameCount--;
+    base[0] = callee;
+    bool pushed = method ? pushMethod(callee, receiver, base, argc)
+                         : callValue(base, argc);
+    if (!pushed) {
+      returned = base[0];
+    }
+    return pushed;
+  }
+
+  // Inline cache of the member access at pc, named by the word after it
+  static InlineCache &memberCache(CallFrame *frame, const uint32_t *pc) {
+    return frame->Closure->Function->Caches[decodeBx(pc[1])];
+  }
+
+  // The cache a lookup for the access at pc adds to. Workers run the code
+  // of the machine that made them, alongside each other, so they only read
+  // its caches and add to a copy.
+  InlineCache &fillCache(CallFrame *frame, const uint32_t *pc) {
+    if (worker) {
+      scratchCache = memberCache(frame, pc);
+      return scratchCache;
+    }
+    return memberCache(frame, pc);
+  }
+
+  // Runs the instruction at pc, one that neither calls nor jumps
+  void operate(CallFrame *frame, const uint32_t *pc) {
+    uint32_t instruction = *pc;
+    Value *registers = frame->Registers;
+    Value &target = registers[decodeA(instruction)];
+    const Value &left = registers[decodeB(instruction)];
+    const Value &right = registers[decodeC(instruction)];
+    const Value *environment = frame->Closure->Environment.data();
+    const std::vector<std::string> &names = frame->Closure->Function->Names;
+    switch (decodeOpcode(instruction)) {
+    case Opcode::GetGlobal:
+      target = globals[decodeBx(instruction)];
+      return;
+    case Opcode::SetGlobal:
+      globals[decodeBx(instruction)] = target;
+      return;
+    case Opcode::GetEnvironment:
+      target = environment[decodeB(instruction)];
+      return;
+    case Opcode::GetReference:
+      target = stack[environment[decodeB(instruction)].asInt()];
+      return;
+    case Opcode::SetReference:
+      stack[environment[decodeA(instruction)].asInt()] = left;
+      return;
+    case Opcode::NewCell:
+      target = Value::object(heap.allocate<CellObject>(target));
+      return;
+    case Opcode::GetCell:
+      target = static_cast<CellObject *>(left.asObject())->Contents;
+      return;
+    case Opcode::SetCell:
+      heap.writeBarrier(target);
+      static_cast<CellObject *>(target.asObject())->Contents = left;
+      return;
+    case Opcode::LoadThis:
+      target = frame->Receiver;
+      return;
+    case Opcode::GetField:
+      target = receiverInstance(frame)->fields()[decodeB(instruction)];
+      return;
+    case Opcode::SetField:
+      heap.writeBarrier(receiverInstance(frame));
+      receiverInstance(frame)->fields()[decodeA(instruction)] = left;
+      return;
+    case Opcode::GetMember:
+      target = getMember(left, names[decodeC(instruction)],
+                         fillCache(frame, pc));
+      return;
+    case Opcode::SetMember:
+      setMember(target, names[decodeB(instruction)], right,
+                fillCache(frame, pc));
+      return;
+    case Opcode::Add:
+    case Opcode::AddDouble:
+      target = add(left, right);
+      return;
+    case Opcode::Subtract:
+    case Opcode::SubtractDouble:
+      target = arithmetic(BinaryOperator::Subtract, left, right);
+      return;
+    case Opcode::Multiply:
+    case Opcode::MultiplyDouble:
+      target = arithmetic(BinaryOperator::Multiply, left, right);
+      return;
+    case Opcode::Divide:
+    case Opcode::DivideInt:
+    case Opcode::DivideDouble:
+      target = arithmetic(BinaryOperator::Divide, left, right);
+      return;
+    case Opcode::Modulo:
+    case Opcode::ModuloInt:
+    case Opcode::ModuloDouble:
+      target = arithmetic(BinaryOperator::Modulo, left, right);
+      return;
+    case Opcode::Equal:
+      target = Value::boolean(valuesEqual(left, right));
+      return;
+    case Opcode::NotEqual:
+      target = Value::boolean(!valuesEqual(left, right));
+      return;
+    case Opcode::Less:
+    case Opcode::LessInt:
+    case Opcode::LessDouble:
+      target = Value::boolean(relation(BinaryOperator::Less, left, right));
+      return;
+    case Opcode::LessEqual:
+    case Opcode::LessEqualInt:
+    case Opcode::LessEqualDouble:
+      target = Value::boolean(relation(BinaryOperator::LessEqual, left, right));
+      return;
+    case Opcode::Greater:
+    case Opcode::GreaterInt:
+    case Opcode::GreaterDouble:
+      target = Value::boolean(relation(BinaryOperator::Greater, left, right));
+      return;
+    case Opcode::GreaterEqual:
+    case Opcode::GreaterEqualInt:
+    case Opcode::GreaterEqualDouble:
+      target =
+          Value::boolean(relation(BinaryOperator::GreaterEqual, left, right));
+      return;
+    case Opcode::ToDouble:
+      target = toDouble(left);
+      return;
+    case Opcode::Concat:
+      target = concatenateAll(&left, decodeC(instruction));
+      return;
+    case Opcode::Closure: {
+      FunctionObject *prototype =
+          frame->Closure->Function->Prototypes[decodeBx(instruction)];
+      auto *closure = heap.allocate<ClosureObject>(prototype);
+      closure->Receiver = frame->Receiver;
+      closure->Environment.reserve(prototype->Captures.size());
+      for (const CaptureDescriptor &captured : prototype->Captures) {
+        if (captured.FromEnvironment) {
+          closure->Environment.push_back(environment[captured.Index]);
+        } else if (captured.ByReference) {
+          closure->Environment.push_back(
+              Value::integer(&registers[captured.Index] - stack.data()));
+        } else {
+          closure->Environment.push_back(registers[captured.Index]);
+        }
+      }
+      target = Value::object(closure);
+      return;
+    }
+    default:
+      fail("Invalid opcode");
+    }
+  }
+
+  InstanceObject *receiverInstance(CallFrame *frame) {
+    if (!frame->Receiver.isObject() ||
+        frame->Receiver.asObject()->Kind != ObjectKind::Instance) {
+      fail("Field access without an instance");
+    }
+    return static_cast<InstanceObject *>(frame->Receiver.asObject());
+  }
+
+  // Pops frame for its Return instruction and hands the result to the
+  // callee register just below it
+  Value popFrame(CallFrame *frame, uint32_t instruction) {
+    Value result =
+        decodeB(instruction) ? frame->Registers[decodeA(instruction)] : Value();
+    if (frame->ReturnsReceiver) {
+      result = frame->Receiver;
+    }
+    frame->Registers[-1] = result;
+    frameCount--;
+    if (frame->Task) {
+      settle(frame->Task, result, nullptr);
+    }
+    return result;
+  }
+
+  // Tasks
+
+  // Starts closure, an async function, as a task with the argc arguments;
+  // it first runs once the event loop gets to it
+  Value spawn(ClosureObject *closure, const Value *arguments, int argc,
+              const Value &receiver) {
+    FunctionObject *function = closure->Function;
+    checkArity(function->Name, function->Arity, argc);
+    auto *task = heap.allocate<TaskObject>();
+    heap.writeBarrier(task);
+    task->Closure = closure;
+    task->Receiver = receiver;
+    task->Registers.assign(arguments, arguments + argc);
+    loop.schedule(task);
+    return Value::object(task);
+  }
+
+  // Continues task in a frame on top of the stack, or starts it, until it
+  // returns or awaits a task that is not done yet
+  void resume(TaskObject *task) {
+    int floor = frameCount;
+    int depth = nesting;
+    TaskObject *awaited = task->Awaited;
+    if (awaited && awaited->State == TaskState::Failed) {
+      settle(task, Value(), awaited->Error.c_str());
+      return;
+    }
+    try {
+      FunctionObject *function = task->Closure->Function;
+      Value *registers = stackTop() + 1;
+      ensureStack(registers - 1, function->RegisterCount + 1);
+      registers[-1] = Value();
+      int saved = static_cast<int>(task->Registers.size());
+      std::copy(task->Registers.begin(), task->Registers.end(), registers);
+      if (!task->Pc) {
+        pushFrame(task->Closure, registers, saved, task->Receiver, false);
+      } else {
+        reserveFrame();
+        CallFrame &frame = frames[frameCount++];
+        frame.Closure = task->Closure;
+        frame.Pc = task->Pc;
+        frame.Registers = registers;
+        frame.Receiver = task->Receiver;
+        frame.ReturnsReceiver = false;
+        registers[task->ResultRegister] = awaited->Result;
+      }
+      frames[frameCount - 1].Task = task;
+      heap.writeBarrier(task);
+      task->Registers.clear();
+      task->Awaited = nullptr;
+      executeNested(floor);
+    } catch (const RuntimeError &e) {
+      frameCount = floor;
+      nesting = depth;
+      settle(task, Value(), e.what());
+    }
+  }
+
+  // Runs the Await instruction at pc in frame, the frame of a task the
+  // event loop is running. Returns true if the frame suspended, which pops
+  // it.
+  bool suspend(CallFrame *frame, const uint32_t *pc) {
+    uint32_t instruction = *pc;
+    Value *registers = frame->Registers;
+    const Value &operand = registers[decodeB(instruction)];
+    if (!operand.isObject() || operand.asObject()->Kind != ObjectKind::Task) {
+      // Awaiting anything else is the value itself
+      registers[decodeA(instruction)] = operand;
+      return false;
+    }
+    auto *awaited = static_cast<TaskObject *>(operand.asObject());
+    switch (awaited->State) {
+    case TaskState::Done:
+      registers[decodeA(instruction)] = awaited->Result;
+      return false;
+    case TaskState::Failed:
+      loop.observe(awaited);
+      throw RuntimeError(awaited->Error);
+    case TaskState::Pending:
+      break;
+    }
+    TaskObject *task = frame->Task;
+    if (awaited == task) {
+      fail("A task cannot await itself");
+    }
+    heap.writeBarrier(task);
+    task->Registers.assign(registers,
+                           registers + frame->Closure->Function->RegisterCount);
+    task->Pc = pc + 1;
+    task->ResultRegister = decodeA(instruction);
+    task->Awaited = awaited;
+    heap.writeBarrier(awaited);
+    awaited->Waiters.push_back(task);
+    frameCount--;
+    return true;
+  }
+
+  // Ends task with result, or with the error failure unless it is null,
+  // and schedules the tasks awaiting it
+  void settle(TaskObject *task, const Value &result, const char *failure) {
+    heap.writeBarrier(task);
+    task->State = failure ? TaskState::Failed : TaskState::Done;
+    task->Result = result;
+    task->Closure = nullptr;
+    task->Receiver = Value();
+    std::vector<Value>().swap(task->Registers);
+    if (failure) {
+      task->Error = failure;
+      if (task->Waiters.empty()) {
+        loop.addFailed(task);
+      }
+    }
+    for (TaskObject *waiter : task->Waiters) {
+      loop.schedule(waiter);
+    }
+    std::vector<TaskObject *>().swap(task->Waiters);
+  }
+
+  static Value nativeSleep(ScriptRuntime &runtime, const Value *arguments,
+                           int) {
+    auto &machine = static_cast<VirtualMachine &>(runtime);
+    if (!arguments[0].isNumber()) {
+      machine.fail("sleep expects a number of milliseconds");
+    }
+    auto *task = machine.heap.allocate<TaskObject>();
+    machine.loop.addTimer(task, arguments[0].asNumber());
+    return Value::object(task);
+  }
+
+  static Value nativeReadable(ScriptRuntime &runtime, const Value *arguments,
+                              int) {
+    return static_cast<VirtualMachine &>(runtime).watch(arguments[0], false);
+  }
+
+  static Value nativeWritable(ScriptRuntime &runtime, const Value *arguments,
+                              int) {
+    return static_cast<VirtualMachine &>(runtime).watch(arguments[0], true);
+  }
+
+  // A task done once the file descriptor fd can be written, or read,
+  // without blocking
+  Value watch(const Value &fd, bool write) {
+    if (!fd.isInt()) {
+      fail("Expected a file descriptor");
+    }
+    int number = static_cast<int>(fd.asInt());
+    TaskObject *task = loop.watching(number, write);
+    if (!task) {
+      task = heap.allocate<TaskObject>();
+      if (!loop.watch(number, write, task)) {
+        fail("Cannot wait on file descriptor " + std::to_string(number));
+      }
+    }
+    return Value::object(task);
+  }
+
+  // Parallel bodies
+
+  static Value nativeParallelMap(ScriptRuntime &runtime,
+                                 const Value *arguments, int) {
+    return static_cast<VirtualMachine &>(runtime).parallelMap(arguments[0],
+                                                              arguments[1]);
+  }
+
+  // A new array of body called with each element of array, the calls
+  // spread over the work pool's threads
+  Value parallelMap(const Value &array, const Value &body) {
+    if (!array.isObject() || array.asObject()->Kind != ObjectKind::Array) {
+      fail("parallelMap expects an Array");
+    }
+    requireParallel(body);
+    auto *source = static_cast<ArrayObject *>(array.asObject());
+    std::vector<Value> elements(source->count());
+    for (size_t i = 0; i < elements.size(); i++) {
+      elements[i] = source->get(i);
+    }
+    if (worker) {
+      // Inside a body, which already has the threads busy
+      auto *mapped = heap.allocate<ArrayObject>();
+      heap.writeBarrier(mapped);
+      for (const Value &element : elements) {
+        mapped->append(call(body, &element, 1));
+      }
+      return Value::object(mapped);
+    }
+    WorkStealingPool &pool =
+        workPool ? *workPool : WorkStealingPool::getShared();
+    std::vector<std::unique_ptr<VirtualMachine>> workers(
+        pool.getParticipants());
+    std::vector<Value> results(elements.size());
+    std::atomic<bool> failed{false};
+    std::mutex failing;
+    std::string failure;
+    // Nothing may escape a body: helpers would die in std::terminate, and
+    // the caller would leave run while they still use its job
+    auto record = [&](const char *message) {
+      std::lock_guard<std::mutex> lock(failing);
+      if (!failed) {
+        failure = message;
+        failed = true;
+      }
+    };
+    pool.run(elements.size(), pool.chunkSize(elements.size()),
+             [&](size_t begin, size_t end, int participant) {
+               std::unique_ptr<VirtualMachine> &machine = workers[participant];
+               try {
+                 if (!machine) {
+                   machine = makeWorker();
+                 }
+                 for (size_t i = begin; i < end && !failed; i++) {
+                   results[i] = machine->call(body, &elements[i], 1);
+                 }
+               } catch (const RuntimeError &e) {
+                 record(e.what());
+               } catch (const std::bad_alloc &) {
+                 record("Out of memory in a parallel body");
+               } catch (...) {
+                 record("A parallel body failed");
+               }
+             });
+    if (failed) {
+      throw RuntimeError(failure);
+    }
+    return gather(results, workers);
+  }
+
+  // A machine to run parallel bodies in, with the same globals. It runs
+  // the machine code this one compiled but compiles none, and never
+  // collects, since its objects refer into this machine's heap.
+  std::unique_ptr<VirtualMachine> makeWorker() {
+    std::unique_ptr<VirtualMachine> machine(
+        new VirtualMachine(stack.capacity(), frames.capacity()));
+    JitOptions options = jitOptions;
+    options.Enabled = false;
+    machine->setJitOptions(options);
+    HeapOptions heapOptions;
+    heapOptions.Collect = false;
+    heapOptions.NurserySize = 0;
+    machine->heap.setOptions(heapOptions);
+    machine->globals = globals;
+    machine->globalNames = globalNames;
+    machine->worker = true;
+    FuelOptions fuel = fuelOptions;
+    fuel.Slice = 0;
+    machine->setFuelOptions(fuel);
+    return machine;
+  }
+
+  // The results of the workers in an array of this machine's heap. What
+  // a worker allocated goes with it, so strings and wide ints it made are
+  // copied, and anything else it made cannot be a result.
+  Value gather(std::vector<Value> &results,
+               const std::vector<std::unique_ptr<VirtualMachine>> &workers) {
+    std::unordered_set<const HeapObject *> allocated;
+    bool found = false;
+    std::vector<std::pair<size_t, std::string>> strings;
+    std::vector<std::pair<size_t, int64_t>> integers;
+    // Nothing is allocated here until every result is one of this heap's
+    for (size_t i = 0; i < results.size(); i++) {
+      HeapObject *object = results[i].getReference();
+      if (!object) {
+        continue;
+      }
+      if (object->Kind == ObjectKind::Integer) {
+        integers.emplace_back(i, results[i].asInt());
+        results[i] = Value();
+        continue;
+      }
+      if (!found) {
+        for (const auto &machine : workers) {
+          if (machine) {
+            machine->heap.forEachOld(
+                [&](HeapObject *local) { allocated.insert(local); });
+          }
+        }
+        found = true;
+      }
+      if (allocated.count(object)) {
+        if (object->Kind != ObjectKind::String) {
+          fail("A parallel body cannot return " +
+               std::string(valueTypeName(results[i])) + " it created");
+        }
+        strings.emplace_back(i, asString(results[i])->text());
+        results[i] = Value();
+      }
+    }
+    Heap::RootRange root(heap, results.data(), results.size());
+    for (const auto &string : strings) {
+      results[string.first] = Value::object(newString(string.second));
+    }
+    for (const auto &integer : integers) {
+      results[integer.first] = heap.integer(integer.second);
+    }
+    auto *mapped = heap.allocate<ArrayObject>();
+    heap.writeBarrier(mapped);
+    mapped->assign(results.data(), results.size());
+    return Value::object(mapped);
+  }
+
+  // Fails unless a parallel body can call callee
+  void requireParallel(const Value &callee) {
+    if (callee.isObject()) {
+      switch (callee.asObject()->Kind) {
+      case ObjectKind::Closure:
+        requireParallel(static_cast<ClosureObject *>(callee.asObject())
+                            ->Function);
+        return;
+      case ObjectKind::Native: {
+        auto *native = static_cast<NativeObject *>(callee.asObject());
+        if (!native->Pure) {
+          fail("'" + native->Name + "' cannot be called in parallel");
+        }
+        return;
+      }
+      default:
+        break;
+      }
+    }
+    fail("Cannot call " + std::string(valueTypeName(callee)) +
+         " in parallel");
+  }
+
+  void requireParallel(FunctionObject *function) {
+    uint8_t verdict = function->Parallel.load(std::memory_order_relaxed);
+    if (verdict == 0) {
+      verdict = parallelHazard(*function) ? 2 : 1;
+      function->Parallel.store(verdict, std::memory_order_relaxed);
+    }
+    if (verdict == 2) {
+      fail("'" + function->Name + "' cannot run in parallel, since " +
+           parallelHazard(*function));
+    }
+  }
+
+  // Why calls of function could change what another thread reads, or
+  // null if they cannot. Writes to the frame's own registers and to
+  // captured slots of frames below it are the calls' own.
+  static const char *parallelHazard(const FunctionObject &function) {
+    if (function.Async) {
+      return "it is async";
+    }
+    for (uint32_t instruction : function.Code) {
+      switch (decodeOpcode(instruction)) {
+      case Opcode::SetGlobal:
+        return "it assigns a global";
+      case Opcode::SetCell:
+        return "it assigns a variable a closure captures";
+      case Opcode::SetField:
+      case Opcode::SetMember:
+        return "it assigns a member";
+      case Opcode::New:
+        return "it creates an instance";
+      case Opcode::CallMember:
+        if (function.Names[decodeC(instruction)] == "append") {
+          return "it appends to an array";
+        }
+        if (function.Names[decodeC(instruction)] == "fill") {
+          return "it fills an array";
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    return nullptr;
+  }
+
+  // Machine code
+
+  // Async functions keep to the interpreter, which can suspend them
+  bool compileHot(FunctionObject *function) {
+    if (function->Async) {
+      return false;
+    }
+    if (!function->Jit) {
+      function->Jit = jit.compile(*function);
+      if (!function->Jit) {
+        // Out of executable memory; interpret from now on
+        jitEnabled = false;
+      }
+    }
+    return function->Jit != nullptr;
+  }
+
+  // Whether the innermost frame is to continue in machine code
+  bool canRunCompiled() const {
+    return frames[frameCount - 1].Closure->Function->Jit &&
+           nesting < MaxNesting;
+  }
+
+  // Runs the innermost frame in machine code from start, or from its first
+  // instruction, and then each frame a tail call puts in its place that
+  // has machine code too. Returns false once a frame returns, true if the
+  // innermost frame is left to the interpreter.
+  bool runCompiled(const uint8_t *start) {
+    for (;;) {
+      int count = frameCount;
+      CallFrame *frame = &frames[frameCount - 1];
+      JitFunction *compiled = frame->Closure->Function->Jit;
+      nesting++;
+      int failed =
+          compiled->Entry(this, frame, start ? start : compiled->Labels[0]);
+      nesting--;
+      if (failed) {
+        throw RuntimeError(jitError);
+      }
+      if (frameCount != count) {
+        return false;
+      }
+      if (!canRunCompiled()) {
+        return true;
+      }
+      start = nullptr;
+    }
+  }
+
+  // Entry points for machine code. Errors cannot unwind through generated
+  // frames, so they are stored and reported by the return value instead.
+
+  static int jitOperate(void *vm, void *frame, const uint32_t *pc) {
+    auto *self = static_cast<VirtualMachine *>(vm);
+    try {
+      self->operate(static_cast<CallFrame *>(frame), pc);
+      return 0;
+    } catch (const std::exception &e) {
+      self->jitError = e.what();
+      return 1;
+    }
+  }
+
+  static int jitInvoke(void *vm, void *frame, const uint32_t *pc) {
+    auto *self = static_cast<VirtualMachine *>(vm);
+    try {
+      int floor = self->frameCount;
+      if (self->invoke(static_cast<CallFrame *>(frame), pc)) {
+        self->execute(floor);
+      }
+      return 0;
+    } catch (const std::exception &e) {
+      self->jitError = e.what();
+      return 1;
+    }
+  }
+
+  static int jitTailCall(void *vm, void *frame, const uint32_t *pc) {
+    auto *self = static_cast<VirtualMachine *>(vm);
+    try {
+      self->tailCall(static_cast<CallFrame *>(frame), pc);
+      return 0;
+    } catch (const std::exception &e) {
+      self->jitError = e.what();
+      return 1;
+    }
+  }
+
+  static int jitReturn(void *vm, void *frame, const uint32_t *pc) {
+    auto *self = static_cast<VirtualMachine *>(vm);
+    self->returned = self->popFrame(static_cast<CallFrame *>(frame), *pc);
+    return 0;
+  }
+
+  static int jitFuel(void *vm, void *frame, const uint32_t *pc) {
+    auto *self = static_cast<VirtualMachine *>(vm);
+    try {
+      (void)frame;
+      (void)pc;
+      self->refuel();
+      return 0;
+    } catch (const std::exception &e) {
+      self->jitError = e.what();
+      return 1;
+    }
+  }
+
+  // Interpreter loop
+
+  // Runs frames pushed for a call from native code, which nests on the
+  // native stack
+  Value executeNested(int floor) {
+    if (nesting == MaxNesting) {
+      frameCount = floor;
+      fail("Stack overflow");
+    }
+    nesting++;
+    Value result = execute(floor);
+    nesting--;
+    return result;
+  }
+
+  // Runs until the frame count drops back to floor and returns the value
+  // the last frame returned
+  Value execute(int floor) {
+    CallFrame *frame;
+    const uint32_t *pc;
+    Value *registers;
+    const Value *constants;
+    uint32_t instruction;
+
+#define VM_LOAD_FRAME()                                                        \
+  do {                                                                         \
+    frame = &frames[frameCount - 1];                                           \
+    pc = frame->Pc;                                                            \
+    registers = frame->Registers;                                              \
+    constants = frame->Closure->Function->Constants.data();                    \
+  } while (0)
+#define VM_SAVE_PC() (frame->Pc = pc)
+// Enters a frame just pushed, in machine code if its function has some
+#define VM_ENTER_FRAME()                                                       \
+  do {                                                                         \
+    if (canRunCompiled() && !runCompiled(nullptr) && frameCount == floor) {    \
+      return returned;                                                         \
+    }                                                                          \
+    VM_LOAD_FRAME();                                                           \
+  } while (0)
+#define R(n) registers[n]
+#define A decodeA(instruction)
+#define B decodeB(instruction)
+#define C decodeC(instruction)
+
+#if SODA_COMPUTED_GOTO
+    static void *labels[] = {
+#define SODA_OPCODE_LABEL(name) &&op_##name,
+        SODA_OPCODES(SODA_OPCODE_LABEL)
+#undef SODA_OPCODE_LABEL
+    };
+#define VM_CASE(name) op_##name:
+#define VM_NEXT()                                                              \
+  do {                                                                         \
+    instruction = *pc++;                                                       \
+    goto *labels[instruction & 0xFF];                                          \
+  } while (0)
+#else
+#define VM_CASE(name) case Opcode::name:
+#define VM_NEXT() continue
+#endif
+
+    VM_ENTER_FRAME();
+#if SODA_COMPUTED_GOTO
+    VM_NEXT();
+#else
+    for (;;) {
+      instruction = *pc++;
+      switch (decodeOpcode(instruction)) {
+#endif
+
+    VM_CASE(Move) {
+      R(A) = R(B);
+      VM_NEXT();
+    }
+    VM_CASE(LoadConstant) {
+      R(A) = constants[decodeBx(instruction)];
+      VM_NEXT();
+    }
+    VM_CASE(LoadNull) {
+      R(A) = Value();
+      VM_NEXT();
+    }
+    VM_CASE(LoadBool) {
+      R(A) = Value::boolean(B != 0);
+      VM_NEXT();
+    }
+    VM_CASE(LoadInt) {
+      R(A) = Value::integer(decodesBx(instruction));
+      VM_NEXT();
+    }
+    VM_CASE(GetGlobal) {
+      R(A) = globals[decodeBx(instruction)];
+      VM_NEXT();
+    }
+    VM_CASE(SetGlobal) {
+      globals[decodeBx(instruction)] = R(A);
+      VM_NEXT();
+    }
+    VM_CASE(GetEnvironment)
+    VM_CASE(GetReference)
+    VM_CASE(SetReference)
+    VM_CASE(NewCell)
+    VM_CASE(GetCell)
+    VM_CASE(SetCell)
+    VM_CASE(LoadThis)
+    VM_CASE(GetField)
+    VM_CASE(SetField)
+    VM_CASE(Concat)
+    VM_CASE(Closure) {
+      VM_SAVE_PC();
+      operate(frame, pc - 1);
+      VM_NEXT();
+    }
+    VM_CASE(GetMember) {
+      // A field of a shape the site has seen is one compare and a load
+      const InlineCache &cache = memberCache(frame, pc - 1);
+      if (!cache.getField(R(B), R(A))) {
+        VM_SAVE_PC();
+        operate(frame, pc - 1);
+      }
+      pc++;
+      VM_NEXT();
+    }
+    VM_CASE(SetMember) {
+      const InlineCache &cache = memberCache(frame, pc - 1);
+      if (!cache.setField(R(A), R(C))) {
+        VM_SAVE_PC();
+        operate(frame, pc - 1);
+      }
+      pc++;
+      VM_NEXT();
+    }
+    VM_CASE(Add) {
+      if (!Value::addInline(R(B), R(C), R(A))) {
+        VM_SAVE_PC();
+        R(A) = add(R(B), R(C));
+      }
+      VM_NEXT();
+    }
+    VM_CASE(Subtract) {
+      if (!Value::subtractInline(R(B), R(C), R(A))) {
+        VM_SAVE_PC();
+        R(A) = arithmetic(BinaryOperator::Subtract, R(B), R(C));
+      }
+      VM_NEXT();
+    }
+    VM_CASE(Multiply) {
+      if (!Value::multiplyInline(R(B), R(C), R(A))) {
+        VM_SAVE_PC();
+        R(A) = arithmetic(BinaryOperator::Multiply, R(B), R(C));
+      }
+      VM_NEXT();
+    }
+    VM_CASE(Divide) {
+      VM_SAVE_PC();
+      R(A) = arithmetic(BinaryOperator::Divide, R(B), R(C));
+      VM_NEXT();
+    }
+    VM_CASE(Modulo) {
+      VM_SAVE_PC();
+      R(A) = arithmetic(BinaryOperator::Modulo, R(B), R(C));
+      VM_NEXT();
+    }
+    VM_CASE(Equal) {
+      R(A) = Value::boolean(valuesEqual(R(B), R(C)));
+      VM_NEXT();
+    }
+    VM_CASE(NotEqual) {
+      R(A) = Value::boolean(!valuesEqual(R(B), R(C)));
+      VM_NEXT();
+    }
+    VM_CASE(Less) {
+      const Value &left = R(B);
+      const Value &right = R(C);
+      if (left.isInt() && right.isInt()) {
+        R(A) = Value::boolean(left.asInt() < right.asInt());
+      } else {
+        VM_SAVE_PC();
+        R(A) = Value::boolean(relation(BinaryOperator::Less, left, right));
+      }
+      VM_NEXT();
+    }
+    VM_CASE(LessEqual) {
+      VM_SAVE_PC();
+      R(A) = Value::boolean(relation(BinaryOperator::LessEqual, R(B), R(C)));
+      VM_NEXT();
+    }
+    VM_CASE(Greater) {
+      VM_SAVE_PC();
+      R(A) = Value::boolean(relation(BinaryOperator::Greater, R(B), R(C)));
+      VM_NEXT();
+    }
+    VM_CASE(GreaterEqual) {
+      VM_SAVE_PC();
+      R(A) =
+          Value::boolean(relation(BinaryOperator::GreaterEqual, R(B), R(C)));
+      VM_NEXT();
+    }
+    // Typed operators; the untyped ones handle whatever else turns up
+#define VM_INT_CASE(name, op, result)                                          \
+  VM_CASE(name) {                                                              \
+    if (R(B).isInlineInt() && R(C).isInlineInt()) {                            \
+      int64_t x = R(B).asInt();                                                \
+      int64_t y = R(C).asInt();                                                \
+      R(A) = result;                                                           \
+    } else {                                                                   \
+      VM_SAVE_PC();                                                            \
+      R(A) = op;                                                               \
+    }                                                                          \
+    VM_NEXT();                                                                 \
+  }
+#define VM_DOUBLE_CASE(name, op, result)                                       \
+  VM_CASE(name) {                                                              \
+    if (R(B).isDouble() && R(C).isDouble()) {                                  \
+      double x = R(B).asDouble();                                              \
+      double y = R(C).asDouble();                                              \
+      R(A) = result;                                                           \
+    } else {                                                                   \
+      VM_SAVE_PC();                                                            \
+      R(A) = op;                                                               \
+    }                                                                          \
+    VM_NEXT();                                                                 \
+  }
+#define VM_ARITHMETIC(op) arithmetic(BinaryOperator::op, R(B), R(C))
+#define VM_RELATION(op) Value::boolean(relation(BinaryOperator::op, R(B), R(C)))
+    VM_CASE(DivideInt) {
+      // Dividing by 0 fails, and by -1 can overflow
+      int64_t y = R(C).isInlineInt() ? R(C).asInt() : 0;
+      if (R(B).isInlineInt() && y != 0 && y != -1) {
+        R(A) = Value::integer(R(B).asInt() / y);
+      } else {
+        VM_SAVE_PC();
+        R(A) = VM_ARITHMETIC(Divide);
+      }
+      VM_NEXT();
+    }
+    VM_CASE(ModuloInt) {
+      int64_t y = R(C).isInlineInt() ? R(C).asInt() : 0;
+      if (R(B).isInlineInt() && y != 0 && y != -1) {
+        R(A) = Value::integer(R(B).asInt() % y);
+      } else {
+        VM_SAVE_PC();
+        R(A) = VM_ARITHMETIC(Modulo);
+      }
+      VM_NEXT();
+    }
+    VM_INT_CASE(LessInt, VM_RELATION(Less), Value::boolean(x < y))
+    VM_INT_CASE(LessEqualInt, VM_RELATION(LessEqual), Value::boolean(x <= y))
+    VM_INT_CASE(GreaterInt, VM_RELATION(Greater), Value::boolean(x > y))
+    VM_INT_CASE(GreaterEqualInt, VM_RELATION(GreaterEqual),
+                Value::boolean(x >= y))
+    VM_DOUBLE_CASE(AddDouble, add(R(B), R(C)), Value::number(x + y))
+    VM_DOUBLE_CASE(SubtractDouble, VM_ARITHMETIC(Subtract),
+                   Value::number(x - y))
+    VM_DOUBLE_CASE(MultiplyDouble, VM_ARITHMETIC(Multiply),
+                   Value::number(x * y))
+    VM_DOUBLE_CASE(DivideDouble, VM_ARITHMETIC(Divide), Value::number(x / y))
+    VM_DOUBLE_CASE(ModuloDouble, VM_ARITHMETIC(Modulo),
+                   Value::number(std::fmod(x, y)))
+    VM_DOUBLE_CASE(LessDouble, VM_RELATION(Less), Value::boolean(x < y))
+    VM_DOUBLE_CASE(LessEqualDouble, VM_RELATION(LessEqual),
+                   Value::boolean(x <= y))
+    VM_DOUBLE_CASE(GreaterDouble, VM_RELATION(Greater), Value::boolean(x > y))
+    VM_DOUBLE_CASE(GreaterEqualDouble, VM_RELATION(GreaterEqual),
+                   Value::boolean(x >= y))
+#undef VM_INT_CASE
+#undef VM_DOUBLE_CASE
+#undef VM_ARITHMETIC
+#undef VM_RELATION
+    VM_CASE(ToDouble) {
+      R(A) = toDouble(R(B));
+      VM_NEXT();
+    }
+    VM_CASE(Jump) {
+      int offset = decodesBx(instruction);
+      pc += offset;
+      if (offset < 0) {
+        if ((fuel += offset) <= 0) {
+          VM_SAVE_PC();
+          refuel();
+        }
+        // A loop that keeps running is compiled and continued in machine
+        // code from the head of the loop
+        FunctionObject *function = frame->Closure->Function;
+        if (jitEnabled && ++function->BackEdges >= jitOptions.LoopThreshold &&
+            compileHot(function) && nesting < MaxNesting) {
+          size_t head = pc - function->Code.data();
+          if (!runCompiled(function->Jit->Labels[head]) &&
+              frameCount == floor) {
+            return returned;
+          }
+          VM_LOAD_FRAME();
+        }
+      }
+      VM_NEXT();
+    }
+    VM_CASE(JumpIfFalse) {
+      if (!R(A).isTruthy()) {
+        pc += decodesBx(instruction);
+      }
+      VM_NEXT();
+    }
+    VM_CASE(JumpIfTrue) {
+      if (R(A).isTruthy()) {
+        pc += decodesBx(instruction);
+      }
+      VM_NEXT();
+    }
+    VM_CASE(Call)
+    VM_CASE(CallMethod)
+    VM_CASE(CallFinal)
+    VM_CASE(CallStatic)
+    VM_CASE(CallSuper)
+    VM_CASE(New) {
+      VM_SAVE_PC();
+      if (invoke(frame, pc - 1)) {
+        VM_ENTER_FRAME();
+      }
+      VM_NEXT();
+    }
+    VM_CASE(CallMember) {
+      // Returns past the cache word
+      pc++;
+      VM_SAVE_PC();
+      if (invoke(frame, pc - 2)) {
+        VM_ENTER_FRAME();
+      }
+      VM_NEXT();
+    }
+    VM_CASE(TailCall)
+    VM_CASE(TailCallMethod) {
+      VM_SAVE_PC();
+      if (tailCall(frame, pc - 1)) {
+        VM_ENTER_FRAME();
+      } else if (frameCount == floor) {
+        return returned;
+      } else {
+        VM_LOAD_FRAME();
+      }
+      VM_NEXT();
+    }
+    VM_CASE(Return) {
+      Value result = popFrame(frame, instruction);
+      if (frameCount == floor) {
+        return result;
+      }
+      VM_LOAD_FRAME();
+      VM_NEXT();
+    }
+    VM_CASE(Await) {
+      VM_SAVE_PC();
+      if (suspend(frame, pc - 1)) {
+        // Only the event loop runs tasks, each at the floor of its own run
+        return Value();
+      }
+      VM_NEXT();
+    }
+    VM_CASE(MemberCache) {
+      // Always skipped by the access it belongs to
+      fail("Invalid opcode");
+    }
+
+#if !SODA_COMPUTED_GOTO
+      default:
+        fail("Invalid opcode");
+      }
+    }
+#endif
+
+#undef VM_LOAD_FRAME
+#undef VM_SAVE_PC
+#undef VM_ENTER_FRAME
+#undef R
+#undef A
+#undef B
+#undef C
+#undef VM_CASE
+#undef VM_NEXT
+  }
+};
+
+#endif // VIRTUAL_MACHINE_H
@@ -0,0 +1,187 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the chunks of an index range on a fixed set of threads and the
+// thread asking, for data-parallel work like parallelMap. Each taking part
+// starts on chunks dealt to it and, once they run out, steals from the
+// others, the ones last dealt first, so uneven chunks still keep every
+// thread busy. Any number of threads can run ranges at once; the pool's
+// threads help whichever is still going.
+class WorkStealingPool {
+public:
+  // Runs the indexes from begin up to end, as the participant numbered
+  // participant; must not throw
+  typedef std::function<void(size_t begin, size_t end, int participant)>
+      Body;
+
+  explicit WorkStealingPool(
+      int threads = static_cast<int>(std::thread::hardware_concurrency()) -
+                    1) {
+    for (int i = 0; i < std::max(threads, 0); i++) {
+      workers.emplace_back([this, i] { work(i + 1); });
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // The pool's threads and the thread asking, which is participant 0
+  int getParticipants() const { return static_cast<int>(workers.size()) + 1; }
+
+  // About eight chunks for each participant, so one that is slow to start
+  // leaves little idle, but no smaller than minimum indexes each
+  size_t chunkSize(size_t count, size_t minimum = 1) const {
+    size_t chunks = static_cast<size_t>(getParticipants()) * 8;
+    return std::max(std::max((count + chunks - 1) / chunks, minimum),
+                    size_t(1));
+  }
+
+  // Runs body over the indexes below count in chunks of grain, returning
+  // once all have run. A range too small to split runs on the calling
+  // thread alone.
+  void run(size_t count, size_t grain, const Body &body) {
+    if (count == 0) {
+      return;
+    }
+    grain = std::max(grain, size_t(1));
+    if (count <= grain || workers.empty()) {
+      body(0, count, 0);
+      return;
+    }
+    Job job(getParticipants(), body);
+    size_t chunks = (count + grain - 1) / grain;
+    job.Remaining = chunks;
+    for (size_t i = 0; i < chunks; i++) {
+      job.Queues[i % job.Queues.size()].Chunks.push_back(
+          Chunk{i * grain, std::min((i + 1) * grain, count)});
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(&job);
+    }
+    wake.notify_all();
+    size_t ran = job.work(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    job.Remaining -= ran;
+    forget(&job);
+    done.wait(lock, [&job] { return job.Remaining == 0 && job.Helpers == 0; });
+  }
+
+  // One pool for the whole process, made on first use
+  static WorkStealingPool &getShared() {
+    static WorkStealingPool shared;
+    return shared;
+  }
+
+private:
+  struct Chunk {
+    size_t Begin;
+    size_t End;
+  };
+
+  struct Queue {
+    std::mutex Mutex;
+    std::deque<Chunk> Chunks;
+  };
+
+  struct Job {
+    std::vector<Queue> Queues; // One per participant
+    const Body &Run;
+    size_t Remaining = 0; // Chunks not yet run, under the pool's mutex
+    int Helpers = 0;      // Pool threads working on it, likewise
+
+    Job(int participants, const Body &run) : Queues(participants), Run(run) {}
+
+    // The participant's own next chunk, or else the last one dealt to
+    // another
+    bool take(int participant, Chunk &chunk) {
+      int count = static_cast<int>(Queues.size());
+      for (int i = 0; i < count; i++) {
+        Queue &queue = Queues[(participant + i) % count];
+        std::lock_guard<std::mutex> lock(queue.Mutex);
+        if (!queue.Chunks.empty()) {
+          if (i == 0) {
+            chunk = queue.Chunks.front();
+            queue.Chunks.pop_front();
+          } else {
+            chunk = queue.Chunks.back();
+            queue.Chunks.pop_back();
+          }
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Runs chunks until none is left to take, and returns how many
+    size_t work(int participant) {
+      size_t ran = 0;
+      Chunk chunk;
+      while (take(participant, chunk)) {
+        Run(chunk.Begin, chunk.End, participant);
+        ran++;
+      }
+      return ran;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  std::vector<Job *> jobs; // Still dealing out chunks
+  bool stopping = false;
+
+  void work(int participant) {
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t next = 0;
+    for (;;) {
+      wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+      if (stopping) {
+        return;
+      }
+      Job *job = jobs[next++ % jobs.size()];
+      job->Helpers++;
+      lock.unlock();
+      size_t ran = job->work(participant);
+      lock.lock();
+      job->Remaining -= ran;
+      job->Helpers--;
+      forget(job);
+      if (job->Remaining == 0 && job->Helpers == 0) {
+        done.notify_all();
+      }
+    }
+  }
+
+  // Stops offering job once nothing is left to take from it
+  void forget(Job *job) {
+    auto found = std::find(jobs.begin(), jobs.end(), job);
+    if (found != jobs.end()) {
+      jobs.erase(found);
+    }
+  }
+};
+
+#endif // WORK_STEALING_POOL_H
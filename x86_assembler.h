@@ -0,0 +1,271 @@
+#ifndef X86_ASSEMBLER_H
+#define X86_ASSEMBLER_H
+
+#include <cstdint>
+#include <vector>
+
+// Encodes the handful of x86-64 instructions the BaselineJit emits. Memory
+// operands are always [base + disp32].
+class X86Assembler {
+public:
+  enum Register {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+  };
+
+  enum Condition {
+    Overflow = 0x0,
+    Equal = 0x4,
+    NotEqual = 0x5,
+    Less = 0xC,
+    GreaterEqual = 0xD,
+    LessEqual = 0xE,
+    Greater = 0xF,
+  };
+
+  // A jump target; jumps to it may come before or after it is bound
+  struct Label {
+    int Offset = -1;
+    std::vector<int> Uses; // Positions of rel32 fields to patch
+  };
+
+  const std::vector<uint8_t> &getCode() const { return code; }
+
+  int offset() const { return static_cast<int>(code.size()); }
+
+  void bind(Label &label) {
+    label.Offset = offset();
+    for (int use : label.Uses) {
+      patchRel32(use, label.Offset);
+    }
+    label.Uses.clear();
+  }
+
+  void push(Register reg) {
+    rexIfNeeded(false, 0, reg);
+    emit(0x50 + (reg & 7));
+  }
+
+  void pop(Register reg) {
+    rexIfNeeded(false, 0, reg);
+    emit(0x58 + (reg & 7));
+  }
+
+  void ret() { emit(0xC3); }
+
+  // mov dst, src
+  void move(Register dst, Register src) {
+    rex(true, src, dst);
+    emit(0x89);
+    emit(0xC0 | ((src & 7) << 3) | (dst & 7));
+  }
+
+  // mov dst, imm64
+  void moveImmediate(Register dst, uint64_t value) {
+    rex(true, 0, dst);
+    emit(0xB8 + (dst & 7));
+    emit64(value);
+  }
+
+  // mov dst32, imm32
+  void moveImmediate32(Register dst, uint32_t value) {
+    rexIfNeeded(false, 0, dst);
+    emit(0xB8 + (dst & 7));
+    emit32(value);
+  }
+
+  // mov dst, qword [base + disp]
+  void load(Register dst, Register base, int32_t disp) {
+    memoryOp(true, 0x8B, dst, base, disp);
+  }
+
+  // mov dst32, dword [base + disp], zero-extending
+  void load32(Register dst, Register base, int32_t disp) {
+    memoryOp(false, 0x8B, dst, base, disp);
+  }
+
+  // movzx dst32, byte [base + disp]
+  void load8(Register dst, Register base, int32_t disp) {
+    rexIfNeeded(false, dst, base);
+    emit(0x0F);
+    emit(0xB6);
+    modrm(dst, base, disp);
+  }
+
+  // mov qword [base + disp], src
+  void store(Register base, int32_t disp, Register src) {
+    memoryOp(true, 0x89, src, base, disp);
+  }
+
+  // add dst, src
+  void add(Register dst, Register src) { registerOp(0x01, src, dst); }
+
+  // sub dst, src
+  void subtract(Register dst, Register src) { registerOp(0x29, src, dst); }
+
+  // and dst, src
+  void bitAnd(Register dst, Register src) { registerOp(0x21, src, dst); }
+
+  // or dst, src
+  void bitOr(Register dst, Register src) { registerOp(0x09, src, dst); }
+
+  // cmp left, right
+  void compare(Register left, Register right) {
+    registerOp(0x39, right, left);
+  }
+
+  // imul dst, src
+  void multiply(Register dst, Register src) {
+    rex(true, dst, src);
+    emit(0x0F);
+    emit(0xAF);
+    emit(0xC0 | ((dst & 7) << 3) | (src & 7));
+  }
+
+  // cmp reg32, imm32
+  void compareImmediate32(Register reg, uint32_t value) {
+    rexIfNeeded(false, 0, reg);
+    emit(0x81);
+    emit(0xC0 | (7 << 3) | (reg & 7));
+    emit32(value);
+  }
+
+  // shl reg, count
+  void shiftLeft(Register reg, uint8_t count) { shift(4, reg, count); }
+
+  // shr reg, count
+  void shiftRight(Register reg, uint8_t count) { shift(5, reg, count); }
+
+  // sar reg, count
+  void shiftRightArithmetic(Register reg, uint8_t count) {
+    shift(7, reg, count);
+  }
+
+  // setcc al; movzx eax, al
+  void setCondition(Condition condition) {
+    emit(0x0F);
+    emit(0x90 + condition);
+    emit(0xC0);
+    emit(0x0F);
+    emit(0xB6);
+    emit(0xC0);
+  }
+
+  // test eax, eax
+  void testEax() {
+    emit(0x85);
+    emit(0xC0);
+  }
+
+  void call(Register target) {
+    rexIfNeeded(false, 0, target);
+    emit(0xFF);
+    emit(0xD0 | (target & 7));
+  }
+
+  void jump(Register target) {
+    rexIfNeeded(false, 0, target);
+    emit(0xFF);
+    emit(0xE0 | (target & 7));
+  }
+
+  void jump(Label &label) {
+    emit(0xE9);
+    useLabel(label);
+  }
+
+  void jumpIf(Condition condition, Label &label) {
+    emit(0x0F);
+    emit(0x80 + condition);
+    useLabel(label);
+  }
+
+private:
+  std::vector<uint8_t> code;
+
+  void emit(uint8_t byte) { code.push_back(byte); }
+
+  void emit32(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+      emit(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  }
+
+  void emit64(uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+      emit(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  }
+
+  void rex(bool wide, int reg, int base) {
+    emit(0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0));
+  }
+
+  void rexIfNeeded(bool wide, int reg, int base) {
+    if (wide || (reg & 8) || (base & 8)) {
+      rex(wide, reg, base);
+    }
+  }
+
+  // mod=10 with a 32-bit displacement; rsp and r12 as base need a SIB byte
+  void modrm(int reg, int base, int32_t disp) {
+    emit(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) {
+      emit(0x24);
+    }
+    emit32(static_cast<uint32_t>(disp));
+  }
+
+  // Register to register, the 64-bit form with reg in the reg field
+  void registerOp(uint8_t opcode, int reg, int rm) {
+    rex(true, reg, rm);
+    emit(opcode);
+    emit(0xC0 | ((reg & 7) << 3) | (rm & 7));
+  }
+
+  void shift(int operation, Register reg, uint8_t count) {
+    rex(true, 0, reg);
+    emit(0xC1);
+    emit(0xC0 | (operation << 3) | (reg & 7));
+    emit(count);
+  }
+
+  void memoryOp(bool wide, uint8_t opcode, int reg, int base, int32_t disp) {
+    rexIfNeeded(wide, reg, base);
+    emit(opcode);
+    modrm(reg, base, disp);
+  }
+
+  void useLabel(Label &label) {
+    int use = offset();
+    emit32(0);
+    if (label.Offset >= 0) {
+      patchRel32(use, label.Offset);
+    } else {
+      label.Uses.push_back(use);
+    }
+  }
+
+  void patchRel32(int use, int target) {
+    uint32_t rel = static_cast<uint32_t>(target - (use + 4));
+    for (int i = 0; i < 4; i++) {
+      code[use + i] = static_cast<uint8_t>(rel >> (i * 8));
+    }
+  }
+};
+
+#endif // X86_ASSEMBLER_H